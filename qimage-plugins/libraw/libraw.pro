@@ -9,13 +9,20 @@ DESTDIR = imageformats
 PKGCONFIG += \
     libraw
 
+INCLUDEPATH += $$PWD/../../src/src/utils
+
 HEADERS += \
     datastream.h \
-    rawiohandler.h
+    rawiohandler.h \
+    $$PWD/../../src/src/utils/fileidentity.h \
+    $$PWD/../../src/src/utils/imagetypedetector.h \
+    $$PWD/../../src/src/utils/exiforientation.h
 SOURCES += \
     datastream.cpp \
     main.cpp \
-    rawiohandler.cpp
+    rawiohandler.cpp \
+    $$PWD/../../src/src/utils/imagetypedetector.cpp \
+    $$PWD/../../src/src/utils/exiforientation.cpp
 OTHER_FILES += \
     raw.json
 
@@ -44,6 +44,7 @@
 #include <QStringList>
 
 #include "rawiohandler.h"
+#include "imagetypedetector.h"
 
 class FreeimageQt5Plugin: public QImageIOPlugin
 {
@@ -63,15 +64,18 @@ public:
 QStringList FreeimageQt5Plugin::keys() const
 {
 
+    //和raw.json中的Keys保持一致
     const QStringList raws = QStringList()
                              << QLatin1String("CR2") << QLatin1String("CRW")   // Canon cameras
                              << QLatin1String("DCR") << QLatin1String("KDC")   // Kodak cameras
                              << QLatin1String("MRW")            // Minolta cameras
-                             << QLatin1String("NEF")            // Nikon cameras
+                             << QLatin1String("NEF") << QLatin1String("NRW")   // Nikon cameras
                              << QLatin1String("ORF")            // Olympus cameras
                              << QLatin1String("PEF")            // Pentax cameras
                              << QLatin1String("RAF")            // Fuji cameras
-                             << QLatin1String("SRF")            // Sony cameras
+                             << QLatin1String("SRF") << QLatin1String("SR2")   // Sony cameras
+                             << QLatin1String("ARW")
+                             << QLatin1String("RW2")            // Panasonic cameras
                              << QLatin1String("DNG");           //
 //            << QLatin1String("X3F");           // Sigma cameras
     return raws;
@@ -80,15 +84,35 @@ QStringList FreeimageQt5Plugin::keys() const
 QImageIOPlugin::Capabilities
 FreeimageQt5Plugin::capabilities(QIODevice *device, const QByteArray &format) const
 {
-    if (keys().contains(format.toUpper()) ||
-            format == "tif" ||
-            format == "tiff")
+    if (keys().contains(format.toUpper()))
         return Capabilities(CanRead);
+    // Plain TIFF scans belong to Qt's tiff plugin; only claim .tif files
+    // whose IFDs mark them as DNG or camera RAW.
+    if (format == "tif" || format == "tiff") {
+        if (device && ImageTypeDetector::isRawTiff(device))
+            return Capabilities(CanRead);
+        return nullptr;
+    }
     if (!format.isEmpty())
         return nullptr;
 
     Capabilities cap;
-    if (device->isReadable() && RawIOHandler::canRead(device))
+    if (!device || !device->isReadable())
+        return cap;
+
+    // Qt asks every plugin when the format is unknown; don't build a LibRaw
+    // instance for files whose magic bytes already identify a non-RAW format.
+    const QByteArray header = device->peek(ImageTypeDetector::HEADER_SIZE);
+    const ImageTypeDetector::ImageType type =
+        ImageTypeDetector::typeFromHeader(header.constData(), header.size());
+    if (type != ImageTypeDetector::TypeRaw &&
+            type != ImageTypeDetector::TypeTiff &&
+            type != ImageTypeDetector::TypeUnknown)
+        return cap;
+    if (type == ImageTypeDetector::TypeTiff && !ImageTypeDetector::isRawTiff(device))
+        return cap;
+
+    if (RawIOHandler::canRead(device))
         cap |= CanRead;
     return cap;
 }
@@ -40,10 +40,17 @@
 
 #include "datastream.h"
 #include "rawiohandler.h"
+#include "exiforientation.h"
 
 #include <QDebug>
+#include <QFileDevice>
 #include <QImage>
 #include <QVariant>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QStringList>
+#include <QBuffer>
+#include <QImageReader>
 
 #include <libraw.h>
 
@@ -59,14 +66,48 @@ public:
     ~RawIOHandlerPrivate();
 
     bool load(QIODevice *device);
+    //open_datastream已经解析的EXIF和厂商信息，不需要unpack
+    QString description() const;
 
     LibRaw *raw;
     Datastream *stream;
     QSize            defaultSize;
     QSize            scaledSize;
+    //open_datastream耗时，通过图片的xraw.open文本返回
+    double           openMs = 0;
+    //最终的EXIF方向，附属文件（看图的无损旋转）优先于相机记录的方向
+    int              orientation = 1;
     mutable RawIOHandler *q;
 };
 
+namespace {
+//看图的--bench设置此环境变量，插件才输出各阶段耗时
+const char *const STAGE_TIMING_ENV = "DEEPIN_IMAGE_VIEWER_XRAW_TIMING";
+
+double elapsedMs(QElapsedTimer &timer)
+{
+    const double ms = timer.nsecsElapsed() / 1000000.0;
+    timer.restart();
+    return ms;
+}
+
+//QImageReader::text()的格式："key: value"，两项之间空一行；值中不能有空行
+void appendText(QStringList *pairs, const QString &key, const QString &value)
+{
+    const QString simplified = value.simplified();
+    if (!simplified.isEmpty()) {
+        pairs->append(key + ": " + simplified);
+    }
+}
+
+void appendNumber(QStringList *pairs, const QString &key, double value)
+{
+    if (value > 0) {
+        appendText(pairs, key, QString::number(value, 'g', 4));
+    }
+}
+}  // namespace
+
 RawIOHandlerPrivate::~RawIOHandlerPrivate()
 {
     delete raw;
@@ -82,9 +123,17 @@ bool RawIOHandlerPrivate::load(QIODevice *device)
     device->seek(0);
     if (raw != nullptr) return true;
 
+    QElapsedTimer timer;
+    timer.start();
     stream = new Datastream(device);
     raw = new LibRaw;
     raw->imgdata.params.use_rawspeed = 1;
+    //插件不能写RAW文件，旋转保存在同名的.xmp中，解码时作为变换应用
+    QFileDevice *file = qobject_cast<QFileDevice *>(device);
+    const int sidecar = file ? ExifOrientation::readSidecar(file->fileName()) : 0;
+    if (sidecar > 0) {
+        raw->imgdata.params.user_flip = ExifOrientation::toLibRawFlip(sidecar);
+    }
     if (raw->open_datastream(stream) != LIBRAW_SUCCESS) {
         delete raw;
         raw = nullptr;
@@ -92,15 +141,43 @@ bool RawIOHandlerPrivate::load(QIODevice *device)
         stream = nullptr;
         return false;
     }
+    openMs = elapsedMs(timer);
 
     defaultSize = QSize(raw->imgdata.sizes.width,
                         raw->imgdata.sizes.height);
-    if (raw->imgdata.sizes.flip == 5 || raw->imgdata.sizes.flip == 6) {
+    //此时sizes.flip还是相机记录的方向，user_flip要到unpack以后才生效
+    orientation = sidecar > 0 ? sidecar : ExifOrientation::fromLibRawFlip(raw->imgdata.sizes.flip);
+    //5~8需要交换宽高
+    if (orientation >= 5) {
         defaultSize.transpose();
     }
     return true;
 }
 
+QString RawIOHandlerPrivate::description() const
+{
+    const libraw_data_t &imgdata = raw->imgdata;
+    QStringList pairs;
+    appendText(&pairs, "Orientation", QString::number(orientation));
+    appendText(&pairs, "Make", QString::fromLatin1(imgdata.idata.make));
+    appendText(&pairs, "Model", QString::fromLatin1(imgdata.idata.model));
+    appendText(&pairs, "LensModel", QString::fromLatin1(imgdata.lens.Lens));
+    appendText(&pairs, "Artist", QString::fromLatin1(imgdata.other.artist));
+    if (imgdata.other.shutter > 0) {
+        //曝光时间习惯写成1/250
+        appendText(&pairs, "ExposureTime", imgdata.other.shutter < 1
+                   ? QString("1/%1").arg(qRound(1 / imgdata.other.shutter))
+                   : QString::number(imgdata.other.shutter, 'g', 4));
+    }
+    appendNumber(&pairs, "FNumber", imgdata.other.aperture);
+    appendNumber(&pairs, "ISOSpeedRatings", imgdata.other.iso_speed);
+    appendNumber(&pairs, "FocalLength", imgdata.other.focal_len);
+    if (imgdata.other.timestamp > 0) {
+        appendText(&pairs, "DateTimeOriginal", QDateTime::fromTime_t(uint(imgdata.other.timestamp))
+                   .toString("yyyy:MM:dd HH:mm:ss"));
+    }
+    return pairs.join("\n\n");
+}
 
 RawIOHandler::RawIOHandler():
     d(new RawIOHandlerPrivate(this))
@@ -142,35 +219,55 @@ bool RawIOHandler::read(QImage *image)
     QSize finalSize = d->scaledSize.isValid() ?
                       d->scaledSize : d->defaultSize;
 
+    //--bench运行时各阶段耗时写入图片文本（xraw.*），平时不附加，避免随图片另存时写入文件
+    QElapsedTimer timer;
+    timer.start();
+    double unpackMs = 0;
+    double processMs = 0;
+    bool useThumbnail = false;
+
     const libraw_data_t &imgdata = d->raw->imgdata;
     libraw_processed_image_t *output;
     if (finalSize.width() < imgdata.thumbnail.twidth ||
             finalSize.height() < imgdata.thumbnail.theight) {
         qDebug() << "Using thumbnail";
+        useThumbnail = true;
         d->raw->unpack_thumb();
+        unpackMs = elapsedMs(timer);
         output = d->raw->dcraw_make_mem_thumb();
+        processMs = elapsedMs(timer);
     } else {
         qDebug() << "Decoding raw data";
         d->raw->unpack();
+        unpackMs = elapsedMs(timer);
         d->raw->dcraw_process();
         output = d->raw->dcraw_make_mem_image();
+        processMs = elapsedMs(timer);
     }
 
     QImage unscaled;
+    QSize previewSize;
     uchar *pixels = nullptr;
     if (output->type == LIBRAW_IMAGE_JPEG) {
-        unscaled.loadFromData(output->data, static_cast<int>(output->data_size), "JPEG");
-        if (imgdata.sizes.flip != 0) {
-            QTransform rotation;
-            int angle = 0;
-            if (imgdata.sizes.flip == 3) angle = 180;
-            else if (imgdata.sizes.flip == 5) angle = -90;
-            else if (imgdata.sizes.flip == 6) angle = 90;
-            if (angle != 0) {
-                rotation.rotate(angle);
-                unscaled = unscaled.transformed(rotation);
-            }
+        //内嵌预览常常和原图一样大，按缩放尺寸解码时libjpeg直接做1/2、1/4、1/8的IDCT，不生成整张大图
+        QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(output->data),
+                                                  static_cast<int>(output->data_size));
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer, "jpeg");
+        reader.setAutoTransform(false);
+        //finalSize是按方向显示后的尺寸，缩小发生在旋转之前
+        QSize target = finalSize;
+        if (d->orientation >= 5) {
+            target.transpose();
         }
+        previewSize = reader.size();
+        if (target.isValid() && previewSize.isValid() && target != previewSize) {
+            reader.setScaledSize(target);
+        }
+        reader.read(&unscaled);
+        //内嵌预览没有按方向处理，镜像的方向也一并处理
+        unscaled = ExifOrientation::apply(unscaled, d->orientation);
     } else {
         int numPixels = output->width * output->height;
         int colorSize = output->bits / 8;
@@ -195,6 +292,8 @@ bool RawIOHandler::read(QImage *image)
                    .convertToFormat(QImage::Format_ARGB32);
     }
 
+    const double convertMs = elapsedMs(timer);
+
     if (unscaled.size() != finalSize) {
         // TODO: use quality parameter to decide transformation method
         *image = unscaled.scaled(finalSize, Qt::IgnoreAspectRatio,
@@ -210,6 +309,19 @@ bool RawIOHandler::read(QImage *image)
     d->raw->dcraw_clear_mem(output);
     delete[] pixels;
 
+    static const bool stageTiming = qEnvironmentVariableIsSet(STAGE_TIMING_ENV);
+    if (!stageTiming) {
+        return true;
+    }
+    image->setText("xraw.path", useThumbnail ? "thumbnail" : "raw");
+    if (previewSize.isValid()) {
+        image->setText("xraw.preview", QString("%1x%2").arg(previewSize.width()).arg(previewSize.height()));
+    }
+    image->setText("xraw.open", QString::number(d->openMs, 'f', 3));
+    image->setText("xraw.unpack", QString::number(unpackMs, 'f', 3));
+    image->setText("xraw.process", QString::number(processMs, 'f', 3));
+    image->setText("xraw.convert", QString::number(convertMs, 'f', 3));
+    image->setText("xraw.scale", QString::number(elapsedMs(timer), 'f', 3));
     return true;
 }
 
@@ -224,6 +336,12 @@ QVariant RawIOHandler::option(ImageOption option) const
         return d->defaultSize;
     case ScaledSize:
         return d->scaledSize;
+    case Description:
+        //只解析文件头，QImageReader::text("Orientation")不需要解码
+        if (!d->load(device())) {
+            return QVariant();
+        }
+        return d->description();
     default:
         break;
     }
@@ -249,6 +367,7 @@ bool RawIOHandler::supportsOption(ImageOption option) const
     case ImageFormat:
     case Size:
     case ScaledSize:
+    case Description:
         return true;
     default:
         break;
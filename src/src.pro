@@ -10,7 +10,7 @@ QT += core gui dbus concurrent svg  printsupport sql
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 CONFIG -= app_bundle
 CONFIG += c++11 link_pkgconfig
-PKGCONFIG +=   libexif dtkwidget  gio-qt
+PKGCONFIG +=   libexif dtkwidget  gio-qt libtiff-4
 # PKGCONFIG += xext x11 gio-unix-2.0
  QT += dtkwidget
  QT += dbus
@@ -38,15 +38,14 @@ isEmpty(PREFIX){
 #include (src/frame/frame.pri)
 include (src/module/modules.pri)
 include (src/mainwindow/mainwindow.pri)
-#include (src/utils/utils.pri)
+include (src/utils/utils.pri)
 #include (src/controller/controller.pri)
-#include (src/service/service.pri)
+include (src/service/service.pri)
+include (src/dirwatcher/dirwatcher.pri)
+include (src/settings/settings.pri)
+include (src/widgets/widgets.pri)
 #include (src/third-party/accessibility/accessibility-suite.pri)
 
-#!isEmpty(FULL_FUNCTIONALITY) {
-#    include (src/settings/settings.pri)
-#    include (src/dirwatcher/dirwatcher.pri)
-#}
 
 HEADERS += \
 #    src/application.h \
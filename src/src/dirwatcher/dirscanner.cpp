@@ -0,0 +1,234 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dirscanner.h"
+#include "utils/imagetypedetector.h"
+#include "utils/pathingest.h"
+
+#include <QtConcurrent>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThread>
+#include <QSet>
+#include <QPair>
+#include <QFile>
+#include <QDir>
+
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+//第一批尽快返回，让第一张图先显示出来
+const int FIRST_BATCH_SIZE = 32;
+const int BATCH_SIZE = 512;
+//模拟慢速文件系统时，每读取多少项等待一次
+const int LIST_DELAY_STEP = 64;
+//目录扫描以IO为主，线程数不少于4
+const int MIN_SCAN_THREADS = 4;
+
+bool isImageEntry(const QString &path, const char *name)
+{
+    const char *dot = strrchr(name, '.');
+    if (dot) {
+        const ImageTypeDetector::ImageType type =
+            ImageTypeDetector::typeFromSuffix(QString::fromLatin1(dot + 1));
+        if (type != ImageTypeDetector::TypeUnknown) {
+            return ImageTypeDetector::isImageType(type);
+        }
+    }
+    //后缀无法判断的才读文件头
+    return ImageTypeDetector::instance()->isImage(path);
+}
+}  // namespace
+
+struct DirScanner::ScanState {
+    QAtomicInt cancelled;
+    QAtomicInt pending;
+    QAtomicInt found;
+    QMutex mutex;
+    QStringList dirs;
+    //已经扫描过的目录(st_dev, st_ino)，绑定挂载等方式出现的同一目录只扫描一次
+    QSet<QPair<quint64, quint64>> visited;
+};
+
+int DirScanner::s_listDelayUsec = 0;
+
+DirScanner::DirScanner(QObject *parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(qMax(MIN_SCAN_THREADS, QThread::idealThreadCount()));
+}
+
+DirScanner::~DirScanner()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void DirScanner::start(const QStringList &roots)
+{
+    cancel();
+    m_state = QSharedPointer<ScanState>::create();
+    if (roots.isEmpty()) {
+        emit sigFinished(0);
+        return;
+    }
+    for (const QString &root : roots) {
+        enqueue(m_state, QDir::cleanPath(root));
+    }
+}
+
+void DirScanner::cancel()
+{
+    if (m_state) {
+        m_state->cancelled.storeRelease(1);
+        m_pool.clear();
+    }
+}
+
+bool DirScanner::isRunning() const
+{
+    return m_state && !m_state->cancelled.loadAcquire() && m_state->pending.loadAcquire() > 0;
+}
+
+QStringList DirScanner::scannedDirectories() const
+{
+    if (!m_state) {
+        return QStringList();
+    }
+    QMutexLocker locker(&m_state->mutex);
+    return m_state->dirs;
+}
+
+void DirScanner::setListDelayForTest(int usec)
+{
+    s_listDelayUsec = usec;
+}
+
+void DirScanner::enqueue(const QSharedPointer<ScanState> &state, const QString &dir)
+{
+    state->pending.ref();
+    QtConcurrent::run(&m_pool, [this, state, dir]() {
+        if (!state->cancelled.loadAcquire()) {
+            scanDirectory(state, dir);
+        }
+        //最后一个任务结束时通知扫描完成
+        if (!state->pending.deref() && !state->cancelled.loadAcquire()) {
+            const int total = state->found.loadAcquire();
+            QMetaObject::invokeMethod(this, [this, state, total]() {
+                if (state == m_state && !state->cancelled.loadAcquire()) {
+                    emit sigFinished(total);
+                }
+            }, Qt::QueuedConnection);
+        }
+    });
+}
+
+void DirScanner::scanDirectory(const QSharedPointer<ScanState> &state, const QString &dir)
+{
+    DIR *handle = opendir(QFile::encodeName(dir).constData());
+    if (!handle) {
+        return;
+    }
+    const int fd = dirfd(handle);
+    struct stat dirStat;
+    if (fstat(fd, &dirStat) != 0) {
+        closedir(handle);
+        return;
+    }
+    {
+        QMutexLocker locker(&state->mutex);
+        const QPair<quint64, quint64> key(quint64(dirStat.st_dev), quint64(dirStat.st_ino));
+        if (state->visited.contains(key)) {
+            locker.unlock();
+            closedir(handle);
+            return;
+        }
+        state->visited.insert(key);
+        state->dirs << dir;
+    }
+    const QString prefix = dir.endsWith('/') ? dir : dir + '/';
+
+    QStringList batch;
+    int listed = 0;
+    struct dirent *entry = nullptr;
+    while ((entry = readdir(handle)) != nullptr) {
+        if (state->cancelled.loadAcquire()) {
+            break;
+        }
+        if (s_listDelayUsec > 0 && ++listed % LIST_DELAY_STEP == 0) {
+            usleep(useconds_t(s_listDelayUsec));
+        }
+
+        const char *name = entry->d_name;
+        //跳过 . .. 和隐藏文件
+        if (name[0] == '.') {
+            continue;
+        }
+
+        //d_type不可靠时才stat，软链接目录不跟随，避免循环
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN) {
+            struct stat st;
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR
+                   : S_ISLNK(st.st_mode) ? DT_LNK : DT_UNKNOWN;
+        }
+        //软链接只接受指向普通文件的
+        if (type == DT_LNK) {
+            struct stat st;
+            if (fstatat(fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+                continue;
+            }
+            type = DT_REG;
+        }
+
+        const QString path = prefix + QFile::decodeName(name);
+        if (type == DT_DIR) {
+            enqueue(state, path);
+        } else if (type == DT_REG && isImageEntry(path, name)) {
+            batch << path;
+            const int limit = state->found.loadAcquire() == 0 ? FIRST_BATCH_SIZE : BATCH_SIZE;
+            if (batch.size() >= limit) {
+                flush(state, batch);
+            }
+        }
+    }
+    closedir(handle);
+    flush(state, batch);
+}
+
+void DirScanner::flush(const QSharedPointer<ScanState> &state, QStringList &batch)
+{
+    if (batch.isEmpty()) {
+        return;
+    }
+    PathIngest::sortNatural(batch);
+    state->found.fetchAndAddOrdered(batch.size());
+    //回到所属线程再发信号，已取消或被新扫描替换的结果直接丢弃
+    const QStringList images = batch;
+    batch.clear();
+    QMetaObject::invokeMethod(this, [this, state, images]() {
+        if (state == m_state && !state->cancelled.loadAcquire()) {
+            emit sigImagesFound(images);
+        }
+    }, Qt::QueuedConnection);
+}
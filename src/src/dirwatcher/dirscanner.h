@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DIRSCANNER_H
+#define DIRSCANNER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QStringList>
+
+//并行递归扫描目录，边扫描边分批返回图片
+//每个目录是线程池中的一个任务，子目录继续投递新任务
+class DirScanner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DirScanner(QObject *parent = nullptr);
+    ~DirScanner() override;
+
+    void start(const QStringList &roots);
+    void cancel();
+    bool isRunning() const;
+    //本次扫描经过的目录（不含被跳过的隐藏目录），用于建立监控
+    QStringList scannedDirectories() const;
+
+    //测试用：每读取一批目录项额外等待的微秒数，模拟慢速文件系统
+    static void setListDelayForTest(int usec);
+
+signals:
+    //一批图片，同一目录内已经自然排序
+    void sigImagesFound(const QStringList &images);
+    void sigFinished(int total);
+
+private:
+    struct ScanState;
+    void enqueue(const QSharedPointer<ScanState> &state, const QString &dir);
+    void scanDirectory(const QSharedPointer<ScanState> &state, const QString &dir);
+    void flush(const QSharedPointer<ScanState> &state, QStringList &batch);
+
+private:
+    QThreadPool m_pool;
+    QSharedPointer<ScanState> m_state;
+    static int s_listDelayUsec;
+};
+
+#endif // DIRSCANNER_H
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dirwatcher.h"
+#include "utils/imagetypedetector.h"
+#include "utils/pathingest.h"
+
+#include <QtConcurrent>
+#include <QSocketNotifier>
+#include <QDirIterator>
+#include <QFile>
+#include <QDir>
+#include <QDebug>
+
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace {
+const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM
+                            | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR;
+const int EVENT_BUFFER_SIZE = 64 * 1024;
+const int DEFAULT_COALESCE_INTERVAL = 300;
+const int DEFAULT_MAX_DELAY = 2000;
+}  // namespace
+
+DirWatcher::DirWatcher(QObject *parent)
+    : QObject(parent)
+    , m_interval(DEFAULT_COALESCE_INTERVAL)
+    , m_maxDelay(DEFAULT_MAX_DELAY)
+{
+    m_pool.setMaxThreadCount(1);
+    m_coalesceTimer.setSingleShot(true);
+    connect(&m_coalesceTimer, &QTimer::timeout, this, &DirWatcher::onCoalesced);
+
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        qWarning() << "inotify_init1 failed:" << strerror(errno);
+        return;
+    }
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &DirWatcher::onReadyRead);
+}
+
+DirWatcher::~DirWatcher()
+{
+    m_generation.fetchAndAddOrdered(1);
+    m_pool.clear();
+    m_pool.waitForDone();
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+}
+
+bool DirWatcher::isValid() const
+{
+    return m_fd >= 0;
+}
+
+bool DirWatcher::addPath(const QString &dir)
+{
+    return addWatch(QDir::cleanPath(dir), m_generation.loadAcquire());
+}
+
+bool DirWatcher::addWatch(const QString &path, int generation)
+{
+    if (m_fd < 0) {
+        return false;
+    }
+    QMutexLocker locker(&m_watchMutex);
+    //removeAll之后才遍历到的目录不再监控
+    if (generation != m_generation.loadAcquire()) {
+        return false;
+    }
+    if (m_pathToWd.contains(path)) {
+        return true;
+    }
+    const int wd = inotify_add_watch(m_fd, QFile::encodeName(path).constData(), WATCH_MASK);
+    if (wd < 0) {
+        //通常是max_user_watches不够
+        qWarning() << "inotify_add_watch failed:" << path << strerror(errno);
+        return false;
+    }
+    //同一个inode的不同路径会得到相同的wd
+    m_pathToWd.remove(m_wdToPath.value(wd));
+    m_wdToPath.insert(wd, path);
+    m_pathToWd.insert(path, wd);
+    return true;
+}
+
+void DirWatcher::addPaths(const QStringList &dirs)
+{
+    for (const QString &dir : dirs) {
+        addPath(dir);
+    }
+}
+
+void DirWatcher::removeAll()
+{
+    QMutexLocker locker(&m_watchMutex);
+    m_generation.fetchAndAddOrdered(1);
+    for (auto it = m_wdToPath.constBegin(); it != m_wdToPath.constEnd(); ++it) {
+        inotify_rm_watch(m_fd, it.key());
+    }
+    m_wdToPath.clear();
+    m_pathToWd.clear();
+    m_added.clear();
+    m_removed.clear();
+    m_coalesceTimer.stop();
+}
+
+QStringList DirWatcher::directories() const
+{
+    QMutexLocker locker(&m_watchMutex);
+    return m_pathToWd.keys();
+}
+
+void DirWatcher::setCoalesceInterval(int msec, int maxDelayMsec)
+{
+    m_interval = msec;
+    m_maxDelay = qMax(msec, maxDelayMsec);
+}
+
+void DirWatcher::onReadyRead()
+{
+    //一次读空，导入时一次可以拿到几百个事件
+    char buffer[EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        const ssize_t len = ::read(m_fd, buffer, sizeof(buffer));
+        if (len <= 0) {
+            break;
+        }
+        for (char *ptr = buffer; ptr < buffer + len;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                qWarning() << "inotify queue overflow";
+                emit sigOverflow();
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_IGNORED)) {
+                removeWatch(event->wd);
+                continue;
+            }
+            m_watchMutex.lock();
+            const QString dir = m_wdToPath.value(event->wd);
+            m_watchMutex.unlock();
+            if (dir.isEmpty() || event->len == 0 || event->name[0] == '.') {
+                continue;
+            }
+            const QString path = dir + '/' + QFile::decodeName(event->name);
+
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    addTree(path);
+                } else if (event->mask & IN_MOVED_FROM) {
+                    //移走的目录不会再收到IN_DELETE_SELF
+                    removeTree(path);
+                    fileRemoved(path);
+                } else if (event->mask & IN_DELETE) {
+                    fileRemoved(path);
+                }
+                continue;
+            }
+
+            //新建文件等写完关闭后再处理，IN_CREATE只用于目录
+            if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                fileAdded(path);
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                fileRemoved(path);
+            }
+        }
+    }
+}
+
+void DirWatcher::onCoalesced()
+{
+    if (m_added.isEmpty() && m_removed.isEmpty()) {
+        return;
+    }
+    const QStringList candidates = m_added.toList();
+    const QStringList removed = m_removed.toList();
+    m_added.clear();
+    m_removed.clear();
+
+    //写入完成后才判断类型，非图片直接丢弃；慢速文件系统上读文件头不能卡住界面
+    const int generation = m_generation.loadAcquire();
+    QtConcurrent::run(&m_pool, [this, candidates, removed, generation]() {
+        QStringList added;
+        added.reserve(candidates.size());
+        for (const QString &path : candidates) {
+            if (generation != m_generation.loadAcquire()) {
+                return;
+            }
+            if (ImageTypeDetector::instance()->isImage(path)) {
+                added << path;
+            }
+        }
+        if (added.isEmpty() && removed.isEmpty()) {
+            return;
+        }
+        PathIngest::sortNatural(added);
+        QMetaObject::invokeMethod(this, [this, added, removed, generation]() {
+            if (generation == m_generation.loadAcquire()) {
+                emit sigChanged(added, removed);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void DirWatcher::addTree(const QString &dir)
+{
+    //先监控新目录本身，子目录在工作线程中边遍历边添加
+    addPath(dir);
+    const int generation = m_generation.loadAcquire();
+    QtConcurrent::run(&m_pool, [this, dir, generation]() {
+        scanTree(dir, generation);
+    });
+}
+
+void DirWatcher::scanTree(const QString &dir, int generation)
+{
+    //新目录可能在监控建立之前就已经写入了文件
+    QStringList files;
+    QDirIterator it(dir, QDir::AllEntries | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        if (generation != m_generation.loadAcquire()) {
+            return;
+        }
+        if (it.fileName().startsWith('.')) {
+            continue;
+        }
+        if (it.fileInfo().isDir() && !it.fileInfo().isSymLink()) {
+            addWatch(path, generation);
+        } else if (it.fileInfo().isFile()) {
+            files << path;
+        }
+    }
+    if (files.isEmpty()) {
+        return;
+    }
+    QMetaObject::invokeMethod(this, [this, files, generation]() {
+        if (generation != m_generation.loadAcquire()) {
+            return;
+        }
+        for (const QString &path : files) {
+            fileAdded(path);
+        }
+    }, Qt::QueuedConnection);
+}
+
+void DirWatcher::removeWatch(int wd)
+{
+    QMutexLocker locker(&m_watchMutex);
+    const QString path = m_wdToPath.take(wd);
+    if (!path.isEmpty()) {
+        m_pathToWd.remove(path);
+    }
+}
+
+void DirWatcher::removeTree(const QString &dir)
+{
+    const QString prefix = dir + '/';
+    QMutexLocker locker(&m_watchMutex);
+    const QList<int> wds = m_wdToPath.keys();
+    for (int wd : wds) {
+        const QString path = m_wdToPath.value(wd);
+        if (path == dir || path.startsWith(prefix)) {
+            inotify_rm_watch(m_fd, wd);
+            m_wdToPath.remove(wd);
+            m_pathToWd.remove(path);
+        }
+    }
+}
+
+void DirWatcher::fileAdded(const QString &path)
+{
+    m_removed.remove(path);
+    m_added.insert(path);
+    schedule();
+}
+
+void DirWatcher::fileRemoved(const QString &path)
+{
+    //合并周期内新建又删除的文件，列表里没有时删除是空操作
+    m_added.remove(path);
+    m_removed.insert(path);
+    schedule();
+}
+
+void DirWatcher::schedule()
+{
+    if (!m_coalesceTimer.isActive()) {
+        m_pendingSince.start();
+        m_coalesceTimer.start(m_interval);
+        return;
+    }
+    //持续有事件时推迟发出，但不超过最长等待时间
+    const qint64 remaining = m_maxDelay - m_pendingSince.elapsed();
+    if (remaining > 0) {
+        m_coalesceTimer.start(int(qMin<qint64>(remaining, m_interval)));
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DIRWATCHER_H
+#define DIRWATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QMutex>
+
+class QSocketNotifier;
+
+//基于inotify监控目录，把新建、移动、删除转换成增量的图片增删
+//短时间内的大量事件合并后一次发出，导入过程中不需要重新扫描
+//类型判断和新目录遍历在工作线程中进行，结果按事件顺序回到所属线程
+class DirWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DirWatcher(QObject *parent = nullptr);
+    ~DirWatcher() override;
+
+    bool isValid() const;
+
+    //监控目录本身，子目录需要分别添加
+    bool addPath(const QString &dir);
+    void addPaths(const QStringList &dirs);
+    void removeAll();
+    QStringList directories() const;
+
+    //最后一个事件后等待的时间，持续有事件时最长不超过maxDelay
+    void setCoalesceInterval(int msec, int maxDelayMsec);
+
+signals:
+    //removed中可能是目录，表示该目录下的图片全部移除
+    void sigChanged(const QStringList &added, const QStringList &removed);
+    //内核事件队列溢出，增量信息不完整，需要重新扫描
+    void sigOverflow();
+
+private slots:
+    void onReadyRead();
+    void onCoalesced();
+
+private:
+    bool addWatch(const QString &path, int generation);
+    void addTree(const QString &dir);
+    void scanTree(const QString &dir, int generation);
+    void removeWatch(int wd);
+    void removeTree(const QString &dir);
+    void fileAdded(const QString &path);
+    void fileRemoved(const QString &path);
+    void schedule();
+
+private:
+    int m_fd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    //工作线程遍历新目录时也会添加监控
+    mutable QMutex m_watchMutex;
+    QHash<int, QString> m_wdToPath;
+    QHash<QString, int> m_pathToWd;
+
+    //等待合并发出的变化
+    QSet<QString> m_added;
+    QSet<QString> m_removed;
+    QTimer m_coalesceTimer;
+    QElapsedTimer m_pendingSince;
+    int m_interval = 300;
+    int m_maxDelay = 2000;
+
+    //单线程保证各批结果按提交顺序发出
+    QThreadPool m_pool;
+    //removeAll后递增，之前提交的任务结果直接丢弃
+    QAtomicInt m_generation;
+};
+
+#endif // DIRWATCHER_H
@@ -0,0 +1,8 @@
+HEADERS += \
+    $$PWD/dirscanner.h \
+    $$PWD/dirwatcher.h \
+
+SOURCES += \
+    $$PWD/dirscanner.cpp \
+    $$PWD/dirwatcher.cpp \
+
@@ -43,6 +43,12 @@
 
 #include "mainwindow/mainwindow.h"
 #include "application.h"
+#include "utils/startupprofiler.h"
+#include "utils/startupwarmup.h"
+#include "utils/pathingest.h"
+#include "service/batchconverter.h"
+#include "service/decodebenchmark.h"
+#include "service/decodepool.h"
 
 //using namespace Dtk::Core;
 
@@ -91,38 +97,24 @@ bool CheckWayland()
         return false;
     }
 }
-//转换路径
-QUrl UrlInfo(QString path)
+int main(int argc, char *argv[])
 {
-    QUrl url;
-    // Just check if the path is an existing file.
-    if (QFile::exists(path)) {
-        url = QUrl::fromLocalFile(QDir::current().absoluteFilePath(path));
-        return url;
+    //进程外解码池的子进程
+    if (DecodePool::isWorkerMode(argc, argv)) {
+        return DecodePool::execWorker(argc, argv);
     }
-
-    const auto match = QRegularExpression(QStringLiteral(":(\\d+)(?::(\\d+))?:?$")).match(path);
-
-    if (match.isValid()) {
-        // cut away line/column specification from the path.
-        path.chop(match.capturedLength());
+    //无界面批量转换、生成缩略图，不创建DApplication和窗口
+    if (BatchConverter::isBatchMode(argc, argv)) {
+        return BatchConverter::exec(argc, argv);
     }
-
-    // make relative paths absolute using the current working directory
-    // prefer local file, if in doubt!
-    url = QUrl::fromUserInput(path, QDir::currentPath(), QUrl::AssumeLocalFile);
-
-    // in some cases, this will fail, e.g.
-    // assume a local file and just convert it to an url.
-    if (!url.isValid()) {
-        // create absolute file path, we will e.g. pass this over dbus to other processes
-        url = QUrl::fromLocalFile(QDir::current().absoluteFilePath(path));
+    if (DecodeBenchmark::isBenchMode(argc, argv)) {
+        return DecodeBenchmark::exec(argc, argv);
     }
-    return url;
-}
 
-int main(int argc, char *argv[])
-{
+    //启动耗时统计，尽量早地开始计时
+    StartupProfiler *profiler = StartupProfiler::instance();
+    profiler->parseArguments(argc, argv);
+
     //for qt5platform-plugins load DPlatformIntegration or DPlatformIntegrationParent
     if (!QString(qgetenv("XDG_CURRENT_DESKTOP")).toLower().startsWith("deepin")) {
         setenv("XDG_CURRENT_DESKTOP", "Deepin", 1);
@@ -136,22 +128,34 @@ int main(int argc, char *argv[])
 
 //    Application::loadDXcbPlugin();
     Application  a(argc, argv);
+    profiler->mark("application");
+    //多次启动测试，只负责拉起子进程并汇总
+    if (profiler->launchCount() > 0) {
+        return profiler->runLaunches();
+    }
+
+    //mime数据库和图片插件在后台预热，和下面创建窗口并行
+    QFuture<void> warmup = StartupWarmup::start();
+
     a.setAttribute(Qt::AA_ForceRasterWidgets);
     a.setAttribute(Qt::AA_UseHighDpiPixmaps);
     a.setOrganizationName("deepin");
     a.setApplicationName("deepin-image-viewer");
+    //翻译只需要加载一次
     a.loadTranslator();
     a.setApplicationDisplayName(QObject::tr("Image Viewer"));
     a.setProductIcon(QIcon::fromTheme("deepin-image-viewer"));
     a.setApplicationDescription(QObject::tr("Image Viewer is an image viewing tool with fashion interface and smooth performance."));
-    a.loadTranslator();
+    profiler->mark("translator");
     //save theme
     DApplicationSettings saveTheme;
     Q_UNUSED(saveTheme);
+    profiler->mark("theme-settings");
 
     DLogManager::registerConsoleAppender();
     DLogManager::registerFileAppender();
     qDebug() << "LogFile:" << DLogManager::getlogFilePath();
+    profiler->mark("log");
     a.setApplicationVersion("1.0.0");
 #ifdef CMAKE_BUILD
     //增加版本号
@@ -165,6 +169,7 @@ int main(int argc, char *argv[])
     MainWindow *w = new MainWindow(mainwindow);
     mainwindow->setCentralWidget(w);
     w->setDMainWindow(mainwindow);
+    profiler->mark("main-window");
 
     //初始化大小为上次关闭大小
     if (mainwindow) {
@@ -187,19 +192,28 @@ int main(int argc, char *argv[])
         mainwindow->resize(ww, wh);
         mainwindow->setMinimumSize(MAINWIDGET_MINIMUN_WIDTH, MAINWIDGET_MINIMUN_HEIGHT);
     }
-    QString filepath = "";
+    profiler->mark("restore-size");
+
+    //打开图片需要mime数据库，等待预热完成（通常已经结束）
+    warmup.waitForFinished();
+    profiler->mark("warmup-wait");
+
+    //参数一次性批量解析、去重、排序后交给看图
     QStringList arguments = QCoreApplication::arguments();
-    for (QString path : arguments) {
-        path = UrlInfo(path).toLocalFile();
-        if (QFileInfo(path).isFile()) {
-            bool bRet = w->slotDrogImg(QStringList(path));
-            if (bRet) {
-                break;
-            }
-        }
+    arguments.removeFirst();
+    QStringList dirs;
+    const QStringList files = PathIngest::ingest(arguments, &dirs, true);
+    if (!dirs.isEmpty()) {
+        w->slotDrogFolders(dirs, files);
+    } else if (!files.isEmpty()) {
+        w->slotDrogImg(files);
     }
 
+    profiler->mark("open-arguments");
+
+    profiler->watchFirstFrame(mainwindow);
     mainwindow->show();
+    profiler->mark("show");
 
     //修复窗口会一直在中间变小的问题
     if (checkOnly()) {
@@ -26,9 +26,11 @@
 #include <QProcess>
 #include <QDesktopWidget>
 #include <QShortcut>
+#include <QKeyEvent>
+#include <QTimer>
 #include <QDir>
+#include <QFileInfo>
 #include <QMimeData>
-#include <QSettings>
 #include <QCommandLineParser>
 #include <QStandardPaths>
 #include <QDebug>
@@ -38,12 +40,32 @@
 #include <DFileDialog>
 
 #include "module/view/homepagewidget.h"
+#include "dirwatcher/dirscanner.h"
+#include "dirwatcher/dirwatcher.h"
+#include "settings/settingsstore.h"
+#include "widgets/resizeoverlay.h"
+#include "widgets/viewswitchprobe.h"
+#include "widgets/framepreview.h"
+#include "widgets/slideshowview.h"
+#include "widgets/ocrview.h"
+#include "widgets/imageinfoview.h"
+#include "service/decodepool.h"
+#include "service/imagedecoder.h"
+#include "service/tilepyramid.h"
+#include "service/neighborprefetcher.h"
+#include "service/framering.h"
+#include "service/burstnavigator.h"
+#include "service/losslessrotator.h"
+#include "service/ocrservice.h"
+#include "service/metadataservice.h"
+#include "service/folderindex.h"
 #include "../libimageviewer/imageviewer.h"
 #include "../libimageviewer/imageengine.h"
 #include "application.h"
 
 const int MAINWIDGET_MINIMUN_HEIGHT = 335;
 const int MAINWIDGET_MINIMUN_WIDTH = 730;//增加了ocr，最小宽度为630到现在730
+const int HOMEPAGE_TITLEBAR_HEIGHT = 50;
 
 const QString CONFIG_PATH =   QDir::homePath() +
                               "/.config/deepin/deepin-image-viewer/config.conf";
@@ -61,7 +83,9 @@ MainWindow::MainWindow(QWidget *parent)
 
 MainWindow::~MainWindow()
 {
-
+    //正在生成的一批完成后写回索引文件
+    FolderIndex::instance()->cancel();
+    FolderIndex::instance()->waitForDone();
 }
 
 void MainWindow::setDMainWindow(DMainWindow *mainwidow)
@@ -76,24 +100,18 @@ void MainWindow::setDMainWindow(DMainWindow *mainwidow)
 void MainWindow::setValue(const QString &group, const QString &key, const QVariant &value)
 {
     if (!m_settings) {
-        m_settings = new QSettings(CONFIG_PATH, QSettings::IniFormat, this);
+        m_settings = new SettingsStore(CONFIG_PATH, this);
     }
-    m_settings->beginGroup(group);
-    m_settings->setValue(key, value);
-    m_settings->endGroup();
+    //只更新内存，合并后在后台写入
+    m_settings->setValue(group, key, value);
 }
 
 QVariant MainWindow::value(const QString &group, const QString &key, const QVariant &defaultValue)
 {
     if (!m_settings) {
-        m_settings = new QSettings(CONFIG_PATH, QSettings::IniFormat, this);
+        m_settings = new SettingsStore(CONFIG_PATH, this);
     }
-    QVariant value;
-    m_settings->beginGroup(group);
-    value = m_settings->value(key, defaultValue);
-    m_settings->endGroup();
-
-    return value;
+    return m_settings->value(group, key, defaultValue);
 }
 
 QJsonObject MainWindow::createShorcutJson()
@@ -243,29 +261,179 @@ void MainWindow::initUI()
                          + QDir::separator() + "deepin" + QDir::separator() + "image-view-plugin";
 
     m_imageViewer = new ImageViewer(imageViewerSpace::ImgViewerType::ImgViewerTypeLocal, CACHE_PATH, nullptr, this);
+    //超大图片的瓦片金字塔和看图缓存放在一起
+    TilePyramid::setCacheRoot(CACHE_PATH + QDir::separator() + "pyramid");
     m_centerWidget->addWidget(m_imageViewer);
 
     m_centerWidget->setCurrentWidget(m_homePageWidget);
 
+    m_switchProbe = new ViewSwitchProbe(m_centerWidget, this);
+
+    //拖动改变窗口大小时看图区域用截图快速缩放，停止后再高质量缩放一次
+    m_resizeOverlay = new ResizeOverlay(m_imageViewer, this);
+
+    //可选：RAW在独立的子进程中解码，插件崩溃或卡死时只重启子进程
+    const int decodeWorkers = value(DECODE_GROUP, DECODE_WORKERS_KEY, 0).toInt();
+    if (decodeWorkers > 0) {
+        m_decodePool = new DecodePool(decodeWorkers, this);
+        ImageDecoder::setDecodePool(m_decodePool);
+    }
+
+    //按翻页顺序预读前后的文件；看图自己翻页（按键、缩略图、滚轮、删除）后按它当前的图片重新定位
+    m_prefetcher = new NeighborPrefetcher(this);
+    m_viewerSync = new QTimer(this);
+    m_viewerSync->setSingleShot(true);
+    m_viewerSync->setInterval(0);
+    connect(m_viewerSync, &QTimer::timeout, this, &MainWindow::syncViewerPosition);
+    qApp->installEventFilter(this);
+
+    //前后图片按窗口大小提前解码，翻页时先盖一层显示，内存按预算而不是张数限制
+    m_frameRing = new FrameRing(this);
+    m_frameRing->setBudget(value(DECODE_GROUP, DECODE_NEIGHBOR_BUDGET_KEY, 256).toLongLong() * 1024 * 1024);
+    m_framePreview = new FramePreview(m_imageViewer);
+    connect(m_prefetcher, &NeighborPrefetcher::sigPathsReady, this, [ = ](const QStringList & paths, const QString & current) {
+        if (m_imageViewer) {
+            m_frameRing->setFrameSize(m_imageViewer->size() * m_imageViewer->devicePixelRatioF());
+        }
+        m_frameRing->setPaths(paths, current);
+        //打开单个文件时看图浏览所在目录，目录内容以展开的结果为准
+        if (!m_fileFolder.isEmpty() && m_scanRoots.isEmpty()) {
+            const bool changed = m_scanShown && m_imageList.paths() != paths;
+            m_imageList.setPaths(paths);
+            m_imageList.setCurrentPath(current);
+            m_scanShown = true;
+            if (changed) {
+                syncImageList();
+            }
+        }
+        //下次打开同一目录时只需要stat，RAW直接读取内嵌预览
+        FolderIndex::instance()->ensure(paths);
+    });
+
+    //按住方向键时只显示缓存或小尺寸预览，停下来再让看图完整解码最终的图片
+    m_burstNavigator = new BurstNavigator(this);
+    m_burstNavigator->setFrameRing(m_frameRing);
+    connect(m_burstNavigator, &BurstNavigator::sigPreview, this, [ = ](const QString & path, const QImage & image) {
+        if (m_framePreview && path == m_burstNavigator->currentPath()) {
+            m_previewPending.clear();
+            m_framePreview->present(image, true);
+        }
+    });
+    connect(m_burstNavigator, &BurstNavigator::sigSettled, this, [ = ](const QString & path) {
+        m_swallowedKey = 0;
+        if (!m_imageViewer || path.isEmpty()) {
+            return;
+        }
+        if (m_imageList.contains(path)) {
+            m_imageList.setCurrentPath(path);
+        }
+        //没有解码好的图片时保留最后一张预览，直到看图显示这张图片并重绘
+        const QImage frame = m_frameRing->arrive(path);
+        if (m_framePreview && !frame.isNull()) {
+            m_framePreview->present(frame);
+        }
+        m_imageViewer->startImgView(path, m_viewerPaths);
+        m_previewPending = path;
+        if (m_infoView && m_infoView->isVisible()) {
+            showImageInfo(path);
+        }
+    });
+
+    //旋转在后台写文件，完成后如果还停在这张图片就重新加载
+    m_rotator = new LosslessRotator(this);
+    connect(m_rotator, &LosslessRotator::sigRotated, this, [ = ](const QString & path, bool ok) {
+        if (!ok) {
+            return;
+        }
+        m_frameRing->remove(path);
+        if (m_imageViewer && path == currentViewerPath()
+                && m_centerWidget->currentWidget() == m_imageViewer) {
+            showInViewer(path, m_viewerPaths);
+        }
+    });
+
+    //识别结果按文件内容缓存，同一张图片再次识别立即返回
+    //默认仍由看图调用deepin-ocr识别，没有安装或者设置为tesseract时才在本地识别
+    //查找tesseract在后台进行，找到之前Alt+O交给看图
+    m_ocr = new OcrService(this);
+    m_ocr->probeTesseract(value(OCR_GROUP, OCR_LANGUAGES_KEY, "chi_sim+eng").toString(),
+                          value(OCR_GROUP, OCR_ENGINE_KEY, "deepin-ocr").toString() != "tesseract");
+
+    //图片信息在后台读取文件头，按文件身份缓存
+    m_metadata = new MetadataService(this);
+    connect(m_metadata, &MetadataService::sigReady, this, [ = ](const QString & path, const ImageMetadata & metadata) {
+        if (m_infoView) {
+            m_infoView->setMetadata(path, metadata);
+        }
+    });
+
     connect(m_homePageWidget, &HomePageWidget::sigOpenImage, this, &MainWindow::slotOpenImg);
 
-    connect(m_homePageWidget, &HomePageWidget::sigDrogImage, this, &MainWindow::slotDrogImg);
+    connect(m_homePageWidget, &HomePageWidget::sigDrogImage, this, [ = ](const QStringList & paths) {
+        stopFolderTracking();
+        slotDrogImg(paths);
+    });
+
+    connect(m_homePageWidget, &HomePageWidget::sigDrogFolders, this, &MainWindow::slotDrogFolders);
+
+    m_dirScanner = new DirScanner(this);
+    connect(m_dirScanner, &DirScanner::sigImagesFound, this, [ = ](const QStringList & images) {
+        m_imageList.append(images);
+        //第一批到达就显示，不等整个目录树扫描完
+        if (!m_scanShown) {
+            m_scanShown = slotDrogImg(m_imageList.paths());
+        }
+    });
+    connect(m_dirScanner, &DirScanner::sigFinished, this, [ = ](int total) {
+        qDebug() << "dir scan finished, images:" << total;
+        m_dirWatcher->addPaths(m_dirScanner->scannedDirectories());
+        //重新扫描后仍停在原来的图片
+        if (!m_rescanCurrent.isEmpty()) {
+            m_imageList.setCurrentPath(m_rescanCurrent);
+            m_rescanCurrent.clear();
+        }
+        //看图库只支持整体替换列表，扫描结束时刷新一次
+        syncImageList();
+    });
+
+    //目录监控：导入过程中的变化合并后增量更新列表，不重新扫描
+    m_dirWatcher = new DirWatcher(this);
+    connect(m_dirWatcher, &DirWatcher::sigChanged, this, [ = ](const QStringList & added, const QStringList & removed) {
+        QStringList images = added;
+        //单个文件所在目录中新建的子目录不在看图的列表里
+        if (!m_fileFolder.isEmpty()) {
+            images.clear();
+            for (const QString &path : added) {
+                if (QFileInfo(path).absolutePath() == m_fileFolder) {
+                    images << path;
+                }
+            }
+        }
+        if (m_imageList.apply(images, removed) && !m_dirScanner->isRunning()) {
+            syncImageList();
+        }
+    });
+    connect(m_dirWatcher, &DirWatcher::sigOverflow, this, [ = ] {
+        //事件丢失只能重新列出目录；列表从头建立，已经删除的文件不会留下
+        if (!m_fileFolder.isEmpty()) {
+            if (m_imageList.count() > 0) {
+                m_prefetcher->setPaths(QStringList() << m_imageList.currentPath());
+            }
+            return;
+        }
+        m_rescanCurrent = m_imageList.currentPath();
+        m_imageList.clear();
+        m_dirScanner->start(m_scanRoots);
+    });
 
     //ImageEngine::instance()->sigPicCountIsNull()
     connect(ImageEngine::instance(), &ImageEngine::sigPicCountIsNull, this, [ = ] {
-        m_centerWidget->setCurrentWidget(m_homePageWidget);
-        if (m_mainwidow && m_mainwidow->titlebar())
+        if (m_mainwidow)
         {
             //需要全屏切回普通窗口
             m_mainwidow->showNormal();
-            //隐藏原有DMainWindow titlebar，使用自定义标题栏
-            m_mainwidow->titlebar()->setFixedHeight(50);
-            m_mainwidow->titlebar()->setIcon(QIcon::fromTheme("deepin-image-viewer"));
-            m_mainwidow->setTitlebarShadowEnabled(true);
-            int normalheight = m_mainwidow->height() + 1;
-            m_mainwidow->resize(m_mainwidow->width(), normalheight);
-            m_mainwidow->resize(m_mainwidow->width(), normalheight - 1);
         }
+        switchToHomePage();
     });
 
     QShortcut *openFileManager = new QShortcut(QKeySequence("Ctrl+o"), this);
@@ -285,27 +453,18 @@ void MainWindow::slotOpenImg()
 #ifdef NOUSE_TEST
     bool bRet = m_imageViewer->startChooseFileDialog();
     if (bRet) {
-#else
-    {
-#endif
-        if (m_imageViewer)
-        {
-            m_centerWidget->setCurrentWidget(m_imageViewer);
-        }
-        if (m_mainwidow && m_mainwidow->titlebar())
-        {
-            //隐藏原有DMainWindow titlebar，使用自定义标题栏
-            m_mainwidow->titlebar()->setFixedHeight(0);
-            m_mainwidow->titlebar()->setIcon(QIcon::fromTheme("deepin-image-viewer"));
-            m_mainwidow->setTitlebarShadowEnabled(true);
-            //全屏的情况不用切换大小
-            if (!window()->isFullScreen()) {
-                int normalheight = m_mainwidow->height() + 1;
-                m_mainwidow->resize(m_mainwidow->width(), normalheight);
-                m_mainwidow->resize(m_mainwidow->width(), normalheight - 1);
-            }
+        stopFolderTracking();
+        switchToViewer();
+        const QString path = m_imageViewer->getCurrentPath();
+        if (!path.isEmpty()) {
+            m_prefetcher->setPaths(QStringList() << path);
+            watchFileFolder(path);
         }
     }
+#else
+    stopFolderTracking();
+    switchToViewer();
+#endif
 
 }
 
@@ -318,6 +477,9 @@ bool MainWindow::slotDrogImg(const QStringList &paths)
     }
     if (bRet) {
         bRet = m_imageViewer->startdragImage(paths);
+        //看图自己决定浏览的列表，不知道它的顺序时不合并翻页
+        m_viewerPaths.clear();
+        m_burstNavigator->setPaths(QStringList(), QString());
     }
     if (bRet) {
 #else
@@ -325,30 +487,195 @@ bool MainWindow::slotDrogImg(const QStringList &paths)
     bRet = true;
     {
 #endif
-        if (m_imageViewer) {
-            m_centerWidget->setCurrentWidget(m_imageViewer);
-        }
-        if (m_mainwidow && m_mainwidow->titlebar()) {
-            //隐藏原有DMainWindow titlebar，使用自定义标题栏
-            m_mainwidow->titlebar()->setFixedHeight(0);
-            m_mainwidow->titlebar()->setIcon(QIcon::fromTheme("deepin-image-viewer"));
-            m_mainwidow->setTitlebarShadowEnabled(true);
-            //全屏的情况不用切换大小
-            if (!window()->isFullScreen()) {
-                int normalheight = m_mainwidow->height() + 1;
-                m_mainwidow->resize(m_mainwidow->width(), normalheight);
-                m_mainwidow->resize(m_mainwidow->width(), normalheight - 1);
+        switchToViewer();
+        //目录导入时由syncImageList设置完整列表
+        if (m_scanRoots.isEmpty()) {
+            m_prefetcher->setPaths(paths);
+            if (paths.size() == 1) {
+                watchFileFolder(paths.first());
             }
         }
     }
     return bRet;
 }
 
+void MainWindow::switchToViewer()
+{
+    //隐藏原有DMainWindow titlebar，使用自定义标题栏
+    switchPage(m_imageViewer, 0);
+}
+
+void MainWindow::switchToHomePage()
+{
+    switchPage(m_homePageWidget, HOMEPAGE_TITLEBAR_HEIGHT);
+}
+
+void MainWindow::switchPage(QWidget *page, int titlebarHeight)
+{
+    m_switchProbe->markSwitchStart();
+    if (!m_mainwidow || !m_mainwidow->titlebar()) {
+        if (page) {
+            m_centerWidget->setCurrentWidget(page);
+        }
+        return;
+    }
+    //标题栏高度和页面一起切换，暂停绘制，同步布局一次后只绘制一次
+    m_mainwidow->setUpdatesEnabled(false);
+    m_mainwidow->titlebar()->setFixedHeight(titlebarHeight);
+    m_mainwidow->titlebar()->setIcon(QIcon::fromTheme("deepin-image-viewer"));
+    m_mainwidow->setTitlebarShadowEnabled(true);
+    if (page) {
+        m_centerWidget->setCurrentWidget(page);
+    }
+    if (m_mainwidow->layout()) {
+        m_mainwidow->layout()->activate();
+    }
+    m_mainwidow->setUpdatesEnabled(true);
+}
+
+ViewSwitchProbe *MainWindow::viewSwitchProbe() const
+{
+    return m_switchProbe;
+}
+
+void MainWindow::slotDrogFolders(const QStringList &dirs, const QStringList &files)
+{
+    m_fileFolder.clear();
+    m_rescanCurrent.clear();
+    m_scanRoots = dirs;
+    m_imageList.setPaths(files);
+    m_scanShown = false;
+    if (!files.isEmpty()) {
+        m_scanShown = slotDrogImg(files);
+    }
+    //先监控根目录，子目录在扫描结束后加入
+    m_dirWatcher->removeAll();
+    m_dirWatcher->addPaths(dirs);
+    m_dirScanner->start(dirs);
+}
+
+void MainWindow::startSlideshow()
+{
+    const QStringList paths = m_viewerPaths;
+    SlideshowView *view = new SlideshowView(this);
+    connect(view, &SlideshowView::sigClosed, this, [ = ](const QString & path) {
+        m_swallowedKey = 0;
+        if (!m_imageViewer || path.isEmpty()) {
+            return;
+        }
+        showInViewer(path, paths);
+    });
+    view->start(paths, currentViewerPath(), value(SLIDESHOW_GROUP, SLIDESHOW_INTERVAL_KEY, 3000).toInt());
+}
+
+void MainWindow::rotateCurrent(bool clockwise)
+{
+    const QString path = currentViewerPath();
+    if (!path.isEmpty()) {
+        m_rotator->rotate(QStringList() << path, clockwise);
+    }
+}
+
+void MainWindow::recognizeCurrent()
+{
+    const QString path = currentViewerPath();
+    if (path.isEmpty()) {
+        return;
+    }
+    if (!m_ocrView) {
+        m_ocrView = new OcrView(m_ocr, this);
+    }
+    m_ocrView->start(path);
+}
+
+void MainWindow::showImageInfo(const QString &path)
+{
+    if (!m_infoView) {
+        m_infoView = new ImageInfoView(this);
+    }
+    m_infoView->setPath(path);
+    ImageMetadata metadata;
+    if (m_metadata->cached(path, &metadata)) {
+        m_infoView->setMetadata(path, metadata);
+    } else {
+        m_metadata->request(path);
+    }
+    m_infoView->show();
+}
+
+void MainWindow::syncViewerPosition()
+{
+    const QString path = currentViewerPath();
+    if (path.isEmpty()) {
+        return;
+    }
+    m_prefetcher->setCurrentPath(path);
+    if (path == m_viewerPath) {
+        return;
+    }
+    //看图自己翻页时自己解码显示，这里只让前后图片以它为中心预解码
+    m_viewerPath = path;
+    m_frameRing->arrive(path);
+}
+
+QString MainWindow::currentViewerPath() const
+{
+    //连续翻页期间看图还停在开始的图片，用户看到的是预览的图片
+    if (m_burstNavigator && m_burstNavigator->isBursting()) {
+        return m_burstNavigator->currentPath();
+    }
+    return m_imageViewer ? m_imageViewer->getCurrentPath() : QString();
+}
+
+void MainWindow::syncImageList()
+{
+    if (m_scanShown && m_imageViewer && m_imageList.count() > 0) {
+        showInViewer(m_imageList.currentPath(), m_imageList.paths());
+        m_prefetcher->setPaths(m_imageList.paths(), m_imageList.currentPath());
+    }
+}
+
+void MainWindow::showInViewer(const QString &path, const QStringList &paths)
+{
+    m_imageViewer->startImgView(path, paths);
+    //交给看图的列表是确定的，连续翻页只在这个列表中进行
+    m_viewerPaths = paths;
+    m_burstNavigator->setPaths(paths, path);
+}
+
+void MainWindow::watchFileFolder(const QString &path)
+{
+    m_dirWatcher->removeAll();
+    m_imageList.clear();
+    m_scanShown = false;
+    m_fileFolder = QFileInfo(path).absolutePath();
+    m_dirWatcher->addPath(m_fileFolder);
+}
+
+void MainWindow::stopFolderTracking()
+{
+    m_dirScanner->cancel();
+    m_dirWatcher->removeAll();
+    m_scanRoots.clear();
+    m_fileFolder.clear();
+    m_rescanCurrent.clear();
+    m_imageList.clear();
+    m_scanShown = false;
+    m_viewerPaths.clear();
+    m_burstNavigator->setPaths(QStringList(), QString());
+}
+
 void MainWindow::quitApp()
 {
+    if (m_settings) {
+        m_settings->flush();
+    }
+    m_dirScanner->cancel();
     if (m_imageViewer) {
         delete m_imageViewer;
         m_imageViewer = nullptr;
+        //随看图控件一起删除
+        m_framePreview = nullptr;
     }
 //    this->close();
     //程序退出
@@ -385,11 +712,101 @@ void MainWindow::resizeEvent(QResizeEvent *e)
 
 bool MainWindow::eventFilter(QObject *obj, QEvent *event)
 {
-    if (event->type() == QEvent::Close) {
+    //快捷键先于按键事件处理，ShortcutOverride一定会发给焦点控件；事件向上传递时只统计一次
+    //幻灯片等其它窗口中的按键不处理
+    if (event->type() == QEvent::ShortcutOverride && obj == qApp->focusObject()
+            && obj->isWidgetType() && static_cast<QWidget *>(obj)->window() == window()
+            && m_centerWidget && m_centerWidget->currentWidget() == m_imageViewer) {
+        QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+        //看图自带的旋转会重新编码JPEG，改为只改写方向；TIFF、GIF、有损格式等仍由看图旋转
+        if (keyEvent->key() == Qt::Key_R && (keyEvent->modifiers() == Qt::ControlModifier
+                                             || keyEvent->modifiers() == (Qt::ControlModifier | Qt::ShiftModifier))
+                && (m_swallowedKey == Qt::Key_R || LosslessRotator::canRotate(currentViewerPath()))) {
+            keyEvent->accept();
+            m_swallowedKey = Qt::Key_R;
+            if (!keyEvent->isAutoRepeat()) {
+                rotateCurrent(!(keyEvent->modifiers() & Qt::ShiftModifier));
+            }
+            return true;
+        }
+        //两种识别都不可用时交给看图处理
+        if (keyEvent->key() == Qt::Key_O && keyEvent->modifiers() == Qt::AltModifier && m_ocr->isAvailable()) {
+            keyEvent->accept();
+            m_swallowedKey = Qt::Key_O;
+            if (!keyEvent->isAutoRepeat()) {
+                recognizeCurrent();
+            }
+            return true;
+        }
+        if (keyEvent->key() == Qt::Key_I && keyEvent->modifiers() == Qt::ControlModifier) {
+            keyEvent->accept();
+            m_swallowedKey = Qt::Key_I;
+            if (!keyEvent->isAutoRepeat()) {
+                if (m_infoView && m_infoView->isVisible()) {
+                    m_infoView->hide();
+                } else if (!currentViewerPath().isEmpty()) {
+                    showImageInfo(currentViewerPath());
+                }
+            }
+            return true;
+        }
+        if (keyEvent->modifiers() == Qt::NoModifier) {
+            if (keyEvent->key() == Qt::Key_F5 && !m_viewerPaths.isEmpty()) {
+                keyEvent->accept();
+                m_swallowedKey = Qt::Key_F5;
+                startSlideshow();
+                return true;
+            }
+            const int delta = keyEvent->key() == Qt::Key_Right ? 1 : keyEvent->key() == Qt::Key_Left ? -1 : 0;
+            if (delta != 0) {
+                //缩略图栏、工具栏、滚轮和删除都会让看图自己翻页，先和它当前显示的图片同步
+                m_burstNavigator->setCurrentPath(currentViewerPath());
+                if (m_burstNavigator->navigate(delta, keyEvent->isAutoRepeat())) {
+                    //看图不再处理这次翻页，跳过的图片不会开始完整解码
+                    m_frameRing->cancelPending();
+                    m_prefetcher->setCurrentPath(m_burstNavigator->currentPath());
+                    m_swallowedKey = keyEvent->key();
+                    keyEvent->accept();
+                    return true;
+                }
+                //看图处理完这次按键后再读取它显示的图片
+                m_viewerSync->start();
+            }
+        }
+    }
+    //预览层不遮挡看图的绘制，看图显示最终的图片并重绘后才隐藏预览
+    if (event->type() == QEvent::Paint && !m_previewPending.isEmpty() && m_framePreview
+            && obj != m_framePreview && obj->isWidgetType() && m_imageViewer
+            && m_imageViewer->isAncestorOf(static_cast<QWidget *>(obj))
+            && currentViewerPath() == m_previewPending) {
+        m_previewPending.clear();
+        m_framePreview->repainted();
+    }
+    //看图中的鼠标、滚轮和其它按键也可能翻页或删除图片
+    if ((event->type() == QEvent::MouseButtonRelease || event->type() == QEvent::Wheel
+            || event->type() == QEvent::KeyRelease) && obj->isWidgetType() && m_imageViewer && m_viewerSync
+            && m_imageViewer->isAncestorOf(static_cast<QWidget *>(obj))) {
+        m_viewerSync->start();
+    }
+    if (m_swallowedKey != 0 && (event->type() == QEvent::KeyPress || event->type() == QEvent::KeyRelease)) {
+        QKeyEvent *keyEvent = static_cast<QKeyEvent *>(event);
+        if (keyEvent->key() == m_swallowedKey) {
+            //松开按键立即结束连续翻页，自动重复产生的KeyRelease不算
+            if (event->type() == QEvent::KeyRelease && !keyEvent->isAutoRepeat()) {
+                m_burstNavigator->release();
+                m_swallowedKey = 0;
+            }
+            return true;
+        }
+    }
+    //应用级事件过滤器也会收到其它窗口的关闭事件
+    if (event->type() == QEvent::Close && obj == m_mainwidow) {
         //监控到mainwindow关闭，则关闭m_imageViewer
         if (m_imageViewer) {
             delete m_imageViewer;
             m_imageViewer = nullptr;
+            //随看图控件一起删除
+            m_framePreview = nullptr;
         }
     }
     return DWidget::eventFilter(obj, event);
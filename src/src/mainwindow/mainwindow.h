@@ -39,14 +39,45 @@
 #include <QStatusBar>
 #include <QButtonGroup>
 #include <QJsonObject>
+#include <QPointer>
+
+#include "service/imagelistmodel.h"
 
 const QString SETTINGS_GROUP = "MAINWINDOW";
 const QString SETTINGS_WINSIZE_W_KEY = "WindowWidth";
 const QString SETTINGS_WINSIZE_H_KEY = "WindowHeight";
+//RAW进程外解码的子进程数，0为不启用
+const QString DECODE_GROUP = "DECODE";
+const QString DECODE_WORKERS_KEY = "IsolatedWorkers";
+//前后图片预解码占用的内存上限(MB)
+const QString DECODE_NEIGHBOR_BUDGET_KEY = "NeighborBufferMB";
+//幻灯片播放间隔(ms)
+const QString SLIDESHOW_GROUP = "SLIDESHOW";
+const QString SLIDESHOW_INTERVAL_KEY = "Interval";
+//文字识别：默认deepin-ocr，设置为tesseract或者没有安装deepin-ocr时在本地用tesseract识别
+const QString OCR_GROUP = "OCR";
+const QString OCR_ENGINE_KEY = "Engine";
+//tesseract识别使用的语言
+const QString OCR_LANGUAGES_KEY = "Languages";
 DWIDGET_USE_NAMESPACE
 class HomePageWidget;
 class ImageViewer;
-class QSettings;
+class DirScanner;
+class DirWatcher;
+class SettingsStore;
+class ResizeOverlay;
+class ViewSwitchProbe;
+class DecodePool;
+class NeighborPrefetcher;
+class FrameRing;
+class FramePreview;
+class BurstNavigator;
+class LosslessRotator;
+class OcrService;
+class OcrView;
+class MetadataService;
+class ImageInfoView;
+class QTimer;
 class MainWindow : public DWidget
 {
     Q_OBJECT
@@ -66,9 +97,40 @@ public:
     //初始化大小
     void initSize();
 
+    //F5全屏播放当前列表，退出后看图停在最后一张
+    void startSlideshow();
+
+    //Ctrl+R/Ctrl+Shift+R无损旋转当前图片，写入文件后看图重新加载
+    void rotateCurrent(bool clockwise);
+
+    //Alt+O在后台识别当前图片中的文字
+    void recognizeCurrent();
+
+    //Ctrl+I显示图片信息，只读取文件头；再按一次关闭
+    void showImageInfo(const QString &path);
+
+    //主页和看图页面切换的耗时统计
+    ViewSwitchProbe *viewSwitchProbe() const;
+
 private:
 
     void initUI();
+    //把当前列表整体同步给看图
+    void syncImageList();
+    //用确定的列表打开图片，记下这个列表
+    void showInViewer(const QString &path, const QStringList &paths);
+    //看图自己翻页以后，预读和预解码按它实际显示的图片重新定位
+    void syncViewerPosition();
+    //用户正在看的图片：看图当前的图片，连续翻页期间是预览的图片
+    QString currentViewerPath() const;
+    //打开了单个文件，监控所在目录
+    void watchFileFolder(const QString &path);
+    //打开了其它图片，停止目录扫描和监控
+    void stopFolderTracking();
+    //切换页面并调整标题栏，只做一次布局
+    void switchToViewer();
+    void switchToHomePage();
+    void switchPage(QWidget *page, int titlebarHeight);
 protected:
     void resizeEvent(QResizeEvent *e) Q_DECL_OVERRIDE;
     bool eventFilter(QObject *obj, QEvent *event) Q_DECL_OVERRIDE;
@@ -77,6 +139,8 @@ protected:
 public slots:
     void slotOpenImg();
     bool slotDrogImg(const QStringList &paths);
+    //递归扫描目录，第一批图片到达即打开，扫描结束后刷新完整列表
+    void slotDrogFolders(const QStringList &dirs, const QStringList &files = QStringList());
     void quitApp();
 
     //显示快捷键预览
@@ -86,7 +150,37 @@ private:
     HomePageWidget   *m_homePageWidget = nullptr;
     ImageViewer      *m_imageViewer = nullptr;
     DMainWindow      *m_mainwidow = nullptr;
-    QSettings        *m_settings = nullptr;
+    SettingsStore    *m_settings = nullptr;
+    ResizeOverlay    *m_resizeOverlay = nullptr;
+    ViewSwitchProbe  *m_switchProbe = nullptr;
+    DecodePool       *m_decodePool = nullptr;
+    NeighborPrefetcher *m_prefetcher = nullptr;
+    FrameRing        *m_frameRing = nullptr;
+    FramePreview     *m_framePreview = nullptr;
+    BurstNavigator   *m_burstNavigator = nullptr;
+    LosslessRotator  *m_rotator = nullptr;
+    OcrService       *m_ocr = nullptr;
+    QPointer<OcrView> m_ocrView;
+    MetadataService  *m_metadata = nullptr;
+    QPointer<ImageInfoView> m_infoView;
+    //连续翻页时被吞掉的按键，对应的KeyPress也不交给看图
+    int               m_swallowedKey = 0;
+    //看图处理完事件后同步一次当前图片
+    QTimer           *m_viewerSync = nullptr;
+    QString           m_viewerPath;
+    //连续翻页结束后交给看图的图片，看图重绘它以后隐藏预览
+    QString           m_previewPending;
+    //通过startImgView交给看图的列表，看图自己生成列表时为空
+    QStringList       m_viewerPaths;
+    DirScanner       *m_dirScanner = nullptr;
+    DirWatcher       *m_dirWatcher = nullptr;
+    QStringList       m_scanRoots;
+    //打开单个文件时看图浏览的目录
+    QString           m_fileFolder;
+    //事件溢出重新扫描前显示的图片
+    QString           m_rescanCurrent;
+    ImageListModel    m_imageList;
+    bool              m_scanShown = false;
 };
 
 #endif // MAINWINDOW_H
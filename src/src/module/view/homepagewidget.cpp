@@ -3,11 +3,15 @@
 
 #include "accessibility/ac-desktop-define.h"
 #include "../libimageviewer/imageviewer.h"
+#include "utils/pathingest.h"
+#include "utils/imagetypedetector.h"
+#include "service/dragreadahead.h"
 
 #include <QMimeDatabase>
 #include <QFileInfo>
 #include <QDropEvent>
 #include <QDebug>
+#include <QtConcurrent>
 
 namespace {
 const QSize THUMBNAIL_BORDERSIZE = QSize(130, 130);
@@ -30,6 +34,7 @@ HomePageWidget::HomePageWidget(QWidget *parent)
     grabGesture(Qt::PanGesture);
     setAcceptDrops(true);
     setMouseTracking(true);
+    m_readahead = new DragReadahead(this);
     m_thumbnailLabel = new DLabel(this);
     //    m_thumbnailLabel->setObjectName("ThumbnailLabel");
     m_thumbnailLabel->setFixedSize(THUMBNAIL_BORDERSIZE);
@@ -118,10 +123,37 @@ void HomePageWidget::openImageInDialog()
 
 void HomePageWidget::dragEnterEvent(QDragEnterEvent *event)
 {
+    //只根据后缀和缓存立即判断，不在界面线程读文件，慢速设备上拖入不会卡住
     const QMimeData *mimeData = event->mimeData();
-    if (!checkMimeData(mimeData)) {
-        return;
+    QStringList pending;
+    m_dragCheckPending = false;
+    if (!quickCheckMimeData(mimeData, &pending)) {
+        if (pending.isEmpty()) {
+            return;
+        }
+        //暂时接受，后台确认内容
+        m_dragCheck = QtConcurrent::run([pending]() -> bool {
+            for (const QString &path : pending) {
+                //目录交给扫描器处理
+                if (QFileInfo(path).isDir() || ImageTypeDetector::instance()->isImage(path)) {
+                    return true;
+                }
+            }
+            return false;
+        });
+        m_dragCheckPending = true;
+    }
+
+    //松手前通常还有几百毫秒，提前读取第一张的文件内容
+    const QList<QUrl> urls = mimeData->urls();
+    for (const QUrl &url : urls) {
+        const QString path = PathIngest::localPath(url);
+        if (ImageTypeDetector::instance()->quickCheck(path) != ImageTypeDetector::TypeNotImage) {
+            m_readahead->start(path);
+            break;
+        }
     }
+
     event->setDropAction(Qt::CopyAction);
     event->accept();
     event->acceptProposedAction();
@@ -133,21 +165,45 @@ void HomePageWidget::dragMoveEvent(QDragMoveEvent *event)
     event->accept();
 }
 
+void HomePageWidget::dragLeaveEvent(QDragLeaveEvent *event)
+{
+    //后台检查无法中断，丢弃结果即可
+    m_dragCheckPending = false;
+    m_readahead->cancel();
+    DWidget::dragLeaveEvent(event);
+}
+
 void HomePageWidget::dropEvent(QDropEvent *event)
 {
+    //后台已经确认全部不是图片时拒绝，未完成的交给slotDrogImg再检查
+    if (m_dragCheckPending && m_dragCheck.isFinished() && !m_dragCheck.result()) {
+        m_dragCheckPending = false;
+        m_readahead->cancel();
+        event->ignore();
+        return;
+    }
+    m_dragCheckPending = false;
+    m_readahead->keep();
+
     QList<QUrl> urls = event->mimeData()->urls();
     if (urls.isEmpty()) {
         return;
     }
     QStringList paths;
-    for (QUrl url : urls) {
+    paths.reserve(urls.size());
+    for (const QUrl &url : urls) {
         //修复style问题，取消了path
-        //lmh0901判断是否是图片
-        QString path = url.toLocalFile();
-        if (path.isEmpty()) {
-            path = url.path();
-        }
-        paths << path;
+        paths << PathIngest::localPath(url);
+    }
+    //批量stat、去重、排序后一次交给看图，目录单独递归扫描
+    QStringList dirs;
+    paths = PathIngest::ingest(paths, &dirs);
+    if (!dirs.isEmpty()) {
+        emit sigDrogFolders(dirs, paths);
+        return;
+    }
+    if (paths.isEmpty()) {
+        return;
     }
     emit sigDrogImage(paths);
 }
@@ -171,50 +227,47 @@ bool HomePageWidget::checkMimeData(const QMimeData *mimeData)
         if (path.isEmpty()) {
             path = url.path();
         }
-        QFileInfo fileinfo(path);
-        if (fileinfo.isDir()) {
-            continue;
-        } else {
-            QFileInfo info(path);
-            QMimeDatabase db;
-            QMimeType mt = db.mimeTypeForFile(info.filePath(), QMimeDatabase::MatchContent);
-            QMimeType mt1 = db.mimeTypeForFile(info.filePath(), QMimeDatabase::MatchExtension);
-            QString str = info.suffix().toLower();
-            qDebug() << mt1.name();
-            if (mt1.name().startsWith("image/") || mt1.name().startsWith("video/x-mng")
-                    || mt.name().startsWith("image/") || mt.name().startsWith("video/x-mng")) {
-                result = true;
-                break;
-            }
-
-            continue;
+        //非图片文件跳过，目录可以递归扫描
+        if (QFileInfo(path).isDir() || ImageTypeDetector::instance()->isImage(path)) {
+            result = true;
+            break;
         }
     }
 
     return result;
 }
 
+bool HomePageWidget::quickCheckMimeData(const QMimeData *mimeData, QStringList *pending)
+{
+    if (!mimeData->hasUrls()) {
+        return false;
+    }
+    const QList<QUrl> urlList = mimeData->urls();
+    for (const QUrl &url : urlList) {
+        const QString path = PathIngest::localPath(url);
+        const ImageTypeDetector::ImageType type = ImageTypeDetector::instance()->quickCheck(path);
+        if (ImageTypeDetector::isImageType(type)) {
+            return true;
+        }
+        if (type == ImageTypeDetector::TypeUnknown && pending) {
+            *pending << path;
+        }
+    }
+    return false;
+}
+
+DragReadahead *HomePageWidget::dragReadahead() const
+{
+    return m_readahead;
+}
+
 bool HomePageWidget::checkMinePaths(const QStringList &pathlist)
 {
     bool result = false;
-    for (QString path : pathlist) {
-
-        QFileInfo fileinfo(path);
-        if (fileinfo.isDir()) {
-            continue;
-        } else {
-            QFileInfo info(path);
-            QMimeDatabase db;
-            QMimeType mt = db.mimeTypeForFile(info.filePath(), QMimeDatabase::MatchContent);
-            QMimeType mt1 = db.mimeTypeForFile(info.filePath(), QMimeDatabase::MatchExtension);
-            QString str = info.suffix().toLower();
-            if (mt1.name().startsWith("image/") || mt1.name().startsWith("video/x-mng")
-                    || mt.name().startsWith("image/") || mt.name().startsWith("video/x-mng")) {
-                result = true;
-                break;
-            }
-
-            continue;
+    for (const QString &path : pathlist) {
+        if (ImageTypeDetector::instance()->isImage(path)) {
+            result = true;
+            break;
         }
     }
 
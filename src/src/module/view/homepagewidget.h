@@ -14,7 +14,9 @@
 #include <QMimeData>
 #include <QFileInfo>
 #include <QMimeDatabase>
+#include <QFuture>
 
+class DragReadahead;
 class QGestureEvent;
 class QPinchGesture;
 class QSwipeGesture;
@@ -32,9 +34,15 @@ public:
 
     bool checkMimeData(const QMimeData *mimeData);
     bool checkMinePaths(const QStringList &pathlist);
+    //不做IO的快速检查，无法确定的路径通过pending返回
+    bool quickCheckMimeData(const QMimeData *mimeData, QStringList *pending);
+
+    DragReadahead *dragReadahead() const;
 signals:
     void sigOpenImage();
     void sigDrogImage(const QStringList &);
+    //拖入的目录需要递归扫描，files为同时拖入的图片
+    void sigDrogFolders(const QStringList &dirs, const QStringList &files);
 public slots:
 
     void ThemeChange(DGuiApplicationHelper::ColorType type);
@@ -44,8 +52,15 @@ public slots:
 protected:
     void dragEnterEvent(QDragEnterEvent *event) Q_DECL_OVERRIDE;
     void dragMoveEvent(QDragMoveEvent *event) Q_DECL_OVERRIDE;
+    void dragLeaveEvent(QDragLeaveEvent *event) Q_DECL_OVERRIDE;
     void dropEvent(QDropEvent *event) Q_DECL_OVERRIDE;
 private:
+    //拖入时后台确认文件内容，松手时才根据结果拒绝
+    QFuture<bool> m_dragCheck;
+    bool m_dragCheckPending = false;
+    //拖拽悬停时提前读取第一张图片的文件内容
+    DragReadahead *m_readahead = nullptr;
+
     bool m_isDefaultThumbnail = false;
     DLabel *m_thumbnailLabel;
     QPixmap m_logo;
@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "batchconverter.h"
+#include "imagedecoder.h"
+#include "decodescheduler.h"
+#include "utils/imagetypedetector.h"
+#include "utils/pathingest.h"
+
+#include <QtConcurrent>
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImageWriter>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QPainter>
+#include <QMutex>
+#include <QSet>
+#include <QDir>
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+const char *const CONVERT_OPTION = "--convert";
+const char *const THUMBNAIL_OPTION = "--thumbnail";
+const int DEFAULT_THUMBNAIL_SIZE = 256;
+
+//"800x600"或"800"
+QSize parseSize(const QString &text)
+{
+    const QStringList parts = text.split('x', QString::SkipEmptyParts);
+    bool okW = false;
+    bool okH = false;
+    if (parts.size() == 1) {
+        const int side = parts.first().toInt(&okW);
+        return okW ? QSize(side, side) : QSize();
+    }
+    if (parts.size() == 2) {
+        const QSize size(parts.at(0).toInt(&okW), parts.at(1).toInt(&okH));
+        return okW && okH ? size : QSize();
+    }
+    return QSize();
+}
+
+//JPEG不支持透明，透明部分填充白色
+QImage flattenForJpeg(const QImage &image)
+{
+    if (!image.hasAlphaChannel()) {
+        return image;
+    }
+    QImage flat(image.size(), QImage::Format_RGB32);
+    flat.fill(Qt::white);
+    QPainter painter(&flat);
+    painter.drawImage(0, 0, image);
+    return flat;
+}
+}  // namespace
+
+bool BatchConverter::isBatchMode(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], CONVERT_OPTION) == 0 || strcmp(argv[i], THUMBNAIL_OPTION) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int BatchConverter::exec(int argc, char *argv[])
+{
+    //服务器上没有显示环境，不需要窗口时统一使用offscreen
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    app.setOrganizationName("deepin");
+    app.setApplicationName("deepin-image-viewer");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Batch image conversion and thumbnail generation.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("convert", "Convert images to the output format."));
+    parser.addOption(QCommandLineOption("thumbnail", "Generate thumbnails (default size 256)."));
+    parser.addOption(QCommandLineOption(QStringList() << "o" << "output", "Output directory.", "dir"));
+    parser.addOption(QCommandLineOption(QStringList() << "f" << "format", "jpg or png.", "format", "jpg"));
+    parser.addOption(QCommandLineOption(QStringList() << "s" << "size", "Fit into WxH.", "size"));
+    parser.addOption(QCommandLineOption(QStringList() << "q" << "quality", "Output quality 0-100.", "quality", "90"));
+    parser.addOption(QCommandLineOption(QStringList() << "j" << "jobs", "Worker threads.", "jobs", "0"));
+    parser.addPositionalArgument("inputs", "Image files or directories.", "inputs...");
+    parser.process(app);
+
+    Options options;
+    options.mode = parser.isSet("thumbnail") ? Thumbnail : Convert;
+    options.outputDir = parser.value("output");
+    options.format = parser.value("format").toLower();
+    options.quality = parser.value("quality").toInt();
+    options.jobs = parser.value("jobs").toInt();
+    if (parser.isSet("size")) {
+        options.size = parseSize(parser.value("size"));
+        if (!options.size.isValid()) {
+            fprintf(stderr, "invalid size: %s\n", qPrintable(parser.value("size")));
+            return 2;
+        }
+    } else if (options.mode == Thumbnail) {
+        options.size = QSize(DEFAULT_THUMBNAIL_SIZE, DEFAULT_THUMBNAIL_SIZE);
+    }
+    if (options.format == "jpeg") {
+        options.format = "jpg";
+    }
+    if (options.format != "jpg" && options.format != "png") {
+        fprintf(stderr, "unsupported format: %s\n", qPrintable(options.format));
+        return 2;
+    }
+
+    QStringList roots;
+    const QStringList inputs = collectInputs(parser.positionalArguments(), &roots);
+    if (inputs.isEmpty()) {
+        fprintf(stderr, "no input images\n");
+        return 2;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QList<Result> results = processAll(inputs, roots, options, true);
+    const qint64 wallMs = timer.elapsed();
+
+    int failed = 0;
+    for (const Result &result : results) {
+        failed += result.ok ? 0 : 1;
+    }
+    fprintf(stdout, "files=%d ok=%d failed=%d wall=%lldms rate=%.1f/s\n",
+            results.size(), results.size() - failed, failed, wallMs,
+            wallMs > 0 ? results.size() * 1000.0 / wallMs : 0.0);
+    return failed == 0 ? 0 : 1;
+}
+
+QStringList BatchConverter::collectInputs(const QStringList &paths, QStringList *roots)
+{
+    QStringList dirs;
+    QStringList files = PathIngest::ingest(paths, &dirs, true);
+    QStringList fileRoots;
+    for (int i = 0; i < files.size(); i++) {
+        fileRoots << QString();
+    }
+
+    for (const QString &dir : dirs) {
+        QStringList found;
+        QDirIterator it(dir, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString path = it.next();
+            if (ImageTypeDetector::instance()->isImage(path)) {
+                found << path;
+            }
+        }
+        PathIngest::sortNatural(found);
+        for (const QString &path : found) {
+            files << path;
+            fileRoots << dir;
+        }
+    }
+    if (roots) {
+        *roots = fileRoots;
+    }
+    return files;
+}
+
+QString BatchConverter::outputPath(const QString &input, const QString &root, const Options &options)
+{
+    const QFileInfo info(input);
+    QString dir = info.absolutePath();
+    if (!options.outputDir.isEmpty()) {
+        dir = options.outputDir;
+        //目录输入时保留子目录结构，避免同名文件互相覆盖
+        if (!root.isEmpty()) {
+            const QString relative = QDir(root).relativeFilePath(info.absolutePath());
+            dir += '/' + QFileInfo(root).fileName();
+            if (relative != ".") {
+                dir += '/' + relative;
+            }
+        }
+    }
+    const QString tag = options.mode == Thumbnail ? ".thumb" : QString();
+    QString output = QDir::cleanPath(dir + '/' + info.completeBaseName() + tag + '.' + options.format);
+    //不覆盖输入文件
+    if (QFileInfo(output).absoluteFilePath() == info.absoluteFilePath()) {
+        output = QDir::cleanPath(dir + '/' + info.completeBaseName() + ".converted." + options.format);
+    }
+    return output;
+}
+
+QStringList BatchConverter::outputPaths(const QStringList &inputs, const QStringList &roots, const Options &options)
+{
+    //输入文件都不能被覆盖：不指定--output时a.png转jpg会和同目录的a.jpg重名
+    QSet<QString> taken;
+    for (const QString &input : inputs) {
+        taken.insert(QFileInfo(input).absoluteFilePath());
+    }
+    QStringList outputs;
+    outputs.reserve(inputs.size());
+    for (int i = 0; i < inputs.size(); i++) {
+        QString output = QFileInfo(outputPath(inputs.at(i), roots.value(i), options)).absoluteFilePath();
+        //--output下不同目录的同名文件也会重名
+        const QString stem = output.left(output.size() - options.format.size() - 1);
+        for (int n = 2; taken.contains(output); n++) {
+            output = QString("%1.%2.%3").arg(stem).arg(n).arg(options.format);
+        }
+        taken.insert(output);
+        outputs << output;
+    }
+    return outputs;
+}
+
+BatchConverter::Result BatchConverter::processOne(const QString &input, const QString &output, const Options &options)
+{
+    Result result;
+    result.input = input;
+    result.output = output;
+
+    QElapsedTimer timer;
+    timer.start();
+    QImage image = ImageDecoder::decode(input, options.size, &result.error);
+    result.decodeMs = timer.nsecsElapsed() / 1000000.0;
+    if (image.isNull()) {
+        if (result.error.isEmpty()) {
+            result.error = "decode failed";
+        }
+        return result;
+    }
+    result.size = image.size();
+
+    timer.restart();
+    QDir().mkpath(QFileInfo(result.output).absolutePath());
+    if (options.format == "jpg") {
+        image = flattenForJpeg(image);
+    }
+    QImageWriter writer(result.output, options.format.toLatin1());
+    writer.setQuality(options.quality);
+    result.ok = writer.write(image);
+    if (!result.ok) {
+        result.error = writer.errorString();
+    }
+    result.encodeMs = timer.nsecsElapsed() / 1000000.0;
+    return result;
+}
+
+QList<BatchConverter::Result> BatchConverter::processAll(const QStringList &inputs, const QStringList &roots,
+                                                         const Options &options, bool printProgress)
+{
+    QThreadPool pool;
+    //默认按容器或systemd的CPU配额，而不是机器的核数
+    pool.setMaxThreadCount(options.jobs > 0 ? options.jobs : DecodeScheduler::availableCpus());
+
+    //并行写入之前确定全部输出路径，避免互相覆盖
+    const QStringList outputs = outputPaths(inputs, roots, options);
+    QMutex printMutex;
+    QList<QFuture<Result> > futures;
+    futures.reserve(inputs.size());
+    for (int i = 0; i < inputs.size(); i++) {
+        const QString input = inputs.at(i);
+        const QString output = outputs.at(i);
+        futures << QtConcurrent::run(&pool, [input, output, &options, &printMutex, printProgress]() {
+            const Result result = processOne(input, output, options);
+            if (printProgress) {
+                QMutexLocker locker(&printMutex);
+                if (result.ok) {
+                    fprintf(stdout, "%s -> %s %dx%d decode=%.1fms encode=%.1fms\n",
+                            qPrintable(result.input), qPrintable(result.output),
+                            result.size.width(), result.size.height(),
+                            result.decodeMs, result.encodeMs);
+                } else {
+                    fprintf(stdout, "FAILED %s: %s\n", qPrintable(result.input), qPrintable(result.error));
+                }
+                fflush(stdout);
+            }
+            return result;
+        });
+    }
+
+    QList<Result> results;
+    results.reserve(futures.size());
+    for (QFuture<Result> &future : futures) {
+        results << future.result();
+    }
+    return results;
+}
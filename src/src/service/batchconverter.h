@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BATCHCONVERTER_H
+#define BATCHCONVERTER_H
+
+#include <QString>
+#include <QStringList>
+#include <QSize>
+#include <QList>
+
+//无界面批量转换和生成缩略图，和看图使用同样的解码路径（包括xraw插件）
+//  deepin-image-viewer --convert   [选项] 文件或目录...
+//  deepin-image-viewer --thumbnail [选项] 文件或目录...
+//选项：--output 目录  --format jpg|png  --size WxH  --quality 0-100  --jobs N
+class BatchConverter
+{
+public:
+    enum Mode {
+        Convert,
+        Thumbnail
+    };
+
+    struct Options {
+        Mode mode = Convert;
+        QString outputDir;
+        QString format = "jpg";
+        //无效时保持原尺寸
+        QSize size;
+        int quality = 90;
+        //0表示按可用的CPU数（包括cgroup配额）
+        int jobs = 0;
+    };
+
+    struct Result {
+        QString input;
+        QString output;
+        bool ok = false;
+        QString error;
+        QSize size;
+        double decodeMs = 0;
+        double encodeMs = 0;
+    };
+
+    //在创建任何Application之前调用
+    static bool isBatchMode(int argc, char *argv[]);
+    //创建QGuiApplication，没有显示环境时使用offscreen平台，返回进程退出码
+    static int exec(int argc, char *argv[]);
+
+    //目录递归展开为图片列表
+    static QStringList collectInputs(const QStringList &paths, QStringList *roots = nullptr);
+    static Result processOne(const QString &input, const QString &output, const Options &options);
+    //在线程池中处理，每完成一个打印一行耗时
+    static QList<Result> processAll(const QStringList &inputs, const QStringList &roots,
+                                    const Options &options, bool printProgress);
+    //root为输入所在的目录参数，输出时保留相对路径
+    static QString outputPath(const QString &input, const QString &root, const Options &options);
+    //全部输入的输出路径，和输入文件或其它输出重名时加序号，开始处理前确定
+    static QStringList outputPaths(const QStringList &inputs, const QStringList &roots, const Options &options);
+};
+
+#endif // BATCHCONVERTER_H
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "burstnavigator.h"
+#include "imagedecoder.h"
+#include "framering.h"
+#include "folderindex.h"
+#include "decodescheduler.h"
+
+#include <QDebug>
+
+namespace {
+//连续两次翻页间隔小于此值也算连续翻页（不支持自动重复的键盘、快速连按）
+const qint64 BURST_INTERVAL_MS = 150;
+//最后一次翻页后停顿这么久才开始完整解码
+const int DEFAULT_SETTLE_DELAY = 200;
+const QSize DEFAULT_PREVIEW_SIZE(480, 320);
+}  // namespace
+
+BurstNavigator::BurstNavigator(QObject *parent)
+    : QObject(parent)
+    , m_group(QString("burst-%1").arg(quintptr(this)))
+    , m_previewSize(DEFAULT_PREVIEW_SIZE)
+{
+    m_settleTimer.setSingleShot(true);
+    m_settleTimer.setInterval(DEFAULT_SETTLE_DELAY);
+    connect(&m_settleTimer, &QTimer::timeout, this, &BurstNavigator::settle);
+}
+
+BurstNavigator::~BurstNavigator()
+{
+    m_serial.fetchAndAddOrdered(1);
+    DecodeScheduler::instance()->cancel(m_group);
+    DecodeScheduler::instance()->waitForDone(m_group);
+}
+
+void BurstNavigator::setPaths(const QStringList &paths, const QString &current)
+{
+    m_paths = paths;
+    m_current = paths.indexOf(current);
+    m_bursting = false;
+    m_settleTimer.stop();
+    m_lastStep.invalidate();
+    m_serial.fetchAndAddOrdered(1);
+    DecodeScheduler::instance()->cancel(m_group);
+}
+
+bool BurstNavigator::setCurrentPath(const QString &path)
+{
+    //连续翻页期间看图还停在开始的图片上，以自己记录的为准
+    if (m_bursting) {
+        return m_current >= 0;
+    }
+    m_current = m_paths.indexOf(path);
+    return m_current >= 0;
+}
+
+QStringList BurstNavigator::paths() const
+{
+    return m_paths;
+}
+
+QString BurstNavigator::currentPath() const
+{
+    return m_paths.value(m_current);
+}
+
+bool BurstNavigator::navigate(int delta, bool autoRepeat)
+{
+    //不知道看图停在哪一张时不能替它翻页
+    if (m_current < 0 || delta == 0) {
+        return false;
+    }
+    const bool quick = m_lastStep.isValid() && m_lastStep.elapsed() < BURST_INTERVAL_MS;
+    m_lastStep.start();
+    m_stats.steps++;
+    m_current = qBound(0, m_current + delta, m_paths.size() - 1);
+    if (!m_bursting && !autoRepeat && !quick) {
+        //普通翻页照常交给看图
+        return false;
+    }
+
+    m_bursting = true;
+    m_stats.coalesced++;
+    requestPreview(currentPath());
+    m_settleTimer.start();
+    return true;
+}
+
+void BurstNavigator::release()
+{
+    if (m_bursting) {
+        settle();
+    }
+}
+
+bool BurstNavigator::isBursting() const
+{
+    return m_bursting;
+}
+
+void BurstNavigator::setFrameRing(FrameRing *ring)
+{
+    m_frameRing = ring;
+}
+
+void BurstNavigator::setPreviewSize(const QSize &size)
+{
+    m_previewSize = size;
+}
+
+void BurstNavigator::setSettleDelay(int msec)
+{
+    m_settleTimer.setInterval(msec);
+}
+
+BurstNavigator::Stats BurstNavigator::stats() const
+{
+    return m_stats;
+}
+
+void BurstNavigator::requestPreview(const QString &path)
+{
+    //上一张还没开始的预览已经没有意义
+    const int serial = m_serial.fetchAndAddOrdered(1) + 1;
+    m_stats.cancelled += DecodeScheduler::instance()->cancel(m_group);
+
+    const QImage cached = m_frameRing ? m_frameRing->frame(path) : QImage();
+    if (!cached.isNull()) {
+        m_stats.previews++;
+        emit sigPreview(path, cached);
+        return;
+    }
+    //目录索引中的占位图立即显示，小尺寸预览解码后再替换
+    const QImage placeholder = FolderIndex::instance()->placeholder(path);
+    if (!placeholder.isNull()) {
+        emit sigPreview(path, placeholder);
+    }
+
+    const QSize size = m_previewSize;
+    DecodeScheduler::instance()->submit(DecodeScheduler::PriorityThumbnail, [this, path, size, serial]() {
+        if (m_serial.loadAcquire() != serial) {
+            return;
+        }
+        //按小尺寸解码，JPEG只做缩小的DCT，RAW直接取内嵌预览
+        const QImage image = ImageDecoder::decode(path, size);
+        if (image.isNull() || m_serial.loadAcquire() != serial) {
+            return;
+        }
+        QMetaObject::invokeMethod(this, [this, path, image, serial]() {
+            if (m_serial.loadAcquire() == serial && m_bursting) {
+                m_stats.previews++;
+                emit sigPreview(path, image);
+            }
+        }, Qt::QueuedConnection);
+    }, m_group);
+}
+
+void BurstNavigator::settle()
+{
+    m_settleTimer.stop();
+    if (!m_bursting) {
+        return;
+    }
+    m_bursting = false;
+    m_serial.fetchAndAddOrdered(1);
+    m_stats.cancelled += DecodeScheduler::instance()->cancel(m_group);
+    m_stats.settles++;
+    qDebug() << "burst navigation steps:" << m_stats.steps << "coalesced:" << m_stats.coalesced
+             << "previews:" << m_stats.previews << "cancelled:" << m_stats.cancelled;
+    emit sigSettled(currentPath());
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BURSTNAVIGATOR_H
+#define BURSTNAVIGATOR_H
+
+#include <QObject>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QImage>
+#include <QTimer>
+#include <QPointer>
+
+class FrameRing;
+
+//按住方向键连续翻页时合并翻页：期间只显示缓存的图片或小尺寸预览（JPEG按比例解码、RAW内嵌预览），
+//被跳过的预览解码直接取消，停下来以后才对最终的图片做一次完整解码
+class BurstNavigator : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats {
+        int steps = 0;
+        //被合并、没有交给看图的翻页
+        int coalesced = 0;
+        int previews = 0;
+        int cancelled = 0;
+        int settles = 0;
+    };
+
+    explicit BurstNavigator(QObject *parent = nullptr);
+    ~BurstNavigator() override;
+
+    //paths必须是看图正在浏览的列表，current不在列表中时不合并翻页
+    void setPaths(const QStringList &paths, const QString &current);
+    //和看图当前显示的图片同步，不在列表中返回false，之后的翻页都交给看图
+    bool setCurrentPath(const QString &path);
+    QStringList paths() const;
+    QString currentPath() const;
+
+    //翻页，返回true表示处于连续翻页中，调用方不要再交给看图
+    bool navigate(int delta, bool autoRepeat);
+    //松开按键，连续翻页立即结束
+    void release();
+    bool isBursting() const;
+
+    //前后已经解码好的图片直接显示，不再解码预览
+    void setFrameRing(FrameRing *ring);
+    //预览解码的尺寸（设备像素）
+    void setPreviewSize(const QSize &size);
+    void setSettleDelay(int msec);
+    Stats stats() const;
+
+signals:
+    void sigPreview(const QString &path, const QImage &image);
+    //连续翻页结束，path需要完整解码
+    void sigSettled(const QString &path);
+
+private:
+    void requestPreview(const QString &path);
+    void settle();
+
+private:
+    const QString m_group;
+    QStringList m_paths;
+    int m_current = -1;
+    bool m_bursting = false;
+    QElapsedTimer m_lastStep;
+    QTimer m_settleTimer;
+    QSize m_previewSize;
+    QPointer<FrameRing> m_frameRing;
+    QAtomicInt m_serial;
+    Stats m_stats;
+};
+
+#endif // BURSTNAVIGATOR_H
@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "decodebenchmark.h"
+#include "batchconverter.h"
+#include "imagedecoder.h"
+#include "decodescheduler.h"
+#include "burstnavigator.h"
+#include "metadataservice.h"
+#include "utils/imagetypedetector.h"
+
+#include <QGuiApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QBuffer>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QFile>
+#include <QThread>
+#include <QAtomicInt>
+
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+namespace {
+const char *const BENCH_OPTION = "--bench";
+const int DEFAULT_ITERATIONS = 5;
+const char *const STAGE_PREFIX = "xraw.";
+//xraw插件只在设置了此变量时输出各阶段耗时
+const char *const STAGE_TIMING_ENV = "DEEPIN_IMAGE_VIEWER_XRAW_TIMING";
+//按键自动重复大约每秒30次
+const int DEFAULT_NAVIGATE_INTERVAL = 33;
+//没有指定--size时按常见屏幕计算
+const QSize DEFAULT_EMBEDDED_SIZE(1920, 1080);
+
+double median(std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    return values.size() % 2 ? values[values.size() / 2]
+           : (values[values.size() / 2 - 1] + values[values.size() / 2]) / 2;
+}
+
+//RAW取内嵌预览的字节，JPEG使用整个文件
+QByteArray embeddedJpeg(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    const ImageTypeDetector::ImageType type = ImageTypeDetector::instance()->detect(path);
+    if (type == ImageTypeDetector::TypeJpeg) {
+        return file.readAll();
+    }
+    if (type != ImageTypeDetector::TypeRaw) {
+        return QByteArray();
+    }
+    const ImageMetadata metadata = MetadataService::read(path);
+    if (metadata.previewOffset < 0 || !file.seek(metadata.previewOffset)) {
+        return QByteArray();
+    }
+    return file.read(metadata.previewLength);
+}
+
+double decodeOnce(const QString &path, const QSize &size, QImage *image, QString *error)
+{
+    QElapsedTimer timer;
+    timer.start();
+    *image = ImageDecoder::decode(path, size, error);
+    return timer.nsecsElapsed() / 1000000.0;
+}
+
+//合并翻页依赖事件循环里的定时器和跨线程回调
+void pumpEvents(int msec)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (timer.elapsed() < msec) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 5);
+        QThread::msleep(1);
+    }
+}
+
+void dropAll(const QStringList &paths)
+{
+    for (const QString &path : paths) {
+        DecodeBenchmark::dropPageCache(path);
+    }
+}
+
+//插件写入的各阶段耗时
+QJsonObject stagesOf(const QImage &image)
+{
+    QJsonObject stages;
+    const QStringList keys = image.textKeys();
+    for (const QString &key : keys) {
+        if (!key.startsWith(STAGE_PREFIX)) {
+            continue;
+        }
+        const QString name = key.mid(int(strlen(STAGE_PREFIX)));
+        bool ok = false;
+        const double ms = image.text(key).toDouble(&ok);
+        if (ok) {
+            stages.insert(name, ms);
+        } else {
+            stages.insert(name, image.text(key));
+        }
+    }
+    return stages;
+}
+}  // namespace
+
+bool DecodeBenchmark::isBenchMode(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], BENCH_OPTION) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int DecodeBenchmark::exec(int argc, char *argv[])
+{
+    //用户机器上也可能在ssh里运行，不需要窗口时统一使用offscreen
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    //插件加载之前设置，解码子进程也会继承
+    qputenv(STAGE_TIMING_ENV, "1");
+    QGuiApplication app(argc, argv);
+    app.setOrganizationName("deepin");
+    app.setApplicationName("deepin-image-viewer");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Decode benchmark through the viewer's image plugins.");
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("bench", "Run the decode benchmark."));
+    parser.addOption(QCommandLineOption(QStringList() << "n" << "iterations", "Warm iterations per file.",
+                                        "count", QString::number(DEFAULT_ITERATIONS)));
+    parser.addOption(QCommandLineOption(QStringList() << "s" << "size", "Decode to fit into WxH.", "size"));
+    parser.addOption(QCommandLineOption(QStringList() << "o" << "output", "Write JSON to file.", "file"));
+    parser.addOption(QCommandLineOption("navigate", "Simulate holding the arrow key for N steps.", "steps"));
+    parser.addOption(QCommandLineOption("interval", "Milliseconds between simulated key repeats.", "ms",
+                                        QString::number(DEFAULT_NAVIGATE_INTERVAL)));
+    parser.addOption(QCommandLineOption("embedded", "Compare full and scaled-DCT decoding of embedded JPEG previews."));
+    parser.addPositionalArgument("inputs", "Image files or directories.", "inputs...");
+    parser.process(app);
+
+    QSize size;
+    if (parser.isSet("size")) {
+        const QStringList parts = parser.value("size").split('x');
+        if (parts.size() == 2) {
+            size = QSize(parts.at(0).toInt(), parts.at(1).toInt());
+        }
+        if (!size.isValid()) {
+            fprintf(stderr, "invalid size: %s\n", qPrintable(parser.value("size")));
+            return 2;
+        }
+    }
+    const int iterations = qMax(1, parser.value("iterations").toInt());
+    const QStringList inputs = BatchConverter::collectInputs(parser.positionalArguments());
+    if (inputs.isEmpty()) {
+        fprintf(stderr, "no input images\n");
+        return 2;
+    }
+
+    QJsonObject report = run(inputs, iterations, size);
+    if (parser.isSet("embedded")) {
+        report.insert("embedded", benchEmbedded(inputs, size.isValid() ? size : DEFAULT_EMBEDDED_SIZE, iterations));
+    }
+    if (parser.isSet("navigate")) {
+        report.insert("navigation", benchNavigation(inputs, size, parser.value("navigate").toInt(),
+                                                    qMax(1, parser.value("interval").toInt())));
+    }
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (parser.isSet("output")) {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            fprintf(stderr, "cannot write %s\n", qPrintable(parser.value("output")));
+            return 1;
+        }
+    } else {
+        fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+    return report.value("failed").toInt() == 0 ? 0 : 1;
+}
+
+QJsonObject DecodeBenchmark::run(const QStringList &inputs, int iterations, const QSize &size)
+{
+    QJsonArray files;
+    int failed = 0;
+    for (const QString &path : inputs) {
+        const QJsonObject result = benchFile(path, iterations, size);
+        failed += result.value("ok").toBool() ? 0 : 1;
+        files.append(result);
+    }
+
+    QJsonObject report;
+    report.insert("platform", QGuiApplication::platformName());
+    report.insert("iterations", iterations);
+    if (size.isValid()) {
+        report.insert("fit_size", QString("%1x%2").arg(size.width()).arg(size.height()));
+    }
+    report.insert("files", files);
+    report.insert("failed", failed);
+    report.insert("peak_rss_kb", peakRssKb());
+    return report;
+}
+
+QJsonObject DecodeBenchmark::benchFile(const QString &path, int iterations, const QSize &size)
+{
+    QJsonObject result;
+    result.insert("path", path);
+
+    QImageReader reader(path);
+    const QSize sourceSize = reader.size();
+    result.insert("format", QString::fromLatin1(reader.format()));
+    result.insert("width", sourceSize.width());
+    result.insert("height", sourceSize.height());
+
+    QImage image;
+    QString error;
+    //冷：页缓存清掉后第一次解码，插件自身的初始化也计算在内
+    const bool dropped = dropPageCache(path);
+    const double coldMs = decodeOnce(path, size, &image, &error);
+    result.insert("cache_dropped", dropped);
+    if (image.isNull()) {
+        result.insert("ok", false);
+        result.insert("error", error.isEmpty() ? QString("decode failed") : error);
+        return result;
+    }
+    result.insert("ok", true);
+    result.insert("decoded_width", image.width());
+    result.insert("decoded_height", image.height());
+    result.insert("cold_ms", coldMs);
+    const QJsonObject coldStages = stagesOf(image);
+    if (!coldStages.isEmpty()) {
+        result.insert("cold_stages", coldStages);
+    }
+
+    std::vector<double> warm;
+    warm.reserve(size_t(iterations));
+    for (int i = 0; i < iterations; i++) {
+        warm.push_back(decodeOnce(path, size, &image, &error));
+    }
+    std::sort(warm.begin(), warm.end());
+    const double warmMedian = median(warm);
+    result.insert("warm_min_ms", warm.front());
+    result.insert("warm_median_ms", warmMedian);
+    result.insert("warm_max_ms", warm.back());
+    const QJsonObject warmStages = stagesOf(image);
+    if (!warmStages.isEmpty()) {
+        result.insert("warm_stages", warmStages);
+    }
+
+    //按原图像素计算吞吐
+    const QSize pixels = sourceSize.isValid() ? sourceSize : image.size();
+    const double megapixels = double(pixels.width()) * pixels.height() / 1000000.0;
+    result.insert("megapixels", megapixels);
+    result.insert("cold_mp_per_s", coldMs > 0 ? megapixels * 1000.0 / coldMs : 0.0);
+    result.insert("warm_mp_per_s", warmMedian > 0 ? megapixels * 1000.0 / warmMedian : 0.0);
+    result.insert("peak_rss_kb", peakRssKb());
+    return result;
+}
+
+QJsonObject DecodeBenchmark::benchNavigation(const QStringList &inputs, const QSize &size, int steps, int intervalMs)
+{
+    QJsonObject result;
+    steps = qBound(0, steps, inputs.size() - 1);
+    result.insert("steps", steps);
+    result.insert("interval_ms", intervalMs);
+    if (steps == 0) {
+        return result;
+    }
+    const QString last = inputs.at(steps);
+    DecodeScheduler *scheduler = DecodeScheduler::instance();
+    QElapsedTimer timer;
+
+    //每次翻页都开始完整解码，已经开始的解码不能取消
+    dropAll(inputs);
+    double cpu = cpuTimeMs();
+    QAtomicInt decodes;
+    qint64 lastDoneAt = 0;
+    timer.start();
+    for (int i = 1; i <= steps; i++) {
+        const QString path = inputs.at(i);
+        scheduler->submit(DecodeScheduler::PriorityVisible, [&, path]() {
+            ImageDecoder::decode(path, size);
+            decodes.ref();
+            if (path == last) {
+                lastDoneAt = timer.elapsed();
+            }
+        }, "bench-naive");
+        pumpEvents(intervalMs);
+    }
+    const qint64 releasedAt = timer.elapsed();
+    scheduler->waitForDone("bench-naive");
+    QJsonObject naive;
+    naive.insert("cpu_ms", cpuTimeMs() - cpu);
+    naive.insert("final_latency_ms", double(qMax<qint64>(0, lastDoneAt - releasedAt)));
+    naive.insert("full_decodes", decodes.load());
+    result.insert("naive", naive);
+
+    //合并翻页：期间只有小尺寸预览，松开后解码一次
+    dropAll(inputs);
+    cpu = cpuTimeMs();
+    BurstNavigator navigator;
+    navigator.setPaths(inputs, inputs.first());
+    for (int i = 1; i <= steps; i++) {
+        navigator.navigate(1, true);
+        pumpEvents(intervalMs);
+    }
+    QElapsedTimer latency;
+    latency.start();
+    double finalMs = 0;
+    QObject::connect(&navigator, &BurstNavigator::sigSettled, [&](const QString & path) {
+        ImageDecoder::decode(path, size);
+        finalMs = latency.nsecsElapsed() / 1000000.0;
+    });
+    navigator.release();
+    scheduler->waitForDone();
+    const BurstNavigator::Stats stats = navigator.stats();
+    QJsonObject coalesced;
+    coalesced.insert("cpu_ms", cpuTimeMs() - cpu);
+    coalesced.insert("final_latency_ms", finalMs);
+    coalesced.insert("full_decodes", stats.settles);
+    coalesced.insert("previews", stats.previews);
+    coalesced.insert("cancelled", stats.cancelled);
+    result.insert("coalesced", coalesced);
+    return result;
+}
+
+QJsonObject DecodeBenchmark::benchEmbedded(const QStringList &inputs, const QSize &size, int iterations)
+{
+    QJsonArray files;
+    double fullTotal = 0;
+    double scaledTotal = 0;
+    for (const QString &path : inputs) {
+        const QByteArray jpeg = embeddedJpeg(path);
+        if (jpeg.isEmpty()) {
+            continue;
+        }
+        QJsonObject result = benchScaledJpeg(jpeg, size, iterations);
+        result.insert("path", path);
+        fullTotal += result.value("full_ms").toDouble();
+        scaledTotal += result.value("scaled_ms").toDouble();
+        files.append(result);
+    }
+    QJsonObject report;
+    report.insert("fit_size", QString("%1x%2").arg(size.width()).arg(size.height()));
+    report.insert("files", files);
+    report.insert("speedup", scaledTotal > 0 ? fullTotal / scaledTotal : 0.0);
+    return report;
+}
+
+QJsonObject DecodeBenchmark::benchScaledJpeg(const QByteArray &jpeg, const QSize &size, int iterations)
+{
+    QJsonObject result;
+    QByteArray data = jpeg;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    const QSize source = QImageReader(&buffer, "jpeg").size();
+    const QSize target = ImageDecoder::fittedSize(source, size);
+    result.insert("preview_width", source.width());
+    result.insert("preview_height", source.height());
+    result.insert("target_width", target.width());
+    result.insert("target_height", target.height());
+
+    std::vector<double> full;
+    std::vector<double> scaled;
+    qint64 fullBytes = 0;
+    qint64 scaledBytes = 0;
+    QElapsedTimer timer;
+    for (int i = 0; i < iterations; i++) {
+        //原来的做法：整张解码，再平滑缩放
+        timer.start();
+        const QImage decoded = QImage::fromData(jpeg, "JPEG");
+        const QImage reduced = decoded.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        full.push_back(timer.nsecsElapsed() / 1000000.0);
+        fullBytes = qMax<qint64>(fullBytes, decoded.sizeInBytes() + reduced.sizeInBytes());
+
+        //按缩放尺寸解码，libjpeg只输出缩小后的像素
+        timer.start();
+        buffer.seek(0);
+        QImageReader reader(&buffer, "jpeg");
+        reader.setScaledSize(target);
+        const QImage image = reader.read();
+        scaled.push_back(timer.nsecsElapsed() / 1000000.0);
+        scaledBytes = qMax<qint64>(scaledBytes, image.sizeInBytes());
+    }
+    result.insert("full_ms", median(full));
+    result.insert("scaled_ms", median(scaled));
+    //解码出来的图片占用的内存，不包括libjpeg内部的缓冲
+    result.insert("full_image_bytes", fullBytes);
+    result.insert("scaled_image_bytes", scaledBytes);
+    return result;
+}
+
+bool DecodeBenchmark::dropPageCache(const QString &path)
+{
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    ::close(fd);
+    return ok;
+}
+
+qint64 DecodeBenchmark::peakRssKb()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return qint64(usage.ru_maxrss);
+}
+
+double DecodeBenchmark::cpuTimeMs()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+           + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DECODEBENCHMARK_H
+#define DECODEBENCHMARK_H
+
+#include <QJsonObject>
+#include <QStringList>
+#include <QSize>
+
+//现场诊断用的解码测试，无界面运行，结果输出为JSON
+//  deepin-image-viewer --bench [--iterations N] [--size WxH] [--output file.json] 文件或目录...
+//每个文件先清掉页缓存解码一次（冷），再重复解码N次（热）
+//  --navigate N [--interval ms]：模拟按住方向键翻N页，对比每页都解码和合并翻页的CPU时间及最终图片的延迟
+//  --embedded：RAW的内嵌预览（JPEG直接使用文件本身）先整张解码再缩放，和按缩放尺寸做DCT缩小的对比
+class DecodeBenchmark
+{
+public:
+    static bool isBenchMode(int argc, char *argv[]);
+    //创建QGuiApplication，没有显示环境时使用offscreen平台，返回进程退出码
+    static int exec(int argc, char *argv[]);
+
+    //size有效时和看图一样按尺寸缩放解码
+    static QJsonObject run(const QStringList &inputs, int iterations, const QSize &size);
+    static QJsonObject benchFile(const QString &path, int iterations, const QSize &size);
+    static QJsonObject benchNavigation(const QStringList &inputs, const QSize &size, int steps, int intervalMs);
+    static QJsonObject benchEmbedded(const QStringList &inputs, const QSize &size, int iterations);
+    //同一份JPEG数据：整张解码后QImage::scaled，和QImageReader::setScaledSize
+    static QJsonObject benchScaledJpeg(const QByteArray &jpeg, const QSize &size, int iterations);
+
+    //让内核丢弃文件的页缓存，模拟冷启动读取
+    static bool dropPageCache(const QString &path);
+    //进程峰值内存，单位KB
+    static qint64 peakRssKb();
+    //进程累计使用的CPU时间（用户态+内核态），单位毫秒
+    static double cpuTimeMs();
+};
+
+#endif // DECODEBENCHMARK_H
@@ -0,0 +1,506 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "decodepool.h"
+#include "imagedecoder.h"
+
+#include <QtConcurrent>
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <QFile>
+#include <QDebug>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace {
+const char *const WORKER_OPTION = "--decode-worker";
+const int DEFAULT_TIMEOUT = 10000;
+const quint32 REQUEST_MAGIC = 0x44505251;
+const quint32 REPLY_MAGIC = 0x44505250;
+//路径最长字节数，SOCK_SEQPACKET一次收完整条消息
+const int MAX_PATH_BYTES = 16384;
+
+struct Request {
+    quint32 magic;
+    quint32 id;
+    qint32 fitWidth;
+    qint32 fitHeight;
+    qint32 pathLength;
+};
+
+struct Reply {
+    quint32 magic;
+    quint32 id;
+    qint32 ok;
+    qint32 width;
+    qint32 height;
+    qint32 bytesPerLine;
+    qint32 format;
+    qint32 errorLength;
+};
+
+struct Mapping {
+    void *address;
+    size_t length;
+};
+
+void unmapImage(void *info)
+{
+    Mapping *mapping = static_cast<Mapping *>(info);
+    munmap(mapping->address, mapping->length);
+    delete mapping;
+}
+
+int createMemfd(const char *name)
+{
+    //旧版glibc没有memfd_create的封装
+    return int(syscall(SYS_memfd_create, name, MFD_CLOEXEC));
+}
+
+bool sendReply(int fd, const Reply &reply, const QByteArray &error, int memfd)
+{
+    QByteArray message(reinterpret_cast<const char *>(&reply), sizeof(reply));
+    message += error;
+
+    struct iovec iov;
+    iov.iov_base = message.data();
+    iov.iov_len = size_t(message.size());
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    if (memfd >= 0) {
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+    }
+    return sendmsg(fd, &msg, MSG_NOSIGNAL) == ssize_t(message.size());
+}
+
+//子进程中解码一张图片，像素写入memfd
+void serveRequest(int fd, const Request &request, const QString &path, DecodePool::RequestHook hook)
+{
+    Reply reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.magic = REPLY_MAGIC;
+    reply.id = request.id;
+
+    if (hook) {
+        hook(path);
+    }
+
+    QString error;
+    QImage image = ImageDecoder::decode(path, QSize(request.fitWidth, request.fitHeight), &error);
+    //索引色图片的颜色表无法通过共享内存传递
+    if (!image.isNull() && image.colorCount() > 0) {
+        image = image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    }
+    if (image.isNull()) {
+        const QByteArray text = (error.isEmpty() ? QString("decode failed") : error).toUtf8();
+        reply.errorLength = text.size();
+        sendReply(fd, reply, text, -1);
+        return;
+    }
+
+    const size_t length = size_t(image.bytesPerLine()) * size_t(image.height());
+    const int memfd = createMemfd("deepin-image-viewer-decode");
+    void *address = MAP_FAILED;
+    if (memfd >= 0 && ftruncate(memfd, off_t(length)) == 0) {
+        address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    }
+    if (address == MAP_FAILED) {
+        const QByteArray text = QString("memfd: %1").arg(strerror(errno)).toUtf8();
+        reply.errorLength = text.size();
+        sendReply(fd, reply, text, -1);
+        if (memfd >= 0) {
+            ::close(memfd);
+        }
+        return;
+    }
+    memcpy(address, image.constBits(), length);
+    munmap(address, length);
+
+    reply.ok = 1;
+    reply.width = image.width();
+    reply.height = image.height();
+    reply.bytesPerLine = image.bytesPerLine();
+    reply.format = int(image.format());
+    sendReply(fd, reply, QByteArray(), memfd);
+    ::close(memfd);
+}
+}  // namespace
+
+DecodePool::DecodePool(int workers, QObject *parent)
+    : QObject(parent)
+    , m_workers(qMax(1, workers))
+    , m_program(QCoreApplication::applicationFilePath())
+    , m_timeout(DEFAULT_TIMEOUT)
+{
+    m_pool.setMaxThreadCount(m_workers.size());
+    m_spawnContext = new QObject;
+    m_spawnContext->moveToThread(&m_spawner);
+    m_spawner.setObjectName("DecodePoolSpawner");
+    m_spawner.start();
+}
+
+DecodePool::~DecodePool()
+{
+    if (ImageDecoder::decodePool() == this) {
+        ImageDecoder::setDecodePool(nullptr);
+    }
+    m_pool.waitForDone();
+    {
+        QMutexLocker locker(&m_mutex);
+        for (Worker &worker : m_workers) {
+            terminate(&worker);
+        }
+    }
+    m_spawner.quit();
+    m_spawner.wait();
+    delete m_spawnContext;
+}
+
+int DecodePool::workerCount() const
+{
+    return m_workers.size();
+}
+
+void DecodePool::setTimeout(int msec)
+{
+    m_timeout = msec;
+}
+
+void DecodePool::setWorkerProgram(const QString &program, const QStringList &arguments)
+{
+    m_program = program;
+    m_arguments = arguments;
+}
+
+int DecodePool::restartCount() const
+{
+    return m_restarts.load();
+}
+
+QImage DecodePool::decode(const QString &path, const QSize &fitSize, QString *errorMsg)
+{
+    Worker *worker = acquire();
+    //子进程在第一次使用时才启动
+    if (worker->fd < 0 && !spawn(worker)) {
+        release(worker);
+        if (errorMsg) {
+            *errorMsg = "cannot start decode worker";
+        }
+        return QImage();
+    }
+    const QImage image = exchange(worker, path, fitSize, errorMsg);
+    release(worker);
+    return image;
+}
+
+QFuture<QImage> DecodePool::decodeAsync(const QString &path, const QSize &fitSize)
+{
+    return QtConcurrent::run(&m_pool, [this, path, fitSize]() {
+        return decode(path, fitSize);
+    });
+}
+
+DecodePool::Worker *DecodePool::acquire()
+{
+    QMutexLocker locker(&m_mutex);
+    for (;;) {
+        for (Worker &worker : m_workers) {
+            if (!worker.busy) {
+                worker.busy = true;
+                return &worker;
+            }
+        }
+        m_idle.wait(&m_mutex);
+    }
+}
+
+void DecodePool::release(Worker *worker)
+{
+    QMutexLocker locker(&m_mutex);
+    worker->busy = false;
+    m_idle.wakeOne();
+}
+
+bool DecodePool::spawn(Worker *worker)
+{
+    if (QThread::currentThread() == &m_spawner) {
+        return forkWorker(worker);
+    }
+    bool ok = false;
+    QMetaObject::invokeMethod(m_spawnContext, [this, worker, &ok]() {
+        ok = forkWorker(worker);
+    }, Qt::BlockingQueuedConnection);
+    return ok;
+}
+
+bool DecodePool::forkWorker(Worker *worker)
+{
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        qWarning() << "decode pool socketpair failed:" << strerror(errno);
+        return false;
+    }
+
+    //fork之后只能调用async-signal-safe的函数，参数提前准备好
+    const QByteArray program = QFile::encodeName(m_program);
+    const QByteArray fdArgument = QByteArray::number(fds[1]);
+    QList<QByteArray> extra;
+    for (const QString &argument : m_arguments) {
+        extra << argument.toLocal8Bit();
+    }
+    QVector<char *> argv;
+    argv << const_cast<char *>(program.constData())
+         << const_cast<char *>(WORKER_OPTION)
+         << const_cast<char *>(fdArgument.constData());
+    for (const QByteArray &argument : extra) {
+        argv << const_cast<char *>(argument.constData());
+    }
+    argv << nullptr;
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        qWarning() << "decode pool fork failed:" << strerror(errno);
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        //看图退出时子进程一起退出（fork所在的线程一直存在，直到解码池销毁）
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        fcntl(fds[1], F_SETFD, 0);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    ::close(fds[1]);
+    worker->pid = pid;
+    worker->fd = fds[0];
+    return true;
+}
+
+void DecodePool::terminate(Worker *worker)
+{
+    if (worker->fd >= 0) {
+        ::close(worker->fd);
+        worker->fd = -1;
+    }
+    if (worker->pid > 0) {
+        kill(worker->pid, SIGKILL);
+        while (waitpid(worker->pid, nullptr, 0) < 0 && errno == EINTR) {
+        }
+        worker->pid = -1;
+    }
+}
+
+QImage DecodePool::exchange(Worker *worker, const QString &path, const QSize &fitSize, QString *errorMsg)
+{
+    const QByteArray encoded = QFile::encodeName(path);
+    if (encoded.size() > MAX_PATH_BYTES) {
+        if (errorMsg) {
+            *errorMsg = "path too long";
+        }
+        return QImage();
+    }
+
+    Request request;
+    request.magic = REQUEST_MAGIC;
+    request.id = quint32(m_requestId.fetchAndAddRelaxed(1));
+    request.fitWidth = fitSize.isValid() ? fitSize.width() : -1;
+    request.fitHeight = fitSize.isValid() ? fitSize.height() : -1;
+    request.pathLength = encoded.size();
+    const QByteArray message = QByteArray(reinterpret_cast<const char *>(&request), sizeof(request)) + encoded;
+
+    QString failure;
+    if (send(worker->fd, message.constData(), size_t(message.size()), MSG_NOSIGNAL) != ssize_t(message.size())) {
+        failure = "decode worker exited";
+    } else {
+        struct pollfd pfd;
+        pfd.fd = worker->fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = 0;
+        do {
+            ready = poll(&pfd, 1, m_timeout);
+        } while (ready < 0 && errno == EINTR);
+        if (ready == 0) {
+            failure = "decode worker timed out";
+        }
+    }
+
+    Reply reply;
+    QByteArray error(MAX_PATH_BYTES, Qt::Uninitialized);
+    int memfd = -1;
+    if (failure.isEmpty()) {
+        struct iovec iov[2];
+        iov[0].iov_base = &reply;
+        iov[0].iov_len = sizeof(reply);
+        iov[1].iov_base = error.data();
+        iov[1].iov_len = size_t(error.size());
+
+        char control[CMSG_SPACE(sizeof(int))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t received = 0;
+        do {
+            received = recvmsg(worker->fd, &msg, MSG_CMSG_CLOEXEC);
+        } while (received < 0 && errno == EINTR);
+
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+                memcpy(&memfd, CMSG_DATA(cmsg), sizeof(int));
+            }
+        }
+        //EOF表示子进程已经崩溃
+        if (received < ssize_t(sizeof(reply)) || reply.magic != REPLY_MAGIC || reply.id != request.id) {
+            failure = received <= 0 ? "decode worker crashed" : "decode worker protocol error";
+        } else {
+            error.resize(qBound(0, reply.errorLength, int(received - ssize_t(sizeof(reply)))));
+        }
+    }
+
+    if (!failure.isEmpty()) {
+        if (memfd >= 0) {
+            ::close(memfd);
+        }
+        qWarning() << failure << path;
+        //重启子进程，下一次请求不受影响
+        terminate(worker);
+        m_restarts.ref();
+        spawn(worker);
+        if (errorMsg) {
+            *errorMsg = failure;
+        }
+        return QImage();
+    }
+
+    if (!reply.ok || memfd < 0) {
+        if (memfd >= 0) {
+            ::close(memfd);
+        }
+        if (errorMsg) {
+            *errorMsg = QString::fromUtf8(error);
+        }
+        return QImage();
+    }
+
+    //memfd比图片小时访问超出的页会SIGBUS，映射之前先检查大小
+    const size_t length = size_t(reply.bytesPerLine) * size_t(reply.height);
+    struct stat st;
+    if (reply.width <= 0 || reply.height <= 0 || reply.bytesPerLine <= 0
+            || reply.format <= int(QImage::Format_Invalid) || reply.format >= int(QImage::NImageFormats)
+            || fstat(memfd, &st) != 0 || st.st_size < off_t(length)) {
+        ::close(memfd);
+        if (errorMsg) {
+            *errorMsg = "decode worker protocol error";
+        }
+        return QImage();
+    }
+    void *address = mmap(nullptr, length, PROT_READ, MAP_SHARED, memfd, 0);
+    ::close(memfd);
+    if (address == MAP_FAILED) {
+        if (errorMsg) {
+            *errorMsg = QString("mmap: %1").arg(strerror(errno));
+        }
+        return QImage();
+    }
+
+    //直接使用共享内存作为像素数据，QImage释放时解除映射，修改时才会拷贝
+    Mapping *mapping = new Mapping;
+    mapping->address = address;
+    mapping->length = length;
+    return QImage(static_cast<const uchar *>(address), reply.width, reply.height, reply.bytesPerLine,
+                  QImage::Format(reply.format), unmapImage, mapping);
+}
+
+bool DecodePool::isWorkerMode(int argc, char *argv[])
+{
+    return argc >= 3 && strcmp(argv[1], WORKER_OPTION) == 0;
+}
+
+int DecodePool::execWorker(int argc, char *argv[], RequestHook hook)
+{
+    const int fd = atoi(argv[2]);
+    if (fd <= STDERR_FILENO) {
+        return 2;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    //和--convert一样使用offscreen，svg等插件需要QGuiApplication
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+    app.setOrganizationName("deepin");
+    app.setApplicationName("deepin-image-viewer");
+
+    QByteArray buffer(int(sizeof(Request)) + MAX_PATH_BYTES, Qt::Uninitialized);
+    for (;;) {
+        const ssize_t received = recv(fd, buffer.data(), size_t(buffer.size()), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        //看图关闭了连接
+        if (received <= 0) {
+            break;
+        }
+        if (received < ssize_t(sizeof(Request))) {
+            continue;
+        }
+        Request request;
+        memcpy(&request, buffer.constData(), sizeof(request));
+        if (request.magic != REQUEST_MAGIC
+                || request.pathLength != int(received - ssize_t(sizeof(Request)))) {
+            continue;
+        }
+        const QString path = QFile::decodeName(buffer.mid(sizeof(Request), request.pathLength));
+        serveRequest(fd, request, path, hook);
+    }
+    ::close(fd);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DECODEPOOL_H
+#define DECODEPOOL_H
+
+#include <QObject>
+#include <QImage>
+#include <QSize>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QAtomicInt>
+#include <QFuture>
+#include <QVector>
+#include <QThread>
+#include <QStringList>
+
+#include <sys/types.h>
+
+//进程外解码池：N个 --decode-worker 子进程，通过socketpair通信
+//子进程把像素写入memfd并通过SCM_RIGHTS传回，界面进程mmap后直接包装为QImage，不再拷贝
+//子进程崩溃或超时无响应时杀掉并重新拉起，调用方得到失败结果，程序继续运行
+class DecodePool : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DecodePool(int workers, QObject *parent = nullptr);
+    ~DecodePool() override;
+
+    int workerCount() const;
+    //单张图片的最长解码时间，超过则认为子进程卡死，默认10秒
+    void setTimeout(int msec);
+    //默认是当前程序；arguments附加在 --decode-worker fd 之后
+    void setWorkerProgram(const QString &program, const QStringList &arguments = QStringList());
+
+    //可以在任意线程调用，没有空闲子进程时等待
+    QImage decode(const QString &path, const QSize &fitSize = QSize(), QString *errorMsg = nullptr);
+    QFuture<QImage> decodeAsync(const QString &path, const QSize &fitSize = QSize());
+
+    //子进程被重新拉起的次数
+    int restartCount() const;
+
+    //子进程在解码每个请求之前调用，测试程序用来模拟崩溃和卡死
+    typedef void (*RequestHook)(const QString &path);
+
+    //子进程入口，需要在main函数最开始判断
+    static bool isWorkerMode(int argc, char *argv[]);
+    static int execWorker(int argc, char *argv[], RequestHook hook = nullptr);
+
+private:
+    struct Worker {
+        pid_t pid = -1;
+        int fd = -1;
+        bool busy = false;
+    };
+
+    //在m_spawner线程中fork，PR_SET_PDEATHSIG跟随的是fork所在的线程
+    bool spawn(Worker *worker);
+    bool forkWorker(Worker *worker);
+    void terminate(Worker *worker);
+    Worker *acquire();
+    void release(Worker *worker);
+    //发送一次请求并等待结果，超时或子进程退出时重启子进程
+    QImage exchange(Worker *worker, const QString &path, const QSize &fitSize, QString *errorMsg);
+
+private:
+    QVector<Worker> m_workers;
+    QMutex m_mutex;
+    QWaitCondition m_idle;
+    QThreadPool m_pool;
+    //线程池中的线程空闲后会退出，子进程统一由这个常驻线程启动
+    QThread m_spawner;
+    QObject *m_spawnContext = nullptr;
+    QString m_program;
+    QStringList m_arguments;
+    int m_timeout;
+    QAtomicInt m_restarts;
+    QAtomicInt m_requestId;
+};
+
+#endif // DECODEPOOL_H
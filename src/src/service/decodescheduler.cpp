@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "decodescheduler.h"
+
+#include <QRunnable>
+#include <QThread>
+#include <QFile>
+#include <QDir>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+const int BACKGROUND_NICE = 10;
+const QString CGROUP_ROOT = "/sys/fs/cgroup";
+
+class SchedulerTask : public QRunnable
+{
+public:
+    explicit SchedulerTask(const std::function<void()> &work)
+        : m_work(work)
+    {
+    }
+
+    void run() override
+    {
+        m_work();
+    }
+
+private:
+    std::function<void()> m_work;
+};
+
+QByteArray readFile(const QString &path)
+{
+    QFile file(path);
+    return file.open(QIODevice::ReadOnly) ? file.readAll().trimmed() : QByteArray();
+}
+
+int affinityCpus()
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return QThread::idealThreadCount();
+    }
+    return CPU_COUNT(&set);
+}
+
+int cfsQuotaCpus(const QString &dir)
+{
+    bool okQuota = false;
+    bool okPeriod = false;
+    const qint64 quota = readFile(dir + "/cpu.cfs_quota_us").toLongLong(&okQuota);
+    const qint64 period = readFile(dir + "/cpu.cfs_period_us").toLongLong(&okPeriod);
+    if (!okQuota || !okPeriod || quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return int((quota + period - 1) / period);
+}
+
+//cgroup的CPU配额换算成的CPU数，没有限额返回0
+int cgroupCpus()
+{
+    int result = 0;
+    auto merge = [&result](int cpus) {
+        if (cpus > 0) {
+            result = result > 0 ? qMin(result, cpus) : cpus;
+        }
+    };
+    const QList<QByteArray> lines = readFile("/proc/self/cgroup").split('\n');
+    for (const QByteArray &line : lines) {
+        const QList<QByteArray> fields = line.split(':');
+        if (fields.size() < 3) {
+            continue;
+        }
+        const QString path = QString::fromLocal8Bit(fields.at(2));
+        if (fields.at(0) == "0" && fields.at(1).isEmpty()) {
+            //cgroup v2：上级目录的限额同样生效
+            QString dir = QDir::cleanPath(CGROUP_ROOT + path);
+            while (dir.startsWith(CGROUP_ROOT)) {
+                merge(DecodeScheduler::quotaCpus(readFile(dir + "/cpu.max")));
+                if (dir == CGROUP_ROOT) {
+                    break;
+                }
+                dir = QFileInfo(dir).path();
+            }
+        } else if (fields.at(1).split(',').contains("cpu")) {
+            //cgroup v1：容器里通常只挂载了自己的层级
+            for (const QString &mount : {CGROUP_ROOT + "/cpu,cpuacct", CGROUP_ROOT + "/cpu"}) {
+                merge(cfsQuotaCpus(mount + path));
+                merge(cfsQuotaCpus(mount));
+            }
+        }
+    }
+    return result;
+}
+}  // namespace
+
+DecodeScheduler *DecodeScheduler::instance()
+{
+    static DecodeScheduler scheduler;
+    return &scheduler;
+}
+
+DecodeScheduler::DecodeScheduler()
+    : m_workers(availableCpus())
+{
+    m_clock.start();
+    m_foreground.setMaxThreadCount(m_workers);
+    m_background.setMaxThreadCount(m_workers);
+    qDebug() << "decode scheduler workers:" << m_workers;
+}
+
+int DecodeScheduler::availableCpus()
+{
+    const int affinity = qMax(1, affinityCpus());
+    const int quota = cgroupCpus();
+    return quota > 0 ? qMin(affinity, quota) : affinity;
+}
+
+int DecodeScheduler::quotaCpus(const QByteArray &cpuMax)
+{
+    const QList<QByteArray> fields = cpuMax.trimmed().split(' ');
+    if (fields.isEmpty() || fields.first() == "max") {
+        return 0;
+    }
+    bool okQuota = false;
+    bool okPeriod = true;
+    const qint64 quota = fields.first().toLongLong(&okQuota);
+    //没有写周期时内核默认100ms
+    const qint64 period = fields.size() > 1 ? fields.at(1).toLongLong(&okPeriod) : 100000;
+    if (!okQuota || !okPeriod || quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return int((quota + period - 1) / period);
+}
+
+void DecodeScheduler::submit(Priority priority, const Job &job, const QString &group)
+{
+    Task task;
+    task.job = job;
+    task.group = group;
+    QMutexLocker locker(&m_mutex);
+    task.queuedAt = m_clock.elapsed();
+    m_queues[priority] << task;
+    m_pending[group]++;
+    m_total++;
+    dispatchLocked();
+}
+
+int DecodeScheduler::cancel(const QString &group)
+{
+    QMutexLocker locker(&m_mutex);
+    int cancelled = 0;
+    for (QList<Task> &queue : m_queues) {
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (it->group == group) {
+                it = queue.erase(it);
+                cancelled++;
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (cancelled > 0) {
+        m_stats.cancelled += quint64(cancelled);
+        m_total -= cancelled;
+        if ((m_pending[group] -= cancelled) <= 0) {
+            m_pending.remove(group);
+        }
+        m_idle.wakeAll();
+    }
+    return cancelled;
+}
+
+void DecodeScheduler::waitForDone(const QString &group)
+{
+    QMutexLocker locker(&m_mutex);
+    while (group.isEmpty() ? m_total > 0 : m_pending.value(group) > 0) {
+        m_idle.wait(&m_mutex);
+    }
+}
+
+int DecodeScheduler::workerCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_workers;
+}
+
+void DecodeScheduler::setWorkerCount(int count)
+{
+    QMutexLocker locker(&m_mutex);
+    m_workers = qMax(1, count);
+    m_foreground.setMaxThreadCount(m_workers);
+    m_background.setMaxThreadCount(m_workers);
+    dispatchLocked();
+}
+
+DecodeScheduler::Stats DecodeScheduler::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats stats = m_stats;
+    stats.running = m_running;
+    stats.queued = 0;
+    for (const QList<Task> &queue : m_queues) {
+        stats.queued += queue.size();
+    }
+    return stats;
+}
+
+void DecodeScheduler::dispatchLocked()
+{
+    //单线程时不预留，否则后台任务永远不能运行
+    const int backgroundLimit = qMax(1, m_workers - 1);
+    for (int priority = PriorityVisible; priority < PriorityCount && m_running < m_workers; priority++) {
+        QList<Task> &queue = m_queues[priority];
+        while (!queue.isEmpty() && m_running < m_workers) {
+            const bool visible = priority == PriorityVisible;
+            if (!visible && m_backgroundRunning >= backgroundLimit) {
+                return;
+            }
+            const Task task = queue.takeFirst();
+            const qint64 waited = m_clock.elapsed() - task.queuedAt;
+            m_stats.maxWaitMs[priority] = qMax(m_stats.maxWaitMs[priority], waited);
+            m_running++;
+            if (!visible) {
+                m_backgroundRunning++;
+            }
+
+            const Priority taskPriority = Priority(priority);
+            SchedulerTask *runnable = new SchedulerTask([this, task, taskPriority, visible]() {
+                if (!visible) {
+                    setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), BACKGROUND_NICE);
+                }
+                task.job();
+                finish(taskPriority, task.group);
+            });
+            (visible ? m_foreground : m_background).start(runnable);
+        }
+    }
+}
+
+void DecodeScheduler::finish(Priority priority, const QString &group)
+{
+    QMutexLocker locker(&m_mutex);
+    m_running--;
+    if (priority != PriorityVisible) {
+        m_backgroundRunning--;
+    }
+    m_stats.finished[priority]++;
+    m_total--;
+    if (--m_pending[group] <= 0) {
+        m_pending.remove(group);
+    }
+    m_idle.wakeAll();
+    dispatchLocked();
+}
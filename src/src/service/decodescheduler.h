@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DECODESCHEDULER_H
+#define DECODESCHEDULER_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+#include <functional>
+
+//应用内所有后台解码共用的调度器，按优先级依次执行
+//线程数按sched_getaffinity和cgroup的CPU配额计算，容器或systemd限额下不会超订
+//非当前图片的任务最多占用N-1个线程，当前图片总能立即开始解码
+class DecodeScheduler
+{
+public:
+    enum Priority {
+        PriorityVisible = 0,    //正在显示的图片
+        PriorityAdjacent,       //前后预解码、拖拽投机解码
+        PriorityThumbnail,      //缩略图
+        PriorityBackground,     //OCR、批量转换等
+        PriorityCount
+    };
+
+    typedef std::function<void()> Job;
+
+    struct Stats {
+        quint64 finished[PriorityCount] = {};
+        quint64 cancelled = 0;
+        //排队等待的最长时间
+        qint64 maxWaitMs[PriorityCount] = {};
+        int queued = 0;
+        int running = 0;
+    };
+
+    static DecodeScheduler *instance();
+
+    //group不为空时可以用cancel整组取消排队中的任务
+    void submit(Priority priority, const Job &job, const QString &group = QString());
+    //取消排队中还没开始的任务，已经开始的不能中断，返回取消的个数
+    int cancel(const QString &group);
+    //等待组内（group为空时所有）任务结束
+    void waitForDone(const QString &group = QString());
+
+    int workerCount() const;
+    //测试使用，正在运行的任务不受影响
+    void setWorkerCount(int count);
+    Stats stats() const;
+
+    //进程可用的CPU数：亲和性掩码和cgroup配额中较小的
+    static int availableCpus();
+    //解析cgroup v2的cpu.max（"quota period"或"max period"），不限额返回0
+    static int quotaCpus(const QByteArray &cpuMax);
+
+private:
+    DecodeScheduler();
+    void dispatchLocked();
+    void finish(Priority priority, const QString &group);
+
+    struct Task {
+        Job job;
+        QString group;
+        qint64 queuedAt = 0;
+    };
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_idle;
+    //当前图片在正常优先级的线程上解码，其余任务的线程降低nice值，不和界面抢CPU
+    QThreadPool m_foreground;
+    QThreadPool m_background;
+    QList<Task> m_queues[PriorityCount];
+    //组内排队和运行中的任务数
+    QHash<QString, int> m_pending;
+    int m_total = 0;
+    int m_workers;
+    int m_running = 0;
+    int m_backgroundRunning = 0;
+    QElapsedTimer m_clock;
+    Stats m_stats;
+};
+
+#endif // DECODESCHEDULER_H
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "dragreadahead.h"
+#include "decodescheduler.h"
+
+#include <QFile>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+//单个文件最多预读的字节数
+const off_t MAX_ADVISE_BYTES = 64 * 1024 * 1024;
+}
+
+DragReadahead::DragReadahead(QObject *parent)
+    : QObject(parent)
+    , m_group(QString("readahead-%1").arg(quintptr(this)))
+{
+}
+
+DragReadahead::~DragReadahead()
+{
+    m_generation.fetchAndAddOrdered(1);
+    DecodeScheduler::instance()->cancel(m_group);
+    DecodeScheduler::instance()->waitForDone(m_group);
+}
+
+void DragReadahead::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!enabled) {
+        cancel();
+    }
+}
+
+bool DragReadahead::isEnabled() const
+{
+    return m_enabled;
+}
+
+void DragReadahead::start(const QString &path)
+{
+    if (!m_enabled || path.isEmpty() || path == m_path) {
+        return;
+    }
+    cancel();
+    m_path = path;
+
+    const int generation = m_generation.loadAcquire();
+    //只是发起预读，排在当前图片和前后图片的解码之后
+    DecodeScheduler::instance()->submit(DecodeScheduler::PriorityBackground, [this, path, generation]() {
+        if (m_generation.loadAcquire() != generation) {
+            return;
+        }
+        const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            //WILLNEED只是发起异步读取，不等待完成
+            posix_fadvise(fd, 0, qMin(off_t(st.st_size), MAX_ADVISE_BYTES), POSIX_FADV_WILLNEED);
+        }
+        ::close(fd);
+    }, m_group);
+}
+
+void DragReadahead::cancel()
+{
+    m_generation.fetchAndAddOrdered(1);
+    DecodeScheduler::instance()->cancel(m_group);
+    m_path.clear();
+}
+
+void DragReadahead::keep()
+{
+    m_path.clear();
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef DRAGREADAHEAD_H
+#define DRAGREADAHEAD_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QString>
+
+//拖拽悬停期间提前读取第一张图片的文件内容（posix_fadvise WILLNEED）
+//看图自己解码，这里只让松手后的第一次读取不再等待磁盘
+class DragReadahead : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DragReadahead(QObject *parent = nullptr);
+    ~DragReadahead() override;
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    void start(const QString &path);
+    //拖拽离开，不再预读
+    void cancel();
+    //拖拽已经放下
+    void keep();
+
+private:
+    //在DecodeScheduler中的任务组
+    const QString m_group;
+    QAtomicInt m_generation;
+    QString m_path;
+    bool m_enabled = true;
+};
+
+#endif // DRAGREADAHEAD_H
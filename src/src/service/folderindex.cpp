@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "folderindex.h"
+#include "imagedecoder.h"
+#include "metadataservice.h"
+#include "decodescheduler.h"
+#include "utils/exiforientation.h"
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QImageReader>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QBuffer>
+#include <QDir>
+#include <QDebug>
+
+namespace {
+const quint32 INDEX_MAGIC = 0x44495849;     //"DIXI"
+const quint32 INDEX_VERSION = 1;
+const QString INDEX_GROUP = "folder-index";
+//写回不随ensure取消
+const QString FLUSH_GROUP = "folder-index-flush";
+const QString INDEX_SUFFIX = ".idx";
+//每个后台任务处理的文件数，中间可以插入其它任务或取消
+const int ENSURE_BATCH = 32;
+const int PLACEHOLDER_QUALITY = 60;
+//预览至少达到需要尺寸的这个比例才使用
+const double PREVIEW_TOLERANCE = 0.98;
+
+QMutex s_rootMutex;
+QString s_cacheRoot;
+
+QString folderOf(const QString &path)
+{
+    return QFileInfo(path).absolutePath();
+}
+
+QString nameOf(const QString &path)
+{
+    return QFileInfo(path).fileName();
+}
+
+QImage decodePreview(const QString &path, const FolderIndex::Entry &entry, const QSize &fitSize)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(entry.previewOffset)) {
+        return QImage();
+    }
+    QByteArray data = file.read(entry.previewLength);
+    if (data.size() != entry.previewLength) {
+        return QImage();
+    }
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer, "jpeg");
+    //预览按存储方向保存，缩放后再旋转
+    QSize target = fitSize;
+    if (entry.orientation >= 5) {
+        target.transpose();
+    }
+    const QSize scaled = ImageDecoder::fittedSize(entry.previewSize, target);
+    if (scaled.isValid() && scaled != entry.previewSize) {
+        reader.setScaledSize(scaled);
+    }
+    QImage image;
+    if (!reader.read(&image)) {
+        return QImage();
+    }
+    return ExifOrientation::apply(image, entry.orientation);
+}
+
+QDataStream &operator<<(QDataStream &stream, const FolderIndex::Entry &entry)
+{
+    stream << entry.identity.dev << entry.identity.ino << entry.identity.mtimeNs << entry.identity.size
+           << entry.size << qint32(entry.orientation) << entry.previewOffset << entry.previewLength
+           << entry.previewSize << entry.placeholder;
+    return stream;
+}
+
+QDataStream &operator>>(QDataStream &stream, FolderIndex::Entry &entry)
+{
+    qint32 orientation = 1;
+    stream >> entry.identity.dev >> entry.identity.ino >> entry.identity.mtimeNs >> entry.identity.size
+           >> entry.size >> orientation >> entry.previewOffset >> entry.previewLength
+           >> entry.previewSize >> entry.placeholder;
+    entry.orientation = orientation;
+    return stream;
+}
+}  // namespace
+
+FolderIndex *FolderIndex::instance()
+{
+    static FolderIndex index;
+    return &index;
+}
+
+FolderIndex::FolderIndex()
+{
+}
+
+void FolderIndex::setCacheRoot(const QString &dir)
+{
+    QMutexLocker locker(&s_rootMutex);
+    s_cacheRoot = dir;
+}
+
+QString FolderIndex::cacheRoot()
+{
+    QMutexLocker locker(&s_rootMutex);
+    if (s_cacheRoot.isEmpty()) {
+        return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/folders";
+    }
+    return s_cacheRoot;
+}
+
+QString FolderIndex::indexFile(const QString &dir)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(QFile::encodeName(QDir(dir).absolutePath()));
+    return cacheRoot() + '/' + QString::fromLatin1(hash.result().toHex()) + INDEX_SUFFIX;
+}
+
+FolderIndex::Entry FolderIndex::build(const QString &path)
+{
+    Entry entry;
+    const FileIdentity identity = FileIdentity::fromPath(path);
+    const ImageMetadata metadata = MetadataService::read(path);
+    if (!identity.isValid() || !metadata.valid) {
+        return entry;
+    }
+    entry.identity = identity;
+    entry.size = metadata.size;
+    entry.orientation = qBound(1, metadata.fields.value("Orientation").toInt(), 8);
+    entry.previewOffset = metadata.previewOffset;
+    entry.previewLength = metadata.previewLength;
+    entry.previewSize = metadata.previewSize;
+
+    const QSize placeholderSize(PLACEHOLDER_SIZE, PLACEHOLDER_SIZE);
+    QImage image = entry.previewOffset >= 0 ? decodePreview(path, entry, placeholderSize) : QImage();
+    if (image.isNull()) {
+        image = ImageDecoder::decode(path, placeholderSize);
+    }
+    if (!image.isNull()) {
+        QBuffer buffer(&entry.placeholder);
+        buffer.open(QIODevice::WriteOnly);
+        image.scaled(ImageDecoder::fittedSize(image.size(), placeholderSize), Qt::IgnoreAspectRatio,
+                     Qt::SmoothTransformation).save(&buffer, "JPEG", PLACEHOLDER_QUALITY);
+    }
+    return entry;
+}
+
+bool FolderIndex::lookup(const QString &path, Entry *entry)
+{
+    //只需要一次stat
+    const FileIdentity identity = FileIdentity::fromPath(path);
+    loadFolder(folderOf(path));
+    QMutexLocker locker(&m_mutex);
+    Folder *folder = folderLocked(folderOf(path));
+    const auto it = folder->entries.constFind(nameOf(path));
+    if (!identity.isValid() || it == folder->entries.constEnd() || it->identity != identity) {
+        m_misses++;
+        return false;
+    }
+    m_hits++;
+    *entry = it.value();
+    return true;
+}
+
+bool FolderIndex::isCurrent(const QString &path)
+{
+    const FileIdentity identity = FileIdentity::fromPath(path);
+    loadFolder(folderOf(path));
+    QMutexLocker locker(&m_mutex);
+    const Folder *folder = folderLocked(folderOf(path));
+    const auto it = folder->entries.constFind(nameOf(path));
+    return !identity.isValid() || (it != folder->entries.constEnd() && it->identity == identity);
+}
+
+void FolderIndex::update(const QString &path, const Entry &entry)
+{
+    loadFolder(folderOf(path));
+    QMutexLocker locker(&m_mutex);
+    Folder *folder = folderLocked(folderOf(path));
+    folder->entries.insert(nameOf(path), entry);
+    folder->dirty = true;
+}
+
+void FolderIndex::remove(const QString &path)
+{
+    loadFolder(folderOf(path));
+    QMutexLocker locker(&m_mutex);
+    Folder *folder = folderLocked(folderOf(path));
+    if (folder->entries.remove(nameOf(path)) > 0) {
+        folder->dirty = true;
+    }
+}
+
+void FolderIndex::flush()
+{
+    QHash<QString, Folder> dirty;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (auto it = m_folders.begin(); it != m_folders.end(); ++it) {
+            if (it->dirty) {
+                dirty.insert(it.key(), it.value());
+                it->dirty = false;
+            }
+        }
+    }
+    //写文件时不占用锁
+    for (auto it = dirty.constBegin(); it != dirty.constEnd(); ++it) {
+        if (!save(it.key(), it.value())) {
+            qWarning() << "cannot write folder index:" << indexFile(it.key());
+        }
+    }
+}
+
+void FolderIndex::clear()
+{
+    flush();
+    QMutexLocker locker(&m_mutex);
+    m_folders.clear();
+}
+
+void FolderIndex::ensure(const QStringList &paths)
+{
+    //换了目录时之前没开始的不再需要；stat也放到后台，界面线程不做任何IO
+    cancel();
+    const int serial = m_serial.loadAcquire();
+    for (int i = 0; i < paths.size(); i += ENSURE_BATCH) {
+        const QStringList batch = paths.mid(i, ENSURE_BATCH);
+        m_pending.fetchAndAddOrdered(1);
+        DecodeScheduler::instance()->submit(DecodeScheduler::PriorityBackground, [this, batch, serial]() {
+            for (const QString &path : batch) {
+                if (m_serial.loadAcquire() != serial) {
+                    break;
+                }
+                if (isCurrent(path)) {
+                    continue;
+                }
+                const Entry entry = build(path);
+                if (entry.identity.isValid()) {
+                    update(path, entry);
+                }
+            }
+            //最后一批完成后写回
+            if (m_pending.fetchAndAddOrdered(-1) == 1) {
+                flush();
+            }
+        }, INDEX_GROUP);
+    }
+}
+
+void FolderIndex::cancel()
+{
+    m_serial.fetchAndAddOrdered(1);
+    const int cancelled = DecodeScheduler::instance()->cancel(INDEX_GROUP);
+    if (cancelled > 0 && m_pending.fetchAndAddOrdered(-cancelled) == cancelled) {
+        scheduleFlush();
+    }
+}
+
+void FolderIndex::waitForDone()
+{
+    DecodeScheduler::instance()->waitForDone(INDEX_GROUP);
+    DecodeScheduler::instance()->waitForDone(FLUSH_GROUP);
+}
+
+QImage FolderIndex::placeholder(const QString &path)
+{
+    QByteArray data;
+    {
+        QMutexLocker locker(&m_mutex);
+        const auto folder = m_folders.constFind(folderOf(path));
+        if (folder == m_folders.constEnd()) {
+            return QImage();
+        }
+        data = folder->entries.value(nameOf(path)).placeholder;
+    }
+    if (data.isEmpty()) {
+        return QImage();
+    }
+    return QImage::fromData(data, "JPEG");
+}
+
+QImage FolderIndex::preview(const QString &path, const QSize &fitSize)
+{
+    Entry entry;
+    if (!fitSize.isValid() || !lookup(path, &entry) || entry.previewOffset < 0) {
+        return QImage();
+    }
+    QSize shown = entry.previewSize;
+    if (entry.orientation >= 5) {
+        shown.transpose();
+    }
+    const QSize needed = ImageDecoder::fittedSize(entry.size, fitSize);
+    if (shown.width() < needed.width() * PREVIEW_TOLERANCE || shown.height() < needed.height() * PREVIEW_TOLERANCE) {
+        return QImage();
+    }
+    QImage image = decodePreview(path, entry, fitSize);
+    //预览的宽高比和原图略有差别时以原图为准
+    if (!image.isNull() && image.size() != needed) {
+        image = image.scaled(needed, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    }
+    return image;
+}
+
+quint64 FolderIndex::hits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_hits;
+}
+
+quint64 FolderIndex::misses() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_misses;
+}
+
+void FolderIndex::loadFolder(const QString &dir)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_folders.contains(dir)) {
+            return;
+        }
+    }
+    Folder folder;
+    load(dir, &folder);
+    QMutexLocker locker(&m_mutex);
+    //同时读取的另一个线程已经放入
+    if (!m_folders.contains(dir)) {
+        m_folders.insert(dir, folder);
+    }
+}
+
+FolderIndex::Folder *FolderIndex::folderLocked(const QString &dir)
+{
+    //调用前已经loadFolder，clear()之后才可能不存在
+    auto it = m_folders.find(dir);
+    if (it == m_folders.end()) {
+        it = m_folders.insert(dir, Folder());
+    }
+    return &it.value();
+}
+
+void FolderIndex::scheduleFlush()
+{
+    DecodeScheduler::instance()->submit(DecodeScheduler::PriorityBackground, [this]() {
+        flush();
+    }, FLUSH_GROUP);
+}
+
+bool FolderIndex::load(const QString &dir, Folder *folder)
+{
+    QFile file(indexFile(dir));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    quint32 magic = 0, version = 0, count = 0;
+    QString storedDir;
+    stream >> magic >> version >> storedDir >> count;
+    //版本不同或者MD5冲突时整个丢弃
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION || storedDir != dir) {
+        return false;
+    }
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        QString name;
+        Entry entry;
+        stream >> name >> entry;
+        if (stream.status() == QDataStream::Ok) {
+            folder->entries.insert(name, entry);
+        }
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+bool FolderIndex::save(const QString &dir, const Folder &folder)
+{
+    QDir().mkpath(cacheRoot());
+    QSaveFile file(indexFile(dir));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_6);
+    stream << INDEX_MAGIC << INDEX_VERSION << dir << quint32(folder.entries.size());
+    for (auto it = folder.entries.constBegin(); it != folder.entries.constEnd(); ++it) {
+        stream << it.key() << it.value();
+    }
+    return stream.status() == QDataStream::Ok && file.commit();
+}
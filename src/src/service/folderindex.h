@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FOLDERINDEX_H
+#define FOLDERINDEX_H
+
+#include <QImage>
+#include <QHash>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QStringList>
+
+#include "utils/fileidentity.h"
+
+//每个目录一个索引文件，保存在缓存目录下：尺寸、方向、内嵌预览的位置和很小的占位图
+//再次打开目录时只需要stat比较文件身份，RAW不再调用open_datastream解析文件头
+class FolderIndex
+{
+public:
+    struct Entry {
+        FileIdentity identity;
+        //按方向显示后的尺寸
+        QSize size;
+        int orientation = 1;
+        //RAW内嵌的JPEG预览，没有时offset为-1
+        qint64 previewOffset = -1;
+        qint64 previewLength = 0;
+        QSize previewSize;
+        //长边不超过PLACEHOLDER_SIZE的JPEG
+        QByteArray placeholder;
+    };
+
+    static const int PLACEHOLDER_SIZE = 48;
+
+    static FolderIndex *instance();
+
+    static void setCacheRoot(const QString &dir);
+    static QString cacheRoot();
+    //目录的索引文件，按目录的绝对路径命名
+    static QString indexFile(const QString &dir);
+    //读取文件头生成条目，RAW的占位图从内嵌预览生成
+    static Entry build(const QString &path);
+
+    //第一次访问某个目录时读取它的索引文件；文件身份不一致时视为未命中
+    //需要stat和读文件，在后台线程调用
+    bool lookup(const QString &path, Entry *entry);
+    void update(const QString &path, const Entry &entry);
+    void remove(const QString &path);
+    //把修改过的目录写回索引文件
+    void flush();
+    //写回后清空内存中的目录，索引文件保留
+    void clear();
+
+    //在后台为缺少或过期的文件生成条目，完成后写回；取代上一次还没开始的部分
+    void ensure(const QStringList &paths);
+    void cancel();
+    void waitForDone();
+
+    //只查内存中已经读取的目录，不stat也不读文件，界面线程使用；文件被外部修改时可能是旧的
+    QImage placeholder(const QString &path);
+    //直接读取内嵌预览的字节，按缩放尺寸解码；预览比需要的尺寸小时返回空图片
+    QImage preview(const QString &path, const QSize &fitSize);
+
+    quint64 hits() const;
+    quint64 misses() const;
+
+private:
+    FolderIndex();
+
+    struct Folder {
+        QHash<QString, Entry> entries;
+        bool dirty = false;
+    };
+
+    //目录的索引文件不在持有锁时读取，后台的其它任务不需要等待
+    void loadFolder(const QString &dir);
+    Folder *folderLocked(const QString &dir);
+    //在后台写回，界面线程不写文件
+    void scheduleFlush();
+    //条目存在且文件没有修改过（不存在的文件也不需要生成），不计入命中统计
+    bool isCurrent(const QString &path);
+    static bool load(const QString &dir, Folder *folder);
+    static bool save(const QString &dir, const Folder &folder);
+
+    mutable QMutex m_mutex;
+    QHash<QString, Folder> m_folders;
+    quint64 m_hits = 0;
+    quint64 m_misses = 0;
+    //ensure提交的任务：取消用的序号和还没完成的批数
+    QAtomicInt m_serial;
+    QAtomicInt m_pending;
+};
+
+#endif // FOLDERINDEX_H
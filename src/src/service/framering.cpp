@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "framering.h"
+#include "imagedecoder.h"
+#include "decodescheduler.h"
+
+
+#include <climits>
+
+namespace {
+const qint64 DEFAULT_BUDGET = 256ll * 1024 * 1024;
+//预算很大时也不要一次安排太多
+const int MAX_FRAMES = 32;
+//不知道窗口大小时按1080p估算
+const qint64 DEFAULT_FRAME_BYTES = 1920ll * 1080 * 4;
+}  // namespace
+
+FrameRing::FrameRing(QObject *parent)
+    : QObject(parent)
+    , m_group(QString("framering-%1").arg(quintptr(this)))
+    , m_budget(DEFAULT_BUDGET)
+{
+}
+
+FrameRing::~FrameRing()
+{
+    DecodeScheduler::instance()->cancel(m_group);
+    {
+        QMutexLocker locker(&m_mutex);
+        m_rank.clear();
+    }
+    DecodeScheduler::instance()->waitForDone(m_group);
+}
+
+void FrameRing::setBudget(qint64 bytes)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_budget = bytes;
+    }
+    refill();
+}
+
+qint64 FrameRing::budget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_budget;
+}
+
+void FrameRing::setFrameSize(const QSize &size)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (size == m_frameSize) {
+            return;
+        }
+        m_frameSize = size;
+        m_frames.clear();
+        m_stats.usedBytes = 0;
+    }
+    refill();
+}
+
+void FrameRing::setPaths(const QStringList &paths, const QString &current)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_paths = paths;
+        m_indexOf.clear();
+        for (int i = 0; i < paths.size(); i++) {
+            m_indexOf.insert(paths.at(i), i);
+        }
+        m_current = m_indexOf.value(current, paths.isEmpty() ? -1 : 0);
+        m_direction = 1;
+    }
+    refill();
+}
+
+QImage FrameRing::arrive(const QString &path)
+{
+    QImage image;
+    bool hit = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        auto found = m_indexOf.constFind(path);
+        if (found != m_indexOf.constEnd()) {
+            if (m_current >= 0 && found.value() != m_current) {
+                m_direction = found.value() > m_current ? 1 : -1;
+            }
+            m_current = found.value();
+        }
+        auto it = m_frames.constFind(path);
+        hit = it != m_frames.constEnd();
+        if (hit) {
+            image = it.value();
+        }
+    }
+    {
+        QMutexLocker locker(&m_mutex);
+        hit ? m_stats.hits++ : m_stats.misses++;
+    }
+    refill();
+    return image;
+}
+
+bool FrameRing::contains(const QString &path) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_frames.contains(path);
+}
+
+QImage FrameRing::frame(const QString &path) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_frames.value(path);
+}
+
+void FrameRing::cancelPending()
+{
+    DecodeScheduler::instance()->cancel(m_group);
+}
+
+void FrameRing::remove(const QString &path)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_frames.find(path);
+        if (it != m_frames.end()) {
+            m_stats.usedBytes -= it.value().sizeInBytes();
+            m_frames.erase(it);
+        }
+        if (m_running.contains(path)) {
+            m_stale.insert(path);
+        }
+    }
+    refill();
+}
+
+FrameRing::Stats FrameRing::stats() const
+{
+    QMutexLocker locker(&m_mutex);
+    Stats stats = m_stats;
+    stats.frames = m_frames.size();
+    return stats;
+}
+
+double FrameRing::hitRate() const
+{
+    QMutexLocker locker(&m_mutex);
+    const quint64 total = m_stats.hits + m_stats.misses;
+    return total ? double(m_stats.hits) / total : 0.0;
+}
+
+void FrameRing::waitForDone()
+{
+    DecodeScheduler::instance()->waitForDone(m_group);
+}
+
+void FrameRing::refill()
+{
+    //排队中还没开始的任务按旧的优先级，全部取消后重新安排
+    DecodeScheduler::instance()->cancel(m_group);
+
+    QMutexLocker locker(&m_mutex);
+    m_rank.clear();
+    if (m_current < 0 || m_current >= m_paths.size()) {
+        return;
+    }
+
+    //按预算估算能放下几张：当前、翻页方向上两张、反方向一张，依次交替
+    const qint64 frameBytes = m_frameSize.isValid() ? qint64(m_frameSize.width()) * m_frameSize.height() * 4
+                              : DEFAULT_FRAME_BYTES;
+    const int capacity = int(qBound<qint64>(1, m_budget / qMax<qint64>(1, frameBytes), MAX_FRAMES));
+    QStringList order;
+    order << m_paths.at(m_current);
+    auto valid = [this](int index) {
+        return index >= 0 && index < m_paths.size();
+    };
+    int ahead = m_current + m_direction;
+    int behind = m_current - m_direction;
+    //两个方向都到头就停止
+    while (order.size() < capacity && (valid(ahead) || valid(behind))) {
+        for (int i = 0; i < 2 && order.size() < capacity && valid(ahead); i++) {
+            order << m_paths.at(ahead);
+            ahead += m_direction;
+        }
+        if (order.size() < capacity && valid(behind)) {
+            order << m_paths.at(behind);
+            behind -= m_direction;
+        }
+    }
+    for (int i = 0; i < order.size(); i++) {
+        m_rank.insert(order.at(i), i);
+    }
+
+    //不在范围内的图片立即释放
+    for (auto it = m_frames.begin(); it != m_frames.end();) {
+        if (!m_rank.contains(it.key())) {
+            m_stats.usedBytes -= it.value().sizeInBytes();
+            m_stats.evicted++;
+            it = m_frames.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (int i = 0; i < order.size(); i++) {
+        const QString path = order.at(i);
+        if (m_frames.contains(path) || m_running.contains(path)) {
+            continue;
+        }
+        //当前图片和看图同时需要，其余按距离排队
+        const DecodeScheduler::Priority priority = i == 0 ? DecodeScheduler::PriorityVisible
+                                                   : DecodeScheduler::PriorityAdjacent;
+        DecodeScheduler::instance()->submit(priority, [this, path]() {
+            decodeFrame(path);
+        }, m_group);
+    }
+}
+
+void FrameRing::decodeFrame(const QString &path)
+{
+    QSize size;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_rank.contains(path) || m_frames.contains(path) || m_running.contains(path)) {
+            return;
+        }
+        m_running.insert(path);
+        size = m_frameSize;
+    }
+
+    const QImage image = ImageDecoder::decode(path, size);
+
+    bool ready = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running.remove(path);
+        //解码期间窗口大小变了或者文件被修改
+        if (m_stale.remove(path) || image.isNull() || size != m_frameSize || !m_rank.contains(path)) {
+            m_stats.discarded++;
+        } else {
+            ready = insertLocked(path, image);
+        }
+    }
+    if (ready) {
+        emit sigFrameReady(path);
+    }
+}
+
+bool FrameRing::insertLocked(const QString &path, const QImage &image)
+{
+    const qint64 bytes = image.sizeInBytes();
+    const int rank = m_rank.value(path);
+    while (m_stats.usedBytes + bytes > m_budget && !m_frames.isEmpty()) {
+        //找离当前最远的一张
+        auto worst = m_frames.begin();
+        int worstRank = -1;
+        for (auto it = m_frames.begin(); it != m_frames.end(); ++it) {
+            const int r = m_rank.value(it.key(), INT_MAX);
+            if (r > worstRank) {
+                worstRank = r;
+                worst = it;
+            }
+        }
+        if (worstRank <= rank) {
+            m_stats.discarded++;
+            return false;
+        }
+        m_stats.usedBytes -= worst.value().sizeInBytes();
+        m_stats.evicted++;
+        m_frames.erase(worst);
+    }
+    if (m_stats.usedBytes + bytes > m_budget) {
+        m_stats.discarded++;
+        return false;
+    }
+    m_frames.insert(path, image);
+    m_stats.usedBytes += bytes;
+    m_stats.decoded++;
+    return true;
+}
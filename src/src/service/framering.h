@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FRAMERING_H
+#define FRAMERING_H
+
+#include <QObject>
+#include <QImage>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QStringList>
+
+//当前图片前后已经按屏幕尺寸解码好的图片
+//后台线程按距离当前图片的远近依次解码，总大小受内存预算限制而不是固定张数，
+//超出预算时先丢弃离当前最远的
+class FrameRing : public QObject
+{
+    Q_OBJECT
+public:
+    struct Stats {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 decoded = 0;
+        quint64 evicted = 0;
+        //解码完成时已经不需要或者放不下
+        quint64 discarded = 0;
+        qint64 usedBytes = 0;
+        int frames = 0;
+    };
+
+    explicit FrameRing(QObject *parent = nullptr);
+    ~FrameRing() override;
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+    //解码的目标尺寸，变化后已有的图片作废
+    void setFrameSize(const QSize &size);
+
+    void setPaths(const QStringList &paths, const QString &current);
+    //用户翻到path，已经解码好时直接返回，并以它为中心重新安排解码
+    QImage arrive(const QString &path);
+    bool contains(const QString &path) const;
+    //已经解码好的图片，不改变当前位置
+    QImage frame(const QString &path) const;
+    //连续翻页期间取消排队中的解码，下次arrive时重新安排
+    void cancelPending();
+    //文件被修改（例如旋转），丢弃已经解码的图片后重新解码
+    void remove(const QString &path);
+
+    Stats stats() const;
+    double hitRate() const;
+    //等待后台解码完成，测试使用
+    void waitForDone();
+
+signals:
+    void sigFrameReady(const QString &path);
+
+private:
+    void refill();
+    void decodeFrame(const QString &path);
+    bool insertLocked(const QString &path, const QImage &image);
+
+private:
+    //在DecodeScheduler中的任务组
+    const QString m_group;
+    mutable QMutex m_mutex;
+    QStringList m_paths;
+    QHash<QString, int> m_indexOf;
+    int m_current = -1;
+    int m_direction = 1;
+    QSize m_frameSize;
+    qint64 m_budget;
+
+    QHash<QString, QImage> m_frames;
+    //需要的图片及优先级，数值越小越优先
+    QHash<QString, int> m_rank;
+    QSet<QString> m_running;
+    //解码期间文件被修改，结果作废
+    QSet<QString> m_stale;
+    Stats m_stats;
+};
+
+#endif // FRAMERING_H
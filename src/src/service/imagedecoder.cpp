@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "imagedecoder.h"
+#include "decodepool.h"
+#include "tilepyramid.h"
+#include "folderindex.h"
+#include "utils/imagetypedetector.h"
+
+#include <QImageReader>
+#include <QReadWriteLock>
+
+namespace {
+//解码期间持有读锁，setDecodePool(nullptr)等正在进行的解码返回后才让进程池析构
+QReadWriteLock s_poolLock;
+DecodePool *s_decodePool = nullptr;
+}  // namespace
+
+QImage ImageDecoder::decode(const QString &path, const QSize &fitSize, QString *errorMsg)
+{
+    //目录索引记录了RAW内嵌预览的位置，尺寸足够时直接读取这部分字节，不再解析RAW文件头
+    if (fitSize.isValid() && ImageTypeDetector::instance()->detect(path) == ImageTypeDetector::TypeRaw) {
+        const QImage preview = FolderIndex::instance()->preview(path, fitSize);
+        if (!preview.isNull()) {
+            return preview;
+        }
+    }
+    if (ImageTypeDetector::instance()->detect(path) == ImageTypeDetector::TypeRaw) {
+        QReadLocker locker(&s_poolLock);
+        if (s_decodePool) {
+            return s_decodePool->decode(path, fitSize, errorMsg);
+        }
+    }
+    //超大TIFF整张解码会占用数GB，缩放显示时从瓦片金字塔中渲染
+    if (fitSize.isValid() && ImageTypeDetector::instance()->detect(path) == ImageTypeDetector::TypeTiff
+            && TilePyramid::isLarge(path)) {
+        TilePyramid pyramid;
+        if (pyramid.open(path, errorMsg)) {
+            return pyramid.render(QRectF(QPointF(0, 0), QSizeF(pyramid.size())), fittedSize(pyramid.size(), fitSize));
+        }
+    }
+
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+
+    if (fitSize.isValid() && reader.supportsOption(QImageIOHandler::ScaledSize)) {
+        QSize size = reader.size();
+        QSize target = fitSize;
+        //缩放发生在旋转之前，旋转90度的图片目标尺寸要对调
+        if (reader.transformation() & QImageIOHandler::TransformationRotate90) {
+            target.transpose();
+        }
+        const QSize scaled = fittedSize(size, target);
+        if (scaled.isValid() && scaled != size) {
+            reader.setScaledSize(scaled);
+        }
+    }
+
+    QImage image;
+    if (!reader.read(&image)) {
+        if (errorMsg) {
+            *errorMsg = reader.errorString();
+        }
+        return QImage();
+    }
+
+    //插件不支持缩放解码时再缩放
+    if (fitSize.isValid()) {
+        const QSize scaled = fittedSize(image.size(), fitSize);
+        if (scaled != image.size()) {
+            image = image.scaled(scaled, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+    }
+    return image;
+}
+
+QSize ImageDecoder::fittedSize(const QSize &size, const QSize &fitSize)
+{
+    if (!size.isValid() || !fitSize.isValid()) {
+        return size;
+    }
+    if (size.width() <= fitSize.width() && size.height() <= fitSize.height()) {
+        return size;
+    }
+    return size.scaled(fitSize, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+}
+
+void ImageDecoder::setDecodePool(DecodePool *pool)
+{
+    QWriteLocker locker(&s_poolLock);
+    s_decodePool = pool;
+}
+
+DecodePool *ImageDecoder::decodePool()
+{
+    QReadLocker locker(&s_poolLock);
+    return s_decodePool;
+}
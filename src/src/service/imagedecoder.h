@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGEDECODER_H
+#define IMAGEDECODER_H
+
+#include <QImage>
+#include <QString>
+#include <QSize>
+
+class DecodePool;
+
+//统一的解码入口，和看图一样走QImageReader及imageformats插件（包括xraw）
+class ImageDecoder
+{
+public:
+    //fitSize有效时按比例缩放到不超过fitSize，插件支持时直接按缩放尺寸解码
+    static QImage decode(const QString &path, const QSize &fitSize = QSize(),
+                         QString *errorMsg = nullptr);
+
+    //计算按比例缩放到fitSize以内的尺寸，不放大
+    static QSize fittedSize(const QSize &size, const QSize &fitSize);
+
+    //设置后RAW图片交给进程外解码池，插件崩溃不影响看图
+    //设为nullptr时等待正在通过解码池进行的解码返回，之后解码池可以析构
+    static void setDecodePool(DecodePool *pool);
+    static DecodePool *decodePool();
+};
+
+#endif // IMAGEDECODER_H
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "imagelistmodel.h"
+#include "utils/pathingest.h"
+
+#include <algorithm>
+#include <utility>
+
+void ImageListModel::setPaths(const QStringList &paths)
+{
+    clear();
+    append(paths);
+}
+
+void ImageListModel::append(const QStringList &paths)
+{
+    QStringList fresh;
+    fresh.reserve(paths.size());
+    for (const QString &path : paths) {
+        if (!m_index.contains(path)) {
+            m_index.insert(path);
+            fresh << path;
+        }
+    }
+    merge(fresh);
+    if (m_current.isEmpty() && !m_paths.isEmpty()) {
+        m_current = m_paths.first();
+    }
+}
+
+bool ImageListModel::apply(const QStringList &added, const QStringList &removed)
+{
+    bool changed = false;
+    int currentIndex = m_paths.indexOf(m_current);
+
+    if (!removed.isEmpty()) {
+        QSet<QString> files;
+        QSet<QString> dirs;
+        for (const QString &path : removed) {
+            if (m_index.contains(path)) {
+                files.insert(path);
+            } else {
+                dirs.insert(path);
+            }
+        }
+        QStringList kept;
+        kept.reserve(m_paths.size());
+        std::vector<QCollatorSortKey> keptKeys;
+        keptKeys.reserve(m_keys.size());
+        for (int i = 0; i < m_paths.size(); i++) {
+            const QString &path = m_paths.at(i);
+            bool drop = files.contains(path);
+            //逐级检查上层目录是否被删除
+            for (int pos = path.lastIndexOf('/'); !drop && !dirs.isEmpty() && pos > 0;
+                    pos = path.lastIndexOf('/', pos - 1)) {
+                drop = dirs.contains(path.left(pos));
+            }
+            if (drop) {
+                m_index.remove(path);
+                if (i < currentIndex) {
+                    currentIndex--;
+                } else if (i == currentIndex) {
+                    m_current.clear();
+                }
+            } else {
+                kept << path;
+                keptKeys.push_back(m_keys.at(size_t(i)));
+            }
+        }
+        changed = kept.size() != m_paths.size();
+        m_paths.swap(kept);
+        m_keys.swap(keptKeys);
+    }
+
+    QStringList fresh;
+    for (const QString &path : added) {
+        if (!m_index.contains(path)) {
+            m_index.insert(path);
+            fresh << path;
+        }
+    }
+    if (!fresh.isEmpty()) {
+        merge(fresh);
+        changed = true;
+    }
+
+    //当前图片被删除，显示原位置的下一张
+    if (m_current.isEmpty() && !m_paths.isEmpty()) {
+        m_current = m_paths.at(qBound(0, currentIndex, m_paths.size() - 1));
+    }
+    return changed;
+}
+
+void ImageListModel::merge(QStringList &fresh)
+{
+    if (fresh.isEmpty()) {
+        return;
+    }
+    //每个新路径只计算一次排序键，之后的排序与合并都只比较键
+    std::vector<std::pair<QCollatorSortKey, QString> > keyed;
+    keyed.reserve(size_t(fresh.size()));
+    for (const QString &path : fresh) {
+        keyed.push_back(std::make_pair(PathIngest::naturalSortKey(path), path));
+    }
+    std::stable_sort(keyed.begin(), keyed.end(), [](const std::pair<QCollatorSortKey, QString> &a,
+    const std::pair<QCollatorSortKey, QString> &b) {
+        return a.first.compare(b.first) < 0;
+    });
+
+    //相机导入时文件名通常递增，直接追加即可，否则按顺序合并
+    if (m_keys.empty() || m_keys.back().compare(keyed.front().first) <= 0) {
+        for (const auto &item : keyed) {
+            m_keys.push_back(item.first);
+            m_paths << item.second;
+        }
+        return;
+    }
+    QStringList merged;
+    merged.reserve(m_paths.size() + fresh.size());
+    std::vector<QCollatorSortKey> mergedKeys;
+    mergedKeys.reserve(m_keys.size() + keyed.size());
+    size_t i = 0;
+    size_t j = 0;
+    while (i < m_keys.size() || j < keyed.size()) {
+        //相等时已有的在前，和std::merge一致
+        if (j == keyed.size() || (i < m_keys.size() && keyed.at(j).first.compare(m_keys.at(i)) >= 0)) {
+            mergedKeys.push_back(m_keys.at(i));
+            merged << m_paths.at(int(i));
+            i++;
+        } else {
+            mergedKeys.push_back(keyed.at(j).first);
+            merged << keyed.at(j).second;
+            j++;
+        }
+    }
+    m_paths.swap(merged);
+    m_keys.swap(mergedKeys);
+}
+
+void ImageListModel::clear()
+{
+    m_paths.clear();
+    m_keys.clear();
+    m_index.clear();
+    m_current.clear();
+}
+
+const QStringList &ImageListModel::paths() const
+{
+    return m_paths;
+}
+
+int ImageListModel::count() const
+{
+    return m_paths.size();
+}
+
+bool ImageListModel::contains(const QString &path) const
+{
+    return m_index.contains(path);
+}
+
+QString ImageListModel::currentPath() const
+{
+    return m_current;
+}
+
+void ImageListModel::setCurrentPath(const QString &path)
+{
+    if (m_index.contains(path)) {
+        m_current = path;
+    }
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGELISTMODEL_H
+#define IMAGELISTMODEL_H
+
+#include <QStringList>
+#include <QSet>
+#include <QCollatorSortKey>
+
+#include <vector>
+
+//当前浏览的图片列表，保持自然排序，支持增量增删
+class ImageListModel
+{
+public:
+    void setPaths(const QStringList &paths);
+    //扫描分批到达时按自然排序合并，与批次到达的先后无关
+    void append(const QStringList &paths);
+    //removed中的目录会移除其下所有图片
+    //列表有变化时返回true
+    bool apply(const QStringList &added, const QStringList &removed);
+    void clear();
+
+    const QStringList &paths() const;
+    int count() const;
+    bool contains(const QString &path) const;
+
+    //当前显示的图片，被删除时移到相邻的一张
+    QString currentPath() const;
+    void setCurrentPath(const QString &path);
+
+private:
+    //fresh中不能有已在列表中的路径
+    void merge(QStringList &fresh);
+
+private:
+    QStringList m_paths;
+    //和m_paths一一对应的排序键，合并时只比较键
+    std::vector<QCollatorSortKey> m_keys;
+    QSet<QString> m_index;
+    QString m_current;
+};
+
+#endif // IMAGELISTMODEL_H
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "losslessrotator.h"
+#include "metadataservice.h"
+#include "folderindex.h"
+#include "decodescheduler.h"
+#include "utils/exiforientation.h"
+#include "utils/imagetypedetector.h"
+
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QFile>
+#include <QtEndian>
+#include <QElapsedTimer>
+#include <QDebug>
+
+namespace {
+//APNG的动画控制块在第一个IDAT之前，Qt只读第一帧
+bool isAnimatedPng(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(8)) {
+        return false;
+    }
+    uchar header[8];
+    while (file.read(reinterpret_cast<char *>(header), 8) == 8) {
+        const QByteArray type(reinterpret_cast<const char *>(header + 4), 4);
+        if (type == "acTL") {
+            return true;
+        }
+        if (type == "IDAT" || type == "IEND") {
+            return false;
+        }
+        //跳过数据和CRC
+        if (!file.seek(file.pos() + qFromBigEndian<quint32>(header) + 4)) {
+            return false;
+        }
+    }
+    return false;
+}
+}  // namespace
+
+LosslessRotator::LosslessRotator(QObject *parent)
+    : QObject(parent)
+    , m_group(QString("rotate-%1").arg(quintptr(this)))
+{
+}
+
+LosslessRotator::~LosslessRotator()
+{
+    //已经开始的文件必须写完，不能留下一半的文件
+    DecodeScheduler::instance()->waitForDone(m_group);
+}
+
+void LosslessRotator::rotate(const QStringList &paths, bool clockwise)
+{
+    if (paths.isEmpty()) {
+        return;
+    }
+    if (m_pending.loadAcquire() == 0) {
+        m_stats = Stats();
+    }
+    m_pending.fetchAndAddOrdered(paths.size());
+    for (const QString &path : paths) {
+        DecodeScheduler::instance()->submit(DecodeScheduler::PriorityBackground, [this, path, clockwise]() {
+            const Result result = rotateFile(path, clockwise);
+            QMetaObject::invokeMethod(this, [this, path, result]() {
+                onRotated(path, result);
+            }, Qt::QueuedConnection);
+        }, m_group);
+    }
+}
+
+bool LosslessRotator::isBusy() const
+{
+    return m_pending.loadAcquire() > 0;
+}
+
+LosslessRotator::Stats LosslessRotator::stats() const
+{
+    return m_stats;
+}
+
+LosslessRotator::Result LosslessRotator::rotateFile(const QString &path, bool clockwise)
+{
+    Result result;
+    QElapsedTimer timer;
+    timer.start();
+
+    ExifOrientation::IoStats io;
+    const ImageTypeDetector::ImageType type = ImageTypeDetector::instance()->detect(path);
+    if (type == ImageTypeDetector::TypeJpeg) {
+        const int orientation = ExifOrientation::rotated(ExifOrientation::readJpeg(path, &io), clockwise);
+        result.ok = ExifOrientation::writeJpeg(path, orientation, &io, &result.errorMsg);
+        result.method = io.rewritten ? MethodExifRewritten : MethodExifPatched;
+    } else if (type == ImageTypeDetector::TypeRaw) {
+        //已经旋转过的以附属文件为准，否则由xraw插件在文本中返回相机记录的方向
+        int current = ExifOrientation::readSidecar(path);
+        if (current <= 0) {
+            QImageReader reader(path);
+            current = reader.text("Orientation").toInt();
+        }
+        const int orientation = ExifOrientation::rotated(current > 0 ? current : 1, clockwise);
+        result.ok = ExifOrientation::writeSidecar(path, orientation, &io, &result.errorMsg);
+        result.method = MethodSidecar;
+    } else if (type == ImageTypeDetector::TypeTiff) {
+        //重新编码会丢掉EXIF、ICC等标签并改变压缩方式，多页TIFF还会只剩第一页
+        result.errorMsg = QString("rotating %1 would lose its pages, compression or metadata").arg(path);
+    } else if (type == ImageTypeDetector::TypePng || type == ImageTypeDetector::TypeBmp
+               || type == ImageTypeDetector::TypePnm) {
+        //无损格式重新编码也不会损失画质，文本信息随QImage写回
+        QImageReader reader(path);
+        reader.setAutoTransform(true);
+        const QByteArray format = reader.format();
+        //多帧的图片重新编码只剩第一帧
+        const bool multiFrame = reader.imageCount() > 1 || reader.supportsAnimation()
+                                || (type == ImageTypeDetector::TypePng && isAnimatedPng(path));
+        QImage image = multiFrame ? QImage() : reader.read();
+        io.bytesRead = QFileInfo(path).size();
+        if (multiFrame) {
+            result.errorMsg = QString("rotating %1 would drop all frames but the first").arg(path);
+        } else if (image.isNull()) {
+            result.errorMsg = reader.errorString();
+        } else {
+            image = ExifOrientation::apply(image, clockwise ? 6 : 8);
+            QSaveFile file(path);
+            QImageWriter writer(&file, format);
+            if (file.open(QIODevice::WriteOnly) && writer.write(image) && file.commit()) {
+                result.ok = true;
+                io.bytesWritten = QFileInfo(path).size();
+            } else {
+                result.errorMsg = writer.error() != QImageWriter::UnknownError ? writer.errorString() : file.errorString();
+            }
+        }
+        result.method = MethodReencoded;
+    } else {
+        //有损格式重新编码会损失画质，不旋转
+        result.errorMsg = QString("lossless rotation is not supported for %1").arg(path);
+    }
+
+    result.bytesRead = io.bytesRead;
+    result.bytesWritten = io.bytesWritten;
+    result.ms = timer.nsecsElapsed() / 1000000.0;
+    if (result.ok) {
+        //附属文件不改变RAW的文件身份，信息缓存要手动清除
+        MetadataService::invalidate(path);
+        FolderIndex::instance()->remove(path);
+    } else {
+        result.method = MethodNone;
+    }
+    return result;
+}
+
+bool LosslessRotator::canRotate(const QString &path)
+{
+    if (path.isEmpty()) {
+        return false;
+    }
+    switch (ImageTypeDetector::instance()->detect(path)) {
+    case ImageTypeDetector::TypeJpeg:
+    case ImageTypeDetector::TypeRaw:
+    case ImageTypeDetector::TypeBmp:
+    case ImageTypeDetector::TypePnm:
+        return true;
+    case ImageTypeDetector::TypePng:
+        return !isAnimatedPng(path);
+    default:
+        return false;
+    }
+}
+
+void LosslessRotator::onRotated(const QString &path, const Result &result)
+{
+    m_stats.files++;
+    if (!result.ok) {
+        m_stats.failed++;
+        qWarning() << "rotate failed:" << path << result.errorMsg;
+    }
+    m_stats.bytesRead += result.bytesRead;
+    m_stats.bytesWritten += result.bytesWritten;
+    m_stats.totalMs += result.ms;
+    m_stats.maxMs = qMax(m_stats.maxMs, result.ms);
+    emit sigRotated(path, result.ok);
+
+    if (m_pending.fetchAndAddOrdered(-1) == 1) {
+        qDebug() << "rotate files:" << m_stats.files << "failed:" << m_stats.failed
+                 << "read(bytes):" << m_stats.bytesRead << "written(bytes):" << m_stats.bytesWritten
+                 << "total(ms):" << m_stats.totalMs << "max(ms):" << m_stats.maxMs;
+        emit sigFinished(m_stats);
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LOSSLESSROTATOR_H
+#define LOSSLESSROTATOR_H
+
+#include <QObject>
+#include <QStringList>
+#include <QAtomicInt>
+
+//无损旋转：JPEG只改写EXIF方向，RAW写XMP附属文件，PNG等无损格式才重新编码
+//TIFF和多帧图片重新编码会丢失内容，不旋转
+//所有文件在后台低优先级执行，不影响翻页和当前图片的解码
+class LosslessRotator : public QObject
+{
+    Q_OBJECT
+public:
+    enum Method {
+        MethodNone = 0,
+        MethodExifPatched,      //原地改写方向标签
+        MethodExifRewritten,    //插入或扩展APP1，图像数据原样复制
+        MethodSidecar,          //RAW的XMP附属文件
+        MethodReencoded         //无损格式重新编码
+    };
+
+    struct Result {
+        bool ok = false;
+        Method method = MethodNone;
+        QString errorMsg;
+        qint64 bytesRead = 0;
+        qint64 bytesWritten = 0;
+        double ms = 0;
+    };
+
+    struct Stats {
+        int files = 0;
+        int failed = 0;
+        qint64 bytesRead = 0;
+        qint64 bytesWritten = 0;
+        double totalMs = 0;
+        double maxMs = 0;
+    };
+
+    explicit LosslessRotator(QObject *parent = nullptr);
+    ~LosslessRotator() override;
+
+    //顺时针或逆时针旋转90度，上一批没有完成时追加
+    void rotate(const QStringList &paths, bool clockwise);
+    bool isBusy() const;
+    Stats stats() const;
+
+    //同步旋转一个文件，线程安全
+    static Result rotateFile(const QString &path, bool clockwise);
+    //只按文件类型判断能否无损旋转，不能时交给看图自己旋转
+    static bool canRotate(const QString &path);
+
+signals:
+    void sigRotated(const QString &path, bool ok);
+    //这一批全部完成
+    void sigFinished(const LosslessRotator::Stats &stats);
+
+private:
+    void onRotated(const QString &path, const Result &result);
+
+private:
+    const QString m_group;
+    QAtomicInt m_pending;
+    Stats m_stats;
+};
+
+#endif // LOSSLESSROTATOR_H
@@ -0,0 +1,610 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "metadataservice.h"
+#include "decodescheduler.h"
+#include "utils/fileidentity.h"
+#include "utils/imagetypedetector.h"
+
+#include <QImageReader>
+#include <QFileInfo>
+#include <QMutex>
+#include <QHash>
+#include <QFile>
+#include <QtEndian>
+#include <QVector>
+#include <QDebug>
+
+#include <algorithm>
+
+namespace {
+const int CACHE_LIMIT = 2048;
+//EXIF中单个值、PNG中单个块的上限，超过的跳过
+const int MAX_VALUE_SIZE = 64 * 1024;
+const int MAX_EXIF_SIZE = 1024 * 1024;
+const int MAX_IFD_ENTRIES = 512;
+const int IFD_ENTRY_SIZE = 12;
+const quint16 TAG_EXIF_IFD = 0x8769;
+const quint16 TAG_ORIENTATION = 0x0112;
+const int MAX_IFD_CHAIN = 8;
+const int MAX_SUB_IFDS = 16;
+const int MAX_SUB_IFD_DEPTH = 2;
+const char EXIF_HEADER[] = {'E', 'x', 'i', 'f', 0, 0};
+const int EXIF_HEADER_SIZE = 6;
+
+struct TagName {
+    quint16 tag;
+    const char *name;
+};
+
+//信息面板显示的标签，IFD0和Exif子IFD中的都在这里
+const TagName TAGS[] = {
+    {0x0100, "ImageWidth"},
+    {0x0101, "ImageLength"},
+    {0x010F, "Make"},
+    {0x0110, "Model"},
+    {TAG_ORIENTATION, "Orientation"},
+    {0x0131, "Software"},
+    {0x0132, "DateTime"},
+    {0x013B, "Artist"},
+    {0x8298, "Copyright"},
+    {0x829A, "ExposureTime"},
+    {0x829D, "FNumber"},
+    {0x8827, "ISOSpeedRatings"},
+    {0x9003, "DateTimeOriginal"},
+    {0x9209, "Flash"},
+    {0x920A, "FocalLength"},
+    {0xA002, "PixelXDimension"},
+    {0xA003, "PixelYDimension"},
+    {0xA405, "FocalLengthIn35mmFilm"},
+    {0xA434, "LensModel"},
+};
+
+struct CacheEntry {
+    ImageMetadata metadata;
+    FileIdentity identity;
+};
+
+QMutex s_mutex;
+QHash<QString, CacheEntry> s_cache;
+quint64 s_hits = 0;
+quint64 s_misses = 0;
+
+const char *tagName(quint16 tag)
+{
+    for (const TagName &name : TAGS) {
+        if (name.tag == tag) {
+            return name.name;
+        }
+    }
+    return nullptr;
+}
+
+int typeSize(int type)
+{
+    switch (type) {
+    case 1:     //BYTE
+    case 2:     //ASCII
+    case 6:     //SBYTE
+    case 7:     //UNDEFINED
+        return 1;
+    case 3:     //SHORT
+    case 8:     //SSHORT
+        return 2;
+    case 4:     //LONG
+    case 9:     //SLONG
+        return 4;
+    case 5:     //RATIONAL
+    case 10:    //SRATIONAL
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+//TIFF数据：JPEG和PNG中的EXIF已经在内存中，TIFF文件按偏移从文件读取
+class TiffSource
+{
+public:
+    explicit TiffSource(const QByteArray &data)
+        : m_data(data)
+    {
+    }
+    explicit TiffSource(QFile *file, qint64 *bytesRead)
+        : m_file(file)
+        , m_bytesRead(bytesRead)
+    {
+    }
+
+    QByteArray read(quint32 offset, int length) const
+    {
+        if (!m_file) {
+            return qint64(offset) + length <= m_data.size() ? m_data.mid(int(offset), length) : QByteArray();
+        }
+        if (!m_file->seek(offset)) {
+            return QByteArray();
+        }
+        const QByteArray data = m_file->read(length);
+        *m_bytesRead += data.size();
+        return data.size() == length ? data : QByteArray();
+    }
+
+private:
+    QByteArray m_data;
+    QFile *m_file = nullptr;
+    qint64 *m_bytesRead = nullptr;
+};
+
+quint16 get16(const char *p, bool bigEndian)
+{
+    const uchar *u = reinterpret_cast<const uchar *>(p);
+    return bigEndian ? qFromBigEndian<quint16>(u) : qFromLittleEndian<quint16>(u);
+}
+
+quint32 get32(const char *p, bool bigEndian)
+{
+    const uchar *u = reinterpret_cast<const uchar *>(p);
+    return bigEndian ? qFromBigEndian<quint32>(u) : qFromLittleEndian<quint32>(u);
+}
+
+QString formatRational(quint16 tag, qint64 numerator, qint64 denominator)
+{
+    if (denominator == 0) {
+        return QString();
+    }
+    //曝光时间习惯写成1/250
+    if (tag == 0x829A && numerator > 0 && numerator < denominator) {
+        return QString("1/%1").arg(qRound(double(denominator) / numerator));
+    }
+    return QString::number(double(numerator) / denominator, 'g', 4);
+}
+
+QString formatValue(quint16 tag, int type, const QByteArray &value, bool bigEndian)
+{
+    switch (type) {
+    case 2: {
+        const int end = value.indexOf('\0');
+        return QString::fromUtf8(end >= 0 ? value.left(end) : value).trimmed();
+    }
+    case 1:
+    case 7:
+        return value.isEmpty() ? QString() : QString::number(uchar(value.at(0)));
+    case 3:
+        return QString::number(get16(value.constData(), bigEndian));
+    case 8:
+        return QString::number(qint16(get16(value.constData(), bigEndian)));
+    case 4:
+        return QString::number(get32(value.constData(), bigEndian));
+    case 9:
+        return QString::number(qint32(get32(value.constData(), bigEndian)));
+    case 5:
+        return formatRational(tag, get32(value.constData(), bigEndian), get32(value.constData() + 4, bigEndian));
+    case 10:
+        return formatRational(tag, qint32(get32(value.constData(), bigEndian)),
+                              qint32(get32(value.constData() + 4, bigEndian)));
+    default:
+        return QString();
+    }
+}
+
+void parseIfd(const TiffSource &source, quint32 offset, bool bigEndian, QMap<QString, QString> *fields, bool exifIfd)
+{
+    const QByteArray countData = source.read(offset, 2);
+    if (countData.size() != 2) {
+        return;
+    }
+    const int count = qMin<int>(get16(countData.constData(), bigEndian), MAX_IFD_ENTRIES);
+    const QByteArray entries = source.read(offset + 2, count * IFD_ENTRY_SIZE);
+    quint32 subIfd = 0;
+    for (int i = 0; i < entries.size() / IFD_ENTRY_SIZE; i++) {
+        const char *entry = entries.constData() + i * IFD_ENTRY_SIZE;
+        const quint16 tag = get16(entry, bigEndian);
+        const int type = get16(entry + 2, bigEndian);
+        const quint32 valueCount = get32(entry + 4, bigEndian);
+        if (tag == TAG_EXIF_IFD && !exifIfd) {
+            subIfd = get32(entry + 8, bigEndian);
+            continue;
+        }
+        const char *name = tagName(tag);
+        const qint64 size = qint64(typeSize(type)) * valueCount;
+        if (!name || size <= 0 || size > MAX_VALUE_SIZE) {
+            continue;
+        }
+        //不超过4字节的值直接存放在条目中
+        const QByteArray value = size <= 4 ? QByteArray(entry + 8, int(size))
+                                 : source.read(get32(entry + 8, bigEndian), int(size));
+        if (value.size() < typeSize(type)) {
+            continue;
+        }
+        const QString text = formatValue(tag, type, value, bigEndian);
+        if (!text.isEmpty()) {
+            fields->insert(QString::fromLatin1(name), text);
+        }
+    }
+    if (subIfd != 0) {
+        parseIfd(source, subIfd, bigEndian, fields, true);
+    }
+}
+
+bool parseTiffHeader(const TiffSource &source, QMap<QString, QString> *fields)
+{
+    const QByteArray header = source.read(0, 8);
+    if (header.size() != 8 || !(header.startsWith("II*") || header.startsWith(QByteArray("MM\0*", 4)))) {
+        return false;
+    }
+    const bool bigEndian = header.startsWith("MM");
+    parseIfd(source, get32(header.constData() + 4, bigEndian), bigEndian, fields, false);
+    return true;
+}
+
+//只读取图像数据之前的段：APP1中的EXIF和SOF中的尺寸
+bool readJpeg(QFile &file, ImageMetadata *metadata)
+{
+    if (file.read(2) != QByteArray("\xFF\xD8", 2)) {
+        return false;
+    }
+    metadata->bytesRead += 2;
+    bool exifFound = false;
+    while (!file.atEnd()) {
+        const qint64 start = file.pos();
+        const QByteArray marker = file.read(4);
+        metadata->bytesRead += marker.size();
+        if (marker.size() < 4 || uchar(marker.at(0)) != 0xFF) {
+            break;
+        }
+        const uchar type = uchar(marker.at(1));
+        const int length = (uchar(marker.at(2)) << 8) | uchar(marker.at(3));
+        if (type == 0xDA || type == 0xD9 || length < 2) {
+            break;
+        }
+        //SOF0-SOF15，去掉DHT、JPG、DAC
+        if (type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC) {
+            const QByteArray sof = file.read(5);
+            metadata->bytesRead += sof.size();
+            if (sof.size() == 5) {
+                metadata->size = QSize(get16(sof.constData() + 3, true), get16(sof.constData() + 1, true));
+            }
+            //尺寸在EXIF之后，到这里需要的信息都有了
+            break;
+        }
+        if (type == 0xE1 && !exifFound && length > 2 + EXIF_HEADER_SIZE) {
+            const QByteArray payload = file.read(length - 2);
+            metadata->bytesRead += payload.size();
+            if (payload.startsWith(QByteArray(EXIF_HEADER, EXIF_HEADER_SIZE))) {
+                exifFound = parseTiffHeader(TiffSource(payload.mid(EXIF_HEADER_SIZE)), &metadata->fields);
+            }
+        }
+        if (!file.seek(start + 2 + length)) {
+            break;
+        }
+    }
+    return metadata->size.isValid();
+}
+
+//IDAT之前的块：IHDR的尺寸、eXIf和tEXt
+bool readPng(QFile &file, ImageMetadata *metadata)
+{
+    if (file.read(8) != QByteArray("\x89PNG\r\n\x1A\n", 8)) {
+        return false;
+    }
+    metadata->bytesRead += 8;
+    while (!file.atEnd()) {
+        const QByteArray header = file.read(8);
+        metadata->bytesRead += header.size();
+        if (header.size() < 8) {
+            break;
+        }
+        const quint32 length = get32(header.constData(), true);
+        const QByteArray type = header.mid(4);
+        if (type == "IDAT" || type == "IEND") {
+            break;
+        }
+        const qint64 next = file.pos() + length + 4;
+        if ((type == "IHDR" || type == "eXIf" || type == "tEXt") && length <= quint32(MAX_EXIF_SIZE)) {
+            const QByteArray data = file.read(length);
+            metadata->bytesRead += data.size();
+            if (type == "IHDR" && data.size() >= 8) {
+                metadata->size = QSize(int(get32(data.constData(), true)), int(get32(data.constData() + 4, true)));
+            } else if (type == "eXIf") {
+                parseTiffHeader(TiffSource(data.startsWith(QByteArray(EXIF_HEADER, EXIF_HEADER_SIZE))
+                                           ? data.mid(EXIF_HEADER_SIZE) : data), &metadata->fields);
+            } else if (type == "tEXt" && data.size() <= MAX_VALUE_SIZE) {
+                const int separator = data.indexOf('\0');
+                if (separator > 0) {
+                    metadata->fields.insert(QString::fromLatin1(data.left(separator)),
+                                            QString::fromLatin1(data.mid(separator + 1)).trimmed());
+                }
+            }
+        }
+        if (!file.seek(next)) {
+            break;
+        }
+    }
+    return metadata->size.isValid();
+}
+
+bool readTiff(QFile &file, ImageMetadata *metadata)
+{
+    if (!parseTiffHeader(TiffSource(&file, &metadata->bytesRead), &metadata->fields)) {
+        return false;
+    }
+    metadata->size = QSize(metadata->fields.value("ImageWidth").toInt(), metadata->fields.value("ImageLength").toInt());
+    return metadata->size.isValid();
+}
+
+//单个SHORT或LONG值，直接存放在条目中
+quint32 entryValue(const char *entry, bool bigEndian)
+{
+    return get16(entry + 2, bigEndian) == 3 ? get16(entry + 8, bigEndian) : get32(entry + 8, bigEndian);
+}
+
+struct PreviewCandidate {
+    quint32 offset;
+    quint32 length;
+};
+
+//TIFF结构的RAW（NEF、CR2、ARW、DNG、PEF等）中内嵌的JPEG预览：
+//JPEGInterchangeFormat，或者压缩方式为JPEG的单条带（DNG只取缩小的子图）
+void collectPreviews(const TiffSource &source, quint32 offset, bool bigEndian, int depth,
+                     QVector<PreviewCandidate> *candidates)
+{
+    for (int chain = 0; offset != 0 && chain < MAX_IFD_CHAIN; chain++) {
+        const QByteArray countData = source.read(offset, 2);
+        if (countData.size() != 2) {
+            return;
+        }
+        const int count = qMin<int>(get16(countData.constData(), bigEndian), MAX_IFD_ENTRIES);
+        const QByteArray entries = source.read(offset + 2, count * IFD_ENTRY_SIZE + 4);
+        if (entries.size() != count * IFD_ENTRY_SIZE + 4) {
+            return;
+        }
+        quint32 jpegOffset = 0, jpegLength = 0, stripOffset = 0, stripLength = 0;
+        quint32 compression = 0, subfileType = 0;
+        QVector<quint32> subIfds;
+        for (int i = 0; i < count; i++) {
+            const char *entry = entries.constData() + i * IFD_ENTRY_SIZE;
+            const quint32 valueCount = get32(entry + 4, bigEndian);
+            switch (get16(entry, bigEndian)) {
+            case 0x00FE:
+                subfileType = entryValue(entry, bigEndian);
+                break;
+            case 0x0103:
+                compression = entryValue(entry, bigEndian);
+                break;
+            case 0x0201:
+                jpegOffset = entryValue(entry, bigEndian);
+                break;
+            case 0x0202:
+                jpegLength = entryValue(entry, bigEndian);
+                break;
+            case 0x0111:
+                stripOffset = valueCount == 1 ? entryValue(entry, bigEndian) : 0;
+                break;
+            case 0x0117:
+                stripLength = valueCount == 1 ? entryValue(entry, bigEndian) : 0;
+                break;
+            case 0x014A:
+                if (valueCount == 1) {
+                    subIfds << get32(entry + 8, bigEndian);
+                } else if (valueCount <= MAX_SUB_IFDS) {
+                    const QByteArray list = source.read(get32(entry + 8, bigEndian), int(valueCount) * 4);
+                    for (int j = 0; j + 4 <= list.size(); j += 4) {
+                        subIfds << get32(list.constData() + j, bigEndian);
+                    }
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        if (jpegOffset != 0 && jpegLength != 0) {
+            candidates->append(PreviewCandidate{jpegOffset, jpegLength});
+        }
+        if (stripOffset != 0 && stripLength != 0 && (compression == 6 || (compression == 7 && subfileType == 1))) {
+            candidates->append(PreviewCandidate{stripOffset, stripLength});
+        }
+        if (depth < MAX_SUB_IFD_DEPTH) {
+            for (quint32 sub : subIfds) {
+                collectPreviews(source, sub, bigEndian, depth + 1, candidates);
+            }
+        }
+        offset = get32(entries.constData() + count * IFD_ENTRY_SIZE, bigEndian);
+    }
+}
+
+//只接受Qt能解码的基线或渐进JPEG，CR2等的无损JPEG原始数据（SOF3）排除
+QSize jpegSize(QFile &file, qint64 offset, qint64 *bytesRead)
+{
+    qint64 pos = offset + 2;
+    if (!file.seek(offset) || file.read(2) != QByteArray("\xFF\xD8", 2)) {
+        return QSize();
+    }
+    *bytesRead += 2;
+    for (int i = 0; i < MAX_IFD_ENTRIES && file.seek(pos); i++) {
+        const QByteArray marker = file.read(9);
+        *bytesRead += marker.size();
+        if (marker.size() < 4 || uchar(marker.at(0)) != 0xFF) {
+            return QSize();
+        }
+        const uchar type = uchar(marker.at(1));
+        if (type == 0xC0 || type == 0xC1 || type == 0xC2) {
+            return marker.size() == 9 ? QSize(get16(marker.constData() + 7, true), get16(marker.constData() + 5, true))
+                   : QSize();
+        }
+        if (type == 0xDA || (type >= 0xC3 && type <= 0xCF && type != 0xC4 && type != 0xCC)) {
+            return QSize();
+        }
+        pos += 2 + ((uchar(marker.at(2)) << 8) | uchar(marker.at(3)));
+    }
+    return QSize();
+}
+
+void findPreview(QFile &file, ImageMetadata *metadata)
+{
+    TiffSource source(&file, &metadata->bytesRead);
+    const QByteArray header = source.read(0, 8);
+    if (header.size() != 8 || !(header.startsWith("II") || header.startsWith("MM"))) {
+        return;
+    }
+    const bool bigEndian = header.startsWith("MM");
+    QVector<PreviewCandidate> candidates;
+    collectPreviews(source, get32(header.constData() + 4, bigEndian), bigEndian, 0, &candidates);
+    //最大的可用预览
+    std::sort(candidates.begin(), candidates.end(), [](const PreviewCandidate & a, const PreviewCandidate & b) {
+        return a.length > b.length;
+    });
+    for (const PreviewCandidate &candidate : candidates) {
+        if (qint64(candidate.offset) + candidate.length > metadata->fileSize) {
+            continue;
+        }
+        const QSize size = jpegSize(file, candidate.offset, &metadata->bytesRead);
+        if (size.isValid()) {
+            metadata->previewOffset = candidate.offset;
+            metadata->previewLength = candidate.length;
+            metadata->previewSize = size;
+            return;
+        }
+    }
+}
+
+//RAW等其它格式交给QImageReader，只会调用插件的文件头解析
+bool readWithReader(const QString &path, ImageMetadata *metadata)
+{
+    QImageReader reader(path);
+    metadata->size = reader.size();
+    metadata->format = QString::fromLatin1(reader.format());
+    for (const QString &key : reader.textKeys()) {
+        if (!key.startsWith("xraw.")) {
+            metadata->fields.insert(key, reader.text(key).trimmed());
+        }
+    }
+    return metadata->size.isValid();
+}
+}  // namespace
+
+MetadataService::MetadataService(QObject *parent)
+    : QObject(parent)
+    , m_group(QString("metadata-%1").arg(quintptr(this)))
+{
+}
+
+MetadataService::~MetadataService()
+{
+    m_serial.fetchAndAddOrdered(1);
+    DecodeScheduler::instance()->cancel(m_group);
+    DecodeScheduler::instance()->waitForDone(m_group);
+}
+
+bool MetadataService::cached(const QString &path, ImageMetadata *metadata) const
+{
+    const FileIdentity identity = FileIdentity::fromPath(path);
+    QMutexLocker locker(&s_mutex);
+    const auto it = s_cache.constFind(path);
+    if (it == s_cache.constEnd() || it->identity != identity) {
+        return false;
+    }
+    *metadata = it->metadata;
+    return true;
+}
+
+void MetadataService::request(const QString &path)
+{
+    const int serial = m_serial.fetchAndAddOrdered(1) + 1;
+    DecodeScheduler::instance()->cancel(m_group);
+    //用户正在等待面板显示，和当前图片同等优先
+    DecodeScheduler::instance()->submit(DecodeScheduler::PriorityVisible, [this, path, serial]() {
+        if (m_serial.loadAcquire() != serial) {
+            return;
+        }
+        const ImageMetadata metadata = read(path);
+        QMetaObject::invokeMethod(this, [this, path, metadata, serial]() {
+            if (m_serial.loadAcquire() == serial) {
+                emit sigReady(path, metadata);
+            }
+        }, Qt::QueuedConnection);
+    }, m_group);
+}
+
+void MetadataService::invalidate(const QString &path)
+{
+    QMutexLocker locker(&s_mutex);
+    s_cache.remove(path);
+}
+
+ImageMetadata MetadataService::read(const QString &path)
+{
+    const FileIdentity identity = FileIdentity::fromPath(path);
+    {
+        QMutexLocker locker(&s_mutex);
+        const auto it = s_cache.constFind(path);
+        if (it != s_cache.constEnd() && it->identity == identity) {
+            s_hits++;
+            return it->metadata;
+        }
+        s_misses++;
+    }
+
+    ImageMetadata metadata;
+    metadata.fileSize = identity.size;
+    QFile file(path);
+    if (identity.isValid() && file.open(QIODevice::ReadOnly)) {
+        const ImageTypeDetector::ImageType type = ImageTypeDetector::instance()->detect(path);
+        if (type == ImageTypeDetector::TypeRaw) {
+            findPreview(file, &metadata);
+        } else if (type == ImageTypeDetector::TypeJpeg) {
+            metadata.format = "jpeg";
+            metadata.valid = readJpeg(file, &metadata);
+        } else if (type == ImageTypeDetector::TypePng) {
+            metadata.format = "png";
+            metadata.valid = readPng(file, &metadata);
+        } else if (type == ImageTypeDetector::TypeTiff) {
+            metadata.format = "tiff";
+            metadata.valid = readTiff(file, &metadata);
+        }
+        file.close();
+        //RAW的尺寸已经按方向处理
+        if (!metadata.valid) {
+            metadata.fields.clear();
+            metadata.valid = readWithReader(path, &metadata);
+        } else if (metadata.fields.value("Orientation").toInt() >= 5) {
+            metadata.size.transpose();
+        }
+    }
+    //尺寸单独显示
+    metadata.fields.remove("ImageWidth");
+    metadata.fields.remove("ImageLength");
+
+    if (metadata.valid) {
+        QMutexLocker locker(&s_mutex);
+        if (s_cache.size() >= CACHE_LIMIT) {
+            s_cache.clear();
+        }
+        s_cache.insert(path, CacheEntry{metadata, identity});
+    }
+    return metadata;
+}
+
+quint64 MetadataService::cacheHits()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_hits;
+}
+
+quint64 MetadataService::cacheMisses()
+{
+    QMutexLocker locker(&s_mutex);
+    return s_misses;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef METADATASERVICE_H
+#define METADATASERVICE_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QMap>
+#include <QSize>
+
+//图片信息：只读取文件头，不解码像素
+struct ImageMetadata {
+    bool valid = false;
+    QString format;
+    //按EXIF方向显示后的尺寸
+    QSize size;
+    qint64 fileSize = 0;
+    //EXIF标签名（Make、Model、ExposureTime等）到显示文本
+    QMap<QString, QString> fields;
+    //RAW内嵌的JPEG预览在文件中的位置，没有时为-1；尺寸是存储的尺寸，没有按方向处理
+    qint64 previewOffset = -1;
+    qint64 previewLength = 0;
+    QSize previewSize;
+    //读取的字节数，不包括插件读取的部分
+    qint64 bytesRead = 0;
+};
+
+//图片信息读取：JPEG/PNG/TIFF自己解析文件头中的EXIF，RAW使用xraw插件open时解析的结果（包括厂商信息中的镜头）
+//在后台线程执行，结果按文件身份缓存，文件修改后自动失效
+class MetadataService : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetadataService(QObject *parent = nullptr);
+    ~MetadataService() override;
+
+    //有缓存时直接返回true
+    bool cached(const QString &path, ImageMetadata *metadata) const;
+    //后台读取，完成后发出sigReady；有缓存时同样异步发出
+    void request(const QString &path);
+    //附属文件等不改变文件身份的修改后调用
+    static void invalidate(const QString &path);
+
+    //同步读取，线程安全
+    static ImageMetadata read(const QString &path);
+    static quint64 cacheHits();
+    static quint64 cacheMisses();
+
+signals:
+    void sigReady(const QString &path, const ImageMetadata &metadata);
+
+private:
+    const QString m_group;
+    QAtomicInt m_serial;
+};
+
+#endif // METADATASERVICE_H
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "neighborprefetcher.h"
+#include "utils/imagetypedetector.h"
+#include "utils/pathingest.h"
+
+#include <QtConcurrent>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/sysmacros.h>
+
+namespace {
+//快速翻页时预读大约这段时间内会看到的图片
+const qint64 PREFETCH_HORIZON_MS = 2000;
+//超过这个间隔认为重新开始浏览，之前的速度不再参考
+const qint64 IDLE_RESET_MS = 5000;
+const int INTERVAL_SAMPLES = 4;
+const int MIN_LOOKAHEAD = 2;
+const int MAX_LOOKAHEAD_SLOW = 16;
+//SSD上冷读取本来就快，只预读少量
+const int MAX_LOOKAHEAD_FAST = 3;
+//单个文件最多预读的字节数
+const off_t MAX_ADVISE_BYTES = 64 * 1024 * 1024;
+
+//statfs中的网络/用户态文件系统
+const long NFS_MAGIC = 0x6969;
+const long SMB_MAGIC = 0x517B;
+const long CIFS_MAGIC = 0xFF534D42;
+const long FUSE_MAGIC = 0x65735546;
+
+void advise(const QString &path, int advice)
+{
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    off_t length = 0;
+    if (advice == POSIX_FADV_WILLNEED && fstat(fd, &st) == 0) {
+        length = qMin(off_t(st.st_size), MAX_ADVISE_BYTES);
+    }
+    //WILLNEED只是发起异步读取，不等待完成
+    posix_fadvise(fd, 0, length, advice);
+    ::close(fd);
+}
+
+bool readSysFlag(const QString &file)
+{
+    QFile flag(file);
+    return flag.open(QIODevice::ReadOnly) && flag.readAll().trimmed() == "1";
+}
+
+//和看图一样：同目录下的图片按自然排序
+QStringList folderImages(const QString &path)
+{
+    QStringList images;
+    const QDir dir = QFileInfo(path).absoluteDir();
+    const QStringList names = dir.entryList(QDir::Files | QDir::NoDotAndDotDot);
+    for (const QString &name : names) {
+        const QString file = dir.absoluteFilePath(name);
+        //只按后缀判断，不读文件
+        if (ImageTypeDetector::isImageType(ImageTypeDetector::instance()->quickCheck(file))) {
+            images << file;
+        }
+    }
+    PathIngest::sortNatural(images);
+    return images;
+}
+}  // namespace
+
+NeighborPrefetcher::NeighborPrefetcher(QObject *parent)
+    : QObject(parent)
+    , m_lookahead(MIN_LOOKAHEAD)
+{
+    //预读只是提示内核，一个线程足够，也不和解码抢线程
+    m_pool.setMaxThreadCount(1);
+}
+
+NeighborPrefetcher::~NeighborPrefetcher()
+{
+    m_generation.fetchAndAddOrdered(1);
+    m_pool.waitForDone();
+}
+
+void NeighborPrefetcher::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool NeighborPrefetcher::isEnabled() const
+{
+    return m_enabled;
+}
+
+void NeighborPrefetcher::setPaths(const QStringList &paths, const QString &current)
+{
+    const int generation = m_generation.fetchAndAddOrdered(1) + 1;
+    m_intervals.clear();
+    m_stepTimer.invalidate();
+    m_direction = 1;
+    //新列表展开之前不再响应翻页
+    m_paths.clear();
+    m_current = -1;
+    m_shown.clear();
+
+    //上一个列表预读过和看过的文件不再需要
+    QSet<QString> previous = m_advised;
+    previous.unite(m_visited);
+    const QStringList dontNeed = previous.toList();
+    m_advised.clear();
+    m_visited.clear();
+    if (!dontNeed.isEmpty()) {
+        QtConcurrent::run(&m_pool, [this, dontNeed]() {
+            for (const QString &path : dontNeed) {
+                advise(path, POSIX_FADV_DONTNEED);
+                m_droppedCount.ref();
+            }
+        });
+    }
+    if (!m_enabled || paths.isEmpty()) {
+        return;
+    }
+
+    const QString first = current.isEmpty() ? paths.first() : current;
+    QtConcurrent::run(&m_pool, [this, paths, first, generation]() {
+        if (m_generation.loadAcquire() != generation) {
+            return;
+        }
+        const QStringList expanded = paths.size() == 1 ? folderImages(first) : paths;
+        const bool slow = isSlowMedia(first);
+        QMetaObject::invokeMethod(this, [this, generation, expanded, first, slow]() {
+            onFolderExpanded(generation, expanded, first, slow);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void NeighborPrefetcher::onFolderExpanded(int generation, const QStringList &paths, const QString &current, bool slow)
+{
+    if (generation != m_generation.loadAcquire()) {
+        return;
+    }
+    m_paths = paths;
+    m_slowMedia = slow;
+    //展开期间看图可能已经翻页；结果里没有当前图片时不猜位置，等看图翻页后再同步
+    if (m_shown.isEmpty()) {
+        m_shown = current;
+    }
+    m_current = m_paths.indexOf(m_shown);
+    m_lookahead = MIN_LOOKAHEAD;
+    updateWindow();
+    emit sigPathsReady(m_paths, m_shown);
+}
+
+bool NeighborPrefetcher::setCurrentPath(const QString &path)
+{
+    m_shown = path;
+    const int index = m_paths.indexOf(path);
+    if (index < 0) {
+        return false;
+    }
+    if (m_current < 0) {
+        m_current = index;
+        updateWindow();
+    } else if (index != m_current) {
+        step(index - m_current);
+    }
+    return true;
+}
+
+void NeighborPrefetcher::step(int delta)
+{
+    if (!m_enabled || m_paths.isEmpty() || m_current < 0 || delta == 0) {
+        return;
+    }
+    if (m_stepTimer.isValid()) {
+        const qint64 interval = m_stepTimer.restart();
+        if (interval > IDLE_RESET_MS) {
+            m_intervals.clear();
+        } else {
+            m_intervals << interval;
+            if (m_intervals.size() > INTERVAL_SAMPLES) {
+                m_intervals.removeFirst();
+            }
+        }
+    } else {
+        m_stepTimer.start();
+    }
+    m_direction = delta > 0 ? 1 : -1;
+    m_current = qBound(0, m_current + delta, m_paths.size() - 1);
+    m_lookahead = adaptLookahead();
+    updateWindow();
+}
+
+int NeighborPrefetcher::adaptLookahead()
+{
+    const int maximum = m_slowMedia ? MAX_LOOKAHEAD_SLOW : MAX_LOOKAHEAD_FAST;
+    if (m_intervals.isEmpty()) {
+        return qMin(MIN_LOOKAHEAD, maximum);
+    }
+    qint64 total = 0;
+    for (qint64 interval : m_intervals) {
+        total += interval;
+    }
+    const qint64 average = qMax<qint64>(1, total / m_intervals.size());
+    return qBound(qMin(MIN_LOOKAHEAD, maximum), int(PREFETCH_HORIZON_MS / average) + 1, maximum);
+}
+
+void NeighborPrefetcher::updateWindow()
+{
+    if (m_current < 0 || m_current >= m_paths.size()) {
+        return;
+    }
+    m_visited.insert(m_paths.at(m_current));
+
+    //翻页方向上预读K张，反方向少量
+    const int behind = qMax(1, m_lookahead / 4);
+    const int first = qMax(0, m_direction > 0 ? m_current - behind : m_current - m_lookahead);
+    const int last = qMin(m_paths.size() - 1, m_direction > 0 ? m_current + m_lookahead : m_current + behind);
+
+    QSet<QString> window;
+    QStringList willNeed;
+    //离当前越近越先读
+    for (int distance = 1; distance <= qMax(m_current - first, last - m_current); distance++) {
+        const int forward = m_current + distance * m_direction;
+        const int backward = m_current - distance * m_direction;
+        for (int index : {forward, backward}) {
+            if (index < first || index > last) {
+                continue;
+            }
+            const QString &path = m_paths.at(index);
+            window.insert(path);
+            if (!m_advised.contains(path)) {
+                willNeed << path;
+            }
+        }
+    }
+    window.insert(m_paths.at(m_current));
+    if (!m_shown.isEmpty()) {
+        window.insert(m_shown);
+    }
+
+    QStringList dontNeed;
+    for (auto it = m_advised.begin(); it != m_advised.end();) {
+        if (!window.contains(*it)) {
+            dontNeed << *it;
+            m_visited.remove(*it);
+            it = m_advised.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    //看过的图片已经解码，离开窗口后不再需要页缓存
+    for (auto it = m_visited.begin(); it != m_visited.end();) {
+        if (!window.contains(*it)) {
+            dontNeed << *it;
+            it = m_visited.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (const QString &path : willNeed) {
+        m_advised.insert(path);
+    }
+    if (willNeed.isEmpty() && dontNeed.isEmpty()) {
+        return;
+    }
+
+    QtConcurrent::run(&m_pool, [this, willNeed, dontNeed]() {
+        for (const QString &path : dontNeed) {
+            advise(path, POSIX_FADV_DONTNEED);
+            m_droppedCount.ref();
+        }
+        for (const QString &path : willNeed) {
+            advise(path, POSIX_FADV_WILLNEED);
+            m_advisedCount.ref();
+        }
+    });
+}
+
+QString NeighborPrefetcher::currentPath() const
+{
+    return m_paths.value(m_current);
+}
+
+int NeighborPrefetcher::lookahead() const
+{
+    return m_lookahead;
+}
+
+bool NeighborPrefetcher::isSlowMedia() const
+{
+    return m_slowMedia;
+}
+
+int NeighborPrefetcher::advisedCount() const
+{
+    return m_advisedCount.load();
+}
+
+int NeighborPrefetcher::droppedCount() const
+{
+    return m_droppedCount.load();
+}
+
+void NeighborPrefetcher::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+bool NeighborPrefetcher::isSlowMedia(const QString &path)
+{
+    const QByteArray encoded = QFile::encodeName(path);
+    struct statfs fs;
+    if (statfs(encoded.constData(), &fs) == 0) {
+        const long type = long(fs.f_type);
+        if (type == NFS_MAGIC || type == SMB_MAGIC || type == CIFS_MAGIC || type == FUSE_MAGIC) {
+            return true;
+        }
+    }
+    struct stat st;
+    if (::stat(encoded.constData(), &st) != 0) {
+        return false;
+    }
+    //分区没有queue目录，需要看所在的整块设备
+    const QString device = QFileInfo(QString("/sys/dev/block/%1:%2").arg(major(st.st_dev)).arg(minor(st.st_dev)))
+                           .canonicalFilePath();
+    if (device.isEmpty()) {
+        return false;
+    }
+    for (const QString &dir : {device, QFileInfo(device).path()}) {
+        if (QFileInfo::exists(dir + "/queue/rotational")) {
+            return readSysFlag(dir + "/queue/rotational") || readSysFlag(dir + "/removable");
+        }
+    }
+    return false;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef NEIGHBORPREFETCHER_H
+#define NEIGHBORPREFETCHER_H
+
+#include <QObject>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QThreadPool>
+#include <QVector>
+#include <QSet>
+
+//按浏览顺序提前读取前后K张图片的文件内容（posix_fadvise WILLNEED），机械硬盘和U盘上翻页不再等待冷读取
+//K随翻页速度调整；离开窗口的已浏览/已预读文件用DONTNEED释放，浏览大量RAW时不挤掉其他页缓存
+class NeighborPrefetcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit NeighborPrefetcher(QObject *parent = nullptr);
+    ~NeighborPrefetcher() override;
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+
+    //打开了新的列表，只有一个文件时在后台展开为同目录的图片
+    void setPaths(const QStringList &paths, const QString &current = QString());
+    //看图实际显示的图片，翻页后以它为准重新定位预读窗口；不在列表中时返回false
+    //看图的列表顺序无法取得，按猜测的顺序计数会漂移，所以每次翻页后都要同步
+    bool setCurrentPath(const QString &path);
+    //用户向前(1)或向后(-1)翻页
+    void step(int delta);
+
+    QString currentPath() const;
+    //当前的预读窗口（翻页方向上的张数）
+    int lookahead() const;
+    bool isSlowMedia() const;
+
+    int advisedCount() const;
+    int droppedCount() const;
+    //等待后台的预读请求完成，测试使用
+    void waitForDone();
+
+    //机械硬盘、可移动设备、网络文件系统
+    static bool isSlowMedia(const QString &path);
+
+signals:
+    //列表展开完成，和看图的浏览顺序一致
+    void sigPathsReady(const QStringList &paths, const QString &current);
+
+private:
+    void onFolderExpanded(int generation, const QStringList &paths, const QString &current, bool slow);
+    void updateWindow();
+    int adaptLookahead();
+
+private:
+    QThreadPool m_pool;
+    QAtomicInt m_generation;
+    QStringList m_paths;
+    int m_current = -1;
+    //看图正在显示的图片，任何时候都不释放它的页缓存
+    QString m_shown;
+    int m_direction = 1;
+    int m_lookahead;
+    bool m_slowMedia = true;
+    bool m_enabled = true;
+
+    QElapsedTimer m_stepTimer;
+    QVector<qint64> m_intervals;
+    //已经发出WILLNEED的文件
+    QSet<QString> m_advised;
+    //已经显示过的文件，离开窗口时释放
+    QSet<QString> m_visited;
+
+    QAtomicInt m_advisedCount;
+    QAtomicInt m_droppedCount;
+};
+
+#endif // NEIGHBORPREFETCHER_H
@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ocrservice.h"
+#include "imagedecoder.h"
+#include "decodescheduler.h"
+#include "utils/fileidentity.h"
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QSaveFile>
+#include <QProcess>
+#include <QBuffer>
+#include <QMutex>
+#include <QHash>
+#include <QDir>
+#include <QDebug>
+
+namespace {
+const int DEFAULT_MAX_EDGE = 3200;
+const int DEFAULT_BAND_HEIGHT = 1024;
+//相邻条带重叠的高度，切在文字中间的行在下一条中完整出现
+const int BAND_OVERLAP = 96;
+const int ENGINE_TIMEOUT = 60000;
+//查询tesseract安装的语言
+const int PROBE_TIMEOUT = 5000;
+const int HASH_CHUNK = 1024 * 1024;
+const int HASH_MEMO_LIMIT = 1024;
+const QString CACHE_SUFFIX = ".txt";
+
+QMutex s_mutex;
+QString s_cacheRoot;
+QHash<FileIdentity, QByteArray> s_hashes;
+
+QString cacheFile(const QByteArray &contentHash, const QString &engineId, int maxEdge)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(contentHash);
+    hash.addData(QString("%1:%2").arg(engineId).arg(maxEdge).toUtf8());
+    return OcrService::cacheRoot() + '/' + QString::fromLatin1(hash.result().toHex()) + CACHE_SUFFIX;
+}
+}  // namespace
+
+OcrService::OcrService(QObject *parent)
+    : QObject(parent)
+    , m_group(QString("ocr-%1").arg(quintptr(this)))
+    , m_maxEdge(DEFAULT_MAX_EDGE)
+    , m_bandHeight(DEFAULT_BAND_HEIGHT)
+{
+}
+
+OcrService::~OcrService()
+{
+    cancel();
+    DecodeScheduler::instance()->waitForDone(m_group);
+}
+
+void OcrService::setEngine(const Engine &engine, const QString &engineId)
+{
+    m_engine = engine;
+    m_engineId = engineId;
+}
+
+bool OcrService::isAvailable() const
+{
+    return bool(m_engine);
+}
+
+bool OcrService::deepinOcrInstalled()
+{
+    return !QStandardPaths::findExecutable("deepin-ocr").isEmpty();
+}
+
+OcrService::Engine OcrService::tesseractEngine(const QString &languages)
+{
+    const QString program = QStandardPaths::findExecutable("tesseract");
+    if (program.isEmpty()) {
+        return Engine();
+    }
+    //tesseract不自带中文等语言数据，缺少任何一种都不使用
+    QProcess list;
+    list.start(program, QStringList() << "--list-langs");
+    if (!list.waitForFinished(PROBE_TIMEOUT) || list.exitStatus() != QProcess::NormalExit) {
+        list.kill();
+        list.waitForFinished();
+        return Engine();
+    }
+    //语言列表在不同版本中输出到stdout或stderr
+    const QStringList installed = QString::fromUtf8(list.readAllStandardOutput() + list.readAllStandardError())
+                                  .split('\n', QString::SkipEmptyParts);
+    for (const QString &language : languages.split('+', QString::SkipEmptyParts)) {
+        if (!installed.contains(language.trimmed())) {
+            qWarning() << "tesseract language data not installed:" << language;
+            return Engine();
+        }
+    }
+    return [program, languages](const QImage & image, QString * text) {
+        QByteArray png;
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG", 0);
+
+        QProcess process;
+        process.start(program, QStringList() << "stdin" << "stdout" << "-l" << languages);
+        if (!process.waitForStarted()) {
+            return false;
+        }
+        process.write(png);
+        process.closeWriteChannel();
+        if (!process.waitForFinished(ENGINE_TIMEOUT)) {
+            process.kill();
+            process.waitForFinished();
+            return false;
+        }
+        if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0) {
+            qWarning() << "tesseract failed:" << process.readAllStandardError();
+            return false;
+        }
+        *text = QString::fromUtf8(process.readAllStandardOutput());
+        return true;
+    };
+}
+
+void OcrService::probeTesseract(const QString &languages, bool preferDeepinOcr)
+{
+    DecodeScheduler::instance()->submit(DecodeScheduler::PriorityBackground, [this, languages, preferDeepinOcr]() {
+        if (preferDeepinOcr && deepinOcrInstalled()) {
+            return;
+        }
+        const Engine engine = tesseractEngine(languages);
+        if (!engine) {
+            return;
+        }
+        //析构时等待这个任务结束，对象删除后排队的调用会被丢弃
+        QMetaObject::invokeMethod(this, [this, engine, languages]() {
+            setEngine(engine, "tesseract:" + languages);
+        }, Qt::QueuedConnection);
+    }, m_group);
+}
+
+void OcrService::setMaxEdge(int pixels)
+{
+    m_maxEdge = qMax(BAND_OVERLAP * 2, pixels);
+}
+
+void OcrService::setBandHeight(int pixels)
+{
+    m_bandHeight = qMax(BAND_OVERLAP * 2, pixels);
+}
+
+void OcrService::recognize(const QString &path)
+{
+    cancel();
+    const int serial = m_serial.loadAcquire();
+    m_stats.requests++;
+    if (!m_engine) {
+        emit sigFailed(path, "OCR engine not available");
+        return;
+    }
+    m_busy.storeRelease(1);
+    m_timer.start();
+    const Engine engine = m_engine;
+    const QString engineId = m_engineId;
+    const int maxEdge = m_maxEdge;
+    const int bandHeight = m_bandHeight;
+    DecodeScheduler::instance()->submit(DecodeScheduler::PriorityBackground,
+    [this, serial, path, engine, engineId, maxEdge, bandHeight]() {
+        run(serial, path, engine, engineId, maxEdge, bandHeight);
+    }, m_group);
+}
+
+void OcrService::cancel()
+{
+    m_serial.fetchAndAddOrdered(1);
+    DecodeScheduler::instance()->cancel(m_group);
+    m_busy.storeRelease(0);
+}
+
+bool OcrService::isBusy() const
+{
+    return m_busy.loadAcquire() != 0;
+}
+
+OcrService::Stats OcrService::stats() const
+{
+    return m_stats;
+}
+
+void OcrService::setCacheRoot(const QString &dir)
+{
+    QMutexLocker locker(&s_mutex);
+    s_cacheRoot = dir;
+}
+
+QString OcrService::cacheRoot()
+{
+    QMutexLocker locker(&s_mutex);
+    if (s_cacheRoot.isEmpty()) {
+        return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/ocr";
+    }
+    return s_cacheRoot;
+}
+
+QByteArray OcrService::contentHash(const QString &path)
+{
+    const FileIdentity id = FileIdentity::fromPath(path);
+    if (!id.isValid()) {
+        return QByteArray();
+    }
+    {
+        QMutexLocker locker(&s_mutex);
+        const auto it = s_hashes.constFind(id);
+        if (it != s_hashes.constEnd()) {
+            return it.value();
+        }
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QByteArray chunk;
+    while (!(chunk = file.read(HASH_CHUNK)).isEmpty()) {
+        hash.addData(chunk);
+    }
+    const QByteArray result = hash.result();
+    QMutexLocker locker(&s_mutex);
+    if (s_hashes.size() >= HASH_MEMO_LIMIT) {
+        s_hashes.clear();
+    }
+    s_hashes.insert(id, result);
+    return result;
+}
+
+QString OcrService::mergeBand(const QString &previous, const QString &band)
+{
+    QStringList lines = band.split('\n');
+    while (!lines.isEmpty() && lines.last().trimmed().isEmpty()) {
+        lines.removeLast();
+    }
+    while (!lines.isEmpty() && lines.first().trimmed().isEmpty()) {
+        lines.removeFirst();
+    }
+    if (previous.isEmpty() || lines.isEmpty()) {
+        return previous.isEmpty() ? lines.join('\n') : previous;
+    }
+    //重叠区域只有几行：找出上一条末尾和这一条开头相同的最长部分
+    const QStringList before = previous.split('\n');
+    int skip = 0;
+    for (int n = qMin(before.size(), lines.size()); n > 0 && skip == 0; n--) {
+        bool same = true;
+        for (int i = 0; i < n && same; i++) {
+            same = before.at(before.size() - n + i).trimmed() == lines.at(i).trimmed();
+        }
+        if (same) {
+            skip = n;
+        }
+    }
+    lines = lines.mid(skip);
+    return lines.isEmpty() ? previous : previous + '\n' + lines.join('\n');
+}
+
+bool OcrService::isCancelled(int serial) const
+{
+    return m_serial.loadAcquire() != serial;
+}
+
+void OcrService::run(int serial, const QString &path, const Engine &engine, const QString &engineId,
+                     int maxEdge, int bandHeight)
+{
+    const QByteArray hash = contentHash(path);
+    if (hash.isEmpty() || isCancelled(serial)) {
+        if (hash.isEmpty()) {
+            QMetaObject::invokeMethod(this, [this, serial, path]() {
+                if (!isCancelled(serial)) {
+                    m_busy.storeRelease(0);
+                    emit sigFailed(path, "cannot read file");
+                }
+            }, Qt::QueuedConnection);
+        }
+        return;
+    }
+    const QString cachePath = cacheFile(hash, engineId, maxEdge);
+    QFile cached(cachePath);
+    if (cached.open(QIODevice::ReadOnly)) {
+        const QString text = QString::fromUtf8(cached.readAll());
+        QMetaObject::invokeMethod(this, [this, serial, path, text]() {
+            if (!isCancelled(serial)) {
+                m_busy.storeRelease(0);
+                m_stats.cacheHits++;
+                m_stats.lastMs = m_timer.nsecsElapsed() / 1000000.0;
+                emit sigFinished(path, text, true);
+            }
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    //50MP的原图对识别没有帮助，按限制的分辨率解码，灰度图传给引擎的数据也更少
+    QString error;
+    const QImage image = ImageDecoder::decode(path, QSize(maxEdge, maxEdge), &error)
+                         .convertToFormat(QImage::Format_Grayscale8);
+    if (image.isNull()) {
+        QMetaObject::invokeMethod(this, [this, serial, path, error]() {
+            if (!isCancelled(serial)) {
+                m_busy.storeRelease(0);
+                emit sigFailed(path, error.isEmpty() ? QString("cannot decode image") : error);
+            }
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    const int step = bandHeight - BAND_OVERLAP;
+    const int total = qMax(1, (image.height() - BAND_OVERLAP + step - 1) / step);
+    QString text;
+    for (int i = 0; i < total; i++) {
+        //每条之间检查一次，取消后最多再等一条
+        if (isCancelled(serial)) {
+            return;
+        }
+        const int top = i * step;
+        const QImage band = image.copy(0, top, image.width(), qMin(bandHeight, image.height() - top));
+        QString bandText;
+        if (!engine(band, &bandText)) {
+            QMetaObject::invokeMethod(this, [this, serial, path]() {
+                if (!isCancelled(serial)) {
+                    m_busy.storeRelease(0);
+                    emit sigFailed(path, "OCR engine failed");
+                }
+            }, Qt::QueuedConnection);
+            return;
+        }
+        text = mergeBand(text, bandText);
+        const int done = i + 1;
+        QMetaObject::invokeMethod(this, [this, serial, path, text, done, total]() {
+            if (!isCancelled(serial)) {
+                m_stats.tiles++;
+                emit sigPartial(path, text, done, total);
+            }
+        }, Qt::QueuedConnection);
+    }
+
+    QDir().mkpath(cacheRoot());
+    QSaveFile file(cachePath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(text.toUtf8()) < 0 || !file.commit()) {
+        qWarning() << "cannot write OCR cache:" << cachePath << file.errorString();
+    }
+    QMetaObject::invokeMethod(this, [this, serial, path, text]() {
+        if (!isCancelled(serial)) {
+            m_busy.storeRelease(0);
+            m_stats.lastMs = m_timer.nsecsElapsed() / 1000000.0;
+            qDebug() << "ocr finished:" << path << "ms:" << m_stats.lastMs;
+            emit sigFinished(path, text, false);
+        }
+    }, Qt::QueuedConnection);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OCRSERVICE_H
+#define OCRSERVICE_H
+
+#include <QObject>
+#include <QImage>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+
+#include <functional>
+
+//后台文字识别：原图先按限制的分辨率解码，再切成水平条带逐条识别，每条完成后发出已有的结果
+//结果按文件内容的哈希保存在缓存目录，同一张图片（包括复制、改名后）再次识别直接返回
+class OcrService : public QObject
+{
+    Q_OBJECT
+public:
+    //识别一个条带，失败时返回false
+    typedef std::function<bool(const QImage &, QString *)> Engine;
+
+    struct Stats {
+        int requests = 0;
+        int cacheHits = 0;
+        int tiles = 0;
+        //最近一次识别的耗时，从缓存返回时为读取缓存的时间
+        double lastMs = 0;
+    };
+
+    explicit OcrService(QObject *parent = nullptr);
+    ~OcrService() override;
+
+    //engineId参与缓存的key，更换引擎或语言后不会读到旧的结果
+    void setEngine(const Engine &engine, const QString &engineId);
+    bool isAvailable() const;
+    //系统默认的识别程序deepin-ocr是否安装，安装时由看图调用它识别
+    static bool deepinOcrInstalled();
+    //没有deepin-ocr时备用的tesseract命令行，程序或语言数据不存在时返回空的Engine
+    //会启动tesseract检查语言数据，不要在界面线程调用
+    static Engine tesseractEngine(const QString &languages);
+    //在后台查找tesseract，可用时设置为识别引擎；preferDeepinOcr时安装了deepin-ocr就不设置
+    void probeTesseract(const QString &languages, bool preferDeepinOcr);
+
+    //识别前把长边缩小到不超过此值，默认3200
+    void setMaxEdge(int pixels);
+    void setBandHeight(int pixels);
+
+    //开始识别，正在进行的识别被取消
+    void recognize(const QString &path);
+    //取消排队的任务，正在识别的条带完成后停止
+    void cancel();
+    bool isBusy() const;
+    Stats stats() const;
+
+    static void setCacheRoot(const QString &dir);
+    static QString cacheRoot();
+    //文件内容的SHA1，按文件身份缓存，文件未修改时不重复读取
+    static QByteArray contentHash(const QString &path);
+    //合并相邻条带的文本，去掉重叠区域重复识别出的行
+    static QString mergeBand(const QString &previous, const QString &band);
+
+signals:
+    //text为目前为止的结果
+    void sigPartial(const QString &path, const QString &text, int doneTiles, int totalTiles);
+    void sigFinished(const QString &path, const QString &text, bool fromCache);
+    void sigFailed(const QString &path, const QString &errorMsg);
+
+private:
+    void run(int serial, const QString &path, const Engine &engine, const QString &engineId,
+             int maxEdge, int bandHeight);
+    bool isCancelled(int serial) const;
+
+private:
+    const QString m_group;
+    Engine m_engine;
+    QString m_engineId;
+    int m_maxEdge;
+    int m_bandHeight;
+    QAtomicInt m_serial;
+    QAtomicInt m_busy;
+    QElapsedTimer m_timer;
+    Stats m_stats;
+};
+
+#endif // OCRSERVICE_H
@@ -0,0 +1,36 @@
+HEADERS += \
+    $$PWD/imagedecoder.h \
+    $$PWD/dragreadahead.h \
+    $$PWD/imagelistmodel.h \
+    $$PWD/batchconverter.h \
+    $$PWD/decodebenchmark.h \
+    $$PWD/decodepool.h \
+    $$PWD/tilepyramid.h \
+    $$PWD/neighborprefetcher.h \
+    $$PWD/framering.h \
+    $$PWD/decodescheduler.h \
+    $$PWD/burstnavigator.h \
+    $$PWD/slideshowengine.h \
+    $$PWD/losslessrotator.h \
+    $$PWD/ocrservice.h \
+    $$PWD/metadataservice.h \
+    $$PWD/folderindex.h \
+
+SOURCES += \
+    $$PWD/imagedecoder.cpp \
+    $$PWD/dragreadahead.cpp \
+    $$PWD/imagelistmodel.cpp \
+    $$PWD/batchconverter.cpp \
+    $$PWD/decodebenchmark.cpp \
+    $$PWD/decodepool.cpp \
+    $$PWD/tilepyramid.cpp \
+    $$PWD/neighborprefetcher.cpp \
+    $$PWD/framering.cpp \
+    $$PWD/decodescheduler.cpp \
+    $$PWD/burstnavigator.cpp \
+    $$PWD/slideshowengine.cpp \
+    $$PWD/losslessrotator.cpp \
+    $$PWD/ocrservice.cpp \
+    $$PWD/metadataservice.cpp \
+    $$PWD/folderindex.cpp \
+
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "slideshowengine.h"
+#include "imagedecoder.h"
+#include "decodescheduler.h"
+
+#include <QDebug>
+
+#include <cmath>
+
+namespace {
+const int DEFAULT_INTERVAL = 3000;
+const int MAX_LOOKAHEAD = 4;
+//解码时间的平滑系数
+const double DECODE_EMA_WEIGHT = 0.3;
+//解码时间超过间隔的这个比例就多提前一张
+const double LOOKAHEAD_MARGIN = 1.5;
+}  // namespace
+
+SlideshowEngine::SlideshowEngine(QObject *parent)
+    : QObject(parent)
+    , m_group(QString("slideshow-%1").arg(quintptr(this)))
+    , m_interval(DEFAULT_INTERVAL)
+{
+    m_decoder = [](const QString & path, const QSize & size) {
+        return ImageDecoder::decode(path, size);
+    };
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &SlideshowEngine::onDeadline);
+}
+
+SlideshowEngine::~SlideshowEngine()
+{
+    stop();
+    DecodeScheduler::instance()->waitForDone(m_group);
+}
+
+void SlideshowEngine::setPaths(const QStringList &paths, const QString &current)
+{
+    m_paths = paths;
+    m_start = qMax(0, paths.indexOf(current));
+}
+
+void SlideshowEngine::setInterval(int msec)
+{
+    m_interval = qMax(1, msec);
+}
+
+int SlideshowEngine::interval() const
+{
+    return m_interval;
+}
+
+void SlideshowEngine::setFrameSize(const QSize &size)
+{
+    m_frameSize = size;
+}
+
+void SlideshowEngine::setLoop(bool loop)
+{
+    m_loop = loop;
+}
+
+void SlideshowEngine::setDecoder(const Decoder &decoder)
+{
+    m_decoder = decoder;
+}
+
+void SlideshowEngine::start()
+{
+    stop();
+    if (m_paths.isEmpty()) {
+        return;
+    }
+    m_running = true;
+    m_stats = Stats();
+    m_lookahead = 1;
+    m_shown = -1;
+    m_wanted = m_start;
+    m_dueAt = -1;
+    m_overdue = true;
+    m_failures = 0;
+    m_clock.start();
+    schedule();
+}
+
+void SlideshowEngine::stop()
+{
+    m_timer.stop();
+    m_serial.fetchAndAddOrdered(1);
+    DecodeScheduler::instance()->cancel(m_group);
+    if (m_running) {
+        m_running = false;
+        qDebug() << "slideshow shown:" << m_stats.shown << "missed:" << m_stats.missed
+                 << "max late(ms):" << m_stats.maxLateMs << "avg decode(ms):" << m_stats.avgDecodeMs
+                 << "max lookahead:" << m_stats.maxLookahead;
+    }
+    m_ready.clear();
+    m_pending.clear();
+    if (m_shown >= 0) {
+        m_start = m_shown;
+    }
+}
+
+bool SlideshowEngine::isRunning() const
+{
+    return m_running;
+}
+
+QString SlideshowEngine::currentPath() const
+{
+    return m_paths.value(m_shown);
+}
+
+QImage SlideshowEngine::currentFrame() const
+{
+    return m_front;
+}
+
+int SlideshowEngine::lookahead() const
+{
+    return m_lookahead;
+}
+
+SlideshowEngine::Stats SlideshowEngine::stats() const
+{
+    return m_stats;
+}
+
+int SlideshowEngine::nextIndex(int index) const
+{
+    if (index + 1 < m_paths.size()) {
+        return index + 1;
+    }
+    return m_loop && m_paths.size() > 1 ? 0 : -1;
+}
+
+void SlideshowEngine::schedule()
+{
+    const int serial = m_serial.loadAcquire();
+    int index = m_wanted;
+    for (int i = 0; i < m_lookahead && index >= 0; i++, index = nextIndex(index)) {
+        //循环播放且张数很少时不要把当前帧再解码一次
+        if (index == m_shown || m_ready.contains(index) || m_pending.contains(index)) {
+            continue;
+        }
+        m_pending.insert(index);
+        //已经超时的那一张和正在显示的图片同等优先
+        const DecodeScheduler::Priority priority = i == 0 && m_overdue ? DecodeScheduler::PriorityVisible
+                                                   : DecodeScheduler::PriorityAdjacent;
+        const QString path = m_paths.at(index);
+        const QSize size = m_frameSize;
+        const Decoder decoder = m_decoder;
+        DecodeScheduler::instance()->submit(priority, [this, serial, index, path, size, decoder]() {
+            if (m_serial.loadAcquire() != serial) {
+                return;
+            }
+            QElapsedTimer timer;
+            timer.start();
+            const QImage image = decoder(path, size);
+            const double ms = timer.nsecsElapsed() / 1000000.0;
+            QMetaObject::invokeMethod(this, [this, serial, index, image, ms]() {
+                onDecoded(serial, index, image, ms);
+            }, Qt::QueuedConnection);
+        }, m_group);
+    }
+}
+
+void SlideshowEngine::onDecoded(int serial, int index, const QImage &image, double ms)
+{
+    if (serial != m_serial.loadAcquire() || !m_running) {
+        return;
+    }
+    m_pending.remove(index);
+    m_stats.avgDecodeMs = m_stats.avgDecodeMs > 0
+                          ? m_stats.avgDecodeMs * (1 - DECODE_EMA_WEIGHT) + ms * DECODE_EMA_WEIGHT : ms;
+    adapt();
+    if (image.isNull()) {
+        //解码失败直接跳过这一张，全部失败时停止
+        qWarning() << "slideshow cannot decode" << m_paths.at(index);
+        if (index == m_wanted) {
+            m_wanted = ++m_failures < m_paths.size() ? nextIndex(index) : -1;
+            if (m_wanted < 0 && m_overdue) {
+                onDeadline();
+                return;
+            }
+        }
+    } else {
+        m_ready.insert(index, image);
+    }
+    if (m_overdue && m_ready.contains(m_wanted)) {
+        present(m_wanted);
+        return;
+    }
+    schedule();
+}
+
+void SlideshowEngine::onDeadline()
+{
+    if (!m_running) {
+        return;
+    }
+    if (m_wanted < 0) {
+        stop();
+        emit sigFinished();
+        return;
+    }
+    if (m_ready.contains(m_wanted)) {
+        present(m_wanted);
+        return;
+    }
+    //解码好以后立即显示，按实际显示的时间重新计时
+    m_stats.missed++;
+    m_overdue = true;
+    schedule();
+}
+
+void SlideshowEngine::present(int index)
+{
+    const qint64 now = m_clock.elapsed();
+    if (m_dueAt >= 0) {
+        m_stats.maxLateMs = qMax(m_stats.maxLateMs, double(qMax<qint64>(0, now - m_dueAt)));
+    }
+    m_front = m_ready.take(index);
+    m_shown = index;
+    m_overdue = false;
+    m_failures = 0;
+    m_stats.shown++;
+    emit sigFrame(m_paths.at(index), m_front);
+
+    m_wanted = nextIndex(index);
+    //只保留后面几张，其余丢弃
+    QSet<int> window;
+    for (int i = 0, next = m_wanted; i < m_lookahead && next >= 0; i++, next = nextIndex(next)) {
+        window.insert(next);
+    }
+    for (auto it = m_ready.begin(); it != m_ready.end();) {
+        if (window.contains(it.key())) {
+            ++it;
+        } else {
+            it = m_ready.erase(it);
+        }
+    }
+    m_dueAt = now + m_interval;
+    m_timer.start(m_interval);
+    schedule();
+}
+
+void SlideshowEngine::adapt()
+{
+    //平均解码时间接近或超过间隔时同时解码多张，靠调度器的多个线程赶上播放速度
+    const int lookahead = qBound(1, int(std::ceil(m_stats.avgDecodeMs * LOOKAHEAD_MARGIN / m_interval)), MAX_LOOKAHEAD);
+    if (lookahead != m_lookahead) {
+        m_lookahead = lookahead;
+        m_stats.maxLookahead = qMax(m_stats.maxLookahead, lookahead);
+    }
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SLIDESHOWENGINE_H
+#define SLIDESHOWENGINE_H
+
+#include <QObject>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QImage>
+#include <QTimer>
+#include <QHash>
+#include <QSet>
+
+#include <functional>
+
+//幻灯片播放：后台按屏幕尺寸提前解码后面的图片，到时间只交换已经解码好的帧
+//默认前后两帧（双缓冲），解码时间接近播放间隔时（例如大量RAW）自动多解码几张
+class SlideshowEngine : public QObject
+{
+    Q_OBJECT
+public:
+    typedef std::function<QImage(const QString &, const QSize &)> Decoder;
+
+    struct Stats {
+        int shown = 0;
+        //到时间下一张还没有解码好
+        int missed = 0;
+        double maxLateMs = 0;
+        double avgDecodeMs = 0;
+        int maxLookahead = 1;
+    };
+
+    explicit SlideshowEngine(QObject *parent = nullptr);
+    ~SlideshowEngine() override;
+
+    void setPaths(const QStringList &paths, const QString &current = QString());
+    void setInterval(int msec);
+    int interval() const;
+    void setFrameSize(const QSize &size);
+    void setLoop(bool loop);
+    //默认使用ImageDecoder，测试时可以替换
+    void setDecoder(const Decoder &decoder);
+
+    void start();
+    void stop();
+    bool isRunning() const;
+
+    QString currentPath() const;
+    QImage currentFrame() const;
+    //提前解码的张数
+    int lookahead() const;
+    Stats stats() const;
+
+signals:
+    void sigFrame(const QString &path, const QImage &image);
+    //不循环时播放到最后一张
+    void sigFinished();
+
+private:
+    int nextIndex(int index) const;
+    void schedule();
+    void onDecoded(int serial, int index, const QImage &image, double ms);
+    void onDeadline();
+    void present(int index);
+    void adapt();
+
+private:
+    const QString m_group;
+    QStringList m_paths;
+    int m_start = 0;
+    int m_interval;
+    QSize m_frameSize;
+    bool m_loop = true;
+    bool m_running = false;
+    Decoder m_decoder;
+
+    QAtomicInt m_serial;
+    QElapsedTimer m_clock;
+    QTimer m_timer;
+    int m_shown = -1;
+    int m_wanted = -1;
+    //下一张到期的时间，-1表示第一张解码好立即显示
+    qint64 m_dueAt = -1;
+    bool m_overdue = false;
+    //连续解码失败的张数
+    int m_failures = 0;
+    QImage m_front;
+    //已经解码好的后面几张
+    QHash<int, QImage> m_ready;
+    QSet<int> m_pending;
+    int m_lookahead = 1;
+    Stats m_stats;
+};
+
+#endif // SLIDESHOWENGINE_H
@@ -0,0 +1,629 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "tilepyramid.h"
+#include "utils/fileidentity.h"
+#include "utils/imagetypedetector.h"
+
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QFileInfo>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QPainter>
+#include <QThread>
+#include <QDir>
+#include <QDebug>
+
+#include <vector>
+#include <algorithm>
+
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <tiffio.h>
+
+namespace {
+const char *const MANIFEST_NAME = "pyramid.json";
+const int MANIFEST_VERSION = 1;
+const qint64 DEFAULT_TILE_BUDGET = 64 * 1024 * 1024;
+const qint64 DEFAULT_DISK_BUDGET = qint64(2) * 1024 * 1024 * 1024;
+const int JPEG_QUALITY = 90;
+
+QMutex s_rootMutex;
+QString s_cacheRoot;
+qint64 s_diskBudget = DEFAULT_DISK_BUDGET;
+
+qint64 directoryBytes(const QString &dir)
+{
+    qint64 bytes = 0;
+    QDirIterator it(dir, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        bytes += it.fileInfo().size();
+    }
+    return bytes;
+}
+
+//清单中记录金字塔的总大小，清理缓存时不需要遍历瓦片
+qint64 recordedBytes(const QString &dir)
+{
+    QFile file(dir + '/' + MANIFEST_NAME);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    const QJsonValue bytes = QJsonDocument::fromJson(file.readAll()).object().value("bytes");
+    return bytes.isDouble() ? qint64(bytes.toDouble()) : -1;
+}
+
+bool recordBytes(const QString &dir)
+{
+    QFile file(dir + '/' + MANIFEST_NAME);
+    if (!file.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+    QJsonObject manifest = QJsonDocument::fromJson(file.readAll()).object();
+    manifest.insert("bytes", double(directoryBytes(dir)));
+    const QByteArray json = QJsonDocument(manifest).toJson(QJsonDocument::Compact);
+    return file.resize(0) && file.seek(0) && file.write(json) == json.size();
+}
+
+//每级宽高向上取整减半，直到整张图只剩一个瓦片
+QVector<QSize> levelSizes(const QSize &size)
+{
+    QVector<QSize> levels;
+    QSize level = size;
+    levels << level;
+    while (level.width() > TilePyramid::TILE_SIZE || level.height() > TilePyramid::TILE_SIZE) {
+        level = QSize((level.width() + 1) / 2, (level.height() + 1) / 2);
+        levels << level;
+    }
+    return levels;
+}
+
+//按行接收原图，每凑够一个瓦片行就写出瓦片，并缩小一半送给下一级
+class PyramidWriter
+{
+public:
+    PyramidWriter(const QString &dir, const QSize &size, bool alpha)
+        : m_dir(dir)
+        , m_levels(levelSizes(size))
+        , m_bands(m_levels.size())
+        , m_format(alpha ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32)
+        , m_suffix(alpha ? "png" : "jpg")
+    {
+        for (int level = 0; level < m_levels.size(); level++) {
+            QDir().mkpath(QString("%1/%2").arg(m_dir).arg(level));
+        }
+    }
+
+    QImage::Format format() const
+    {
+        return m_format;
+    }
+
+    QString suffix() const
+    {
+        return m_suffix;
+    }
+
+    int levelCount() const
+    {
+        return m_levels.size();
+    }
+
+    bool append(const QImage &rows)
+    {
+        return appendLevel(0, rows);
+    }
+
+    bool isComplete() const
+    {
+        for (int level = 0; level < m_levels.size(); level++) {
+            if (m_bands.at(level).row * TilePyramid::TILE_SIZE < m_levels.at(level).height()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    QString errorString() const
+    {
+        return m_error;
+    }
+
+private:
+    struct Band {
+        QImage image;
+        int filled = 0;
+        //已经写出的瓦片行数
+        int row = 0;
+    };
+
+    bool appendLevel(int level, const QImage &input)
+    {
+        const QSize levelSize = m_levels.at(level);
+        const QImage rows = input.format() == m_format ? input : input.convertToFormat(m_format);
+        Band &band = m_bands[level];
+        if (band.image.isNull()) {
+            band.image = QImage(levelSize.width(), TilePyramid::TILE_SIZE, m_format);
+        }
+        const int lineBytes = qMin(rows.bytesPerLine(), band.image.bytesPerLine());
+        int offset = 0;
+        while (offset < rows.height()) {
+            const int take = qMin(TilePyramid::TILE_SIZE - band.filled, rows.height() - offset);
+            for (int y = 0; y < take; y++) {
+                memcpy(band.image.scanLine(band.filled + y), rows.constScanLine(offset + y), size_t(lineBytes));
+            }
+            band.filled += take;
+            offset += take;
+            if (band.filled == TilePyramid::TILE_SIZE
+                    || band.row * TilePyramid::TILE_SIZE + band.filled >= levelSize.height()) {
+                if (!flush(level)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    bool flush(int level)
+    {
+        Band &band = m_bands[level];
+        const int width = m_levels.at(level).width();
+        const QImage rows = band.filled == band.image.height() ? band.image
+                            : band.image.copy(0, 0, width, band.filled);
+        for (int x = 0, column = 0; x < width; x += TilePyramid::TILE_SIZE, column++) {
+            const QImage tile = rows.copy(x, 0, qMin(TilePyramid::TILE_SIZE, width - x), rows.height());
+            const QString path = QString("%1/%2/%3_%4.%5").arg(m_dir).arg(level).arg(band.row).arg(column).arg(m_suffix);
+            QImageWriter writer(path, m_suffix.toLatin1());
+            writer.setQuality(JPEG_QUALITY);
+            if (!writer.write(tile)) {
+                m_error = writer.errorString();
+                return false;
+            }
+        }
+        band.row++;
+        band.filled = 0;
+
+        if (level + 1 < m_levels.size()) {
+            const QImage half = rows.scaled((width + 1) / 2, (rows.height() + 1) / 2,
+                                            Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            return appendLevel(level + 1, half);
+        }
+        return true;
+    }
+
+private:
+    QString m_dir;
+    QVector<QSize> m_levels;
+    QVector<Band> m_bands;
+    QImage::Format m_format;
+    QString m_suffix;
+    QString m_error;
+};
+
+bool writeManifest(const QString &dir, const QSize &size, const PyramidWriter &writer)
+{
+    QJsonObject manifest;
+    manifest.insert("version", MANIFEST_VERSION);
+    manifest.insert("width", size.width());
+    manifest.insert("height", size.height());
+    manifest.insert("tile", TilePyramid::TILE_SIZE);
+    manifest.insert("levels", writer.levelCount());
+    manifest.insert("suffix", writer.suffix());
+    QFile file(dir + '/' + MANIFEST_NAME);
+    const QByteArray json = QJsonDocument(manifest).toJson(QJsonDocument::Compact);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(json) == json.size();
+}
+
+//libtiff按瓦片行读取，条带和分块存储的TIFF都只解码需要的部分
+bool buildFromTiff(const QString &path, const QString &dir, QSize *size, QString *errorMsg)
+{
+    TIFF *tif = TIFFOpen(QFile::encodeName(path).constData(), "r");
+    if (!tif) {
+        *errorMsg = "cannot open tiff";
+        return false;
+    }
+    char message[1024] = {0};
+    TIFFRGBAImage image;
+    if (!TIFFRGBAImageOK(tif, message) || !TIFFRGBAImageBegin(&image, tif, 0, message)) {
+        *errorMsg = QString::fromLocal8Bit(message);
+        TIFFClose(tif);
+        return false;
+    }
+    image.req_orientation = ORIENTATION_TOPLEFT;
+    const int width = int(image.width);
+    const int height = int(image.height);
+    *size = QSize(width, height);
+
+    PyramidWriter writer(dir, *size, image.alpha != 0);
+    std::vector<uint32_t> raster(size_t(width) * TilePyramid::TILE_SIZE);
+    QImage rows(width, TilePyramid::TILE_SIZE, writer.format());
+    bool ok = true;
+    for (int y = 0; ok && y < height; y += TilePyramid::TILE_SIZE) {
+        const int count = qMin(TilePyramid::TILE_SIZE, height - y);
+        image.row_offset = y;
+        image.col_offset = 0;
+        if (!TIFFRGBAImageGet(&image, raster.data(), uint32_t(width), uint32_t(count))) {
+            *errorMsg = "tiff decode failed";
+            ok = false;
+            break;
+        }
+        //TIFFRGBAImage输出的是预乘过的RGBA
+        for (int line = 0; line < count; line++) {
+            const uint32_t *src = raster.data() + size_t(line) * size_t(width);
+            QRgb *dst = reinterpret_cast<QRgb *>(rows.scanLine(line));
+            for (int x = 0; x < width; x++) {
+                dst[x] = qRgba(int(TIFFGetR(src[x])), int(TIFFGetG(src[x])), int(TIFFGetB(src[x])),
+                               image.alpha ? int(TIFFGetA(src[x])) : 255);
+            }
+        }
+        ok = writer.append(count == rows.height() ? rows : rows.copy(0, 0, width, count));
+        if (!ok) {
+            *errorMsg = writer.errorString();
+        }
+    }
+    TIFFRGBAImageEnd(&image);
+    TIFFClose(tif);
+    return ok && writer.isComplete() && writeManifest(dir, *size, writer);
+}
+
+//其他格式：插件支持裁剪读取时逐个瓦片行读取，否则只能整体解码一次
+bool buildWithReader(const QString &path, const QString &dir, QSize *size, QString *errorMsg)
+{
+    QImageReader probe(path);
+    *size = probe.size();
+    if (!size->isValid()) {
+        *errorMsg = probe.errorString();
+        return false;
+    }
+    const bool alpha = QImage(1, 1, probe.imageFormat()).hasAlphaChannel();
+    const bool clip = probe.supportsOption(QImageIOHandler::ClipRect);
+    PyramidWriter writer(dir, *size, alpha);
+
+    QImage whole;
+    if (!clip && !probe.read(&whole)) {
+        *errorMsg = probe.errorString();
+        return false;
+    }
+    for (int y = 0; y < size->height(); y += TilePyramid::TILE_SIZE) {
+        const QRect band(0, y, size->width(), qMin(TilePyramid::TILE_SIZE, size->height() - y));
+        QImage rows;
+        if (clip) {
+            QImageReader reader(path);
+            reader.setClipRect(band);
+            if (!reader.read(&rows)) {
+                *errorMsg = reader.errorString();
+                return false;
+            }
+        } else {
+            rows = whole.copy(band);
+        }
+        if (!writer.append(rows)) {
+            *errorMsg = writer.errorString();
+            return false;
+        }
+    }
+    return writer.isComplete() && writeManifest(dir, *size, writer);
+}
+}  // namespace
+
+TilePyramid::TilePyramid()
+    : m_budget(DEFAULT_TILE_BUDGET)
+{
+}
+
+void TilePyramid::setCacheRoot(const QString &dir)
+{
+    QMutexLocker locker(&s_rootMutex);
+    s_cacheRoot = dir;
+}
+
+QString TilePyramid::cacheRoot()
+{
+    QMutexLocker locker(&s_rootMutex);
+    if (s_cacheRoot.isEmpty()) {
+        return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/pyramid";
+    }
+    return s_cacheRoot;
+}
+
+void TilePyramid::setDiskBudget(qint64 bytes)
+{
+    QMutexLocker locker(&s_rootMutex);
+    s_diskBudget = bytes;
+}
+
+qint64 TilePyramid::diskBudget()
+{
+    QMutexLocker locker(&s_rootMutex);
+    return s_diskBudget;
+}
+
+qint64 TilePyramid::trimCache(const QString &keep)
+{
+    struct Entry {
+        QString dir;
+        qint64 bytes;
+        qint64 lastUse;
+    };
+    //打开时更新清单的修改时间，按它判断最近使用
+    QVector<Entry> entries;
+    qint64 total = 0;
+    const QFileInfoList dirs = QDir(cacheRoot()).entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QFileInfo &info : dirs) {
+        //正在生成的临时目录
+        if (info.fileName().contains(".tmp-")) {
+            continue;
+        }
+        const QString dir = info.absoluteFilePath();
+        const QFileInfo manifest(dir + '/' + MANIFEST_NAME);
+        qint64 bytes = recordedBytes(dir);
+        if (bytes < 0) {
+            bytes = directoryBytes(dir);
+        }
+        total += bytes;
+        if (dir != QFileInfo(keep).absoluteFilePath()) {
+            entries.append({dir, bytes, manifest.exists() ? manifest.lastModified().toMSecsSinceEpoch() : 0});
+        }
+    }
+    const qint64 budget = diskBudget();
+    if (total <= budget) {
+        return total;
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry & a, const Entry & b) {
+        return a.lastUse < b.lastUse;
+    });
+    for (const Entry &entry : entries) {
+        if (total <= budget) {
+            break;
+        }
+        if (QDir(entry.dir).removeRecursively()) {
+            total -= entry.bytes;
+        }
+    }
+    return total;
+}
+
+bool TilePyramid::isLarge(const QString &path, qint64 threshold)
+{
+    const QSize size = QImageReader(path).size();
+    return size.isValid() && qint64(size.width()) * size.height() > threshold;
+}
+
+QString TilePyramid::pyramidDir(const QString &path)
+{
+    const FileIdentity id = FileIdentity::fromPath(path);
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    hash.addData(QFile::encodeName(QFileInfo(path).absoluteFilePath()));
+    hash.addData(QString("%1:%2:%3:%4").arg(id.dev).arg(id.ino).arg(id.mtimeNs).arg(id.size).toLatin1());
+    return cacheRoot() + '/' + QString::fromLatin1(hash.result().toHex());
+}
+
+bool TilePyramid::build(const QString &path, const QString &dir, QString *errorMsg)
+{
+    //先写到临时目录，完整后再改名，同时打开同一张图不会读到一半的缓存
+    const QString temp = QString("%1.tmp-%2-%3").arg(dir).arg(getpid())
+                         .arg(quintptr(QThread::currentThreadId()), 0, 16);
+    QDir(temp).removeRecursively();
+
+    QString error;
+    QSize size;
+    const bool ok = ImageTypeDetector::instance()->detect(path) == ImageTypeDetector::TypeTiff
+                    ? buildFromTiff(path, temp, &size, &error)
+                    : buildWithReader(path, temp, &size, &error);
+    if (!ok) {
+        QDir(temp).removeRecursively();
+        if (errorMsg) {
+            *errorMsg = error.isEmpty() ? QString("pyramid build failed") : error;
+        }
+        return false;
+    }
+    recordBytes(temp);
+    if (::rename(QFile::encodeName(temp).constData(), QFile::encodeName(dir).constData()) != 0) {
+        //其他线程已经生成了
+        QDir(temp).removeRecursively();
+        return QFileInfo::exists(dir + '/' + MANIFEST_NAME);
+    }
+    return true;
+}
+
+bool TilePyramid::open(const QString &path, QString *errorMsg)
+{
+    const QString dir = pyramidDir(path);
+    QFile file(dir + '/' + MANIFEST_NAME);
+    if (!file.exists()) {
+        QDir().mkpath(cacheRoot());
+        if (!build(path, dir, errorMsg)) {
+            return false;
+        }
+        //新的金字塔占用了磁盘，超出预算时删除最久没有打开的（包括源文件修改前留下的）
+        trimCache(dir);
+    } else {
+        //记录最近使用
+        ::utimes(QFile::encodeName(file.fileName()).constData(), nullptr);
+    }
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorMsg) {
+            *errorMsg = file.errorString();
+        }
+        return false;
+    }
+    const QJsonObject manifest = QJsonDocument::fromJson(file.readAll()).object();
+    const QSize size(manifest.value("width").toInt(), manifest.value("height").toInt());
+    if (manifest.value("version").toInt() != MANIFEST_VERSION || manifest.value("tile").toInt() != TILE_SIZE
+            || !size.isValid()) {
+        if (errorMsg) {
+            *errorMsg = "invalid pyramid manifest";
+        }
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_dir = dir;
+    m_suffix = manifest.value("suffix").toString();
+    m_levels = levelSizes(size);
+    m_tiles.clear();
+    m_used = 0;
+    return true;
+}
+
+bool TilePyramid::isOpen() const
+{
+    return !m_levels.isEmpty();
+}
+
+QSize TilePyramid::size() const
+{
+    return m_levels.isEmpty() ? QSize() : m_levels.first();
+}
+
+int TilePyramid::levelCount() const
+{
+    return m_levels.size();
+}
+
+QSize TilePyramid::levelSize(int level) const
+{
+    return m_levels.value(level);
+}
+
+int TilePyramid::levelForScale(qreal scale) const
+{
+    int level = 0;
+    while (level + 1 < m_levels.size() && scale * qreal(1 << (level + 1)) <= 1.0) {
+        level++;
+    }
+    return level;
+}
+
+QString TilePyramid::tilePath(int level, int column, int row) const
+{
+    return QString("%1/%2/%3_%4.%5").arg(m_dir).arg(level).arg(row).arg(column).arg(m_suffix);
+}
+
+QImage TilePyramid::tile(int level, int column, int row)
+{
+    const quint64 key = (quint64(level) << 48) | (quint64(row) << 24) | quint64(column);
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_tiles.find(key);
+        if (it != m_tiles.end()) {
+            it->lastUse = ++m_clock;
+            return it->image;
+        }
+    }
+
+    const QImage image(tilePath(level, column, row));
+    if (image.isNull()) {
+        return image;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_loads++;
+    if (m_tiles.contains(key)) {
+        return image;
+    }
+    const qint64 bytes = image.sizeInBytes();
+    evictLocked(bytes);
+    Tile &entry = m_tiles[key];
+    entry.image = image;
+    entry.lastUse = ++m_clock;
+    m_used += bytes;
+    return image;
+}
+
+void TilePyramid::paint(QPainter *painter, const QRectF &target, const QRectF &source)
+{
+    if (!isOpen() || source.isEmpty() || target.isEmpty()) {
+        return;
+    }
+    const qreal scale = qMin(target.width() / source.width(), target.height() / source.height());
+    const int level = levelForScale(scale);
+    const qreal factor = qreal(1 << level);
+    const QSize size = m_levels.at(level);
+    const QRectF area(source.x() / factor, source.y() / factor, source.width() / factor, source.height() / factor);
+    const qreal sx = target.width() / area.width();
+    const qreal sy = target.height() / area.height();
+
+    const int firstColumn = qMax(0, int(floor(area.left() / TILE_SIZE)));
+    const int firstRow = qMax(0, int(floor(area.top() / TILE_SIZE)));
+    const int lastColumn = qMin((size.width() - 1) / TILE_SIZE, int(ceil(area.right() / TILE_SIZE)) - 1);
+    const int lastRow = qMin((size.height() - 1) / TILE_SIZE, int(ceil(area.bottom() / TILE_SIZE)) - 1);
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            const QImage image = tile(level, column, row);
+            if (image.isNull()) {
+                continue;
+            }
+            const QRectF rect(target.x() + (column * TILE_SIZE - area.x()) * sx,
+                              target.y() + (row * TILE_SIZE - area.y()) * sy,
+                              image.width() * sx, image.height() * sy);
+            painter->drawImage(rect, image);
+        }
+    }
+}
+
+QImage TilePyramid::render(const QRectF &source, const QSize &targetSize)
+{
+    QImage image(targetSize, m_suffix == "png" ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    paint(&painter, QRectF(QPointF(0, 0), QSizeF(targetSize)), source);
+    painter.end();
+    return image;
+}
+
+void TilePyramid::setTileBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_budget = bytes;
+    evictLocked(0);
+}
+
+qint64 TilePyramid::usedBytes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_used;
+}
+
+int TilePyramid::tileLoads() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_loads;
+}
+
+void TilePyramid::evictLocked(qint64 needed)
+{
+    while (!m_tiles.isEmpty() && m_used + needed > m_budget) {
+        auto oldest = m_tiles.begin();
+        for (auto it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+            if (it->lastUse < oldest->lastUse) {
+                oldest = it;
+            }
+        }
+        m_used -= oldest->image.sizeInBytes();
+        m_tiles.erase(oldest);
+    }
+}
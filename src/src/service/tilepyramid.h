@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TILEPYRAMID_H
+#define TILEPYRAMID_H
+
+#include <QImage>
+#include <QHash>
+#include <QMutex>
+#include <QRectF>
+#include <QString>
+#include <QVector>
+
+class QPainter;
+
+//超大图片的多分辨率瓦片缓存
+//第一次打开时流式读取原图一遍，生成256像素瓦片的各级缩小图（每级宽高减半）写入缓存目录，
+//之后缩放和平移只读取可见区域的瓦片，内存占用与原图大小无关
+class TilePyramid
+{
+public:
+    static const int TILE_SIZE = 256;
+    //超过这个像素数的TIFF走金字塔
+    static const qint64 DEFAULT_THRESHOLD = 64 * 1024 * 1024;
+
+    TilePyramid();
+
+    //瓦片缓存的根目录，默认在用户缓存目录下
+    static void setCacheRoot(const QString &dir);
+    static QString cacheRoot();
+    //缓存目录占用的磁盘上限，生成新的金字塔后删除最久没有打开的
+    static void setDiskBudget(qint64 bytes);
+    static qint64 diskBudget();
+    //删除最久没有打开的金字塔直到不超过预算，keep不会被删除；返回剩余占用
+    static qint64 trimCache(const QString &keep = QString());
+    //只读取文件头判断
+    static bool isLarge(const QString &path, qint64 threshold = DEFAULT_THRESHOLD);
+    //文件修改后目录名随之变化
+    static QString pyramidDir(const QString &path);
+    //流式生成金字塔，内存占用约为两个瓦片行
+    static bool build(const QString &path, const QString &dir, QString *errorMsg = nullptr);
+
+    //缓存中没有时先生成
+    bool open(const QString &path, QString *errorMsg = nullptr);
+    bool isOpen() const;
+
+    QSize size() const;
+    int levelCount() const;
+    QSize levelSize(int level) const;
+    //显示比例对应的层级：分辨率不低于所需的最小一级
+    int levelForScale(qreal scale) const;
+
+    //内存中按LRU缓存，线程安全
+    QImage tile(int level, int column, int row);
+    //把原图坐标下的source区域画到target，只读取相交的瓦片
+    void paint(QPainter *painter, const QRectF &target, const QRectF &source);
+    QImage render(const QRectF &source, const QSize &targetSize);
+
+    void setTileBudget(qint64 bytes);
+    qint64 usedBytes() const;
+    //从磁盘读取瓦片的次数
+    int tileLoads() const;
+
+private:
+    QString tilePath(int level, int column, int row) const;
+    void evictLocked(qint64 needed);
+
+    struct Tile {
+        QImage image;
+        quint64 lastUse = 0;
+    };
+
+    QString m_dir;
+    QString m_suffix;
+    QVector<QSize> m_levels;
+
+    mutable QMutex m_mutex;
+    QHash<quint64, Tile> m_tiles;
+    qint64 m_budget;
+    qint64 m_used = 0;
+    quint64 m_clock = 0;
+    int m_loads = 0;
+};
+
+#endif // TILEPYRAMID_H
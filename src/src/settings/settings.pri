@@ -0,0 +1,6 @@
+HEADERS += \
+    $$PWD/settingsstore.h \
+
+SOURCES += \
+    $$PWD/settingsstore.cpp \
+
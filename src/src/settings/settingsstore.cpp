@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "settingsstore.h"
+
+#include <QtConcurrent>
+#include <QCoreApplication>
+#include <QSettings>
+#include <QFileInfo>
+#include <QDir>
+#include <QDebug>
+
+namespace {
+//窗口拖动时一秒内几百次修改合并成一两次写入
+const int DEFAULT_SAVE_DELAY = 500;
+}  // namespace
+
+SettingsStore::SettingsStore(const QString &fileName, QObject *parent)
+    : QObject(parent)
+    , m_fileName(fileName)
+{
+    m_writer.setMaxThreadCount(1);
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(DEFAULT_SAVE_DELAY);
+    connect(&m_saveTimer, &QTimer::timeout, this, &SettingsStore::onSaveTimeout);
+    if (QCoreApplication::instance()) {
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &SettingsStore::flush);
+    }
+    load();
+}
+
+SettingsStore::~SettingsStore()
+{
+    flush();
+}
+
+QVariant SettingsStore::value(const QString &group, const QString &key, const QVariant &defaultValue) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_values.value(group + '/' + key, defaultValue);
+}
+
+void SettingsStore::setValue(const QString &group, const QString &key, const QVariant &value)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        const QString name = group + '/' + key;
+        auto it = m_values.find(name);
+        if (it != m_values.end() && it.value() == value) {
+            return;
+        }
+        m_values.insert(name, value);
+        m_changed.insert(name, value);
+    }
+    //不重新计时，持续修改时每个周期也能保存一次
+    if (!m_saveTimer.isActive()) {
+        m_saveTimer.start();
+    }
+}
+
+void SettingsStore::flush()
+{
+    m_saveTimer.stop();
+    m_writer.waitForDone();
+
+    ValueMap changes;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_changed.isEmpty()) {
+            return;
+        }
+        changes.swap(m_changed);
+    }
+    write(changes);
+}
+
+void SettingsStore::setSaveDelay(int msec)
+{
+    m_saveTimer.setInterval(msec);
+}
+
+QString SettingsStore::fileName() const
+{
+    return m_fileName;
+}
+
+int SettingsStore::writeCount() const
+{
+    return m_writeCount.loadAcquire();
+}
+
+void SettingsStore::onSaveTimeout()
+{
+    ValueMap changes;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_changed.isEmpty()) {
+            return;
+        }
+        changes.swap(m_changed);
+    }
+    QtConcurrent::run(&m_writer, [this, changes]() {
+        write(changes);
+    });
+}
+
+void SettingsStore::load()
+{
+    QSettings settings(m_fileName, QSettings::IniFormat);
+    const QStringList keys = settings.allKeys();
+    QMutexLocker locker(&m_mutex);
+    for (const QString &key : keys) {
+        m_values.insert(key, settings.value(key));
+    }
+}
+
+bool SettingsStore::write(const ValueMap &changes)
+{
+    //QSettings::sync加锁后重新读取文件，只写回自己修改过的键，其它进程写入的键得以保留
+    //写入经过QSaveFile，写到一半退出也不会损坏原有配置
+    QDir().mkpath(QFileInfo(m_fileName).absolutePath());
+    QSettings settings(m_fileName, QSettings::IniFormat);
+    for (auto it = changes.constBegin(); it != changes.constEnd(); ++it) {
+        settings.setValue(it.key(), it.value());
+    }
+    settings.sync();
+    if (settings.status() != QSettings::NoError) {
+        qWarning() << "write settings failed:" << m_fileName;
+        return false;
+    }
+    m_writeCount.ref();
+    return true;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SETTINGSSTORE_H
+#define SETTINGSSTORE_H
+
+#include <QObject>
+#include <QMap>
+#include <QMutex>
+#include <QTimer>
+#include <QVariant>
+#include <QAtomicInt>
+#include <QThreadPool>
+
+//配置读写缓存在内存，一段时间内的修改合并后在后台线程原子写入
+//退出时同步写入未保存的修改
+class SettingsStore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SettingsStore(const QString &fileName, QObject *parent = nullptr);
+    ~SettingsStore() override;
+
+    QVariant value(const QString &group, const QString &key,
+                   const QVariant &defaultValue = QVariant()) const;
+    void setValue(const QString &group, const QString &key, const QVariant &value);
+
+    //等待后台写入完成，并同步写入尚未保存的修改
+    void flush();
+
+    void setSaveDelay(int msec);
+    QString fileName() const;
+    //实际写文件的次数
+    int writeCount() const;
+
+private slots:
+    void onSaveTimeout();
+
+private:
+    typedef QMap<QString, QVariant> ValueMap;
+
+    void load();
+    //重新读取文件后合并changes再写入
+    bool write(const ValueMap &changes);
+
+private:
+    QString m_fileName;
+    mutable QMutex m_mutex;
+    ValueMap m_values;
+    //上次写入后修改过的键
+    ValueMap m_changed;
+    QTimer m_saveTimer;
+    //写入串行执行，保证后提交的快照后落盘
+    QThreadPool m_writer;
+    QAtomicInt m_writeCount;
+};
+
+#endif // SETTINGSSTORE_H
@@ -0,0 +1,462 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "exiforientation.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QTransform>
+#include <QRegularExpression>
+#include <QtEndian>
+
+namespace {
+const int TAG_ORIENTATION = 0x0112;
+const int TYPE_SHORT = 3;
+const int IFD_ENTRY_SIZE = 12;
+const int MAX_SEGMENT_LENGTH = 0xFFFF;
+const qint64 COPY_CHUNK = 1024 * 1024;
+const qint64 MAX_SIDECAR_SIZE = 4 * 1024 * 1024;
+const char EXIF_HEADER[] = {'E', 'x', 'i', 'f', 0, 0};
+const int EXIF_HEADER_SIZE = 6;
+
+//顺时针旋转90度：显示效果R90 x 原变换
+const int ROTATE_CW[9] = {0, 6, 7, 8, 5, 2, 3, 4, 1};
+const int ROTATE_CCW[9] = {0, 8, 5, 6, 7, 4, 1, 2, 3};
+//dcraw: flip = "50132467"[orientation]
+const int LIBRAW_FLIP[9] = {0, 0, 1, 3, 2, 4, 6, 7, 5};
+const int FROM_LIBRAW_FLIP[8] = {1, 2, 4, 3, 5, 8, 6, 7};
+
+const QString DESCRIPTION_TAG = "<rdf:Description";
+const QString XMP_TEMPLATE = "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">\n"
+                             " <rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">\n"
+                             "  <rdf:Description rdf:about=\"\"\n"
+                             "    xmlns:tiff=\"http://ns.adobe.com/tiff/1.0/\"\n"
+                             "   tiff:Orientation=\"%1\"/>\n"
+                             " </rdf:RDF>\n"
+                             "</x:xmpmeta>\n";
+
+bool validOrientation(int orientation)
+{
+    return orientation >= 1 && orientation <= 8;
+}
+
+quint16 get16(const QByteArray &data, int offset, bool bigEndian)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + offset;
+    return bigEndian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+}
+
+quint32 get32(const QByteArray &data, int offset, bool bigEndian)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData()) + offset;
+    return bigEndian ? qFromBigEndian<quint32>(p) : qFromLittleEndian<quint32>(p);
+}
+
+void put16(QByteArray *data, int offset, quint16 value, bool bigEndian)
+{
+    uchar *p = reinterpret_cast<uchar *>(data->data()) + offset;
+    bigEndian ? qToBigEndian<quint16>(value, p) : qToLittleEndian<quint16>(value, p);
+}
+
+void put32(QByteArray *data, int offset, quint32 value, bool bigEndian)
+{
+    uchar *p = reinterpret_cast<uchar *>(data->data()) + offset;
+    bigEndian ? qToBigEndian<quint32>(value, p) : qToLittleEndian<quint32>(value, p);
+}
+
+//JPEG文件头中和方向有关的位置
+struct JpegExif {
+    //没有EXIF时插入APP1的位置：SOI之后，有JFIF的APP0时在APP0之后
+    qint64 insertAt = 2;
+    //Exif APP1段（0xFFE1）的位置和长度字段
+    qint64 app1Start = -1;
+    int app1Length = 0;
+    //APP1内容中的TIFF部分
+    QByteArray tiff;
+    bool bigEndian = false;
+    quint32 ifd0 = 0;
+    //方向值在文件中的位置
+    qint64 valueOffset = -1;
+    int orientation = 1;
+};
+
+QByteArray readCounted(QFile &file, qint64 size, ExifOrientation::IoStats *stats)
+{
+    const QByteArray data = file.read(size);
+    if (stats) {
+        stats->bytesRead += data.size();
+    }
+    return data;
+}
+
+void parseTiff(qint64 tiffStart, JpegExif *exif)
+{
+    const QByteArray &tiff = exif->tiff;
+    if (tiff.size() < 8 || !(tiff.startsWith("II*") || tiff.startsWith("MM"))) {
+        return;
+    }
+    exif->bigEndian = tiff.startsWith("MM");
+    exif->ifd0 = get32(tiff, 4, exif->bigEndian);
+    if (exif->ifd0 + 2 > quint32(tiff.size())) {
+        return;
+    }
+    const int count = get16(tiff, int(exif->ifd0), exif->bigEndian);
+    for (int i = 0; i < count; i++) {
+        const int entry = int(exif->ifd0) + 2 + i * IFD_ENTRY_SIZE;
+        if (entry + IFD_ENTRY_SIZE > tiff.size()) {
+            return;
+        }
+        if (get16(tiff, entry, exif->bigEndian) == TAG_ORIENTATION
+                && get16(tiff, entry + 2, exif->bigEndian) == TYPE_SHORT) {
+            exif->valueOffset = tiffStart + entry + 8;
+            const int value = get16(tiff, entry + 8, exif->bigEndian);
+            exif->orientation = validOrientation(value) ? value : 1;
+            return;
+        }
+    }
+}
+
+//只读取图像数据之前的段
+bool scanJpeg(QFile &file, JpegExif *exif, ExifOrientation::IoStats *stats)
+{
+    if (readCounted(file, 2, stats) != QByteArray("\xFF\xD8", 2)) {
+        return false;
+    }
+    bool first = true;
+    while (!file.atEnd()) {
+        const qint64 start = file.pos();
+        const QByteArray marker = readCounted(file, 4, stats);
+        if (marker.size() < 4 || uchar(marker.at(0)) != 0xFF) {
+            return true;
+        }
+        const uchar type = uchar(marker.at(1));
+        //图像数据开始，后面不会再有APP段
+        if (type == 0xDA || type == 0xD9) {
+            return true;
+        }
+        const int length = (uchar(marker.at(2)) << 8) | uchar(marker.at(3));
+        if (length < 2) {
+            return true;
+        }
+        if (type == 0xE1 && exif->app1Start < 0 && length >= 2 + EXIF_HEADER_SIZE + 8) {
+            const QByteArray payload = readCounted(file, length - 2, stats);
+            if (payload.startsWith(QByteArray(EXIF_HEADER, EXIF_HEADER_SIZE))) {
+                exif->app1Start = start;
+                exif->app1Length = length;
+                exif->tiff = payload.mid(EXIF_HEADER_SIZE);
+                parseTiff(start + 4 + EXIF_HEADER_SIZE, exif);
+                return true;
+            }
+        } else if (!file.seek(start + 2 + length)) {
+            return true;
+        }
+        if (first && type == 0xE0) {
+            exif->insertAt = file.pos();
+        }
+        first = false;
+    }
+    return true;
+}
+
+bool copyRange(QFile &source, qint64 from, qint64 to, QSaveFile &target, ExifOrientation::IoStats *stats)
+{
+    if (!source.seek(from)) {
+        return false;
+    }
+    for (qint64 left = to - from; left > 0;) {
+        const QByteArray chunk = readCounted(source, qMin(left, COPY_CHUNK), stats);
+        if (chunk.isEmpty() || target.write(chunk) != chunk.size()) {
+            return false;
+        }
+        stats->bytesWritten += chunk.size();
+        left -= chunk.size();
+    }
+    return true;
+}
+
+QByteArray segment(const QByteArray &tiff)
+{
+    QByteArray data("\xFF\xE1", 2);
+    const int length = 2 + EXIF_HEADER_SIZE + tiff.size();
+    data.append(char(length >> 8));
+    data.append(char(length & 0xFF));
+    data.append(EXIF_HEADER, EXIF_HEADER_SIZE);
+    data.append(tiff);
+    return data;
+}
+
+//只有方向标签的最小EXIF
+QByteArray minimalTiff(int orientation)
+{
+    QByteArray tiff(8 + 2 + IFD_ENTRY_SIZE + 4, '\0');
+    tiff[0] = 'M';
+    tiff[1] = 'M';
+    put16(&tiff, 2, 42, true);
+    put32(&tiff, 4, 8, true);
+    put16(&tiff, 8, 1, true);
+    put16(&tiff, 10, TAG_ORIENTATION, true);
+    put16(&tiff, 12, TYPE_SHORT, true);
+    put32(&tiff, 14, 1, true);
+    put16(&tiff, 18, quint16(orientation), true);
+    return tiff;
+}
+
+//IFD0没有方向标签：把IFD0加上方向后复制到末尾，其它数据的偏移都不变
+QByteArray relocateIfd0(const JpegExif &exif, int orientation)
+{
+    QByteArray tiff = exif.tiff;
+    const bool big = exif.bigEndian;
+    if (exif.ifd0 < 8 || exif.ifd0 + 2 > quint32(tiff.size())) {
+        return QByteArray();
+    }
+    const int count = get16(tiff, int(exif.ifd0), big);
+    const int tableEnd = int(exif.ifd0) + 2 + count * IFD_ENTRY_SIZE;
+    if (tableEnd + 4 > tiff.size()) {
+        return QByteArray();
+    }
+    if (tiff.size() % 2) {
+        tiff.append('\0');
+    }
+    const int newIfd = tiff.size();
+    QByteArray entry(IFD_ENTRY_SIZE, '\0');
+    put16(&entry, 0, TAG_ORIENTATION, big);
+    put16(&entry, 2, TYPE_SHORT, big);
+    put32(&entry, 4, 1, big);
+    put16(&entry, 8, quint16(orientation), big);
+
+    QByteArray ifd(2, '\0');
+    put16(&ifd, 0, quint16(count + 1), big);
+    bool inserted = false;
+    for (int i = 0; i < count; i++) {
+        const int offset = int(exif.ifd0) + 2 + i * IFD_ENTRY_SIZE;
+        //标签按升序排列
+        if (!inserted && get16(tiff, offset, big) > TAG_ORIENTATION) {
+            ifd.append(entry);
+            inserted = true;
+        }
+        ifd.append(tiff.mid(offset, IFD_ENTRY_SIZE));
+    }
+    if (!inserted) {
+        ifd.append(entry);
+    }
+    ifd.append(tiff.mid(tableEnd, 4));
+    tiff.append(ifd);
+    put32(&tiff, 4, quint32(newIfd), big);
+    return tiff;
+}
+}  // namespace
+
+int ExifOrientation::rotated(int orientation, bool clockwise)
+{
+    if (!validOrientation(orientation)) {
+        orientation = 1;
+    }
+    return clockwise ? ROTATE_CW[orientation] : ROTATE_CCW[orientation];
+}
+
+QImage ExifOrientation::apply(const QImage &image, int orientation)
+{
+    QTransform rotation;
+    switch (orientation) {
+    case 2:
+        return image.mirrored(true, false);
+    case 3:
+        return image.mirrored(true, true);
+    case 4:
+        return image.mirrored(false, true);
+    case 5:
+        return image.mirrored(true, false).transformed(rotation.rotate(270));
+    case 6:
+        return image.transformed(rotation.rotate(90));
+    case 7:
+        return image.mirrored(true, false).transformed(rotation.rotate(90));
+    case 8:
+        return image.transformed(rotation.rotate(270));
+    default:
+        return image;
+    }
+}
+
+int ExifOrientation::toLibRawFlip(int orientation)
+{
+    return validOrientation(orientation) ? LIBRAW_FLIP[orientation] : 0;
+}
+
+int ExifOrientation::fromLibRawFlip(int flip)
+{
+    return flip >= 0 && flip < 8 ? FROM_LIBRAW_FLIP[flip] : 1;
+}
+
+int ExifOrientation::readJpeg(const QString &path, IoStats *stats)
+{
+    QFile file(path);
+    JpegExif exif;
+    if (!file.open(QIODevice::ReadOnly) || !scanJpeg(file, &exif, stats)) {
+        return 0;
+    }
+    return exif.orientation;
+}
+
+bool ExifOrientation::writeJpeg(const QString &path, int orientation, IoStats *stats, QString *errorMsg)
+{
+    IoStats local;
+    if (!stats) {
+        stats = &local;
+    }
+    auto fail = [errorMsg](const QString & error) {
+        if (errorMsg) {
+            *errorMsg = error;
+        }
+        return false;
+    };
+    if (!validOrientation(orientation)) {
+        return fail("invalid orientation");
+    }
+
+    QFile file(path);
+    JpegExif exif;
+    if (!file.open(QIODevice::ReadOnly) || !scanJpeg(file, &exif, stats)) {
+        return fail("not a JPEG file");
+    }
+    if (exif.valueOffset >= 0) {
+        //原地改写，只写两个字节
+        file.close();
+        if (!file.open(QIODevice::ReadWrite) || !file.seek(exif.valueOffset)) {
+            return fail(file.errorString());
+        }
+        QByteArray value(2, '\0');
+        put16(&value, 0, quint16(orientation), exif.bigEndian);
+        if (file.write(value) != value.size() || !file.flush()) {
+            return fail(file.errorString());
+        }
+        stats->bytesWritten += value.size();
+        return true;
+    }
+
+    QByteArray app1;
+    qint64 copyFrom = exif.insertAt;
+    qint64 resumeAt = exif.insertAt;
+    if (exif.app1Start >= 0) {
+        const QByteArray tiff = relocateIfd0(exif, orientation);
+        if (tiff.isEmpty() || 2 + EXIF_HEADER_SIZE + tiff.size() > MAX_SEGMENT_LENGTH) {
+            return fail("cannot extend EXIF segment");
+        }
+        app1 = segment(tiff);
+        copyFrom = exif.app1Start;
+        resumeAt = exif.app1Start + 2 + exif.app1Length;
+    } else {
+        app1 = segment(minimalTiff(orientation));
+    }
+
+    //图像数据原样复制，写完后替换原文件
+    stats->rewritten = true;
+    QSaveFile target(path);
+    if (!target.open(QIODevice::WriteOnly)) {
+        return fail(target.errorString());
+    }
+    if (!copyRange(file, 0, copyFrom, target, stats) || target.write(app1) != app1.size()) {
+        target.cancelWriting();
+        return fail("write failed");
+    }
+    stats->bytesWritten += app1.size();
+    if (!copyRange(file, resumeAt, file.size(), target, stats) || !target.commit()) {
+        target.cancelWriting();
+        return fail(target.errorString());
+    }
+    return true;
+}
+
+QString ExifOrientation::sidecarPath(const QString &path)
+{
+    const QFileInfo info(path);
+    return info.dir().filePath(info.completeBaseName() + ".xmp");
+}
+
+int ExifOrientation::readSidecar(const QString &path)
+{
+    QFile file(sidecarPath(path));
+    if (!file.open(QIODevice::ReadOnly) || file.size() > MAX_SIDECAR_SIZE) {
+        return 0;
+    }
+    const QString xmp = QString::fromUtf8(file.readAll());
+    static const QRegularExpression attribute("tiff:Orientation\\s*=\\s*[\"'](\\d)[\"']");
+    static const QRegularExpression element("<tiff:Orientation>\\s*(\\d)\\s*</tiff:Orientation>");
+    QRegularExpressionMatch match = attribute.match(xmp);
+    if (!match.hasMatch()) {
+        match = element.match(xmp);
+    }
+    const int orientation = match.hasMatch() ? match.captured(1).toInt() : 0;
+    return validOrientation(orientation) ? orientation : 0;
+}
+
+bool ExifOrientation::writeSidecar(const QString &path, int orientation, IoStats *stats, QString *errorMsg)
+{
+    auto fail = [errorMsg](const QString & error) {
+        if (errorMsg) {
+            *errorMsg = error;
+        }
+        return false;
+    };
+    if (!validOrientation(orientation)) {
+        return fail("invalid orientation");
+    }
+
+    const QString sidecar = sidecarPath(path);
+    QString xmp;
+    QFile existing(sidecar);
+    if (existing.exists()) {
+        if (!existing.open(QIODevice::ReadOnly) || existing.size() > MAX_SIDECAR_SIZE) {
+            return fail("cannot read " + sidecar);
+        }
+        xmp = QString::fromUtf8(existing.readAll());
+        if (stats) {
+            stats->bytesRead += existing.size();
+        }
+        const QString value = QString::number(orientation);
+        static const QRegularExpression attribute("(tiff:Orientation\\s*=\\s*[\"'])\\d([\"'])");
+        static const QRegularExpression element("(<tiff:Orientation>\\s*)\\d(\\s*</tiff:Orientation>)");
+        if (xmp.contains(attribute)) {
+            xmp.replace(attribute, "\\1" + value + "\\2");
+        } else if (xmp.contains(element)) {
+            xmp.replace(element, "\\1" + value + "\\2");
+        } else {
+            //其它软件写的附属文件，在第一个Description上加属性
+            const int description = xmp.indexOf(DESCRIPTION_TAG);
+            if (description < 0) {
+                return fail("unsupported sidecar " + sidecar);
+            }
+            QString added = QString(" tiff:Orientation=\"%1\"").arg(orientation);
+            if (!xmp.contains("xmlns:tiff=")) {
+                added.prepend(" xmlns:tiff=\"http://ns.adobe.com/tiff/1.0/\"");
+            }
+            xmp.insert(description + DESCRIPTION_TAG.size(), added);
+        }
+    } else {
+        xmp = XMP_TEMPLATE.arg(orientation);
+    }
+
+    QSaveFile target(sidecar);
+    const QByteArray data = xmp.toUtf8();
+    if (!target.open(QIODevice::WriteOnly) || target.write(data) != data.size() || !target.commit()) {
+        return fail(target.errorString());
+    }
+    if (stats) {
+        stats->bytesWritten += data.size();
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef EXIFORIENTATION_H
+#define EXIFORIENTATION_H
+
+#include <QString>
+#include <QImage>
+
+//EXIF方向（1-8）的读写，看图程序和xraw插件共用
+//JPEG只改写APP1中的方向标签，不重新编码；插件不能写入的RAW把方向保存在XMP附属文件中
+class ExifOrientation
+{
+public:
+    //读写过程中的IO统计
+    struct IoStats {
+        qint64 bytesRead = 0;
+        qint64 bytesWritten = 0;
+        //是否重写了整个文件（插入或扩展了APP1）
+        bool rewritten = false;
+    };
+
+    //显示效果再顺时针或逆时针旋转90度后的方向
+    static int rotated(int orientation, bool clockwise);
+    //按方向把存储的图像变换为显示效果
+    static QImage apply(const QImage &image, int orientation);
+
+    //LibRaw的flip（dcraw编码）和EXIF方向互相转换
+    static int toLibRawFlip(int orientation);
+    static int fromLibRawFlip(int flip);
+
+    //JPEG的方向，没有EXIF或方向标签时返回1，不是JPEG返回0
+    static int readJpeg(const QString &path, IoStats *stats = nullptr);
+    //有方向标签时原地改写两个字节；没有时插入或扩展APP1，图像数据原样复制
+    static bool writeJpeg(const QString &path, int orientation, IoStats *stats = nullptr,
+                          QString *errorMsg = nullptr);
+
+    //RAW的附属文件：同目录同名的.xmp（和Lightroom等软件一致）
+    static QString sidecarPath(const QString &path);
+    //附属文件中的tiff:Orientation，没有时返回0
+    static int readSidecar(const QString &path);
+    //已有附属文件时只改写方向属性，保留其它内容
+    static bool writeSidecar(const QString &path, int orientation, IoStats *stats = nullptr,
+                             QString *errorMsg = nullptr);
+};
+
+#endif // EXIFORIENTATION_H
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FILEIDENTITY_H
+#define FILEIDENTITY_H
+
+#include <QString>
+#include <QFile>
+#include <QHash>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+//文件身份：设备号+inode+修改时间+大小，用作各种缓存的key
+//文件被替换或修改后key随之变化，缓存自然失效
+struct FileIdentity {
+    quint64 dev = 0;
+    quint64 ino = 0;
+    qint64 mtimeNs = 0;
+    qint64 size = 0;
+    bool regularFile = false;
+
+    bool isValid() const
+    {
+        return ino != 0;
+    }
+
+    static FileIdentity fromStat(const struct stat &st)
+    {
+        FileIdentity id;
+        id.dev = quint64(st.st_dev);
+        id.ino = quint64(st.st_ino);
+        id.mtimeNs = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        id.size = qint64(st.st_size);
+        id.regularFile = S_ISREG(st.st_mode);
+        return id;
+    }
+
+    static FileIdentity fromPath(const QString &path)
+    {
+        struct stat st;
+        if (::stat(QFile::encodeName(path).constData(), &st) != 0) {
+            return FileIdentity();
+        }
+        return fromStat(st);
+    }
+
+    bool operator==(const FileIdentity &other) const
+    {
+        return dev == other.dev && ino == other.ino
+               && mtimeNs == other.mtimeNs && size == other.size;
+    }
+    bool operator!=(const FileIdentity &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+inline uint qHash(const FileIdentity &id, uint seed = 0)
+{
+    return qHash(id.dev, seed) ^ qHash(id.ino, seed) ^ qHash(id.mtimeNs, seed);
+}
+
+#endif // FILEIDENTITY_H
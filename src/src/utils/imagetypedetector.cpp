@@ -0,0 +1,468 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "imagetypedetector.h"
+
+#include <QMimeDatabase>
+#include <QMimeType>
+#include <QIODevice>
+#include <QVector>
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+//缓存上限，超出后整体清空
+const int MAX_CACHE_SIZE = 50000;
+
+struct MagicEntry {
+    int offset;
+    int length;
+    const char *bytes;
+    ImageTypeDetector::ImageType type;
+};
+
+const MagicEntry MAGIC_TABLE[] = {
+    {0, 3, "\xFF\xD8\xFF", ImageTypeDetector::TypeJpeg},
+    {0, 8, "\x89PNG\r\n\x1a\n", ImageTypeDetector::TypePng},
+    {0, 8, "\x8aMNG\r\n\x1a\n", ImageTypeDetector::TypeMng},
+    {0, 6, "GIF87a", ImageTypeDetector::TypeGif},
+    {0, 6, "GIF89a", ImageTypeDetector::TypeGif},
+    {0, 2, "BM", ImageTypeDetector::TypeBmp},
+    {0, 4, "II*\0", ImageTypeDetector::TypeTiff},
+    {0, 4, "MM\0*", ImageTypeDetector::TypeTiff},
+    {0, 4, "IIRO", ImageTypeDetector::TypeRaw},           // Olympus ORF
+    {0, 4, "IIRS", ImageTypeDetector::TypeRaw},           // Olympus ORF
+    {0, 4, "MMOR", ImageTypeDetector::TypeRaw},           // Olympus ORF
+    {0, 4, "IIU\0", ImageTypeDetector::TypeRaw},          // Panasonic RW2
+    {0, 15, "FUJIFILMCCD-RAW", ImageTypeDetector::TypeRaw}, // Fuji RAF
+    {0, 4, "\0MRM", ImageTypeDetector::TypeRaw},          // Minolta MRW
+    {0, 4, "FOVb", ImageTypeDetector::TypeRaw},           // Sigma X3F
+    {6, 8, "HEAPCCDR", ImageTypeDetector::TypeRaw},       // Canon CRW
+    {4, 8, "ftypcrx ", ImageTypeDetector::TypeRaw},       // Canon CR3
+    {4, 8, "ftypheic", ImageTypeDetector::TypeHeif},
+    {4, 8, "ftypheix", ImageTypeDetector::TypeHeif},
+    {4, 8, "ftypmif1", ImageTypeDetector::TypeHeif},
+    {4, 8, "ftypavif", ImageTypeDetector::TypeHeif},
+    {0, 4, "\0\0\1\0", ImageTypeDetector::TypeIco},
+    {0, 4, "\0\0\2\0", ImageTypeDetector::TypeIco},
+    {0, 4, "DDS ", ImageTypeDetector::TypeDds},
+    {0, 4, "8BPS", ImageTypeDetector::TypePsd},
+    {0, 4, "icns", ImageTypeDetector::TypeIcns},
+    {0, 12, "\0\0\0\x0cjP  \r\n\x87\n", ImageTypeDetector::TypeJp2},
+    {0, 4, "\xFF\x4F\xFF\x51", ImageTypeDetector::TypeJp2},
+    {0, 9, "/* XPM */", ImageTypeDetector::TypeXpm},
+    {0, 4, "<svg", ImageTypeDetector::TypeSvg},
+};
+
+QHash<QString, ImageTypeDetector::ImageType> buildSuffixTable()
+{
+    QHash<QString, ImageTypeDetector::ImageType> table;
+    const struct {
+        const char *suffixes;
+        ImageTypeDetector::ImageType type;
+    } groups[] = {
+        {"jpg jpeg jpe jfif", ImageTypeDetector::TypeJpeg},
+        {"png", ImageTypeDetector::TypePng},
+        {"gif", ImageTypeDetector::TypeGif},
+        {"bmp dib", ImageTypeDetector::TypeBmp},
+        {"tif tiff", ImageTypeDetector::TypeTiff},
+        {"webp", ImageTypeDetector::TypeWebp},
+        {"ico cur", ImageTypeDetector::TypeIco},
+        {"svg svgz", ImageTypeDetector::TypeSvg},
+        {"mng", ImageTypeDetector::TypeMng},
+        {"dds", ImageTypeDetector::TypeDds},
+        {"tga", ImageTypeDetector::TypeTga},
+        {"wbmp", ImageTypeDetector::TypeWbmp},
+        {"pbm pgm ppm pnm pam", ImageTypeDetector::TypePnm},
+        {"xpm", ImageTypeDetector::TypeXpm},
+        {"xbm", ImageTypeDetector::TypeXbm},
+        {"psd", ImageTypeDetector::TypePsd},
+        {"icns", ImageTypeDetector::TypeIcns},
+        {"heic heif avif", ImageTypeDetector::TypeHeif},
+        {"jp2 j2k jpf jpx", ImageTypeDetector::TypeJp2},
+        {"cr2 crw cr3 nef nrw arw srf sr2 dng orf rw2 pef raf mrw dcr kdc 3fr erf mos srw x3f raw rwl mef iiq", ImageTypeDetector::TypeRaw},
+        {"pcx ras sgi rgb hdr exr ktx jxr wdp xcf", ImageTypeDetector::TypeOther},
+    };
+    for (const auto &group : groups) {
+        const QStringList suffixes = QString::fromLatin1(group.suffixes).split(' ');
+        for (const QString &suffix : suffixes) {
+            table.insert(suffix, group.type);
+        }
+    }
+    return table;
+}
+
+bool matchAt(const char *data, int size, int offset, const char *bytes, int length)
+{
+    return size >= offset + length && memcmp(data + offset, bytes, size_t(length)) == 0;
+}
+
+//TIFF标签
+const quint16 TAG_COMPRESSION = 259;
+const quint16 TAG_PHOTOMETRIC = 262;
+const quint16 TAG_SUBIFDS = 330;
+const quint16 TAG_DNG_VERSION = 50706;
+const quint16 PHOTOMETRIC_CFA = 32803;
+const quint16 PHOTOMETRIC_LINEAR_RAW = 34892;
+//相机厂商专用的压缩方式，普通TIFF不会使用
+const quint16 RAW_COMPRESSIONS[] = {
+    32767,  // Sony ARW
+    32769,  // Epson ERF
+    32770,  // Samsung SRW
+    34713,  // Nikon NEF
+    65000,  // Kodak DCR
+    65535   // Pentax PEF
+};
+//防止损坏文件中的循环IFD
+const int MAX_IFDS = 16;
+const int MAX_IFD_ENTRIES = 1024;
+const int MAX_SUB_IFDS = 8;
+//顺序设备只能peek
+const int PEEK_SIZE = 65536;
+
+class TiffProbe
+{
+public:
+    explicit TiffProbe(QIODevice *device)
+        : m_device(device)
+        , m_sequential(device->isSequential())
+    {
+        if (m_sequential) {
+            m_window = device->peek(PEEK_SIZE);
+        } else {
+            m_start = device->pos();
+        }
+    }
+
+    ~TiffProbe()
+    {
+        if (!m_sequential) {
+            m_device->seek(m_start);
+        }
+    }
+
+    bool isRaw()
+    {
+        char header[10];
+        if (!read(0, header, 8)) {
+            return false;
+        }
+        if (matchAt(header, 8, 0, "II", 2)) {
+            m_littleEndian = true;
+        } else if (matchAt(header, 8, 0, "MM", 2)) {
+            m_littleEndian = false;
+        } else {
+            return false;
+        }
+        if (u16(header + 2) != 42) {
+            return false;
+        }
+        //CR2在文件头第8字节写有"CR"
+        if (read(8, header + 8, 2) && header[8] == 'C' && header[9] == 'R') {
+            return true;
+        }
+        int budget = MAX_IFDS;
+        quint32 offset = u32(header + 4);
+        while (offset != 0 && budget > 0) {
+            quint32 next = 0;
+            if (scanIfd(offset, true, &budget, &next)) {
+                return true;
+            }
+            offset = next;
+        }
+        return false;
+    }
+
+private:
+    bool read(qint64 offset, char *buffer, int length)
+    {
+        if (m_sequential) {
+            if (offset + length > m_window.size()) {
+                return false;
+            }
+            memcpy(buffer, m_window.constData() + offset, size_t(length));
+            return true;
+        }
+        return m_device->seek(m_start + offset) && m_device->read(buffer, length) == length;
+    }
+
+    quint16 u16(const char *data) const
+    {
+        const uchar *p = reinterpret_cast<const uchar *>(data);
+        return m_littleEndian ? quint16(p[0] | (p[1] << 8)) : quint16((p[0] << 8) | p[1]);
+    }
+
+    quint32 u32(const char *data) const
+    {
+        const uchar *p = reinterpret_cast<const uchar *>(data);
+        return m_littleEndian ? (quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24))
+               : ((quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]));
+    }
+
+    //SHORT或LONG类型的单个值
+    quint32 value(const char *entry) const
+    {
+        return u16(entry + 2) == 3 ? u16(entry + 8) : u32(entry + 8);
+    }
+
+    bool scanIfd(quint32 offset, bool followSubIfds, int *budget, quint32 *next)
+    {
+        (*budget)--;
+        char countBytes[2];
+        if (!read(offset, countBytes, 2)) {
+            return false;
+        }
+        const int count = u16(countBytes);
+        if (count == 0 || count > MAX_IFD_ENTRIES) {
+            return false;
+        }
+        QByteArray entries(count * 12 + 4, Qt::Uninitialized);
+        if (!read(offset + 2, entries.data(), entries.size())) {
+            //最后一个IFD之后可能没有下一个IFD的偏移
+            entries.resize(count * 12);
+            if (!read(offset + 2, entries.data(), entries.size())) {
+                return false;
+            }
+        } else {
+            *next = u32(entries.constData() + count * 12);
+        }
+
+        QVector<quint32> subIfds;
+        for (int i = 0; i < count; i++) {
+            const char *entry = entries.constData() + i * 12;
+            const quint16 tag = u16(entry);
+            if (tag == TAG_DNG_VERSION) {
+                return true;
+            }
+            if (tag == TAG_PHOTOMETRIC) {
+                const quint32 photometric = value(entry);
+                if (photometric == PHOTOMETRIC_CFA || photometric == PHOTOMETRIC_LINEAR_RAW) {
+                    return true;
+                }
+            } else if (tag == TAG_COMPRESSION) {
+                const quint32 compression = value(entry);
+                for (quint16 raw : RAW_COMPRESSIONS) {
+                    if (compression == raw) {
+                        return true;
+                    }
+                }
+            } else if (tag == TAG_SUBIFDS && followSubIfds) {
+                const quint32 n = u32(entry + 4);
+                if (n == 1) {
+                    subIfds << u32(entry + 8);
+                } else if (n > 1 && n <= quint32(MAX_SUB_IFDS)) {
+                    char offsets[MAX_SUB_IFDS * 4];
+                    if (read(u32(entry + 8), offsets, int(n * 4))) {
+                        for (quint32 k = 0; k < n; k++) {
+                            subIfds << u32(offsets + k * 4);
+                        }
+                    }
+                }
+            }
+        }
+        //NEF、ARW等的IFD0是缩略图，原始数据在SubIFD中
+        for (quint32 sub : subIfds) {
+            if (*budget <= 0) {
+                break;
+            }
+            quint32 ignored = 0;
+            if (scanIfd(sub, false, budget, &ignored)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    QIODevice *m_device;
+    bool m_sequential;
+    qint64 m_start = 0;
+    QByteArray m_window;
+    bool m_littleEndian = true;
+};
+
+QString suffixOf(const QString &path)
+{
+    const int dot = path.lastIndexOf('.');
+    if (dot < 0 || dot < path.lastIndexOf('/')) {
+        return QString();
+    }
+    return path.mid(dot + 1).toLower();
+}
+}  // namespace
+
+ImageTypeDetector::HeaderReader ImageTypeDetector::s_headerReader = nullptr;
+
+ImageTypeDetector *ImageTypeDetector::instance()
+{
+    static ImageTypeDetector detector;
+    return &detector;
+}
+
+ImageTypeDetector::ImageTypeDetector()
+{
+}
+
+ImageTypeDetector::ImageType ImageTypeDetector::detect(const QString &path)
+{
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return TypeNotImage;
+    }
+    const FileIdentity id = FileIdentity::fromStat(st);
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_cache.constFind(id);
+        if (it != m_cache.constEnd()) {
+            return it.value();
+        }
+    }
+
+    //后缀能判断就不读文件内容
+    ImageType type = typeFromSuffix(suffixOf(path));
+    if (type == TypeUnknown) {
+        char header[HEADER_SIZE];
+        const int size = s_headerReader ? s_headerReader(path, header, HEADER_SIZE)
+                                        : readHeader(path, header, HEADER_SIZE);
+        type = typeFromHeader(header, size);
+        //没有后缀的NEF、DNG等文件头和普通TIFF一样
+        if (type == TypeTiff && isRawTiff(path)) {
+            type = TypeRaw;
+        }
+        if (type == TypeUnknown) {
+            type = typeFromMime(header, size);
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_cache.size() >= MAX_CACHE_SIZE) {
+        m_cache.clear();
+        m_pathCache.clear();
+    }
+    m_cache.insert(id, type);
+    m_pathCache.insert(path, type);
+    return type;
+}
+
+ImageTypeDetector::ImageType ImageTypeDetector::quickCheck(const QString &path)
+{
+    const ImageType type = typeFromSuffix(suffixOf(path));
+    if (type != TypeUnknown) {
+        return type;
+    }
+    QMutexLocker locker(&m_mutex);
+    return m_pathCache.value(path, TypeUnknown);
+}
+
+bool ImageTypeDetector::isImage(const QString &path)
+{
+    return isImageType(detect(path));
+}
+
+void ImageTypeDetector::clearCache()
+{
+    QMutexLocker locker(&m_mutex);
+    m_cache.clear();
+    m_pathCache.clear();
+}
+
+void ImageTypeDetector::setHeaderReader(HeaderReader reader)
+{
+    s_headerReader = reader;
+}
+
+int ImageTypeDetector::readHeader(const QString &path, char *buffer, int size)
+{
+    const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    const ssize_t n = ::pread(fd, buffer, size_t(size), 0);
+    ::close(fd);
+    return n > 0 ? int(n) : 0;
+}
+
+bool ImageTypeDetector::isImageType(ImageType type)
+{
+    return type != TypeUnknown && type != TypeNotImage;
+}
+
+ImageTypeDetector::ImageType ImageTypeDetector::typeFromSuffix(const QString &suffix)
+{
+    static const QHash<QString, ImageType> table = buildSuffixTable();
+    return table.value(suffix.toLower(), TypeUnknown);
+}
+
+ImageTypeDetector::ImageType ImageTypeDetector::typeFromHeader(const char *data, int size)
+{
+    if (!data || size <= 0) {
+        return TypeUnknown;
+    }
+    for (const MagicEntry &magic : MAGIC_TABLE) {
+        if (matchAt(data, size, magic.offset, magic.bytes, magic.length)) {
+            return magic.type;
+        }
+    }
+    //RIFF容器需要同时匹配两段
+    if (matchAt(data, size, 0, "RIFF", 4) && matchAt(data, size, 8, "WEBP", 4)) {
+        return TypeWebp;
+    }
+    //P1~P7后跟空白字符
+    if (size >= 3 && data[0] == 'P' && data[1] >= '1' && data[1] <= '7'
+            && (data[2] == '\n' || data[2] == '\r' || data[2] == ' ' || data[2] == '\t')) {
+        return TypePnm;
+    }
+    //xml开头的svg
+    if (matchAt(data, size, 0, "<?xml", 5)) {
+        const QByteArray text = QByteArray::fromRawData(data, size);
+        return text.contains("<svg") ? TypeSvg : TypeUnknown;
+    }
+    return TypeUnknown;
+}
+
+ImageTypeDetector::ImageType ImageTypeDetector::typeFromMime(const char *data, int size)
+{
+    //少见格式交给shared-mime-info，只用已经读到的文件头，不再读文件
+    if (size <= 0) {
+        return TypeNotImage;
+    }
+    QMimeDatabase db;
+    const QMimeType mt = db.mimeTypeForData(QByteArray::fromRawData(data, size));
+    if (mt.name().startsWith("image/") || mt.name().startsWith("video/x-mng")) {
+        return TypeOther;
+    }
+    return TypeNotImage;
+}
+
+bool ImageTypeDetector::isRawTiff(QIODevice *device)
+{
+    if (!device || !device->isReadable()) {
+        return false;
+    }
+    TiffProbe probe(device);
+    return probe.isRaw();
+}
+
+bool ImageTypeDetector::isRawTiff(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return isRawTiff(&file);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGETYPEDETECTOR_H
+#define IMAGETYPEDETECTOR_H
+
+#include <QString>
+#include <QHash>
+#include <QMutex>
+
+#include "fileidentity.h"
+
+class QIODevice;
+
+//图片类型检测，看图程序和xraw插件共用
+//先按后缀判断，后缀无法判断时只用一次pread读取文件头，按魔数表匹配
+//结果按(设备号, inode, 修改时间)缓存
+class ImageTypeDetector
+{
+public:
+    enum ImageType {
+        TypeUnknown = 0,
+        TypeNotImage,
+        TypeJpeg,
+        TypePng,
+        TypeGif,
+        TypeBmp,
+        TypeTiff,
+        TypeWebp,
+        TypeIco,
+        TypeSvg,
+        TypeMng,
+        TypeDds,
+        TypeTga,
+        TypeWbmp,
+        TypePnm,
+        TypeXpm,
+        TypeXbm,
+        TypePsd,
+        TypeIcns,
+        TypeHeif,
+        TypeJp2,
+        TypeRaw,
+        TypeOther
+    };
+
+    //一次读取的文件头大小
+    static const int HEADER_SIZE = 256;
+
+    //读取文件头的函数，返回读到的字节数，测试中用来模拟慢速文件系统
+    typedef int (*HeaderReader)(const QString &path, char *buffer, int size);
+
+    static ImageTypeDetector *instance();
+
+    //检测文件类型，带缓存
+    ImageType detect(const QString &path);
+    bool isImage(const QString &path);
+
+    //不做任何IO，只根据后缀和之前的检测结果判断，无法判断时返回TypeUnknown
+    ImageType quickCheck(const QString &path);
+
+    void clearCache();
+
+    static bool isImageType(ImageType type);
+    static ImageType typeFromSuffix(const QString &suffix);
+    static ImageType typeFromHeader(const char *data, int size);
+
+    //TIFF结构的RAW（DNG、CR2、NEF、ARW等）和普通TIFF的区分：
+    //检查IFD0、后续IFD及SubIFD中的DNGVersion、CFA/LinearRaw、相机专用压缩方式
+    //不改变device的读取位置，顺序设备只使用peek到的数据
+    static bool isRawTiff(QIODevice *device);
+    static bool isRawTiff(const QString &path);
+
+    static void setHeaderReader(HeaderReader reader);
+
+private:
+    ImageTypeDetector();
+
+    static ImageType typeFromMime(const char *data, int size);
+    static int readHeader(const QString &path, char *buffer, int size);
+
+private:
+    QMutex m_mutex;
+    QHash<FileIdentity, ImageType> m_cache;
+    //按路径记录的最近结果，供quickCheck使用
+    QHash<QString, ImageType> m_pathCache;
+    static HeaderReader s_headerReader;
+};
+
+#endif // IMAGETYPEDETECTOR_H
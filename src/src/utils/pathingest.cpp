@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "pathingest.h"
+
+#include <QtConcurrent>
+#include <QCollator>
+#include <QCollatorSortKey>
+#include <QRegularExpression>
+#include <QDir>
+#include <QFile>
+#include <QSet>
+#include <QPair>
+
+#include <algorithm>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+namespace {
+//少量路径直接在当前线程处理，避免线程调度开销
+const int PARALLEL_THRESHOLD = 256;
+const int CHUNK_SIZE = 1024;
+
+enum EntryType {
+    EntryMissing,
+    EntryFile,
+    EntryDir
+};
+
+struct Entry {
+    QString path;
+    EntryType type;
+    quint64 dev;
+    quint64 ino;
+};
+
+typedef QVector<Entry> EntryChunk;
+
+struct KeyedPath {
+    KeyedPath(const QString &p, const QCollatorSortKey &k)
+        : path(p), key(k) {}
+    QString path;
+    QCollatorSortKey key;
+};
+
+typedef std::vector<KeyedPath> KeyedChunk;
+
+QCollator naturalCollator()
+{
+    QCollator collator;
+    collator.setNumericMode(true);
+    collator.setCaseSensitivity(Qt::CaseInsensitive);
+    return collator;
+}
+
+QList<QStringList> splitChunks(const QStringList &paths)
+{
+    QList<QStringList> chunks;
+    for (int i = 0; i < paths.size(); i += CHUNK_SIZE) {
+        chunks << paths.mid(i, CHUNK_SIZE);
+    }
+    return chunks;
+}
+
+struct StatChunk {
+    typedef EntryChunk result_type;
+
+    explicit StatChunk(bool r) : resolve(r) {}
+
+    EntryChunk operator()(const QStringList &chunk) const
+    {
+        EntryChunk entries;
+        entries.reserve(chunk.size());
+        for (const QString &path : chunk) {
+            Entry entry;
+            entry.path = resolve ? PathIngest::resolveArgument(path) : path;
+            entry.type = EntryMissing;
+            entry.dev = 0;
+            entry.ino = 0;
+            struct stat st;
+            if (!entry.path.isEmpty() && ::stat(QFile::encodeName(entry.path).constData(), &st) == 0) {
+                if (S_ISDIR(st.st_mode)) {
+                    entry.type = EntryDir;
+                } else if (S_ISREG(st.st_mode)) {
+                    entry.type = EntryFile;
+                }
+                entry.dev = quint64(st.st_dev);
+                entry.ino = quint64(st.st_ino);
+            }
+            entries.append(entry);
+        }
+        return entries;
+    }
+
+    bool resolve;
+};
+
+struct KeyChunk {
+    typedef KeyedChunk result_type;
+
+    KeyedChunk operator()(const QStringList &chunk) const
+    {
+        //QCollator不是线程安全的，每个分块单独创建
+        const QCollator collator = naturalCollator();
+        KeyedChunk keyed;
+        keyed.reserve(size_t(chunk.size()));
+        for (const QString &path : chunk) {
+            keyed.push_back(KeyedPath(path, collator.sortKey(path)));
+        }
+        return keyed;
+    }
+};
+
+bool keyLessThan(const KeyedPath &left, const KeyedPath &right)
+{
+    return left.key.compare(right.key) < 0;
+}
+}  // namespace
+
+QString PathIngest::resolveArgument(const QString &argument)
+{
+    // Just check if the path is an existing file.
+    if (QFile::exists(argument)) {
+        return QDir::current().absoluteFilePath(argument);
+    }
+
+    static const QRegularExpression lineColumnRe(QStringLiteral(":(\\d+)(?::(\\d+))?:?$"));
+    QString path = argument;
+    const QRegularExpressionMatch match = lineColumnRe.match(path);
+    if (match.hasMatch()) {
+        // cut away line/column specification from the path.
+        path.chop(match.capturedLength());
+    }
+
+    // make relative paths absolute using the current working directory
+    // prefer local file, if in doubt!
+    QUrl url = QUrl::fromUserInput(path, QDir::currentPath(), QUrl::AssumeLocalFile);
+
+    // in some cases, this will fail, e.g.
+    // assume a local file and just convert it to an url.
+    if (!url.isValid()) {
+        return QDir::current().absoluteFilePath(path);
+    }
+    return url.toLocalFile();
+}
+
+QString PathIngest::localPath(const QUrl &url)
+{
+    QString path = url.toLocalFile();
+    if (path.isEmpty()) {
+        path = url.path();
+    }
+    return path;
+}
+
+QStringList PathIngest::ingest(const QStringList &paths, QStringList *dirs, bool resolve)
+{
+    QList<EntryChunk> results;
+    if (paths.size() < PARALLEL_THRESHOLD) {
+        results << StatChunk(resolve)(paths);
+    } else {
+        results = QtConcurrent::blockingMapped<QList<EntryChunk> >(splitChunks(paths), StatChunk(resolve));
+    }
+
+    //同一个文件可能通过不同路径（软链接、相对路径）多次传入，按设备号和inode去重
+    QSet<QPair<quint64, quint64> > seen;
+    QStringList files;
+    QStringList folders;
+    for (const EntryChunk &chunk : results) {
+        for (const Entry &entry : chunk) {
+            if (entry.type == EntryMissing) {
+                continue;
+            }
+            const QPair<quint64, quint64> id(entry.dev, entry.ino);
+            if (seen.contains(id)) {
+                continue;
+            }
+            seen.insert(id);
+            if (entry.type == EntryDir) {
+                folders << entry.path;
+            } else {
+                files << entry.path;
+            }
+        }
+    }
+
+    sortNatural(files);
+    if (dirs) {
+        sortNatural(folders);
+        *dirs = folders;
+    }
+    return files;
+}
+
+void PathIngest::sortNatural(QStringList &paths)
+{
+    if (paths.size() < 2) {
+        return;
+    }
+
+    //排序键只计算一次，排序时只做键比较
+    KeyedChunk keyed;
+    if (paths.size() < PARALLEL_THRESHOLD) {
+        keyed = KeyChunk()(paths);
+    } else {
+        const QList<KeyedChunk> chunks = QtConcurrent::blockingMapped<QList<KeyedChunk> >(splitChunks(paths), KeyChunk());
+        keyed.reserve(size_t(paths.size()));
+        for (const KeyedChunk &chunk : chunks) {
+            keyed.insert(keyed.end(), chunk.begin(), chunk.end());
+        }
+    }
+
+    std::stable_sort(keyed.begin(), keyed.end(), keyLessThan);
+
+    paths.clear();
+    paths.reserve(int(keyed.size()));
+    for (const KeyedPath &item : keyed) {
+        paths << item.path;
+    }
+}
+
+int PathIngest::compareNatural(const QString &a, const QString &b)
+{
+    static const QCollator collator = naturalCollator();
+    return collator.compare(a, b);
+}
+
+QCollatorSortKey PathIngest::naturalSortKey(const QString &path)
+{
+    static const QCollator collator = naturalCollator();
+    return collator.sortKey(path);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PATHINGEST_H
+#define PATHINGEST_H
+
+#include <QStringList>
+#include <QUrl>
+#include <QCollatorSortKey>
+
+//批量导入路径：命令行参数、拖拽的url
+//并行解析和stat，按inode去重，使用预先计算的排序键做自然排序
+class PathIngest
+{
+public:
+    //命令行参数转换为本地绝对路径，支持去掉"path:line:column"后缀
+    static QString resolveArgument(const QString &argument);
+    //url转换为本地路径
+    static QString localPath(const QUrl &url);
+
+    //返回去重并自然排序后的文件列表，目录通过dirs返回
+    //resolve为true时每一项先按命令行参数解析
+    static QStringList ingest(const QStringList &paths, QStringList *dirs = nullptr,
+                              bool resolve = false);
+
+    //自然排序（img2 < img10）
+    static void sortNatural(QStringList &paths);
+    //单次比较，与sortNatural规则一致
+    static int compareNatural(const QString &a, const QString &b);
+    //排序键，需要反复比较的列表保存它，比较时不再经过ICU；和compareNatural一样只在界面线程使用
+    static QCollatorSortKey naturalSortKey(const QString &path);
+};
+
+#endif // PATHINGEST_H
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "startupprofiler.h"
+
+#include <QCoreApplication>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QMap>
+#include <QFile>
+#include <QTimer>
+#include <QWidget>
+#include <QEvent>
+
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+
+namespace {
+const char *PROFILE_ARG = "--startup-profile";
+const char *PROFILE_ARG_PREFIX = "--startup-profile=";
+const char *EXIT_AFTER_FIRST_FRAME_ARG = "--exit-after-first-frame";
+const int LAUNCH_TIMEOUT_MS = 60000;
+
+double median(QVector<double> values)
+{
+    if (values.isEmpty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values.at(values.size() / 2);
+}
+}  // namespace
+
+StartupProfiler *StartupProfiler::instance()
+{
+    static StartupProfiler *profiler = nullptr;
+    if (!profiler) {
+        profiler = new StartupProfiler();
+    }
+    return profiler;
+}
+
+StartupProfiler::StartupProfiler(QObject *parent)
+    : QObject(parent)
+{
+    m_timer.start();
+}
+
+void StartupProfiler::parseArguments(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        const QByteArray arg(argv[i]);
+        if (arg == PROFILE_ARG) {
+            m_enabled = true;
+        } else if (arg.startsWith(PROFILE_ARG_PREFIX)) {
+            m_enabled = true;
+            m_launchCount = qMax(1, arg.mid(int(qstrlen(PROFILE_ARG_PREFIX))).toInt());
+        } else if (arg == EXIT_AFTER_FIRST_FRAME_ARG) {
+            m_exitAfterFirstFrame = true;
+        } else {
+            m_forwardArguments << QString::fromLocal8Bit(arg);
+        }
+    }
+}
+
+bool StartupProfiler::isEnabled() const
+{
+    return m_enabled;
+}
+
+int StartupProfiler::launchCount() const
+{
+    return m_launchCount;
+}
+
+void StartupProfiler::mark(const QString &phase)
+{
+    if (!m_enabled) {
+        return;
+    }
+    m_phases.append(qMakePair(phase, m_timer.nsecsElapsed()));
+}
+
+void StartupProfiler::watchFirstFrame(QWidget *window)
+{
+    if (!window || (!m_enabled && !m_exitAfterFirstFrame)) {
+        return;
+    }
+    m_window = window;
+    m_window->installEventFilter(this);
+}
+
+bool StartupProfiler::eventFilter(QObject *obj, QEvent *event)
+{
+    if (obj == m_window && event->type() == QEvent::Paint && !m_firstFrameDone) {
+        m_firstFrameDone = true;
+        m_window->removeEventFilter(this);
+        //等这一帧绘制并刷新到屏幕后再计时
+        QTimer::singleShot(0, this, &StartupProfiler::onFirstFrame);
+    }
+    return QObject::eventFilter(obj, event);
+}
+
+void StartupProfiler::onFirstFrame()
+{
+    mark("first-frame");
+    report();
+    emit sigFirstFrame();
+    if (m_exitAfterFirstFrame) {
+        QCoreApplication::exit(0);
+    }
+}
+
+void StartupProfiler::report() const
+{
+    if (!m_enabled) {
+        return;
+    }
+    qint64 last = 0;
+    for (const QPair<QString, qint64> &phase : m_phases) {
+        fprintf(stdout, "[startup-profile] phase=%s total=%.3f delta=%.3f\n",
+                phase.first.toUtf8().constData(),
+                phase.second / 1e6, (phase.second - last) / 1e6);
+        last = phase.second;
+    }
+    fflush(stdout);
+}
+
+int StartupProfiler::runLaunches()
+{
+    const QRegularExpression lineRe(QStringLiteral("^\\[startup-profile\\] phase=(\\S+) total=([0-9.]+) delta=([0-9.]+)"));
+    QStringList arguments = m_forwardArguments;
+    arguments << PROFILE_ARG << EXIT_AFTER_FIRST_FRAME_ARG;
+
+    QStringList order;
+    QMap<QString, double> cold;
+    QMap<QString, QVector<double> > warm;
+    int failed = 0;
+
+    for (int i = 0; i < m_launchCount; i++) {
+        //root下清空页缓存，保证第一次是真正的冷启动
+        if (i == 0 && geteuid() == 0) {
+            sync();
+            QFile dropCaches("/proc/sys/vm/drop_caches");
+            if (dropCaches.open(QIODevice::WriteOnly)) {
+                dropCaches.write("3");
+            }
+        }
+
+        QProcess process;
+        process.setProcessChannelMode(QProcess::SeparateChannels);
+        process.start(QCoreApplication::applicationFilePath(), arguments);
+        if (!process.waitForFinished(LAUNCH_TIMEOUT_MS)) {
+            process.kill();
+            process.waitForFinished();
+            failed++;
+            continue;
+        }
+
+        const QList<QByteArray> lines = process.readAllStandardOutput().split('\n');
+        for (const QByteArray &line : lines) {
+            const QRegularExpressionMatch match = lineRe.match(QString::fromUtf8(line));
+            if (!match.hasMatch()) {
+                continue;
+            }
+            const QString phase = match.captured(1);
+            const double delta = match.captured(3).toDouble();
+            if (!order.contains(phase)) {
+                order << phase;
+            }
+            if (i == 0) {
+                cold.insert(phase, delta);
+            } else {
+                warm[phase].append(delta);
+            }
+        }
+    }
+
+    fprintf(stdout, "%-20s %10s %10s %10s\n", "phase", "cold(ms)", "warm-min", "warm-med");
+    for (const QString &phase : order) {
+        const QVector<double> values = warm.value(phase);
+        const double warmMin = values.isEmpty() ? 0 : *std::min_element(values.begin(), values.end());
+        fprintf(stdout, "%-20s %10.3f %10.3f %10.3f\n", phase.toUtf8().constData(),
+                cold.value(phase), warmMin, median(values));
+    }
+    fprintf(stdout, "launches: %d, failed: %d\n", m_launchCount, failed);
+    fflush(stdout);
+
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QVector>
+#include <QPair>
+#include <QStringList>
+
+class QWidget;
+
+//启动阶段耗时统计
+//  --startup-profile          打印本次启动各阶段耗时
+//  --startup-profile=N        连续启动N次（首次为冷启动），汇总各阶段耗时
+//  --exit-after-first-frame   主窗口绘制出第一帧后退出
+class StartupProfiler : public QObject
+{
+    Q_OBJECT
+public:
+    static StartupProfiler *instance();
+
+    //解析命令行参数，需要在main函数最开始调用
+    void parseArguments(int argc, char *argv[]);
+
+    bool isEnabled() const;
+    //需要由当前进程重复拉起的启动次数，0表示不需要
+    int launchCount() const;
+
+    //记录一个阶段结束的时间点
+    void mark(const QString &phase);
+
+    //监听窗口的第一帧
+    void watchFirstFrame(QWidget *window);
+
+    //重复拉起N次自身并汇总耗时，返回进程退出码
+    int runLaunches();
+
+signals:
+    void sigFirstFrame();
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    explicit StartupProfiler(QObject *parent = nullptr);
+    void onFirstFrame();
+    void report() const;
+
+private:
+    QElapsedTimer m_timer;
+    QVector<QPair<QString, qint64> > m_phases;
+    QStringList m_forwardArguments;
+    QWidget *m_window = nullptr;
+    bool m_enabled = false;
+    bool m_exitAfterFirstFrame = false;
+    bool m_firstFrameDone = false;
+    int m_launchCount = 0;
+};
+
+#endif // STARTUPPROFILER_H
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "startupwarmup.h"
+
+#include <QtConcurrent>
+#include <QMimeDatabase>
+#include <QImageReader>
+
+QFuture<void> StartupWarmup::start()
+{
+    return QtConcurrent::run([]() {
+        //第一次MatchContent查询需要加载shared-mime-info缓存，放到后台先加载
+        QMimeDatabase db;
+        db.mimeTypeForData(QByteArray("\x89PNG\r\n\x1a\n", 8));
+        db.mimeTypeForFile(QStringLiteral("warmup.jpg"), QMimeDatabase::MatchExtension);
+
+        //枚举格式会加载并实例化全部imageformats插件（包括xraw）
+        QImageReader::supportedImageFormats();
+        QImageReader::supportedMimeTypes();
+    });
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STARTUPWARMUP_H
+#define STARTUPWARMUP_H
+
+#include <QFuture>
+
+//启动时在线程池中预热QMimeDatabase和Qt图片插件，和主线程创建窗口并行
+class StartupWarmup
+{
+public:
+    static QFuture<void> start();
+};
+
+#endif // STARTUPWARMUP_H
@@ -0,0 +1,15 @@
+HEADERS += \
+    $$PWD/startupprofiler.h \
+    $$PWD/startupwarmup.h \
+    $$PWD/pathingest.h \
+    $$PWD/fileidentity.h \
+    $$PWD/imagetypedetector.h \
+    $$PWD/exiforientation.h \
+
+SOURCES += \
+    $$PWD/startupprofiler.cpp \
+    $$PWD/startupwarmup.cpp \
+    $$PWD/pathingest.cpp \
+    $$PWD/imagetypedetector.cpp \
+    $$PWD/exiforientation.cpp \
+
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "framepreview.h"
+
+#include <QResizeEvent>
+#include <QPainter>
+
+namespace {
+//只是防止看图的重绘没有被检测到时一直盖着，正常由repainted()隐藏
+const int DEFAULT_MAX_SHOW_TIME = 3000;
+}  // namespace
+
+FramePreview::FramePreview(QWidget *parent)
+    : QWidget(parent)
+{
+    //不设置WA_OpaquePaintEvent，下面的看图控件照常收到绘制事件，调用方据此判断看图已经重绘
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    hide();
+
+    m_fallbackTimer.setSingleShot(true);
+    m_fallbackTimer.setInterval(DEFAULT_MAX_SHOW_TIME);
+    connect(&m_fallbackTimer, &QTimer::timeout, this, &FramePreview::settle);
+
+    //始终和看图控件一样大
+    parent->installEventFilter(this);
+}
+
+void FramePreview::present(const QImage &image, bool scaleUp)
+{
+    if (image.isNull()) {
+        settle();
+        return;
+    }
+    m_image = image;
+    m_scaleUp = scaleUp;
+    setGeometry(parentWidget()->rect());
+    raise();
+    //标题栏、底部工具栏等浮动在图片上的控件放回上层，不被遮住
+    const QList<QWidget *> siblings = parentWidget()->findChildren<QWidget *>(QString(), Qt::FindDirectChildrenOnly);
+    for (QWidget *sibling : siblings) {
+        if (sibling != this && sibling->isVisible() && !sibling->isWindow()
+                && sibling->height() < parentWidget()->height() / 2) {
+            sibling->raise();
+        }
+    }
+    show();
+    update();
+    m_fallbackTimer.start();
+}
+
+void FramePreview::repainted()
+{
+    if (!isVisible()) {
+        return;
+    }
+    //正在分发看图的绘制事件，回到事件循环再隐藏
+    QTimer::singleShot(0, this, &FramePreview::settle);
+}
+
+void FramePreview::setMaxShowTime(int msec)
+{
+    m_fallbackTimer.setInterval(msec);
+}
+
+bool FramePreview::eventFilter(QObject *obj, QEvent *event)
+{
+    if (obj == parentWidget() && event->type() == QEvent::Resize && isVisible()) {
+        setGeometry(QRect(QPoint(0, 0), static_cast<QResizeEvent *>(event)->size()));
+    }
+    return QWidget::eventFilter(obj, event);
+}
+
+void FramePreview::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().window());
+    if (m_image.isNull()) {
+        return;
+    }
+    //图片按设备像素解码，和看图一样适应窗口居中，不放大
+    const qreal ratio = devicePixelRatioF();
+    QSize target = m_image.size() / ratio;
+    if (m_scaleUp || target.width() > width() || target.height() > height()) {
+        target.scale(size(), Qt::KeepAspectRatio);
+    }
+    const QRect targetRect(QPoint((width() - target.width()) / 2, (height() - target.height()) / 2), target);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.drawImage(targetRect, m_image);
+}
+
+void FramePreview::settle()
+{
+    m_fallbackTimer.stop();
+    hide();
+    m_image = QImage();
+}
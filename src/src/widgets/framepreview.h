@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FRAMEPREVIEW_H
+#define FRAMEPREVIEW_H
+
+#include <QWidget>
+#include <QImage>
+#include <QTimer>
+
+//连续翻页时盖在看图的图片区域上方，显示已经解码好的图片或小尺寸预览
+//工具栏等浮动控件保持在上层；看图显示最终的图片并重绘后由调用方调用repainted()隐藏
+class FramePreview : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit FramePreview(QWidget *parent);
+
+    //image为空时立即隐藏，避免停留在上一张；scaleUp用于小尺寸预览放大到窗口
+    void present(const QImage &image, bool scaleUp = false);
+    //看图已经重绘，事件处理完后隐藏
+    void repainted();
+    //看图一直没有重绘时最多显示的时间
+    void setMaxShowTime(int msec);
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) Q_DECL_OVERRIDE;
+    void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    void settle();
+
+private:
+    QImage m_image;
+    bool m_scaleUp = false;
+    QTimer m_fallbackTimer;
+};
+
+#endif // FRAMEPREVIEW_H
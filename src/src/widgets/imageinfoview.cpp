@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "imageinfoview.h"
+#include "service/metadataservice.h"
+
+#include <QFileInfo>
+#include <QFormLayout>
+#include <QLabel>
+#include <QLocale>
+
+namespace {
+const int MIN_WIDTH = 320;
+}  // namespace
+
+ImageInfoView::ImageInfoView(QWidget *parent)
+    : QWidget(parent, Qt::Tool)
+    , m_layout(new QFormLayout(this))
+{
+    setMinimumWidth(MIN_WIDTH);
+    setWindowTitle(tr("Image info"));
+}
+
+void ImageInfoView::setPath(const QString &path)
+{
+    m_path = path;
+    clearRows();
+    const QFileInfo info(path);
+    addRow(tr("Name"), info.fileName());
+    addRow(tr("Location"), info.absolutePath());
+}
+
+QString ImageInfoView::path() const
+{
+    return m_path;
+}
+
+void ImageInfoView::setMetadata(const QString &path, const ImageMetadata &metadata)
+{
+    if (path != m_path) {
+        return;
+    }
+    setPath(path);
+    addRow(tr("File size"), QLocale().formattedDataSize(metadata.fileSize));
+    addRow(tr("Type"), metadata.format.toUpper());
+    if (metadata.size.isValid()) {
+        addRow(tr("Dimensions"), QString("%1x%2").arg(metadata.size.width()).arg(metadata.size.height()));
+    }
+
+    //常用的EXIF标签按固定顺序显示
+    const QList<QPair<QString, QString>> labels = {
+        {"DateTimeOriginal", tr("Date captured")},
+        {"DateTime", tr("Date modified")},
+        {"Make", tr("Camera brand")},
+        {"Model", tr("Camera model")},
+        {"LensModel", tr("Lens model")},
+        {"ExposureTime", tr("Exposure time")},
+        {"FNumber", tr("Aperture")},
+        {"ISOSpeedRatings", tr("ISO")},
+        {"FocalLength", tr("Focal length")},
+        {"FocalLengthIn35mmFilm", tr("35mm focal length")},
+        {"Flash", tr("Flash")},
+        {"Artist", tr("Artist")},
+        {"Software", tr("Software")},
+        {"Copyright", tr("Copyright")},
+    };
+    for (const auto &label : labels) {
+        const QString value = metadata.fields.value(label.first);
+        if (!value.isEmpty()) {
+            addRow(label.second, value);
+        }
+    }
+}
+
+void ImageInfoView::clearRows()
+{
+    while (m_layout->rowCount() > 0) {
+        m_layout->removeRow(0);
+    }
+}
+
+void ImageInfoView::addRow(const QString &label, const QString &value)
+{
+    QLabel *field = new QLabel(value, this);
+    field->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    field->setWordWrap(true);
+    m_layout->addRow(label, field);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef IMAGEINFOVIEW_H
+#define IMAGEINFOVIEW_H
+
+#include <QWidget>
+
+struct ImageMetadata;
+class QFormLayout;
+
+//图片信息面板，内容来自MetadataService，打开时不等待解码
+class ImageInfoView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit ImageInfoView(QWidget *parent = nullptr);
+
+    //先显示文件名等不需要读取文件的信息，读取完成后再调用setMetadata
+    void setPath(const QString &path);
+    QString path() const;
+    void setMetadata(const QString &path, const ImageMetadata &metadata);
+
+private:
+    void clearRows();
+    void addRow(const QString &label, const QString &value);
+
+private:
+    QString m_path;
+    QFormLayout *m_layout = nullptr;
+};
+
+#endif // IMAGEINFOVIEW_H
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ocrview.h"
+#include "service/ocrservice.h"
+
+#include <QApplication>
+#include <QClipboard>
+#include <QCloseEvent>
+#include <QFileInfo>
+#include <QLabel>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QVBoxLayout>
+
+namespace {
+const QSize DEFAULT_SIZE(480, 560);
+}  // namespace
+
+OcrView::OcrView(OcrService *service, QWidget *parent)
+    : QWidget(parent, Qt::Window)
+    , m_service(service)
+    , m_status(new QLabel(this))
+    , m_text(new QPlainTextEdit(this))
+    , m_copy(new QPushButton(tr("Copy"), this))
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    resize(DEFAULT_SIZE);
+    m_text->setReadOnly(true);
+    m_copy->setEnabled(false);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(m_status);
+    layout->addWidget(m_text, 1);
+    layout->addWidget(m_copy, 0, Qt::AlignRight);
+
+    connect(m_copy, &QPushButton::clicked, this, [ = ]() {
+        QApplication::clipboard()->setText(m_text->toPlainText());
+    });
+    connect(m_service, &OcrService::sigPartial, this,
+    [ = ](const QString & path, const QString & text, int doneTiles, int totalTiles) {
+        if (path == m_path) {
+            m_status->setText(tr("Recognizing... %1/%2").arg(doneTiles).arg(totalTiles));
+            m_text->setPlainText(text);
+            m_copy->setEnabled(!text.isEmpty());
+        }
+    });
+    connect(m_service, &OcrService::sigFinished, this, [ = ](const QString & path, const QString & text, bool fromCache) {
+        Q_UNUSED(fromCache);
+        if (path == m_path) {
+            m_status->setText(text.trimmed().isEmpty() ? tr("No text recognized") : QString());
+            m_status->setVisible(!m_status->text().isEmpty());
+            m_text->setPlainText(text);
+            m_copy->setEnabled(!text.isEmpty());
+        }
+    });
+    connect(m_service, &OcrService::sigFailed, this, [ = ](const QString & path, const QString & errorMsg) {
+        if (path == m_path) {
+            m_status->setText(tr("Recognition failed: %1").arg(errorMsg));
+        }
+    });
+}
+
+void OcrView::start(const QString &path)
+{
+    m_path = path;
+    setWindowTitle(QFileInfo(path).fileName());
+    m_status->setText(tr("Recognizing..."));
+    m_status->show();
+    m_text->clear();
+    m_copy->setEnabled(false);
+    show();
+    activateWindow();
+    m_service->recognize(path);
+}
+
+void OcrView::closeEvent(QCloseEvent *event)
+{
+    //不再需要的识别不继续占用CPU
+    if (m_service->isBusy()) {
+        m_service->cancel();
+    }
+    QWidget::closeEvent(event);
+}
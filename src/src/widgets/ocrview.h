@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef OCRVIEW_H
+#define OCRVIEW_H
+
+#include <QWidget>
+
+class QLabel;
+class QPlainTextEdit;
+class QPushButton;
+class OcrService;
+
+//显示识别结果的窗口，条带识别完成后逐步追加，关闭时取消识别
+class OcrView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit OcrView(OcrService *service, QWidget *parent = nullptr);
+
+    void start(const QString &path);
+
+protected:
+    void closeEvent(QCloseEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    OcrService *m_service = nullptr;
+    QString m_path;
+    QLabel *m_status = nullptr;
+    QPlainTextEdit *m_text = nullptr;
+    QPushButton *m_copy = nullptr;
+};
+
+#endif // OCRVIEW_H
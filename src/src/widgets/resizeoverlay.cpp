@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "resizeoverlay.h"
+
+#include <QElapsedTimer>
+#include <QResizeEvent>
+#include <QPainter>
+#include <QLayout>
+#include <QDebug>
+
+namespace {
+//最后一次大小变化后等待多久认为拖动结束
+const int DEFAULT_SETTLE_DELAY = 150;
+}  // namespace
+
+ResizeOverlay::ResizeOverlay(QWidget *content, QWidget *resized)
+    : QWidget(resized)
+    , m_content(content)
+    , m_resized(resized)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    hide();
+
+    m_settleTimer.setSingleShot(true);
+    m_settleTimer.setInterval(DEFAULT_SETTLE_DELAY);
+    connect(&m_settleTimer, &QTimer::timeout, this, &ResizeOverlay::settle);
+
+    //需要在布局处理Resize之前拿到事件
+    m_resized->installEventFilter(this);
+}
+
+void ResizeOverlay::setLiveResizeEnabled(bool enabled)
+{
+    m_enabled = enabled;
+    if (!enabled && m_active) {
+        settle();
+    }
+}
+
+bool ResizeOverlay::isLiveResizeEnabled() const
+{
+    return m_enabled;
+}
+
+bool ResizeOverlay::isActive() const
+{
+    return m_active;
+}
+
+void ResizeOverlay::setSettleDelay(int msec)
+{
+    m_settleTimer.setInterval(msec);
+}
+
+ResizeOverlay::FrameStats ResizeOverlay::lastStats() const
+{
+    return m_stats;
+}
+
+bool ResizeOverlay::eventFilter(QObject *obj, QEvent *event)
+{
+    if (obj == m_resized && event->type() == QEvent::Resize && m_enabled) {
+        //最大化、全屏只有一次大小变化，直接高质量绘制
+        const Qt::WindowStates states = m_resized->window()->windowState();
+        const bool normal = !(states & (Qt::WindowMaximized | Qt::WindowFullScreen | Qt::WindowMinimized));
+        if (!m_active && normal && m_content && m_content->isVisible() && m_resized->layout()) {
+            begin();
+        }
+        if (m_active) {
+            setGeometry(QRect(QPoint(0, 0), static_cast<QResizeEvent *>(event)->size()));
+            m_settleTimer.start();
+        }
+    }
+    return QWidget::eventFilter(obj, event);
+}
+
+void ResizeOverlay::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QElapsedTimer timer;
+    timer.start();
+
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().window());
+    if (!m_snapshot.isNull()) {
+        //按内容原来的比例居中放大缩小，不做平滑
+        const QSize source = m_snapshot.size() / m_snapshot.devicePixelRatio();
+        const QSize target = source.scaled(size(), Qt::KeepAspectRatio);
+        const QRect targetRect(QPoint((width() - target.width()) / 2, (height() - target.height()) / 2), target);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+        painter.drawPixmap(targetRect, m_snapshot);
+    }
+
+    const double ms = timer.nsecsElapsed() / 1000000.0;
+    m_stats.frames++;
+    m_totalMs += ms;
+    m_stats.avgMs = m_totalMs / m_stats.frames;
+    m_stats.maxMs = qMax(m_stats.maxMs, ms);
+}
+
+void ResizeOverlay::begin()
+{
+    m_active = true;
+    m_stats = FrameStats();
+    m_totalMs = 0;
+
+    //内容控件还是旧的大小，截图后暂停布局，后续的大小变化不再传给它
+    m_snapshot = m_content->grab();
+    m_resized->layout()->setEnabled(false);
+    m_content->setUpdatesEnabled(false);
+    raise();
+    show();
+}
+
+void ResizeOverlay::settle()
+{
+    m_settleTimer.stop();
+    if (!m_active) {
+        return;
+    }
+    m_active = false;
+
+    QElapsedTimer timer;
+    timer.start();
+    //恢复布局，内容控件只收到最终大小，做一次高质量缩放
+    m_resized->layout()->setEnabled(true);
+    m_resized->layout()->activate();
+    hide();
+    if (m_content) {
+        m_content->setUpdatesEnabled(true);
+        m_content->repaint();
+    }
+    m_stats.settleMs = timer.nsecsElapsed() / 1000000.0;
+    m_snapshot = QPixmap();
+
+    qDebug() << "live resize frames:" << m_stats.frames
+             << "avg(ms):" << m_stats.avgMs << "max(ms):" << m_stats.maxMs
+             << "settle(ms):" << m_stats.settleMs;
+    emit sigSettled();
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RESIZEOVERLAY_H
+#define RESIZEOVERLAY_H
+
+#include <QWidget>
+#include <QPixmap>
+#include <QPointer>
+#include <QTimer>
+
+//拖动改变窗口大小时，盖在内容上方用截图快速缩放显示
+//期间暂停布局，内容控件不跟随重新缩放，停止拖动后只做一次高质量缩放
+class ResizeOverlay : public QWidget
+{
+    Q_OBJECT
+public:
+    struct FrameStats {
+        int frames = 0;
+        double avgMs = 0;
+        double maxMs = 0;
+        //停止拖动后内容控件重新布局并绘制的时间
+        double settleMs = 0;
+    };
+
+    //content为被截图的内容控件，resized为大小变化并持有布局的控件
+    ResizeOverlay(QWidget *content, QWidget *resized);
+
+    void setLiveResizeEnabled(bool enabled);
+    bool isLiveResizeEnabled() const;
+    bool isActive() const;
+    void setSettleDelay(int msec);
+
+    FrameStats lastStats() const;
+
+signals:
+    void sigSettled();
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) Q_DECL_OVERRIDE;
+    void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    void begin();
+    void settle();
+
+private:
+    //看图控件关闭时会被删除
+    QPointer<QWidget> m_content;
+    QWidget *m_resized = nullptr;
+    QPixmap m_snapshot;
+    QTimer m_settleTimer;
+    bool m_enabled = true;
+    bool m_active = false;
+
+    FrameStats m_stats;
+    double m_totalMs = 0;
+};
+
+#endif // RESIZEOVERLAY_H
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "slideshowview.h"
+#include "service/slideshowengine.h"
+
+#include <QGuiApplication>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QScreen>
+#include <QWindow>
+
+SlideshowView::SlideshowView(QWidget *parent)
+    : QWidget(parent, Qt::Window | Qt::FramelessWindowHint)
+    , m_engine(new SlideshowEngine(this))
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setAttribute(Qt::WA_DeleteOnClose);
+    connect(m_engine, &SlideshowEngine::sigFrame, this, [ = ](const QString & path, const QImage & image) {
+        Q_UNUSED(path);
+        m_frame = image;
+        update();
+    });
+    connect(m_engine, &SlideshowEngine::sigFinished, this, &SlideshowView::finish);
+}
+
+void SlideshowView::start(const QStringList &paths, const QString &current, int interval)
+{
+    QScreen *screen = parentWidget() && parentWidget()->window()->windowHandle()
+                      ? parentWidget()->window()->windowHandle()->screen() : QGuiApplication::primaryScreen();
+    //按屏幕的物理像素解码，显示时不再缩放
+    m_engine->setFrameSize(screen->size() * screen->devicePixelRatio());
+    m_engine->setPaths(paths, current);
+    m_engine->setInterval(interval);
+    setGeometry(screen->geometry());
+    showFullScreen();
+    activateWindow();
+    setFocus();
+    m_engine->start();
+}
+
+void SlideshowView::finish()
+{
+    const QString path = m_engine->currentPath();
+    m_engine->stop();
+    emit sigClosed(path);
+    close();
+}
+
+SlideshowEngine *SlideshowView::engine() const
+{
+    return m_engine;
+}
+
+void SlideshowView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    if (m_frame.isNull()) {
+        return;
+    }
+    const QSize target = (m_frame.size() / devicePixelRatioF()).scaled(size(), Qt::KeepAspectRatio)
+                         .boundedTo(m_frame.size() / devicePixelRatioF());
+    const QRect targetRect(QPoint((width() - target.width()) / 2, (height() - target.height()) / 2), target);
+    painter.drawImage(targetRect, m_frame);
+}
+
+void SlideshowView::keyPressEvent(QKeyEvent *event)
+{
+    if (event->key() == Qt::Key_Escape || event->key() == Qt::Key_F5) {
+        finish();
+        return;
+    }
+    QWidget::keyPressEvent(event);
+}
+
+void SlideshowView::mousePressEvent(QMouseEvent *event)
+{
+    Q_UNUSED(event);
+    finish();
+}
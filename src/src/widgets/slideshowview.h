@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SLIDESHOWVIEW_H
+#define SLIDESHOWVIEW_H
+
+#include <QWidget>
+#include <QImage>
+
+class SlideshowEngine;
+
+//全屏播放幻灯片，只绘制引擎交换过来的已解码帧，绘制时不做任何解码
+class SlideshowView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit SlideshowView(QWidget *parent = nullptr);
+
+    void start(const QStringList &paths, const QString &current, int interval);
+    void finish();
+    SlideshowEngine *engine() const;
+
+signals:
+    //退出播放，path为最后显示的图片
+    void sigClosed(const QString &path);
+
+protected:
+    void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
+    void keyPressEvent(QKeyEvent *event) Q_DECL_OVERRIDE;
+    void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    SlideshowEngine *m_engine = nullptr;
+    QImage m_frame;
+};
+
+#endif // SLIDESHOWVIEW_H
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "viewswitchprobe.h"
+
+#include <QStackedWidget>
+#include <QApplication>
+#include <QEvent>
+
+namespace {
+//切换后继续统计的时间，覆盖异步的布局和重绘
+const int DEFAULT_SETTLE_WINDOW = 300;
+}  // namespace
+
+ViewSwitchProbe::ViewSwitchProbe(QStackedWidget *stack, QObject *parent)
+    : QObject(parent)
+    , m_stack(stack)
+{
+    m_settleTimer.setSingleShot(true);
+    m_settleTimer.setInterval(DEFAULT_SETTLE_WINDOW);
+    connect(&m_settleTimer, &QTimer::timeout, this, &ViewSwitchProbe::finish);
+    connect(stack, &QStackedWidget::currentChanged, this, &ViewSwitchProbe::onCurrentChanged);
+}
+
+ViewSwitchProbe::~ViewSwitchProbe()
+{
+    if (m_measuring) {
+        qApp->removeEventFilter(this);
+    }
+}
+
+void ViewSwitchProbe::markSwitchStart()
+{
+    if (m_measuring) {
+        finish();
+    }
+    //只在统计期间过滤全局事件
+    m_measuring = true;
+    m_current = SwitchStats();
+    m_timer.start();
+    qApp->installEventFilter(this);
+    m_settleTimer.start();
+}
+
+void ViewSwitchProbe::setSettleWindow(int msec)
+{
+    m_settleTimer.setInterval(msec);
+}
+
+ViewSwitchProbe::SwitchStats ViewSwitchProbe::lastStats() const
+{
+    return m_last;
+}
+
+bool ViewSwitchProbe::eventFilter(QObject *obj, QEvent *event)
+{
+    if (!m_measuring || !m_stack || !obj->isWidgetType()) {
+        return false;
+    }
+    QWidget *widget = static_cast<QWidget *>(obj);
+    if (event->type() == QEvent::Paint) {
+        QWidget *page = m_stack->currentWidget();
+        if (page && (widget == page || page->isAncestorOf(widget))) {
+            m_current.paints++;
+            if (m_current.firstPaintMs < 0 && m_current.index == m_stack->currentIndex()) {
+                m_current.firstPaintMs = m_timer.nsecsElapsed() / 1000000.0;
+            }
+        }
+    } else if (event->type() == QEvent::Resize && widget == m_stack->window()) {
+        m_current.resizes++;
+    }
+    return false;
+}
+
+void ViewSwitchProbe::onCurrentChanged(int index)
+{
+    if (!m_measuring) {
+        markSwitchStart();
+    }
+    m_current.index = index;
+}
+
+void ViewSwitchProbe::finish()
+{
+    m_settleTimer.stop();
+    if (!m_measuring) {
+        return;
+    }
+    m_measuring = false;
+    qApp->removeEventFilter(this);
+    //没有发生切换的统计丢弃
+    if (m_current.index < 0) {
+        return;
+    }
+    m_last = m_current;
+    emit sigSwitchMeasured(m_last);
+}
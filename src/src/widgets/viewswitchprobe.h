@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef VIEWSWITCHPROBE_H
+#define VIEWSWITCHPROBE_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QTimer>
+
+class QStackedWidget;
+
+//统计主页和看图页面切换的耗时：到新页面第一次绘制的时间，
+//以及切换后一段时间内的绘制次数和窗口大小变化次数
+class ViewSwitchProbe : public QObject
+{
+    Q_OBJECT
+public:
+    struct SwitchStats {
+        int index = -1;
+        double firstPaintMs = -1;
+        int paints = 0;
+        int resizes = 0;
+    };
+
+    explicit ViewSwitchProbe(QStackedWidget *stack, QObject *parent = nullptr);
+    ~ViewSwitchProbe() override;
+
+    //切换前调用，把标题栏和布局的处理也计算在内
+    void markSwitchStart();
+    void setSettleWindow(int msec);
+
+    SwitchStats lastStats() const;
+
+signals:
+    void sigSwitchMeasured(const ViewSwitchProbe::SwitchStats &stats);
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) Q_DECL_OVERRIDE;
+
+private:
+    void onCurrentChanged(int index);
+    void finish();
+
+private:
+    QPointer<QStackedWidget> m_stack;
+    QElapsedTimer m_timer;
+    QTimer m_settleTimer;
+    SwitchStats m_current;
+    SwitchStats m_last;
+    bool m_measuring = false;
+};
+
+#endif // VIEWSWITCHPROBE_H
@@ -0,0 +1,16 @@
+HEADERS += \
+    $$PWD/resizeoverlay.h \
+    $$PWD/viewswitchprobe.h \
+    $$PWD/framepreview.h \
+    $$PWD/slideshowview.h \
+    $$PWD/ocrview.h \
+    $$PWD/imageinfoview.h \
+
+SOURCES += \
+    $$PWD/resizeoverlay.cpp \
+    $$PWD/viewswitchprobe.cpp \
+    $$PWD/framepreview.cpp \
+    $$PWD/slideshowview.cpp \
+    $$PWD/ocrview.cpp \
+    $$PWD/imageinfoview.cpp \
+
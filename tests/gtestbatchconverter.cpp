@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QBuffer>
+#include <QDebug>
+
+#include "service/batchconverter.h"
+#include "service/decodebenchmark.h"
+
+namespace {
+void createImages(const QString &dir, int count)
+{
+    QImage image(1600, 1200, QImage::Format_ARGB32);
+    for (int i = 0; i < count; i++) {
+        image.fill(QColor(i * 20 % 255, 80, 160, i % 2 ? 255 : 128));
+        const QString sub = dir + (i % 2 ? "/a" : "/b");
+        QDir().mkpath(sub);
+        image.save(sub + QString("/img%1.%2").arg(i).arg(i % 3 ? "png" : "jpg"));
+    }
+}
+}  // namespace
+
+//批量生成缩略图和转换，目录输入保留子目录结构
+TEST_F(gtestview, batchConverterThumbnails)
+{
+    QTemporaryDir input;
+    QTemporaryDir output;
+    ASSERT_TRUE(input.isValid());
+    ASSERT_TRUE(output.isValid());
+    const int count = 24;
+    createImages(input.path(), count);
+
+    QStringList roots;
+    const QStringList inputs = BatchConverter::collectInputs(QStringList() << input.path(), &roots);
+    ASSERT_EQ(count, inputs.size());
+
+    BatchConverter::Options options;
+    options.mode = BatchConverter::Thumbnail;
+    options.outputDir = output.path();
+    options.size = QSize(128, 128);
+
+    QElapsedTimer timer;
+    timer.start();
+    const QList<BatchConverter::Result> thumbs = BatchConverter::processAll(inputs, roots, options, false);
+    const qint64 thumbMs = timer.elapsed();
+    ASSERT_EQ(count, thumbs.size());
+    for (const BatchConverter::Result &result : thumbs) {
+        EXPECT_TRUE(result.ok) << qPrintable(result.error);
+        EXPECT_TRUE(result.output.startsWith(output.path()));
+        const QSize size = QImageReader(result.output).size();
+        EXPECT_LE(qMax(size.width(), size.height()), 128);
+    }
+
+    options.mode = BatchConverter::Convert;
+    options.format = "png";
+    options.size = QSize();
+    timer.restart();
+    const QList<BatchConverter::Result> converted = BatchConverter::processAll(inputs, roots, options, false);
+    const qint64 convertMs = timer.elapsed();
+    for (const BatchConverter::Result &result : converted) {
+        EXPECT_TRUE(result.ok);
+        EXPECT_EQ(QSize(1600, 1200), QImageReader(result.output).size());
+    }
+
+    double decodeMs = 0;
+    for (const BatchConverter::Result &result : thumbs) {
+        decodeMs += result.decodeMs;
+    }
+    qDebug() << "batchConverterThumbnails files:" << count
+             << "thumbnail wall(ms):" << thumbMs << "avg decode(ms):" << decodeMs / count
+             << "convert wall(ms):" << convertMs;
+}
+
+TEST_F(gtestview, batchConverterOutputPath)
+{
+    BatchConverter::Options options;
+    options.format = "jpg";
+    //同目录同格式时不覆盖输入
+    EXPECT_EQ(QString("/p/a.converted.jpg"), BatchConverter::outputPath("/p/a.jpg", QString(), options));
+    options.mode = BatchConverter::Thumbnail;
+    options.outputDir = "/out";
+    EXPECT_EQ(QString("/out/p/x/a.thumb.jpg"), BatchConverter::outputPath("/p/x/a.png", "/p", options));
+
+    //不覆盖同目录的其它输入，不同目录的同名文件输出到同一目录时不互相覆盖
+    options.mode = BatchConverter::Convert;
+    options.outputDir.clear();
+    EXPECT_EQ(QStringList() << "/p/a.2.jpg" << "/p/a.converted.jpg",
+              BatchConverter::outputPaths(QStringList() << "/p/a.png" << "/p/a.jpg", QStringList(), options));
+    options.outputDir = "/out";
+    EXPECT_EQ(QStringList() << "/out/a.jpg" << "/out/a.2.jpg",
+              BatchConverter::outputPaths(QStringList() << "/p/a.png" << "/q/a.png", QStringList(), options));
+}
+
+//--bench的JSON结果：冷热耗时、吞吐、峰值内存
+TEST_F(gtestview, decodeBenchmarkReport)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QImage image(3000, 2000, QImage::Format_RGB32);
+    image.fill(Qt::darkGreen);
+    image.save(dir.path() + "/a.jpg", "JPEG", 90);
+    image.save(dir.path() + "/b.png");
+    QFile broken(dir.path() + "/c.jpg");
+    broken.open(QIODevice::WriteOnly);
+    broken.write("\xff\xd8\xff\xe0 broken", 11);
+    broken.close();
+
+    const QStringList inputs = BatchConverter::collectInputs(QStringList() << dir.path());
+    const QJsonObject report = DecodeBenchmark::run(inputs, 3, QSize());
+    const QJsonArray files = report.value("files").toArray();
+    ASSERT_EQ(3, files.size());
+    EXPECT_EQ(1, report.value("failed").toInt());
+    EXPECT_GT(report.value("peak_rss_kb").toDouble(), 0);
+
+    const QJsonObject first = files.at(0).toObject();
+    EXPECT_TRUE(first.value("ok").toBool());
+    EXPECT_DOUBLE_EQ(6.0, first.value("megapixels").toDouble());
+    EXPECT_LE(first.value("warm_min_ms").toDouble(), first.value("warm_median_ms").toDouble());
+    EXPECT_GT(first.value("warm_mp_per_s").toDouble(), 0);
+    EXPECT_FALSE(files.at(2).toObject().value("ok").toBool());
+
+    qDebug().noquote() << QJsonDocument(report).toJson(QJsonDocument::Compact);
+}
+
+//内嵌预览按缩放尺寸解码：libjpeg做1/8的IDCT，比整张解码再缩放快且占用内存少
+TEST_F(gtestview, decodeBenchmarkScaledJpeg)
+{
+    QImage image(6000, 4000, QImage::Format_RGB32);
+    for (int y = 0; y < image.height(); y++) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); x++) {
+            line[x] = qRgb(x & 0xFF, y & 0xFF, (x + y) & 0xFF);
+        }
+    }
+    QByteArray jpeg;
+    QBuffer buffer(&jpeg);
+    buffer.open(QIODevice::WriteOnly);
+    ASSERT_TRUE(image.save(&buffer, "JPEG", 90));
+
+    const QJsonObject result = DecodeBenchmark::benchScaledJpeg(jpeg, QSize(750, 500), 3);
+    EXPECT_EQ(750, result.value("target_width").toInt());
+    EXPECT_EQ(500, result.value("target_height").toInt());
+    EXPECT_LT(result.value("scaled_ms").toDouble(), result.value("full_ms").toDouble());
+    EXPECT_LT(result.value("scaled_image_bytes").toDouble() * 8, result.value("full_image_bytes").toDouble());
+    qDebug().noquote() << QJsonDocument(result).toJson(QJsonDocument::Compact);
+}
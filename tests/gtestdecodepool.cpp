@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <QThreadPool>
+#include <QDebug>
+
+#include "service/decodepool.h"
+#include "service/imagedecoder.h"
+
+namespace {
+QStringList createImages(const QString &dir, int count)
+{
+    QStringList paths;
+    QImage image(1200, 900, QImage::Format_RGB32);
+    for (int i = 0; i < count; i++) {
+        image.fill(QColor(i * 30 % 255, 100, 200));
+        const QString path = dir + QString("/img%1.png").arg(i);
+        image.save(path);
+        paths << path;
+    }
+    return paths;
+}
+}  // namespace
+
+//多个子进程并行解码，结果通过共享内存映射，不经过拷贝
+TEST_F(gtestview, decodePoolParallel)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QStringList paths = createImages(dir.path(), 12);
+
+    DecodePool pool(4);
+    QElapsedTimer timer;
+    timer.start();
+    QList<QFuture<QImage> > futures;
+    for (const QString &path : paths) {
+        futures << pool.decodeAsync(path, QSize(600, 600));
+    }
+    for (int i = 0; i < futures.size(); i++) {
+        const QImage image = futures[i].result();
+        ASSERT_FALSE(image.isNull());
+        EXPECT_EQ(QSize(600, 450), image.size());
+        EXPECT_EQ(QColor(i * 30 % 255, 100, 200).rgb(), image.pixel(10, 10));
+        //像素直接位于mmap的页上
+        EXPECT_EQ(0u, quintptr(image.constBits()) % 4096);
+    }
+    qDebug() << "decode pool:" << paths.size() << "images with" << pool.workerCount()
+             << "workers in" << timer.elapsed() << "ms";
+    EXPECT_EQ(0, pool.restartCount());
+}
+
+//子进程崩溃或卡死时重启，后续解码不受影响
+TEST_F(gtestview, decodePoolWorkerRestart)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QStringList paths = createImages(dir.path(), 1);
+    QFile::copy(paths.first(), dir.path() + "/crash.png");
+    QFile::copy(paths.first(), dir.path() + "/hang.png");
+
+    //测试程序自己作为子进程，附加参数后按文件名模拟崩溃和卡死
+    DecodePool pool(1);
+    pool.setWorkerProgram(QCoreApplication::applicationFilePath(), QStringList() << "--inject-faults");
+    pool.setTimeout(1000);
+
+    QString error;
+    EXPECT_TRUE(pool.decode(dir.path() + "/crash.png", QSize(), &error).isNull());
+    EXPECT_FALSE(error.isEmpty());
+    EXPECT_EQ(1, pool.restartCount());
+
+    QElapsedTimer timer;
+    timer.start();
+    EXPECT_TRUE(pool.decode(dir.path() + "/hang.png", QSize(), &error).isNull());
+    EXPECT_LT(timer.elapsed(), 5000);
+    EXPECT_EQ(2, pool.restartCount());
+
+    const QImage image = pool.decode(paths.first());
+    EXPECT_EQ(QSize(1200, 900), image.size());
+
+    error.clear();
+    EXPECT_TRUE(pool.decode(dir.path() + "/missing.png", QSize(), &error).isNull());
+    EXPECT_FALSE(error.isEmpty());
+    EXPECT_EQ(2, pool.restartCount());
+}
+
+//发起第一次解码的线程退出后，子进程不能跟着被杀掉
+TEST_F(gtestview, decodePoolOutlivesCallerThread)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QStringList paths = createImages(dir.path(), 1);
+
+    DecodePool pool(1);
+    QThreadPool callers;
+    callers.setExpiryTimeout(10);
+    QImage first;
+    QtConcurrent::run(&callers, [&]() {
+        first = pool.decode(paths.first());
+    }).waitForFinished();
+    EXPECT_FALSE(first.isNull());
+    //调用线程已经过期退出
+    QTest::qWait(300);
+    EXPECT_EQ(0, callers.activeThreadCount());
+
+    QString error;
+    const QImage second = pool.decode(paths.first(), QSize(), &error);
+    EXPECT_FALSE(second.isNull()) << qPrintable(error);
+    EXPECT_EQ(0, pool.restartCount());
+}
+
+//解码池析构时等待正在通过它解码的调用返回，之后的RAW在进程内解码
+TEST_F(gtestview, decodePoolDestroyedWhileDecoding)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QStringList images = createImages(dir.path(), 4);
+    //按后缀识别为RAW才会交给解码池
+    QStringList paths;
+    for (const QString &image : images) {
+        const QString path = image.left(image.lastIndexOf('.')) + ".nef";
+        ASSERT_TRUE(QFile::rename(image, path));
+        paths << path;
+    }
+
+    DecodePool *pool = new DecodePool(2);
+    ImageDecoder::setDecodePool(pool);
+    QThreadPool callers;
+    callers.setMaxThreadCount(4);
+    QAtomicInt failed;
+    QList<QFuture<void> > futures;
+    for (int i = 0; i < 4; i++) {
+        futures << QtConcurrent::run(&callers, [&, i]() {
+            for (int n = 0; n < 10; n++) {
+                if (ImageDecoder::decode(paths.at((i + n) % paths.size()), QSize(300, 300)).isNull()) {
+                    failed.fetchAndAddOrdered(1);
+                }
+            }
+        });
+    }
+    QTest::qWait(50);
+    delete pool;
+    EXPECT_EQ(nullptr, ImageDecoder::decodePool());
+    for (QFuture<void> &future : futures) {
+        future.waitForFinished();
+    }
+    EXPECT_EQ(0, failed.load());
+}
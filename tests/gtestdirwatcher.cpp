@@ -0,0 +1,286 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QDir>
+#include <QDebug>
+#include <QThread>
+#include <QAtomicInt>
+
+#include "dirwatcher/dirscanner.h"
+#include "dirwatcher/dirwatcher.h"
+#include "service/imagelistmodel.h"
+#include "utils/imagetypedetector.h"
+
+namespace {
+//界面线程中读取文件头的次数
+QAtomicInt s_guiHeaderReads;
+
+int countingHeaderReader(const QString &path, char *buffer, int size)
+{
+    if (QThread::currentThread() == qApp->thread()) {
+        s_guiHeaderReads.fetchAndAddOrdered(1);
+    }
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    return int(file.read(buffer, size));
+}
+
+//在dir下生成 dirCount 个子目录，每个目录 filesPerDir 个文件，三分之一不是图片
+int createTree(const QString &dir, int dirCount, int filesPerDir)
+{
+    int images = 0;
+    for (int d = 0; d < dirCount; d++) {
+        const QString sub = dir + QString("/album%1/day%2").arg(d % 4).arg(d);
+        QDir().mkpath(sub);
+        for (int i = 0; i < filesPerDir; i++) {
+            const bool image = i % 3 != 0;
+            QFile file(sub + QString(image ? "/IMG_%1.jpg" : "/note_%1.txt").arg(i));
+            file.open(QIODevice::WriteOnly);
+            images += image ? 1 : 0;
+        }
+    }
+    return images;
+}
+
+struct ScanResult {
+    qint64 firstBatchMs = -1;
+    qint64 totalMs = -1;
+    int batches = 0;
+    int images = 0;
+};
+
+ScanResult runScan(const QString &root)
+{
+    ScanResult result;
+    DirScanner scanner;
+    QEventLoop loop;
+    QElapsedTimer timer;
+    QObject::connect(&scanner, &DirScanner::sigImagesFound, [&](const QStringList & images) {
+        if (result.firstBatchMs < 0) {
+            result.firstBatchMs = timer.elapsed();
+        }
+        result.batches++;
+        result.images += images.size();
+    });
+    QObject::connect(&scanner, &DirScanner::sigFinished, [&](int) {
+        result.totalMs = timer.elapsed();
+        loop.quit();
+    });
+    QTimer::singleShot(60000, &loop, &QEventLoop::quit);
+    timer.start();
+    scanner.start(QStringList() << root);
+    loop.exec();
+    return result;
+}
+}  // namespace
+
+//目录扫描吞吐：第一批到达时间和总时间，本地与模拟慢速文件系统
+TEST_F(gtestview, dirScannerThroughput)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const int expected = createTree(dir.path(), 40, 300);
+
+    const ScanResult local = runScan(dir.path());
+    EXPECT_EQ(expected, local.images);
+    EXPECT_GE(local.firstBatchMs, 0);
+    EXPECT_LE(local.firstBatchMs, local.totalMs);
+
+    //每64项等待2ms
+    DirScanner::setListDelayForTest(2000);
+    const ScanResult slow = runScan(dir.path());
+    DirScanner::setListDelayForTest(0);
+    EXPECT_EQ(expected, slow.images);
+    EXPECT_LT(slow.firstBatchMs, slow.totalMs);
+
+    qDebug() << "dirScannerThroughput images:" << expected
+             << "local first(ms):" << local.firstBatchMs << "total(ms):" << local.totalMs
+             << "batches:" << local.batches
+             << "slow first(ms):" << slow.firstBatchMs << "total(ms):" << slow.totalMs;
+}
+
+//取消后不再有结果回来
+TEST_F(gtestview, dirScannerCancel)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    createTree(dir.path(), 8, 100);
+
+    DirScanner scanner;
+    int received = 0;
+    QObject::connect(&scanner, &DirScanner::sigImagesFound, [&](const QStringList & images) {
+        received += images.size();
+    });
+    DirScanner::setListDelayForTest(5000);
+    scanner.start(QStringList() << dir.path());
+    scanner.cancel();
+    QTest::qWait(200);
+    DirScanner::setListDelayForTest(0);
+    EXPECT_EQ(0, received);
+    EXPECT_FALSE(scanner.isRunning());
+}
+
+//高速写入：几百个文件连续写入、改名、删除，事件合并后增量更新列表
+TEST_F(gtestview, dirWatcherBurst)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const int fileCount = 600;
+
+    DirWatcher watcher;
+    ASSERT_TRUE(watcher.isValid());
+    watcher.setCoalesceInterval(100, 500);
+    ASSERT_TRUE(watcher.addPath(dir.path()));
+
+    ImageListModel model;
+    int notifications = 0;
+    QObject::connect(&watcher, &DirWatcher::sigChanged, [&](const QStringList & added, const QStringList & removed) {
+        notifications++;
+        model.apply(added, removed);
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < fileCount; i++) {
+        //相机导入常见的先写临时文件再改名
+        const QString name = dir.path() + QString("/DSC_%1.jpg").arg(i);
+        QFile file(i % 2 ? name : name + ".part");
+        file.open(QIODevice::WriteOnly);
+        file.write("\xff\xd8\xff\xe0", 4);
+        file.close();
+        if (i % 2 == 0) {
+            QFile::rename(name + ".part", name);
+        }
+        if (i % 50 == 0) {
+            QCoreApplication::processEvents();
+        }
+    }
+    const qint64 writeMs = timer.elapsed();
+    //删掉前10个，中途新建的子目录也要被监控到
+    for (int i = 0; i < 10; i++) {
+        QFile::remove(dir.path() + QString("/DSC_%1.jpg").arg(i));
+    }
+    QDir().mkpath(dir.path() + "/sub");
+    QFile sub(dir.path() + "/sub/late.png");
+    sub.open(QIODevice::WriteOnly);
+    sub.close();
+
+    QTest::qWait(800);
+    QFile late(dir.path() + "/sub/later.png");
+    late.open(QIODevice::WriteOnly);
+    late.close();
+    QTest::qWait(400);
+
+    EXPECT_EQ(fileCount - 10 + 2, model.count());
+    EXPECT_FALSE(model.contains(dir.path() + "/DSC_0.jpg"));
+    EXPECT_TRUE(model.contains(dir.path() + "/DSC_599.jpg"));
+    EXPECT_TRUE(model.contains(dir.path() + "/sub/later.png"));
+    //合并后通知次数远少于文件数
+    EXPECT_LT(notifications, 20);
+
+    qDebug() << "dirWatcherBurst files:" << fileCount << "write(ms):" << writeMs
+             << "notifications:" << notifications;
+}
+
+TEST_F(gtestview, imageListModelApply)
+{
+    ImageListModel model;
+    model.setPaths(QStringList() << "/a/1.jpg" << "/a/2.jpg" << "/a/b/3.jpg" << "/a/b/4.jpg");
+    model.setCurrentPath("/a/b/3.jpg");
+
+    //追加时保持自然排序
+    EXPECT_TRUE(model.apply(QStringList() << "/a/b/10.jpg", QStringList()));
+    EXPECT_EQ(QString("/a/b/10.jpg"), model.paths().last());
+    EXPECT_TRUE(model.apply(QStringList() << "/a/0.jpg", QStringList()));
+    EXPECT_EQ(QString("/a/0.jpg"), model.paths().first());
+
+    //删除目录时移除其下所有图片，当前图片移到相邻位置
+    EXPECT_TRUE(model.apply(QStringList(), QStringList() << "/a/b"));
+    EXPECT_EQ(3, model.count());
+    EXPECT_EQ(QString("/a/2.jpg"), model.currentPath());
+    EXPECT_FALSE(model.apply(QStringList() << "/a/1.jpg", QStringList() << "/a/x.txt"));
+
+    //扫描批次按线程完成顺序到达，结果与先后无关
+    ImageListModel scanned;
+    scanned.append(QStringList() << "/r/b/1.jpg" << "/r/b/2.jpg");
+    scanned.append(QStringList() << "/r/a/2.jpg" << "/r/a/1.jpg");
+    scanned.append(QStringList() << "/r/c/1.jpg" << "/r/a/1.jpg");
+    EXPECT_EQ(QStringList() << "/r/a/1.jpg" << "/r/a/2.jpg" << "/r/b/1.jpg" << "/r/b/2.jpg" << "/r/c/1.jpg",
+              scanned.paths());
+    EXPECT_EQ(QString("/r/b/1.jpg"), scanned.currentPath());
+}
+
+//指向上层目录的软链接不会造成循环扫描
+TEST_F(gtestview, dirScannerSymlinkLoop)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const int expected = createTree(dir.path(), 2, 6);
+    ASSERT_TRUE(QFile::link(dir.path(), dir.path() + "/album0/loop"));
+
+    const ScanResult result = runScan(dir.path());
+    EXPECT_EQ(expected, result.images);
+    EXPECT_GE(result.totalMs, 0);
+}
+
+//移入的目录在工作线程中遍历和判断类型，界面线程不读取文件头
+TEST_F(gtestview, dirWatcherMovedTree)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QString watched = dir.path() + "/watched";
+    const QString outside = dir.path() + "/outside";
+    ASSERT_TRUE(QDir().mkpath(watched));
+    ASSERT_TRUE(QDir().mkpath(outside + "/day1"));
+    QFile image(outside + "/day1/noext");
+    image.open(QIODevice::WriteOnly);
+    image.write(QByteArray("\x89PNG\r\n\x1a\n\0\0\0\rIHDR", 16));
+    image.close();
+    QFile text(outside + "/day1/notes");
+    text.open(QIODevice::WriteOnly);
+    text.write("plain text");
+    text.close();
+
+    ImageTypeDetector::instance()->clearCache();
+    ImageTypeDetector::setHeaderReader(countingHeaderReader);
+    s_guiHeaderReads.store(0);
+
+    DirWatcher watcher;
+    ASSERT_TRUE(watcher.isValid());
+    watcher.setCoalesceInterval(100, 500);
+    ASSERT_TRUE(watcher.addPath(watched));
+    QStringList added;
+    QObject::connect(&watcher, &DirWatcher::sigChanged, [&](const QStringList & images, const QStringList &) {
+        added << images;
+    });
+
+    ASSERT_TRUE(QDir().rename(outside, watched + "/album"));
+    QTest::qWait(800);
+
+    EXPECT_EQ(QStringList() << watched + "/album/day1/noext", added);
+    EXPECT_TRUE(watcher.directories().contains(watched + "/album/day1"));
+    EXPECT_EQ(0, s_guiHeaderReads.load());
+
+    ImageTypeDetector::setHeaderReader(nullptr);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDebug>
+
+#include "service/folderindex.h"
+
+//第一次打开目录时在后台生成索引，再次打开时只需要stat
+TEST_F(gtestview, folderIndexReopen)
+{
+    QTemporaryDir dir;
+    QTemporaryDir cache;
+    ASSERT_TRUE(dir.isValid() && cache.isValid());
+    FolderIndex::setCacheRoot(cache.path());
+    FolderIndex *index = FolderIndex::instance();
+    index->clear();
+
+    QStringList paths;
+    for (int i = 0; i < 200; i++) {
+        QImage image(800, 600, QImage::Format_RGB32);
+        image.fill(QColor(i, 100, 200));
+        const QString path = dir.path() + QString("/img%1.jpg").arg(i);
+        ASSERT_TRUE(image.save(path, "jpg"));
+        paths << path;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    index->ensure(paths);
+    index->waitForDone();
+    const qint64 buildMs = timer.elapsed();
+    EXPECT_TRUE(QFileInfo::exists(FolderIndex::indexFile(dir.path())));
+
+    //从索引文件重新读取
+    index->clear();
+    //占位图只查内存，不读取索引文件
+    EXPECT_TRUE(index->placeholder(paths.first()).isNull());
+    const quint64 hits = index->hits();
+    timer.restart();
+    FolderIndex::Entry entry;
+    for (const QString &path : paths) {
+        ASSERT_TRUE(index->lookup(path, &entry));
+        EXPECT_EQ(QSize(800, 600), entry.size);
+        EXPECT_FALSE(entry.placeholder.isEmpty());
+    }
+    const qint64 reopenMs = timer.elapsed();
+    EXPECT_EQ(hits + paths.size(), index->hits());
+    const QImage placeholder = index->placeholder(paths.first());
+    EXPECT_LE(qMax(placeholder.width(), placeholder.height()), FolderIndex::PLACEHOLDER_SIZE);
+    qDebug() << "folder index build(ms):" << buildMs << "reopen(ms):" << reopenMs
+             << "index size(bytes):" << QFileInfo(FolderIndex::indexFile(dir.path())).size();
+
+    //文件修改后条目失效
+    QImage image(400, 300, QImage::Format_RGB32);
+    image.fill(Qt::red);
+    ASSERT_TRUE(image.save(paths.first(), "jpg"));
+    EXPECT_FALSE(index->lookup(paths.first(), &entry));
+
+    index->clear();
+    FolderIndex::setCacheRoot(QString());
+}
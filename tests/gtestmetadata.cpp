@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QImageReader>
+#include <QFileInfo>
+#include <QDebug>
+
+#include "service/metadataservice.h"
+#include "utils/exiforientation.h"
+
+namespace {
+QImage noise(int width, int height)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    for (int y = 0; y < height; y++) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < width; x++) {
+            line[x] = qRgb((x * 7 + y * 13) & 0xFF, (x * y) & 0xFF, (x ^ y) & 0xFF);
+        }
+    }
+    return image;
+}
+}  // namespace
+
+//只读取文件头：读取的字节数远小于文件大小，尺寸按方向交换，第二次命中缓存
+TEST_F(gtestview, metadataHeaderOnly)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QString path = dir.path() + "/photo.jpg";
+    ASSERT_TRUE(noise(3000, 2000).save(path, "jpg", 95));
+    ASSERT_TRUE(ExifOrientation::writeJpeg(path, 6));
+
+    QElapsedTimer timer;
+    timer.start();
+    const ImageMetadata metadata = MetadataService::read(path);
+    const double headerMs = timer.nsecsElapsed() / 1000000.0;
+    ASSERT_TRUE(metadata.valid);
+    EXPECT_EQ(QString("jpeg"), metadata.format);
+    EXPECT_EQ(QSize(2000, 3000), metadata.size);
+    EXPECT_EQ(QString("6"), metadata.fields.value("Orientation"));
+    EXPECT_EQ(QFileInfo(path).size(), metadata.fileSize);
+    EXPECT_LT(metadata.bytesRead, 4096);
+
+    const quint64 hits = MetadataService::cacheHits();
+    timer.restart();
+    MetadataService::read(path);
+    const double cachedMs = timer.nsecsElapsed() / 1000000.0;
+    EXPECT_EQ(hits + 1, MetadataService::cacheHits());
+
+    timer.restart();
+    QImageReader(path).read();
+    const double decodeMs = timer.nsecsElapsed() / 1000000.0;
+    qDebug() << "metadata header(ms):" << headerMs << "cached(ms):" << cachedMs << "full decode(ms):" << decodeMs
+             << "bytes read:" << metadata.bytesRead << "of" << metadata.fileSize;
+
+    //文件修改后缓存失效
+    ASSERT_TRUE(ExifOrientation::writeJpeg(path, 1));
+    EXPECT_EQ(QSize(3000, 2000), MetadataService::read(path).size);
+}
+
+//PNG的tEXt和TIFF的IFD0
+TEST_F(gtestview, metadataPngTiff)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QImage image = noise(640, 480);
+    image.setText("Author", "deepin");
+    const QString png = dir.path() + "/image.png";
+    ASSERT_TRUE(image.save(png, "png"));
+    const ImageMetadata pngData = MetadataService::read(png);
+    ASSERT_TRUE(pngData.valid);
+    EXPECT_EQ(QSize(640, 480), pngData.size);
+    EXPECT_EQ(QString("deepin"), pngData.fields.value("Author"));
+
+    const QString tiff = dir.path() + "/image.tif";
+    if (!image.save(tiff, "tiff")) {
+        return;
+    }
+    const ImageMetadata tiffData = MetadataService::read(tiff);
+    ASSERT_TRUE(tiffData.valid);
+    EXPECT_EQ(QString("tiff"), tiffData.format);
+    EXPECT_EQ(QSize(640, 480), tiffData.size);
+    EXPECT_FALSE(tiffData.fields.contains("ImageWidth"));
+}
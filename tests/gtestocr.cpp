@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QEventLoop>
+#include <QTimer>
+#include <QThread>
+#include <QFile>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "service/ocrservice.h"
+
+namespace {
+//模拟识别引擎：每个条带耗时ms，记录收到的最大宽度
+struct FakeEngine {
+    QAtomicInt calls;
+    QAtomicInt maxWidth;
+    int ms = 20;
+
+    OcrService::Engine engine()
+    {
+        return [this](const QImage & band, QString * text) {
+            calls.fetchAndAddOrdered(1);
+            if (band.width() > maxWidth.loadAcquire()) {
+                maxWidth.storeRelease(band.width());
+            }
+            QThread::msleep(ms);
+            *text = QString("line %1x%2\n").arg(band.width()).arg(band.height());
+            return true;
+        };
+    }
+};
+
+//等待识别完成，超时返回false
+bool waitFinished(OcrService *service, int timeout, QString *text = nullptr, bool *fromCache = nullptr,
+                  int *partials = nullptr)
+{
+    QEventLoop loop;
+    bool finished = false;
+    QObject::connect(service, &OcrService::sigPartial, &loop, [&]() {
+        if (partials) {
+            (*partials)++;
+        }
+    });
+    QObject::connect(service, &OcrService::sigFinished, &loop, [&](const QString &, const QString & result, bool cache) {
+        finished = true;
+        if (text) {
+            *text = result;
+        }
+        if (fromCache) {
+            *fromCache = cache;
+        }
+        loop.quit();
+    });
+    QObject::connect(service, &OcrService::sigFailed, &loop, &QEventLoop::quit);
+    QTimer::singleShot(timeout, &loop, &QEventLoop::quit);
+    loop.exec();
+    return finished;
+}
+}  // namespace
+
+//大图按限制的分辨率分条识别，第二次（包括复制的文件）直接从缓存返回
+TEST_F(gtestview, ocrTilesAndCache)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    OcrService::setCacheRoot(dir.path() + "/cache");
+    const QString path = dir.path() + "/scan.jpg";
+    QImage image(6000, 4000, QImage::Format_RGB32);
+    image.fill(Qt::white);
+    ASSERT_TRUE(image.save(path, "jpg"));
+
+    FakeEngine fake;
+    OcrService service;
+    //没有设置引擎时不可用，Alt+O交给看图调用deepin-ocr
+    EXPECT_FALSE(service.isAvailable());
+    service.setEngine(fake.engine(), "fake");
+    EXPECT_TRUE(service.isAvailable());
+
+    QElapsedTimer timer;
+    timer.start();
+    service.recognize(path);
+    QString text;
+    bool fromCache = true;
+    int partials = 0;
+    ASSERT_TRUE(waitFinished(&service, 30000, &text, &fromCache, &partials));
+    const qint64 firstMs = timer.elapsed();
+    EXPECT_FALSE(fromCache);
+    EXPECT_EQ(3, fake.calls.loadAcquire());
+    EXPECT_EQ(3, partials);
+    EXPECT_LE(fake.maxWidth.loadAcquire(), 3200);
+    EXPECT_FALSE(text.isEmpty());
+
+    const QString copy = dir.path() + "/copy.jpg";
+    ASSERT_TRUE(QFile::copy(path, copy));
+    timer.restart();
+    service.recognize(copy);
+    QString cached;
+    ASSERT_TRUE(waitFinished(&service, 5000, &cached, &fromCache));
+    const qint64 cachedMs = timer.elapsed();
+    EXPECT_TRUE(fromCache);
+    EXPECT_EQ(text, cached);
+    EXPECT_EQ(3, fake.calls.loadAcquire());
+    EXPECT_EQ(1, service.stats().cacheHits);
+    qDebug() << "ocr first(ms):" << firstMs << "cached(ms):" << cachedMs << "tiles:" << service.stats().tiles;
+    OcrService::setCacheRoot(QString());
+}
+
+//取消后当前条带完成就停止，不写入缓存
+TEST_F(gtestview, ocrCancel)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    OcrService::setCacheRoot(dir.path() + "/cache");
+    const QString path = dir.path() + "/page.png";
+    QImage image(1000, 4000, QImage::Format_RGB32);
+    image.fill(Qt::white);
+    ASSERT_TRUE(image.save(path, "png"));
+
+    FakeEngine fake;
+    fake.ms = 150;
+    OcrService service;
+    service.setEngine(fake.engine(), "fake");
+    service.setMaxEdge(4000);
+    service.recognize(path);
+
+    QEventLoop loop;
+    QObject::connect(&service, &OcrService::sigPartial, &loop, &QEventLoop::quit);
+    QTimer::singleShot(10000, &loop, &QEventLoop::quit);
+    loop.exec();
+    service.cancel();
+    EXPECT_FALSE(service.isBusy());
+    EXPECT_FALSE(waitFinished(&service, 500));
+    EXPECT_LT(fake.calls.loadAcquire(), 5);
+    EXPECT_TRUE(QDir(dir.path() + "/cache").entryList(QDir::Files).isEmpty());
+    OcrService::setCacheRoot(QString());
+}
+
+//重叠区域重复识别出的行只保留一次
+TEST_F(gtestview, ocrMergeBands)
+{
+    EXPECT_EQ(QString("a\nb\nc\nd"), OcrService::mergeBand("a\nb\nc", "b\nc\nd\n"));
+    EXPECT_EQ(QString("a\nb\nc"), OcrService::mergeBand("a\nb", "\nc"));
+    EXPECT_EQ(QString("a"), OcrService::mergeBand("", "a\n\n"));
+    EXPECT_EQ(QString("a"), OcrService::mergeBand("a", "a"));
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+#include <QJsonObject>
+#include <QDebug>
+
+#include "service/neighborprefetcher.h"
+#include "service/framering.h"
+#include "service/burstnavigator.h"
+#include "service/decodebenchmark.h"
+
+namespace {
+void waitForList(NeighborPrefetcher *prefetcher)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (prefetcher->currentPath().isEmpty() && timer.elapsed() < 5000) {
+        prefetcher->waitForDone();
+        QCoreApplication::processEvents();
+    }
+}
+}  // namespace
+
+//快速翻页时预读窗口变大，离开窗口的文件被释放
+TEST_F(gtestview, neighborPrefetchWindow)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QStringList paths;
+    const QByteArray content(256 * 1024, 'x');
+    for (int i = 0; i < 60; i++) {
+        QFile file(dir.path() + QString("/img%1.jpg").arg(i));
+        ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+        file.write(content);
+        paths << file.fileName();
+    }
+
+    NeighborPrefetcher prefetcher;
+    prefetcher.setPaths(paths, paths.first());
+    waitForList(&prefetcher);
+    ASSERT_EQ(paths.first(), prefetcher.currentPath());
+    EXPECT_EQ(2, prefetcher.lookahead());
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 30; i++) {
+        prefetcher.step(1);
+    }
+    prefetcher.waitForDone();
+    const qint64 stepMs = timer.elapsed();
+    EXPECT_EQ(paths.at(30), prefetcher.currentPath());
+    EXPECT_EQ(prefetcher.isSlowMedia() ? 16 : 3, prefetcher.lookahead());
+    EXPECT_GE(prefetcher.advisedCount(), 30);
+    EXPECT_GT(prefetcher.droppedCount(), 20);
+    qDebug() << "prefetch slow media:" << prefetcher.isSlowMedia() << "advised:" << prefetcher.advisedCount()
+             << "dropped:" << prefetcher.droppedCount() << "steps(ms):" << stepMs;
+
+    //只打开一个文件时按目录展开，和看图的列表一致
+    prefetcher.setPaths(QStringList() << paths.at(9));
+    waitForList(&prefetcher);
+    EXPECT_EQ(paths.at(9), prefetcher.currentPath());
+    prefetcher.step(1);
+    EXPECT_EQ(paths.at(10), prefetcher.currentPath());
+    prefetcher.step(-20);
+    EXPECT_EQ(paths.first(), prefetcher.currentPath());
+
+    //看图通过缩略图等方式翻页后按它显示的图片重新定位，不在列表中的不猜位置
+    EXPECT_TRUE(prefetcher.setCurrentPath(paths.at(42)));
+    EXPECT_EQ(paths.at(42), prefetcher.currentPath());
+    EXPECT_FALSE(prefetcher.setCurrentPath(dir.path() + "/other.jpg"));
+    EXPECT_EQ(paths.at(42), prefetcher.currentPath());
+}
+
+//前后图片提前解码，翻到时直接命中，内存不超过预算
+TEST_F(gtestview, frameRingBudget)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QStringList paths;
+    for (int i = 0; i < 20; i++) {
+        QImage image(800, 600, QImage::Format_RGB32);
+        image.fill(QColor(i * 10, 100, 200));
+        const QString path = dir.path() + QString("/frame%1.png").arg(i);
+        ASSERT_TRUE(image.save(path));
+        paths << path;
+    }
+
+    FrameRing ring;
+    const QSize frameSize(400, 300);
+    const qint64 budget = 5 * 400 * 300 * 4;
+    ring.setBudget(budget);
+    ring.setFrameSize(frameSize);
+    ring.setPaths(paths, paths.first());
+    ring.waitForDone();
+    EXPECT_TRUE(ring.contains(paths.at(1)));
+    EXPECT_FALSE(ring.contains(paths.at(10)));
+
+    QElapsedTimer timer;
+    qint64 maxArrive = 0;
+    for (int i = 1; i < paths.size(); i++) {
+        timer.restart();
+        const QImage frame = ring.arrive(paths.at(i));
+        EXPECT_FALSE(frame.isNull());
+        EXPECT_EQ(frameSize, frame.size());
+        //耗时受机器负载影响只输出，命中率才是判断依据
+        maxArrive = qMax(maxArrive, timer.elapsed());
+        EXPECT_LE(ring.stats().usedBytes, budget);
+        //模拟看完一张再翻页
+        ring.waitForDone();
+    }
+    const FrameRing::Stats stats = ring.stats();
+    EXPECT_EQ(1.0, ring.hitRate());
+    EXPECT_LE(stats.frames, 5);
+    EXPECT_GT(stats.evicted, 0u);
+    qDebug() << "frame ring hits:" << stats.hits << "misses:" << stats.misses << "decoded:" << stats.decoded
+             << "evicted:" << stats.evicted << "discarded:" << stats.discarded << "bytes:" << stats.usedBytes
+             << "max arrive(ms):" << maxArrive;
+
+    //跳到很远的位置没有命中，反方向翻页时按新方向重新安排
+    EXPECT_TRUE(ring.arrive(paths.at(5)).isNull());
+    ring.waitForDone();
+    EXPECT_TRUE(ring.contains(paths.at(4)));
+    EXPECT_TRUE(ring.contains(paths.at(3)));
+}
+
+//按住方向键时只在停下来后完整解码一次
+TEST_F(gtestview, burstNavigationCoalesce)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QStringList paths;
+    for (int i = 0; i < 30; i++) {
+        QImage image(1600, 1200, QImage::Format_RGB32);
+        image.fill(QColor(i * 8, 120, 60));
+        const QString path = dir.path() + QString("/burst%1.jpg").arg(i, 2, 10, QChar('0'));
+        ASSERT_TRUE(image.save(path, "jpg"));
+        paths << path;
+    }
+
+    BurstNavigator navigator;
+    navigator.setPaths(paths, paths.first());
+    //单次翻页照常交给看图，自动重复开始合并
+    EXPECT_FALSE(navigator.navigate(1, false));
+    EXPECT_TRUE(navigator.navigate(1, true));
+    EXPECT_TRUE(navigator.isBursting());
+    QString settled;
+    QObject::connect(&navigator, &BurstNavigator::sigSettled, [&](const QString & path) {
+        settled = path;
+    });
+    navigator.release();
+    EXPECT_FALSE(navigator.isBursting());
+    EXPECT_EQ(paths.at(2), settled);
+
+    //看图通过缩略图栏等自己翻页后，先同步再合并
+    EXPECT_TRUE(navigator.setCurrentPath(paths.at(10)));
+    EXPECT_TRUE(navigator.navigate(1, true));
+    navigator.release();
+    EXPECT_EQ(paths.at(11), settled);
+    //看图显示的图片不在列表中时全部交给看图
+    EXPECT_FALSE(navigator.setCurrentPath(dir.path() + "/other.jpg"));
+    EXPECT_FALSE(navigator.navigate(1, true));
+    EXPECT_FALSE(navigator.isBursting());
+    navigator.setPaths(paths, QString());
+    EXPECT_TRUE(navigator.currentPath().isEmpty());
+    EXPECT_FALSE(navigator.navigate(1, true));
+
+    const QJsonObject report = DecodeBenchmark::benchNavigation(paths, QSize(800, 600), 25, 10);
+    const QJsonObject naive = report.value("naive").toObject();
+    const QJsonObject coalesced = report.value("coalesced").toObject();
+    EXPECT_EQ(25, naive.value("full_decodes").toInt());
+    EXPECT_EQ(1, coalesced.value("full_decodes").toInt());
+    EXPECT_LE(coalesced.value("previews").toInt(), 25);
+    qDebug() << "burst navigation naive cpu(ms):" << naive.value("cpu_ms").toDouble()
+             << "final(ms):" << naive.value("final_latency_ms").toDouble()
+             << "coalesced cpu(ms):" << coalesced.value("cpu_ms").toDouble()
+             << "final(ms):" << coalesced.value("final_latency_ms").toDouble()
+             << "previews:" << coalesced.value("previews").toInt();
+}
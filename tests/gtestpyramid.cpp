@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QPainter>
+#include <QFileInfo>
+#include <QDebug>
+
+#include "service/tilepyramid.h"
+
+//流式生成瓦片金字塔，之后只按需读取可见瓦片，内存受预算限制
+TEST_F(gtestview, tilePyramidBuildAndPaint)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    TilePyramid::setCacheRoot(dir.path() + "/pyramid");
+
+    //左右两半颜色不同，方便检查瓦片位置
+    QImage source(3000, 2000, QImage::Format_RGB32);
+    source.fill(QColor(200, 40, 40));
+    QPainter painter(&source);
+    painter.fillRect(1500, 0, 1500, 2000, QColor(40, 40, 200));
+    painter.end();
+    const QString path = dir.path() + "/panorama.tif";
+    ASSERT_TRUE(source.save(path, "tiff"));
+
+    QElapsedTimer timer;
+    timer.start();
+    TilePyramid pyramid;
+    QString error;
+    ASSERT_TRUE(pyramid.open(path, &error)) << qPrintable(error);
+    const qint64 buildMs = timer.elapsed();
+    EXPECT_EQ(QSize(3000, 2000), pyramid.size());
+    EXPECT_EQ(5, pyramid.levelCount());
+    EXPECT_EQ(QSize(188, 125), pyramid.levelSize(4));
+    EXPECT_EQ(0, pyramid.levelForScale(1.0));
+    EXPECT_EQ(2, pyramid.levelForScale(0.2));
+
+    const QImage first = pyramid.tile(0, 0, 0);
+    ASSERT_EQ(QSize(256, 256), first.size());
+    EXPECT_LT(qAbs(qRed(first.pixel(10, 10)) - 200), 8);
+    //最后一列瓦片不足256像素
+    EXPECT_EQ(3000 - 11 * 256, pyramid.tile(0, 11, 0).width());
+
+    const QImage overview = pyramid.render(QRectF(0, 0, 3000, 2000), QSize(300, 200));
+    EXPECT_LT(qAbs(qRed(overview.pixel(20, 100)) - 200), 8);
+    EXPECT_LT(qAbs(qBlue(overview.pixel(280, 100)) - 200), 8);
+
+    //原始分辨率平移整张图，缓存不超过预算
+    const qint64 budget = 1024 * 1024;
+    pyramid.setTileBudget(budget);
+    QImage viewport(800, 600, QImage::Format_RGB32);
+    QPainter view(&viewport);
+    for (int x = 0; x + 800 <= 3000; x += 400) {
+        pyramid.paint(&view, QRectF(0, 0, 800, 600), QRectF(x, 700, 800, 600));
+        EXPECT_LE(pyramid.usedBytes(), budget);
+    }
+    view.end();
+    qDebug() << "tile pyramid build:" << buildMs << "ms, tile loads:" << pyramid.tileLoads()
+             << "cached bytes:" << pyramid.usedBytes();
+
+    //第二次打开直接使用缓存
+    timer.restart();
+    TilePyramid cached;
+    ASSERT_TRUE(cached.open(path));
+    EXPECT_LT(timer.elapsed(), buildMs);
+}
+
+//缓存目录超过磁盘预算时删除最久没有打开的金字塔，刚打开的保留
+TEST_F(gtestview, tilePyramidDiskBudget)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    TilePyramid::setCacheRoot(dir.path() + "/pyramid");
+
+    QStringList paths;
+    for (int i = 0; i < 3; i++) {
+        QImage source(1500, 1000, QImage::Format_RGB32);
+        source.fill(QColor(i * 80, 120, 200));
+        paths << dir.path() + QString("/large%1.tif").arg(i);
+        ASSERT_TRUE(source.save(paths.last(), "tiff"));
+    }
+
+    TilePyramid first;
+    ASSERT_TRUE(first.open(paths.at(0)));
+    const qint64 single = TilePyramid::trimCache();
+    ASSERT_GT(single, 0);
+    QTest::qWait(20);
+    TilePyramid second;
+    ASSERT_TRUE(second.open(paths.at(1)));
+    QTest::qWait(20);
+    //再次打开第一张，第二张成为最久没有使用的
+    TilePyramid again;
+    ASSERT_TRUE(again.open(paths.at(0)));
+
+    const qint64 saved = TilePyramid::diskBudget();
+    TilePyramid::setDiskBudget(single * 2 + single / 2);
+    TilePyramid third;
+    ASSERT_TRUE(third.open(paths.at(2)));
+    TilePyramid::setDiskBudget(saved);
+
+    EXPECT_TRUE(QFileInfo::exists(TilePyramid::pyramidDir(paths.at(0))));
+    EXPECT_FALSE(QFileInfo::exists(TilePyramid::pyramidDir(paths.at(1))));
+    EXPECT_TRUE(QFileInfo::exists(TilePyramid::pyramidDir(paths.at(2))));
+}
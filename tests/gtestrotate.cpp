@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QImageReader>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QDebug>
+
+#include "service/losslessrotator.h"
+#include "utils/exiforientation.h"
+#include "rawiohandler.h"
+
+namespace {
+QStringList createJpegs(const QString &dir, int count)
+{
+    QStringList paths;
+    for (int i = 0; i < count; i++) {
+        QImage image(64, 32, QImage::Format_RGB32);
+        image.fill(QColor(i % 256, 80, 160));
+        image.setPixel(0, 0, qRgb(255, 255, 255));
+        const QString path = dir + QString("/rotate%1.jpg").arg(i);
+        if (image.save(path, "jpg")) {
+            paths << path;
+        }
+    }
+    return paths;
+}
+}  // namespace
+
+//顺时针四次回到原方向，顺时针和逆时针互相抵消
+TEST_F(gtestview, exifOrientationCompose)
+{
+    for (int orientation = 1; orientation <= 8; orientation++) {
+        int cw = orientation;
+        for (int i = 0; i < 4; i++) {
+            cw = ExifOrientation::rotated(cw, true);
+        }
+        EXPECT_EQ(orientation, cw);
+        EXPECT_EQ(orientation, ExifOrientation::rotated(ExifOrientation::rotated(orientation, true), false));
+        EXPECT_EQ(orientation, ExifOrientation::fromLibRawFlip(ExifOrientation::toLibRawFlip(orientation)));
+    }
+    EXPECT_EQ(6, ExifOrientation::rotated(1, true));
+    EXPECT_EQ(8, ExifOrientation::rotated(1, false));
+}
+
+//500张JPEG旋转两次：第一次插入APP1，第二次只改写两个字节，图像数据不变
+TEST_F(gtestview, losslessRotateJpeg)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QStringList paths = createJpegs(dir.path(), 500);
+    ASSERT_EQ(500, paths.size());
+    const QImage original = QImage(paths.first()).convertToFormat(QImage::Format_RGB32);
+
+    for (int pass = 0; pass < 2; pass++) {
+        LosslessRotator::Stats stats;
+        int patched = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (const QString &path : paths) {
+            const LosslessRotator::Result result = LosslessRotator::rotateFile(path, true);
+            ASSERT_TRUE(result.ok) << result.errorMsg.toStdString();
+            patched += result.method == LosslessRotator::MethodExifPatched;
+            stats.files++;
+            stats.bytesRead += result.bytesRead;
+            stats.bytesWritten += result.bytesWritten;
+            stats.maxMs = qMax(stats.maxMs, result.ms);
+        }
+        stats.totalMs = timer.nsecsElapsed() / 1000000.0;
+        EXPECT_EQ(pass == 0 ? 0 : paths.size(), patched);
+        qDebug() << "lossless rotate pass:" << pass << "files:" << stats.files << "total(ms):" << stats.totalMs
+                 << "max(ms):" << stats.maxMs << "read(bytes):" << stats.bytesRead
+                 << "written(bytes):" << stats.bytesWritten;
+    }
+
+    //两次顺时针是180度，宽高不变；再转一次宽高交换
+    EXPECT_EQ(3, ExifOrientation::readJpeg(paths.first()));
+    ASSERT_TRUE(LosslessRotator::rotateFile(paths.first(), true).ok);
+    QImageReader reader(paths.first());
+    reader.setAutoTransform(true);
+    const QImage rotated = reader.read();
+    EXPECT_EQ(QSize(32, 64), rotated.size());
+
+    //不按方向变换时解码结果和旋转前完全一样
+    QImageReader raw(paths.first());
+    raw.setAutoTransform(false);
+    EXPECT_EQ(original, raw.read().convertToFormat(QImage::Format_RGB32));
+}
+
+//RAW的方向保存在附属文件中，已有的其它内容保留
+TEST_F(gtestview, losslessRotateSidecar)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QString path = dir.path() + "/photo.nef";
+    EXPECT_EQ(dir.path() + "/photo.xmp", ExifOrientation::sidecarPath(path));
+    EXPECT_EQ(0, ExifOrientation::readSidecar(path));
+
+    ASSERT_TRUE(ExifOrientation::writeSidecar(path, 6));
+    EXPECT_EQ(6, ExifOrientation::readSidecar(path));
+
+    QFile file(ExifOrientation::sidecarPath(path));
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    QByteArray xmp = file.readAll();
+    file.close();
+    xmp.replace("<rdf:Description", "<rdf:Description xmp:Rating=\"4\"");
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    file.write(xmp);
+    file.close();
+
+    ASSERT_TRUE(ExifOrientation::writeSidecar(path, ExifOrientation::rotated(6, true)));
+    EXPECT_EQ(3, ExifOrientation::readSidecar(path));
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    EXPECT_TRUE(file.readAll().contains("xmp:Rating=\"4\""));
+}
+
+//PNG重新编码后保留文本信息，TIFF和APNG不旋转，文件不变
+TEST_F(gtestview, losslessRotateReencode)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QImage image(64, 32, QImage::Format_ARGB32);
+    image.fill(QColor(10, 80, 160, 200));
+    image.setText("Comment", "keep me");
+    const QString png = dir.path() + "/rotate.png";
+    ASSERT_TRUE(image.save(png, "png"));
+    const LosslessRotator::Result result = LosslessRotator::rotateFile(png, true);
+    ASSERT_TRUE(result.ok) << result.errorMsg.toStdString();
+    EXPECT_EQ(LosslessRotator::MethodReencoded, result.method);
+    const QImage rotated(png);
+    EXPECT_EQ(QSize(32, 64), rotated.size());
+    EXPECT_EQ(QString("keep me"), rotated.text("Comment"));
+
+    //在IDAT之前插入acTL块冒充APNG
+    QFile file(png);
+    ASSERT_TRUE(file.open(QIODevice::ReadOnly));
+    QByteArray data = file.readAll();
+    file.close();
+    const int idat = data.indexOf("IDAT") - 4;
+    ASSERT_GT(idat, 8);
+    data.insert(idat, QByteArray::fromHex("00000008") + "acTL" + QByteArray::fromHex("0000000200000000") + QByteArray(4, '\0'));
+    const QString apng = dir.path() + "/rotate-anim.png";
+    QFile animated(apng);
+    ASSERT_TRUE(animated.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    animated.write(data);
+    animated.close();
+    EXPECT_TRUE(LosslessRotator::canRotate(png));
+    EXPECT_FALSE(LosslessRotator::canRotate(apng));
+    EXPECT_FALSE(LosslessRotator::rotateFile(apng, true).ok);
+    ASSERT_TRUE(animated.open(QIODevice::ReadOnly));
+    EXPECT_EQ(data, animated.readAll());
+    animated.close();
+
+    const QString tiff = dir.path() + "/rotate.tif";
+    QFile tiffFile(tiff);
+    ASSERT_TRUE(tiffFile.open(QIODevice::WriteOnly));
+    const QByteArray tiffData = QByteArray("II*\0", 4) + QByteArray(60, '\0');
+    tiffFile.write(tiffData);
+    tiffFile.close();
+    EXPECT_FALSE(LosslessRotator::canRotate(tiff));
+    const LosslessRotator::Result refused = LosslessRotator::rotateFile(tiff, true);
+    EXPECT_FALSE(refused.ok);
+    EXPECT_EQ(LosslessRotator::MethodNone, refused.method);
+    ASSERT_TRUE(tiffFile.open(QIODevice::ReadOnly));
+    EXPECT_EQ(tiffData, tiffFile.readAll());
+}
+
+//RAW插件读取附属文件中的方向：尺寸、解码结果和返回的方向都按旋转后的处理
+TEST_F(gtestview, rawSidecarOrientation)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    //64x48的线性DNG，上面16行是亮的
+    const QString path = dir.path() + "/photo.dng";
+    ASSERT_TRUE(QFile::copy(":/dng.dng", path));
+
+    auto readRaw = [&path](QSize * size, int *orientation, QImage * image) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return false;
+        }
+        RawIOHandler handler;
+        handler.setDevice(&file);
+        *size = handler.option(QImageIOHandler::Size).toSize();
+        const QString description = handler.option(QImageIOHandler::Description).toString();
+        *orientation = 0;
+        for (const QString &pair : description.split("\n\n")) {
+            if (pair.startsWith("Orientation: ")) {
+                *orientation = pair.mid(13).toInt();
+            }
+        }
+        return handler.read(image);
+    };
+
+    QSize size;
+    int orientation = 0;
+    QImage image;
+    ASSERT_TRUE(readRaw(&size, &orientation, &image));
+    EXPECT_EQ(QSize(64, 48), size);
+    EXPECT_EQ(1, orientation);
+    EXPECT_EQ(QSize(64, 48), image.size());
+
+    //顺时针旋转两次，方向按附属文件中的值累加
+    ASSERT_TRUE(LosslessRotator::rotateFile(path, true).ok);
+    EXPECT_EQ(6, ExifOrientation::readSidecar(path));
+    ASSERT_TRUE(readRaw(&size, &orientation, &image));
+    EXPECT_EQ(QSize(48, 64), size);
+    EXPECT_EQ(6, orientation);
+    //没有按原来的尺寸拉伸
+    ASSERT_EQ(QSize(48, 64), image.size());
+    //原来的上边转到了右边
+    const QRgb right = image.pixel(image.width() - 2, image.height() / 2);
+    const QRgb left = image.pixel(1, image.height() / 2);
+    EXPECT_GT(qGray(right), qGray(left));
+
+    ASSERT_TRUE(LosslessRotator::rotateFile(path, true).ok);
+    EXPECT_EQ(3, ExifOrientation::readSidecar(path));
+    ASSERT_TRUE(readRaw(&size, &orientation, &image));
+    EXPECT_EQ(QSize(64, 48), size);
+    EXPECT_EQ(3, orientation);
+    EXPECT_EQ(QSize(64, 48), image.size());
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QSemaphore>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+#include <QDebug>
+
+#include "service/decodescheduler.h"
+
+//cgroup v2的cpu.max换算成CPU数，向上取整
+TEST_F(gtestview, decodeSchedulerQuota)
+{
+    EXPECT_EQ(0, DecodeScheduler::quotaCpus("max 100000"));
+    EXPECT_EQ(0, DecodeScheduler::quotaCpus(""));
+    EXPECT_EQ(1, DecodeScheduler::quotaCpus("50000 100000"));
+    EXPECT_EQ(2, DecodeScheduler::quotaCpus("150000 100000\n"));
+    EXPECT_EQ(4, DecodeScheduler::quotaCpus("400000"));
+
+    const int cpus = DecodeScheduler::availableCpus();
+    EXPECT_GE(cpus, 1);
+    EXPECT_LE(cpus, qMax(1, QThread::idealThreadCount()));
+    qDebug() << "decode scheduler available cpus:" << cpus << "ideal:" << QThread::idealThreadCount();
+}
+
+//后台任务占满时当前图片仍然立即解码，排队中的任务按优先级执行并可以取消
+TEST_F(gtestview, decodeSchedulerPriority)
+{
+    DecodeScheduler *scheduler = DecodeScheduler::instance();
+    const int workers = scheduler->workerCount();
+    scheduler->setWorkerCount(2);
+
+    QSemaphore release;
+    QSemaphore visibleDone;
+    QMutex orderMutex;
+    QStringList order;
+    auto record = [&](const QString &name) {
+        QMutexLocker locker(&orderMutex);
+        order << name;
+    };
+
+    //两个后台任务只能占用一个线程
+    for (int i = 0; i < 2; i++) {
+        scheduler->submit(DecodeScheduler::PriorityBackground, [&, i]() {
+            release.acquire();
+            record(QString("background%1").arg(i));
+        }, "gtest");
+    }
+    scheduler->submit(DecodeScheduler::PriorityThumbnail, [&]() {
+        record("thumbnail");
+    }, "gtest");
+    scheduler->submit(DecodeScheduler::PriorityAdjacent, [&]() {
+        record("adjacent");
+    }, "gtest");
+    scheduler->submit(DecodeScheduler::PriorityBackground, [&]() {
+        record("stale");
+    }, "gtest-stale");
+
+    QElapsedTimer timer;
+    timer.start();
+    scheduler->submit(DecodeScheduler::PriorityVisible, [&]() {
+        record("visible");
+        visibleDone.release();
+    }, "gtest");
+    ASSERT_TRUE(visibleDone.tryAcquire(1, 5000));
+    const qint64 visibleMs = timer.elapsed();
+    EXPECT_EQ(1, scheduler->cancel("gtest-stale"));
+
+    release.release(2);
+    scheduler->waitForDone("gtest");
+    EXPECT_EQ(QStringList() << "visible" << "background0" << "adjacent" << "thumbnail" << "background1", order);
+
+    const DecodeScheduler::Stats stats = scheduler->stats();
+    EXPECT_GE(stats.cancelled, 1u);
+    EXPECT_GE(stats.finished[DecodeScheduler::PriorityVisible], 1u);
+    qDebug() << "decode scheduler visible latency(ms):" << visibleMs
+             << "max background wait(ms):" << stats.maxWaitMs[DecodeScheduler::PriorityBackground];
+    scheduler->setWorkerCount(workers);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QFileInfo>
+#include <QDebug>
+
+#include "settings/settingsstore.h"
+
+//模拟拖动窗口：1秒内几百次尺寸变化，统计配置文件写入次数
+TEST_F(gtestview, settingsStoreResizeWrites)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QString fileName = dir.path() + "/config.conf";
+    const int resizeEvents = 300;
+
+    int writes = 0;
+    {
+        SettingsStore store(fileName);
+        store.setSaveDelay(200);
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < resizeEvents; i++) {
+            //和resizeEvent一样每次写宽高两个值
+            store.setValue("MAINWINDOW", "WindowWidth", 800 + i);
+            store.setValue("MAINWINDOW", "WindowHeight", 600 + i / 2);
+            QTest::qWait(3);
+        }
+        const qint64 resizeMs = timer.elapsed();
+        EXPECT_EQ(800 + resizeEvents - 1, store.value("MAINWINDOW", "WindowWidth").toInt());
+
+        store.flush();
+        writes = store.writeCount();
+        //旧实现每个事件写两次
+        EXPECT_LT(writes, resizeEvents / 10);
+        EXPECT_GE(writes, 1);
+        qDebug() << "settingsStoreResizeWrites events:" << resizeEvents << "duration(ms):" << resizeMs
+                 << "writes:" << writes << "legacy writes:" << resizeEvents * 2;
+    }
+
+    //最终值已经落盘，没有残留临时文件
+    QSettings settings(fileName, QSettings::IniFormat);
+    EXPECT_EQ(800 + resizeEvents - 1, settings.value("MAINWINDOW/WindowWidth").toInt());
+    EXPECT_EQ(600 + (resizeEvents - 1) / 2, settings.value("MAINWINDOW/WindowHeight").toInt());
+    EXPECT_FALSE(QFileInfo::exists(fileName + ".tmp"));
+
+    //重新打开能读到，未修改时不写文件
+    SettingsStore reopened(fileName);
+    EXPECT_EQ(800 + resizeEvents - 1, reopened.value("MAINWINDOW", "WindowWidth").toInt());
+    reopened.setValue("MAINWINDOW", "WindowWidth", 800 + resizeEvents - 1);
+    reopened.flush();
+    EXPECT_EQ(0, reopened.writeCount());
+}
+
+//其它写入者在加载之后写入的键，保存时不会被旧快照覆盖
+TEST_F(gtestview, settingsStoreMergeOnWrite)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QString fileName = dir.path() + "/config.conf";
+
+    SettingsStore store(fileName);
+    {
+        QSettings other(fileName, QSettings::IniFormat);
+        other.setValue("OCR/Languages", "eng");
+        other.sync();
+    }
+    store.setValue("MAINWINDOW", "WindowWidth", 1024);
+    store.flush();
+
+    QSettings settings(fileName, QSettings::IniFormat);
+    EXPECT_EQ(1024, settings.value("MAINWINDOW/WindowWidth").toInt());
+    EXPECT_EQ(QString("eng"), settings.value("OCR/Languages").toString());
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QEventLoop>
+#include <QTimer>
+#include <QThread>
+#include <QDebug>
+
+#include "service/slideshowengine.h"
+#include "service/decodescheduler.h"
+
+namespace {
+QStringList createSlides(const QString &dir, int count)
+{
+    QStringList paths;
+    for (int i = 0; i < count; i++) {
+        QImage image(2400, 1600, QImage::Format_RGB32);
+        image.fill(QColor(i * 20, 80, 160));
+        const QString path = dir + QString("/slide%1.jpg").arg(i);
+        if (image.save(path, "jpg")) {
+            paths << path;
+        }
+    }
+    return paths;
+}
+
+//播放slides张，只按张数结束，超时只防止卡住
+SlideshowEngine::Stats play(SlideshowEngine *engine, int slides)
+{
+    QEventLoop loop;
+    QObject::connect(engine, &SlideshowEngine::sigFrame, &loop, [&]() {
+        if (engine->stats().shown >= slides) {
+            loop.quit();
+        }
+    });
+    QTimer::singleShot(qMax(engine->interval() * slides * 4, 30000), &loop, &QEventLoop::quit);
+    engine->start();
+    loop.exec();
+    const SlideshowEngine::Stats stats = engine->stats();
+    engine->stop();
+    return stats;
+}
+}  // namespace
+
+//按顺序播放，每一帧按屏幕尺寸解码
+//是否按时切换取决于机器负载，只输出不判断
+TEST_F(gtestview, slideshowDeadlines)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QStringList paths = createSlides(dir.path(), 8);
+    ASSERT_EQ(8, paths.size());
+
+    SlideshowEngine engine;
+    engine.setPaths(paths, paths.first());
+    engine.setFrameSize(QSize(1280, 800));
+    engine.setInterval(150);
+    const SlideshowEngine::Stats stats = play(&engine, 12);
+    EXPECT_GE(stats.shown, 12);
+    EXPECT_EQ(QSize(1200, 800), engine.currentFrame().size());
+    qDebug() << "slideshow shown:" << stats.shown << "missed deadlines:" << stats.missed
+             << "max late(ms):" << stats.maxLateMs << "avg decode(ms):" << stats.avgDecodeMs;
+}
+
+//解码时间超过播放间隔时提前解码更多张，解码快时只保留双缓冲
+TEST_F(gtestview, slideshowAdaptiveLookahead)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QStringList paths = createSlides(dir.path(), 6);
+    ASSERT_EQ(6, paths.size());
+
+    SlideshowEngine engine;
+    engine.setPaths(paths);
+    engine.setFrameSize(QSize(640, 400));
+    engine.setInterval(100);
+    //模拟很大的RAW：每张解码120ms
+    engine.setDecoder([](const QString & path, const QSize & size) {
+        QThread::msleep(120);
+        return QImage(path).scaled(size, Qt::KeepAspectRatio);
+    });
+    const SlideshowEngine::Stats stats = play(&engine, 15);
+    EXPECT_GE(stats.shown, 15);
+    //每张至少120ms，间隔100ms时至少提前两张
+    EXPECT_GE(stats.maxLookahead, 2);
+    EXPECT_LE(stats.maxLookahead, 4);
+    qDebug() << "slow slideshow shown:" << stats.shown << "missed deadlines:" << stats.missed
+             << "max late(ms):" << stats.maxLateMs << "lookahead:" << stats.maxLookahead
+             << "workers:" << DecodeScheduler::instance()->workerCount();
+
+    //不实际解码，解码时间远小于间隔
+    engine.setDecoder([](const QString &, const QSize & size) {
+        QImage image(size, QImage::Format_RGB32);
+        image.fill(Qt::black);
+        return image;
+    });
+    const SlideshowEngine::Stats fast = play(&engine, 6);
+    EXPECT_GE(fast.shown, 6);
+    EXPECT_EQ(1, fast.maxLookahead);
+    EXPECT_EQ(1, engine.lookahead());
+}
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QCollator>
+#include <QFileInfo>
+#include <QMimeDatabase>
+#include <QImageReader>
+#include <QDataStream>
+#include <QBuffer>
+#include <QDebug>
+
+#include <algorithm>
+
+#include "utils/pathingest.h"
+#include "utils/imagetypedetector.h"
+
+//10万条路径批量导入：解析+stat+去重+自然排序
+TEST_F(gtestview, pathIngestBenchmark)
+{
+    const int fileCount = 1000;
+    const int pathCount = 100000;
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    for (int i = 0; i < fileCount; i++) {
+        QFile file(dir.path() + QString("/img%1.jpg").arg(i));
+        file.open(QIODevice::WriteOnly);
+    }
+
+    //重复路径、相对写法和不存在的路径混在一起
+    QStringList paths;
+    paths.reserve(pathCount);
+    for (int i = 0; i < pathCount; i++) {
+        if (i % 10 == 9) {
+            paths << dir.path() + QString("/missing%1.jpg").arg(i);
+        } else if (i % 10 == 8) {
+            paths << dir.path() + QString("/./img%1.jpg").arg(i % fileCount);
+        } else {
+            paths << dir.path() + QString("/img%1.jpg").arg(i % fileCount);
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QStringList files = PathIngest::ingest(paths);
+    const qint64 ingestMs = timer.elapsed();
+
+    EXPECT_EQ(fileCount, files.size());
+    EXPECT_TRUE(files.indexOf(dir.path() + "/img2.jpg") < files.indexOf(dir.path() + "/img10.jpg"));
+
+    //旧的方式：逐个QFileInfo，QCollator::compare排序
+    timer.restart();
+    QStringList legacy;
+    for (const QString &path : paths) {
+        if (QFileInfo(path).isFile()) {
+            legacy << path;
+        }
+    }
+    QCollator collator;
+    collator.setNumericMode(true);
+    std::sort(legacy.begin(), legacy.end(), collator);
+    const qint64 legacyMs = timer.elapsed();
+
+    //纯排序，10万个不重复的文件名
+    QStringList names;
+    names.reserve(pathCount);
+    for (int i = pathCount; i > 0; i--) {
+        names << QString("/photos/DSC_%1.NEF").arg(i);
+    }
+    timer.restart();
+    PathIngest::sortNatural(names);
+    const qint64 sortMs = timer.elapsed();
+    EXPECT_EQ(QString("/photos/DSC_1.NEF"), names.first());
+
+    qDebug() << "pathIngestBenchmark paths:" << pathCount
+             << "ingest(ms):" << ingestMs
+             << "legacy(ms):" << legacyMs
+             << "sortNatural(ms):" << sortMs;
+}
+
+//1万个文件的类型检测：旧的QMimeDatabase双重检测 vs ImageTypeDetector
+TEST_F(gtestview, imageTypeDetectorBenchmark)
+{
+    const int fileCount = 10000;
+    const QByteArray pngHeader("\x89PNG\r\n\x1a\n\0\0\0\rIHDR", 16);
+    const QByteArray text("just some text, not an image\n");
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QStringList paths;
+    for (int i = 0; i < fileCount; i++) {
+        //带后缀的图片、无后缀的图片、文本文件各占一部分
+        QString name;
+        QByteArray content = pngHeader;
+        switch (i % 4) {
+        case 0: name = QString("/a%1.png").arg(i); break;
+        case 1: name = QString("/b%1.jpg").arg(i); break;
+        case 2: name = QString("/c%1").arg(i); break;
+        default: name = QString("/d%1.txt").arg(i); content = text; break;
+        }
+        QFile file(dir.path() + name);
+        file.open(QIODevice::WriteOnly);
+        file.write(content);
+        paths << file.fileName();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    int legacyCount = 0;
+    for (const QString &path : paths) {
+        QMimeDatabase db;
+        QMimeType mt = db.mimeTypeForFile(path, QMimeDatabase::MatchContent);
+        QMimeType mt1 = db.mimeTypeForFile(path, QMimeDatabase::MatchExtension);
+        if (mt1.name().startsWith("image/") || mt1.name().startsWith("video/x-mng")
+                || mt.name().startsWith("image/") || mt.name().startsWith("video/x-mng")) {
+            legacyCount++;
+        }
+    }
+    const qint64 legacyMs = timer.elapsed();
+
+    ImageTypeDetector *detector = ImageTypeDetector::instance();
+    detector->clearCache();
+    timer.restart();
+    int coldCount = 0;
+    for (const QString &path : paths) {
+        coldCount += detector->isImage(path) ? 1 : 0;
+    }
+    const qint64 coldMs = timer.elapsed();
+
+    timer.restart();
+    int warmCount = 0;
+    for (const QString &path : paths) {
+        warmCount += detector->isImage(path) ? 1 : 0;
+    }
+    const qint64 warmMs = timer.elapsed();
+
+    EXPECT_EQ(fileCount / 4 * 3, coldCount);
+    EXPECT_EQ(coldCount, warmCount);
+    EXPECT_EQ(ImageTypeDetector::TypePng, detector->detect(paths.at(2)));
+    EXPECT_EQ(ImageTypeDetector::TypeNotImage, detector->detect(paths.at(3)));
+
+    qDebug() << "imageTypeDetectorBenchmark files:" << fileCount
+             << "legacy(ms):" << legacyMs << "images:" << legacyCount
+             << "detector cold(ms):" << coldMs
+             << "detector warm(ms):" << warmMs;
+}
+
+namespace {
+struct TiffEntry {
+    quint16 tag;
+    quint16 type;
+    quint32 value;
+};
+
+//最小的TIFF：文件头+IFD0，sub不为空时IFD0带一个SubIFD
+QByteArray makeTiff(const QVector<TiffEntry> &ifd0, const QVector<TiffEntry> &sub, bool bigEndian)
+{
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setByteOrder(bigEndian ? QDataStream::BigEndian : QDataStream::LittleEndian);
+    out.writeRawData(bigEndian ? "MM" : "II", 2);
+    out << quint16(42) << quint32(8);
+
+    QVector<TiffEntry> entries = ifd0;
+    const quint32 subOffset = 8 + 2 + quint32(ifd0.size() + 1) * 12 + 4;
+    if (!sub.isEmpty()) {
+        entries << TiffEntry{330, 4, subOffset};
+    }
+    for (const QVector<TiffEntry> &ifd : {entries, sub}) {
+        if (ifd.isEmpty()) {
+            continue;
+        }
+        out << quint16(ifd.size());
+        for (const TiffEntry &entry : ifd) {
+            out << entry.tag << entry.type << quint32(1);
+            if (entry.type == 3) {
+                out << quint16(entry.value) << quint16(0);
+            } else {
+                out << entry.value;
+            }
+        }
+        out << quint32(0);
+    }
+    return data;
+}
+}  // namespace
+
+//DNG和相机RAW按IFD标签识别，普通TIFF扫描件不交给RAW插件
+TEST_F(gtestview, rawTiffRouting)
+{
+    const QVector<TiffEntry> rgb = {{259, 3, 1}, {262, 3, 2}};
+    auto probe = [](const QByteArray & data) {
+        QBuffer buffer;
+        buffer.setData(data);
+        buffer.open(QIODevice::ReadOnly);
+        const bool raw = ImageTypeDetector::isRawTiff(&buffer);
+        EXPECT_EQ(0, buffer.pos());
+        return raw;
+    };
+    EXPECT_FALSE(probe(makeTiff(rgb, {}, false)));
+    EXPECT_FALSE(probe(makeTiff(rgb, {}, true)));
+    //DNG
+    EXPECT_TRUE(probe(makeTiff({{262, 3, 2}, {50706, 1, 0x01040000}}, {}, false)));
+    //NEF：IFD0是缩略图，SubIFD中是CFA数据
+    EXPECT_TRUE(probe(makeTiff(rgb, {{259, 3, 1}, {262, 3, 32803}}, true)));
+    //相机专用压缩
+    EXPECT_TRUE(probe(makeTiff({{259, 3, 34713}}, {}, false)));
+    //CR2
+    QByteArray cr2 = makeTiff(rgb, {}, false);
+    cr2.replace(8, 2, "CR");
+    EXPECT_TRUE(probe(cr2));
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    //没有后缀的DNG也能识别为RAW
+    QFile dng(dir.path() + "/camera");
+    ASSERT_TRUE(dng.open(QIODevice::WriteOnly));
+    dng.write(makeTiff({{262, 3, 34892}}, {}, false));
+    dng.close();
+    ImageTypeDetector::instance()->clearCache();
+    EXPECT_EQ(ImageTypeDetector::TypeRaw, ImageTypeDetector::instance()->detect(dng.fileName()));
+
+    //扫描件：识别开销和经Qt tiff插件解码的耗时
+    const int count = 20;
+    QStringList scans;
+    QImage page(2480, 3508, QImage::Format_RGB32);
+    for (int i = 0; i < count; i++) {
+        page.fill(QColor(255 - i, 250, 245));
+        const QString path = dir.path() + QString("/scan%1.tif").arg(i);
+        ASSERT_TRUE(page.save(path, "tiff"));
+        scans << path;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    int raws = 0;
+    for (const QString &path : scans) {
+        raws += ImageTypeDetector::isRawTiff(path) ? 1 : 0;
+    }
+    const qint64 probeUs = timer.nsecsElapsed() / 1000;
+    EXPECT_EQ(0, raws);
+
+    timer.restart();
+    for (const QString &path : scans) {
+        QImageReader reader(path);
+        QImage image;
+        EXPECT_TRUE(reader.read(&image));
+        EXPECT_EQ(QByteArray("tiff"), reader.format());
+    }
+    qDebug() << "rawTiffRouting scans:" << count << "probe(us):" << probeUs
+             << "decode(ms):" << timer.elapsed();
+}
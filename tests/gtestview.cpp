@@ -29,6 +29,73 @@
 #include "module/view/homepagewidget.h"
 #include <libimageviewer/imageengine.h>
 #include <QDropEvent>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QAtomicInt>
+#include "utils/imagetypedetector.h"
+#include "service/dragreadahead.h"
+#include "widgets/viewswitchprobe.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+//记录松手后看图页面第一次绘制的时间
+class FirstFrameProbe : public QObject
+{
+public:
+    explicit FirstFrameProbe(QStackedWidget *stack)
+        : m_stack(stack)
+    {
+        qApp->installEventFilter(this);
+        m_timer.start();
+    }
+    ~FirstFrameProbe() override
+    {
+        qApp->removeEventFilter(this);
+    }
+    qint64 elapsed() const
+    {
+        return m_elapsed;
+    }
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) override
+    {
+        if (m_elapsed < 0 && event->type() == QEvent::Paint && obj->isWidgetType()) {
+            QWidget *page = m_stack->currentWidget();
+            QWidget *widget = static_cast<QWidget *>(obj);
+            if (page && page->objectName() != "ThumbnailWidget" && (widget == page || page->isAncestorOf(widget))) {
+                m_elapsed = m_timer.elapsed();
+            }
+        }
+        return false;
+    }
+
+private:
+    QStackedWidget *m_stack;
+    QElapsedTimer m_timer;
+    qint64 m_elapsed = -1;
+};
+
+//界面线程中读取文件头的次数
+QAtomicInt s_guiHeaderReads;
+
+//模拟sshfs/慢速U盘：每次读取文件头都要等待300ms
+int slowHeaderReader(const QString &path, char *buffer, int size)
+{
+    if (QThread::currentThread() == qApp->thread()) {
+        s_guiHeaderReads.fetchAndAddOrdered(1);
+    }
+    QThread::msleep(300);
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return 0;
+    }
+    return int(file.read(buffer, size));
+}
+}
 
 gtestview::gtestview()
 {
@@ -211,6 +278,176 @@ TEST_F(gtestview, checkMinePaths)
     EXPECT_EQ(true, bRet);
 }
 
+//拖入时不能同步读取文件内容
+TEST_F(gtestview, dragEnterSlowFilesystem)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QFile image(dir.path() + "/noext");
+    image.open(QIODevice::WriteOnly);
+    image.write(QByteArray("\x89PNG\r\n\x1a\n\0\0\0\rIHDR", 16));
+    image.close();
+    QFile text(dir.path() + "/notes");
+    text.open(QIODevice::WriteOnly);
+    text.write("plain text");
+    text.close();
+
+    ImageTypeDetector::instance()->clearCache();
+    ImageTypeDetector::setHeaderReader(slowHeaderReader);
+    s_guiHeaderReads.store(0);
+
+    HomePageWidget *widget = new HomePageWidget();
+    QSignalSpy spy(widget, &HomePageWidget::sigDrogImage);
+    const QPoint pos = widget->rect().center();
+
+    //无后缀图片：立即接受，松手时正常打开
+    QMimeData imageData;
+    imageData.setUrls(QList<QUrl>() << QUrl::fromLocalFile(image.fileName()));
+    QElapsedTimer timer;
+    timer.start();
+    QDragEnterEvent enter(pos, Qt::CopyAction, &imageData, Qt::LeftButton, Qt::NoModifier);
+    qApp->sendEvent(widget, &enter);
+    //耗时受机器负载影响只输出，是否在界面线程读取文件头才是判断依据
+    qDebug() << "drag enter(ms):" << timer.elapsed();
+    EXPECT_EQ(0, s_guiHeaderReads.load());
+    EXPECT_TRUE(enter.isAccepted());
+    QTest::qWait(500);
+    QDropEvent drop(pos, Qt::CopyAction, &imageData, Qt::LeftButton, Qt::NoModifier);
+    qApp->sendEvent(widget, &drop);
+    EXPECT_EQ(1, spy.count());
+
+    //无后缀文本：先接受，后台确认不是图片后松手被拒绝
+    QMimeData textData;
+    textData.setUrls(QList<QUrl>() << QUrl::fromLocalFile(text.fileName()));
+    s_guiHeaderReads.store(0);
+    timer.restart();
+    QDragEnterEvent enterText(pos, Qt::CopyAction, &textData, Qt::LeftButton, Qt::NoModifier);
+    qApp->sendEvent(widget, &enterText);
+    qDebug() << "drag enter text(ms):" << timer.elapsed();
+    EXPECT_EQ(0, s_guiHeaderReads.load());
+    EXPECT_TRUE(enterText.isAccepted());
+    QTest::qWait(500);
+    QDropEvent dropText(pos, Qt::CopyAction, &textData, Qt::LeftButton, Qt::NoModifier);
+    qApp->sendEvent(widget, &dropText);
+    EXPECT_EQ(1, spy.count());
+
+    ImageTypeDetector::setHeaderReader(nullptr);
+    widget->deleteLater();
+    widget = nullptr;
+}
+
+//拖拽悬停期间预读文件：比较松手到第一帧的耗时
+TEST_F(gtestview, dragReadaheadDropLatency)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QImage big(6000, 4000, QImage::Format_RGB32);
+    for (int y = 0; y < big.height(); y++) {
+        QRgb *line = reinterpret_cast<QRgb *>(big.scanLine(y));
+        for (int x = 0; x < big.width(); x++) {
+            line[x] = qRgb(x & 0xff, y & 0xff, (x ^ y) & 0xff);
+        }
+    }
+    const QString withPath = dir.path() + "/with.jpg";
+    const QString withoutPath = dir.path() + "/without.jpg";
+    big.save(withPath, "JPEG", 90);
+    big.save(withoutPath, "JPEG", 90);
+    //刚写入的文件还在页缓存里，先丢掉，模拟冷读取
+    for (const QString &path : {withPath, withoutPath}) {
+        const int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY);
+        if (fd >= 0) {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::close(fd);
+        }
+    }
+
+    auto measure = [](const QString &path, bool readahead) -> qint64 {
+        DMainWindow *dw = new DMainWindow();
+        MainWindow *w = new MainWindow(dw);
+        dw->setCentralWidget(w);
+        w->setDMainWindow(dw);
+        dw->resize(1280, 800);
+        dw->show();
+        QTest::qWait(200);
+
+        auto homepage = w->findChild<HomePageWidget *>("ThumbnailWidget");
+        homepage->dragReadahead()->setEnabled(readahead);
+        QMimeData mimedata;
+        mimedata.setUrls(QList<QUrl>() << QUrl::fromLocalFile(path));
+        const QPoint pos = homepage->rect().center();
+        QDragEnterEvent enter(pos, Qt::CopyAction, &mimedata, Qt::LeftButton, Qt::NoModifier);
+        qApp->sendEvent(homepage, &enter);
+        //模拟用户移动鼠标的悬停时间
+        QTest::qWait(400);
+
+        FirstFrameProbe probe(w->findChild<QStackedWidget *>());
+        QDropEvent drop(pos, Qt::CopyAction, &mimedata, Qt::LeftButton, Qt::NoModifier);
+        qApp->sendEvent(homepage, &drop);
+        for (int i = 0; i < 100 && probe.elapsed() < 0; i++) {
+            QTest::qWait(20);
+        }
+        const qint64 latency = probe.elapsed();
+
+        dw->close();
+        dw->deleteLater();
+        QTest::qWait(100);
+        return latency;
+    };
+
+    const qint64 without = measure(withoutPath, false);
+    const qint64 with = measure(withPath, true);
+    EXPECT_GE(without, 0);
+    EXPECT_GE(with, 0);
+    qDebug() << "drop-to-first-frame(ms) without readahead:" << without
+             << "with readahead:" << with;
+}
+
+//主页和看图页面切换：到第一次绘制的时间，切换过程中窗口不应该被改变大小
+TEST_F(gtestview, viewSwitchLatency)
+{
+    DMainWindow *dw = new DMainWindow();
+    MainWindow *w = new MainWindow(dw);
+    dw->setCentralWidget(w);
+    w->setDMainWindow(dw);
+    dw->resize(1280, 800);
+    dw->show();
+    QTest::qWait(200);
+
+    ViewSwitchProbe *probe = w->viewSwitchProbe();
+    ASSERT_TRUE(probe);
+    probe->setSettleWindow(200);
+
+    QList<ViewSwitchProbe::SwitchStats> results;
+    QObject::connect(probe, &ViewSwitchProbe::sigSwitchMeasured, [&](const ViewSwitchProbe::SwitchStats & stats) {
+        results << stats;
+    });
+
+    const int rounds = 5;
+    for (int i = 0; i < rounds; i++) {
+        w->slotDrogImg(QStringList() << m_JPGPath);
+        QTest::qWait(300);
+        emit ImageEngine::instance()->sigPicCountIsNull();
+        QTest::qWait(300);
+    }
+
+    ASSERT_EQ(rounds * 2, results.size());
+    double toViewer = 0;
+    double toHome = 0;
+    for (int i = 0; i < results.size(); i++) {
+        EXPECT_EQ(0, results.at(i).resizes);
+        EXPECT_GE(results.at(i).firstPaintMs, 0);
+        (i % 2 ? toHome : toViewer) += results.at(i).firstPaintMs;
+    }
+    qDebug() << "viewSwitchLatency avg(ms) to viewer:" << toViewer / rounds
+             << "to home page:" << toHome / rounds
+             << "paints:" << results.first().paints;
+
+    dw->close();
+    dw->deleteLater();
+    QTest::qWait(100);
+}
+
 TEST_F(gtestview, showShortCut)
 {
     MainWindow *w = new MainWindow();
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2020 ~ 2021 Uniontech Software Technology Co., Ltd.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gtestview.h"
+
+#include <QElapsedTimer>
+#include <QVBoxLayout>
+#include <QPainter>
+#include <QDebug>
+
+#include "widgets/resizeoverlay.h"
+
+namespace {
+//模拟看图控件：每次大小变化都平滑缩放一张大图
+class HeavyView : public QWidget
+{
+public:
+    explicit HeavyView(QWidget *parent = nullptr)
+        : QWidget(parent)
+        , m_source(6000, 4000, QImage::Format_RGB32)
+    {
+        m_source.fill(Qt::darkCyan);
+    }
+
+    int rescales = 0;
+
+protected:
+    void resizeEvent(QResizeEvent *event) override
+    {
+        rescales++;
+        m_scaled = m_source.scaled(size(), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        QWidget::resizeEvent(event);
+    }
+    void paintEvent(QPaintEvent *) override
+    {
+        QPainter painter(this);
+        painter.drawImage(0, 0, m_scaled);
+    }
+
+private:
+    QImage m_source;
+    QImage m_scaled;
+};
+
+//脚本化拖动：每步改变大小并处理事件，返回每步平均耗时
+double scriptedResize(QWidget *window, int steps)
+{
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < steps; i++) {
+        window->resize(800 + i * 8, 600 + i * 5);
+        QCoreApplication::processEvents();
+    }
+    return double(timer.elapsed()) / steps;
+}
+}  // namespace
+
+TEST_F(gtestview, liveResizeFrameTimes)
+{
+    const int steps = 40;
+
+    QWidget window;
+    QVBoxLayout *layout = new QVBoxLayout(&window);
+    layout->setContentsMargins(0, 0, 0, 0);
+    HeavyView *view = new HeavyView(&window);
+    layout->addWidget(view);
+    ResizeOverlay *overlay = new ResizeOverlay(view, &window);
+    overlay->setSettleDelay(100);
+    window.resize(800, 600);
+    window.show();
+    QTest::qWait(100);
+
+    //不使用快速模式
+    overlay->setLiveResizeEnabled(false);
+    view->rescales = 0;
+    const double legacyStepMs = scriptedResize(&window, steps);
+    const int legacyRescales = view->rescales;
+
+    window.resize(800, 600);
+    QTest::qWait(100);
+
+    overlay->setLiveResizeEnabled(true);
+    view->rescales = 0;
+    const double liveStepMs = scriptedResize(&window, steps);
+    EXPECT_TRUE(overlay->isActive());
+    QTest::qWait(300);
+    EXPECT_FALSE(overlay->isActive());
+
+    //停止后只缩放一次，并且是最终大小
+    EXPECT_EQ(1, view->rescales);
+    EXPECT_EQ(window.size(), view->size());
+    EXPECT_GE(legacyRescales, steps / 2);
+
+    const ResizeOverlay::FrameStats stats = overlay->lastStats();
+    qDebug() << "liveResizeFrameTimes steps:" << steps
+             << "legacy step(ms):" << legacyStepMs << "rescales:" << legacyRescales
+             << "live step(ms):" << liveStepMs << "overlay frames:" << stats.frames
+             << "avg(ms):" << stats.avgMs << "max(ms):" << stats.maxMs
+             << "settle(ms):" << stats.settleMs;
+}
@@ -82,15 +82,42 @@ DCORE_USE_NAMESPACE
 
 #include <gtest/gtest.h>
 #include <gmock/gmock-matchers.h>
+#include "service/decodepool.h"
+#include <QFileInfo>
+#include <string.h>
+#include <unistd.h>
+#include <stdlib.h>
 #ifndef __mips__
 #include <sanitizer/asan_interface.h>
 #endif
+
+namespace {
+//解码子进程的故障注入只在测试程序中：文件名以crash/hang开头时崩溃/卡死
+const char *const DECODE_FAULT_OPTION = "--inject-faults";
+
+void injectDecodeFault(const QString &path)
+{
+    const QString name = QFileInfo(path).fileName();
+    if (name.startsWith("crash")) {
+        abort();
+    }
+    if (name.startsWith("hang")) {
+        for (;;) {
+            pause();
+        }
+    }
+}
+}  // namespace
+
 #define QMYTEST_MAIN(TestObject) \
     QT_BEGIN_NAMESPACE \
     QTEST_ADD_GPU_BLACKLIST_SUPPORT_DEFS \
     QT_END_NAMESPACE \
     int main(int argc, char *argv[]) \
     { \
+        if (DecodePool::isWorkerMode(argc, argv)) \
+            return DecodePool::execWorker(argc, argv, argc > 3 && strcmp(argv[3], DECODE_FAULT_OPTION) == 0 \
+                                          ? injectDecodeFault : nullptr); \
         testing::InitGoogleTest(&argc,argv); \
         DApplication a(argc, argv); \
         a.setAttribute(Qt::AA_Use96Dpi, true); \